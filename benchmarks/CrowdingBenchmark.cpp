@@ -0,0 +1,89 @@
+#include <TransportNetwork.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using NetworkMonitor::Id;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::TransportNetwork;
+
+// Usage: network_monitor_crowding_bench [stations] [events]
+int main(int argc, char* argv[])
+{
+    const size_t nStations{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000};
+    const size_t nEvents{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000000};
+    const size_t k{10};
+    const size_t nQueries{1000};
+
+    TransportNetwork nw{};
+    std::vector<Id> stationIds{};
+    stationIds.reserve(nStations);
+    for(size_t idx{0}; idx < nStations; ++idx)
+    {
+        stationIds.push_back("station_" + std::to_string(idx));
+        nw.AddStation({stationIds.back(), "Station Name " + std::to_string(idx)});
+    }
+
+    // Some stations are much busier than others: We pick them with a
+    // geometric-like skew. Passengers enter a bit more often than they exit.
+    std::mt19937 rng{42};
+    std::geometric_distribution<size_t> skew{10.0 / nStations};
+    std::bernoulli_distribution enters{0.55};
+    std::vector<PassengerEvent> events{};
+    events.reserve(nEvents);
+    for(size_t idx{0}; idx < nEvents; ++idx)
+    {
+        const auto stationIdx{std::min(skew(rng), nStations - 1)};
+        events.push_back(
+            {stationIds[stationIdx], enters(rng) ? PassengerEvent::Type::In : PassengerEvent::Type::Out});
+    }
+
+    using Ms = std::chrono::duration<double, std::milli>;
+    using Us = std::chrono::duration<double, std::micro>;
+
+    // Ingestion, with the crowding heap maintained on every event.
+    auto start{std::chrono::steady_clock::now()};
+    bool ok{true};
+    for(const auto& event : events)
+    {
+        ok &= nw.RecordPassengerEvent(event);
+    }
+    auto elapsed{Ms{std::chrono::steady_clock::now() - start}.count()};
+    std::cout << "stations: " << nStations << ", events: " << nEvents << std::endl;
+    std::cout << "ingestion: " << elapsed << " ms, " << nEvents / elapsed * 1000.0 << " events/s" << std::endl;
+
+    // Top-k from the heap.
+    size_t checksum{0};
+    start = std::chrono::steady_clock::now();
+    for(size_t query{0}; query < nQueries; ++query)
+    {
+        checksum += nw.GetBusiestStations(k).size();
+    }
+    elapsed = Us{std::chrono::steady_clock::now() - start}.count();
+    std::cout << "top-" << k << " (heap): " << elapsed / nQueries << " us/query" << std::endl;
+
+    // Top-k the way we used to do it: Poll every station and sort.
+    start = std::chrono::steady_clock::now();
+    for(size_t query{0}; query < nQueries / 100; ++query)
+    {
+        std::vector<std::pair<long long int, size_t>> counts{};
+        counts.reserve(nStations);
+        for(size_t idx{0}; idx < nStations; ++idx)
+        {
+            counts.emplace_back(nw.GetPassengerCount(stationIds[idx]), idx);
+        }
+        std::partial_sort(counts.begin(), counts.begin() + k, counts.end(), std::greater<>{});
+        checksum += counts.front().second;
+    }
+    elapsed = Us{std::chrono::steady_clock::now() - start}.count();
+    std::cout << "top-" << k << " (full scan): " << elapsed / (nQueries / 100) << " us/query" << std::endl;
+
+    auto busiest{nw.GetBusiestStations(k)};
+    std::cout << "busiest: " << busiest.front().stationId << " (" << busiest.front().count << ")" << std::endl;
+
+    return ok && checksum > 0 ? 0 : 1;
+}
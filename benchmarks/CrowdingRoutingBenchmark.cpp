@@ -0,0 +1,99 @@
+#include <NetworkLayoutGenerator.hpp>
+#include <TransportNetwork.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::CrowdingRoutingOptions;
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::TransportNetwork;
+
+// Usage: network_monitor_crowding_routing_bench [stations] [seconds]
+// Runs crowding-aware journey queries on one thread while another thread
+// records passenger events as fast as it can.
+int main(int argc, char* argv[])
+{
+    const size_t nStations{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000};
+    const double seconds{argc > 2 ? std::strtod(argv[2], nullptr) : 5.0};
+    const size_t k{3};
+
+    NetworkLayoutOptions options{};
+    options.nStations = nStations;
+    options.nLines = nStations / 50;
+    options.routesPerLine = 4;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        nw.AddStation(station);
+    }
+    nw.AddLines(layout.lines);
+    for(const auto& travelTime : layout.travelTimes)
+    {
+        nw.SetTravelTime(travelTime.startStationId, travelTime.endStationId, travelTime.travelTime);
+    }
+    CrowdingRoutingOptions routingOptions{};
+    routingOptions.threshold = 50;
+    routingOptions.minutesPerPassenger = 0.1;
+    routingOptions.maxPenalty = 15;
+    routingOptions.interchangePenalty = 5;
+    nw.SetCrowdingRoutingOptions(routingOptions);
+
+    // Queries between the ends of random routes, so that most journeys cross
+    // several lines.
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<size_t> pickLine{0, layout.lines.size() - 1};
+    std::vector<std::pair<std::string, std::string>> queries{};
+    for(size_t idx{0}; idx < 1000; ++idx)
+    {
+        const auto& from{layout.lines[pickLine(rng)].routes.front()};
+        const auto& to{layout.lines[pickLine(rng)].routes.front()};
+        queries.emplace_back(from.stops.front(), to.stops.back());
+    }
+
+    // Busy stations get most of the events, as in CrowdingBenchmark.
+    std::vector<PassengerEvent> events{};
+    std::geometric_distribution<size_t> skew{10.0 / nStations};
+    std::bernoulli_distribution enters{0.55};
+    for(size_t idx{0}; idx < 1000000; ++idx)
+    {
+        const auto& station{layout.stations[std::min(skew(rng), nStations - 1)]};
+        events.push_back({station.id, enters(rng) ? PassengerEvent::Type::In : PassengerEvent::Type::Out});
+    }
+
+    std::atomic<bool> done{false};
+    size_t nEvents{0};
+    std::thread ingestion{[&]() {
+        while(!done.load(std::memory_order_relaxed))
+        {
+            nw.RecordPassengerEvent(events[nEvents++ % events.size()]);
+        }
+    }};
+
+    size_t nQueries{0};
+    size_t nJourneys{0};
+    const auto start{std::chrono::steady_clock::now()};
+    std::chrono::duration<double> elapsed{0};
+    while(elapsed.count() < seconds)
+    {
+        const auto& [from, to]{queries[nQueries++ % queries.size()]};
+        nJourneys += nw.GetCrowdingAwareJourneys(from, to, k).size();
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    done = true;
+    ingestion.join();
+
+    std::cout << "stations: " << nStations << ", k: " << k << std::endl;
+    std::cout << "queries: " << nQueries / elapsed.count() << " queries/s, "
+              << static_cast<double>(nJourneys) / nQueries << " journeys/query" << std::endl;
+    std::cout << "ingestion: " << nEvents / elapsed.count() << " events/s" << std::endl;
+
+    return nJourneys > 0 ? 0 : 1;
+}
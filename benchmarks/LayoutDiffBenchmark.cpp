@@ -0,0 +1,115 @@
+#include <NetworkLayoutGenerator.hpp>
+#include <TransportNetwork.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::Line;
+using NetworkMonitor::NetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::Route;
+using NetworkMonitor::Station;
+using NetworkMonitor::TransportNetwork;
+
+namespace {
+
+bool Load(TransportNetwork& nw, const NetworkLayout& layout)
+{
+    bool ok{true};
+    for(const auto& station : layout.stations)
+    {
+        ok &= nw.AddStation(station);
+    }
+    ok &= nw.AddLines(layout.lines);
+    for(const auto& [stationA, stationB, travelTime] : layout.travelTimes)
+    {
+        ok &= nw.SetTravelTime(stationA, stationB, travelTime);
+    }
+    return ok;
+}
+
+// Apply `nChanges` changes to a layout, cycling through a travel time change,
+// a renamed station, a removed route, and a new station served by a new line.
+NetworkLayout ChangeLayout(NetworkLayout layout, size_t nChanges)
+{
+    const auto nStations{layout.stations.size()};
+    for(size_t idx{0}; idx < nChanges; ++idx)
+    {
+        const auto pick{idx / 4 * 7919};
+        switch(idx % 4)
+        {
+            case 0:
+                layout.travelTimes[pick % layout.travelTimes.size()].travelTime += 1;
+                break;
+            case 1:
+                layout.stations[pick % nStations].name += " (renamed)";
+                break;
+            case 2:
+            {
+                auto& routes{layout.lines[pick % layout.lines.size()].routes};
+                if(routes.size() > 1)
+                {
+                    routes.pop_back();
+                }
+                break;
+            }
+            default:
+            {
+                const auto suffix{std::to_string(idx)};
+                const Station station{"new_station_" + suffix, "New Station " + suffix};
+                const auto from{layout.stations[pick % nStations].id};
+                layout.stations.push_back(station);
+                layout.lines.push_back(Line{
+                    "new_line_" + suffix,
+                    "New Line " + suffix,
+                    {Route{"new_route_" + suffix, "inbound", "new_line_" + suffix, from, station.id, {from, station.id}}}});
+                layout.travelTimes.push_back({from, station.id, 3});
+                break;
+            }
+        }
+    }
+    return layout;
+}
+
+} // namespace
+
+// Usage: network_monitor_layout_diff_bench [stations] [changes]
+// Compares rebuilding the network from a changed layout with diffing the
+// layout against the loaded network and applying the changes in place.
+int main(int argc, char* argv[])
+{
+    const size_t nStations{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000};
+    const size_t nChanges{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100};
+
+    NetworkLayoutOptions options{};
+    options.nStations = nStations;
+    options.nLines = nStations / 10;
+    const auto layout{GenerateNetworkLayout(options)};
+    const auto newLayout{ChangeLayout(layout, nChanges)};
+
+    using Ms = std::chrono::duration<double, std::milli>;
+    std::cout << "stations: " << nStations << ", changes: " << nChanges << std::endl;
+
+    TransportNetwork nw{};
+    bool ok{Load(nw, layout)};
+
+    const auto rebuildStart{std::chrono::steady_clock::now()};
+    {
+        TransportNetwork rebuilt{};
+        ok &= Load(rebuilt, newLayout);
+    }
+    const auto diffStart{std::chrono::steady_clock::now()};
+    const auto changes{nw.DiffLayout(newLayout)};
+    const auto applyStart{std::chrono::steady_clock::now()};
+    ok &= nw.ApplyLayoutChanges(changes);
+    const auto applied{std::chrono::steady_clock::now()};
+    ok &= nw.DiffLayout(newLayout).empty();
+
+    std::cout << (ok ? "ok" : "FAILED") << ": rebuild " << Ms{diffStart - rebuildStart}.count() << " ms, diff "
+              << Ms{applyStart - diffStart}.count() << " ms, apply " << Ms{applied - applyStart}.count() << " ms ("
+              << changes.size() << " changes)" << std::endl;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#include <Log.hpp>
+#include <boost/system/error_code.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <time.h>
+#endif
+
+using NetworkMonitor::Logger;
+using NetworkMonitor::LogLevel;
+
+namespace {
+
+// The synchronous logger we used to have, writing to a file instead of stderr.
+void SyncLog(std::ostream& out, const std::string& where, boost::system::error_code ec)
+{
+    out << "[" << std::setw(20) << where << "] " << (ec ? "Error: " : "OK") << (ec ? ec.message() : "") << std::endl;
+}
+
+// CPU time spent by the calling thread, in nanoseconds. On a machine with
+// few cores the background thread competes with the producers for the CPU,
+// so this tells us the actual cost of a log call better than the wall time.
+// Returns 0 on platforms where we do not know how to measure it.
+double GetThreadCpuTime()
+{
+#if defined(__linux__)
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) * 1e9 + static_cast<double>(ts.tv_nsec);
+#else
+    return 0;
+#endif
+}
+
+} // namespace
+
+// Usage: network_monitor_log_bench [records per thread] [threads]
+int main(int argc, char* argv[])
+{
+    const size_t nRecords{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000};
+    const size_t nThreads{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1};
+    const auto ec{boost::system::errc::make_error_code(boost::system::errc::connection_refused)};
+
+    using Ns = std::chrono::duration<double, std::nano>;
+
+    // Synchronous logging, with a flush on every line.
+    {
+        std::ofstream out{"/dev/null"};
+        const auto start{std::chrono::steady_clock::now()};
+        for(size_t idx{0}; idx < nRecords; ++idx)
+        {
+            SyncLog(out, "OnConnect", ec);
+        }
+        const auto elapsed{Ns{std::chrono::steady_clock::now() - start}.count()};
+        std::cout << "sync (std::endl): " << elapsed / nRecords << " ns/call" << std::endl;
+    }
+
+    // Asynchronous logging. The buffer is large enough for all records, so we
+    // measure the cost on the calling thread only. The sink drops the lines.
+    for(auto policy : {Logger::OverflowPolicy::Drop, Logger::OverflowPolicy::Block})
+    {
+        Logger logger{nRecords * nThreads, policy, [](std::string_view) {}};
+        const auto start{std::chrono::steady_clock::now()};
+        std::vector<std::thread> producers{};
+        std::vector<double> cpuTimes(nThreads, 0.0);
+        for(size_t thread{0}; thread < nThreads; ++thread)
+        {
+            producers.emplace_back([&logger, &ec, &cpuTimes, thread, nRecords]() {
+                const auto cpuStart{GetThreadCpuTime()};
+                for(size_t idx{0}; idx < nRecords; ++idx)
+                {
+                    logger.Write(LogLevel::Error, "OnConnect", ec);
+                }
+                cpuTimes[thread] = GetThreadCpuTime() - cpuStart;
+            });
+        }
+        for(auto& producer : producers)
+        {
+            producer.join();
+        }
+        const auto elapsed{Ns{std::chrono::steady_clock::now() - start}.count()};
+        logger.Flush();
+        const auto drained{Ns{std::chrono::steady_clock::now() - start}.count()};
+        double cpuTime{0};
+        for(auto time : cpuTimes)
+        {
+            cpuTime += time;
+        }
+        std::cout << "async (" << (policy == Logger::OverflowPolicy::Drop ? "drop" : "block") << ", " << nThreads
+                  << " threads): " << elapsed / nRecords << " ns/call wall, "
+                  << cpuTime / static_cast<double>(nRecords * nThreads) << " ns/call producer CPU, dropped "
+                  << logger.GetDroppedCount() << ", drained in " << drained / 1e6 << " ms" << std::endl;
+    }
+
+    // A disabled level costs a relaxed load.
+    {
+        Logger logger{16, Logger::OverflowPolicy::Drop, [](std::string_view) {}};
+        logger.SetLevel(LogLevel::Off);
+        size_t kept{0};
+        const auto start{std::chrono::steady_clock::now()};
+        for(size_t idx{0}; idx < nRecords; ++idx)
+        {
+            kept += logger.IsEnabled(LogLevel::Error) ? 1 : 0;
+        }
+        const auto elapsed{Ns{std::chrono::steady_clock::now() - start}.count()};
+        std::cout << "disabled at runtime: " << elapsed / nRecords << " ns/call (" << kept << ")" << std::endl;
+    }
+
+    return 0;
+}
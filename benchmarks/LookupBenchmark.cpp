@@ -0,0 +1,112 @@
+#include <FlatHashMap.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using NetworkMonitor::FlatHashMap;
+using NetworkMonitor::StringViewHash;
+
+namespace {
+
+// Look up all keys and sum the values, so that the lookups are not optimized
+// out.
+template <typename Map, typename MakeKey>
+void Benchmark(const char* name, const Map& map, const std::vector<std::string_view>& keys, MakeKey&& makeKey)
+{
+    size_t sum{0};
+    const auto start{std::chrono::steady_clock::now()};
+    for(const auto key : keys)
+    {
+        auto it{map.find(makeKey(key))};
+        sum += it != map.end() ? it->second : 1;
+    }
+    const auto elapsed{std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()};
+    std::cout << name << ": " << elapsed / keys.size() << " ns/lookup (checksum " << sum << ")" << std::endl;
+}
+
+template <typename Map>
+void BenchmarkAll(const char* name,
+                  const Map& map,
+                  const std::vector<std::string_view>& hits,
+                  const std::vector<std::string_view>& misses)
+{
+    const auto makeKey{[](std::string_view key) {
+        if constexpr(std::is_same_v<typename Map::key_type, std::string>)
+        {
+            // The key type of the original maps: Each lookup from a message
+            // builds a string.
+            return std::string{key};
+        }
+        else
+        {
+            return key;
+        }
+    }};
+    Benchmark((std::string{name} + ", hits").c_str(), map, hits, makeKey);
+    Benchmark((std::string{name} + ", misses").c_str(), map, misses, makeKey);
+}
+
+} // namespace
+
+// Usage: network_monitor_lookup_bench [keys] [lookups]
+// Compares the station lookup tables of the network: The original
+// std::unordered_map keyed on strings, the same map keyed on views, and the
+// flat hash map.
+int main(int argc, char* argv[])
+{
+    const size_t nKeys{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000};
+    const size_t nLookups{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000000};
+
+    // Keys shaped like station IDs. Lookups view the keys inside a separate
+    // buffer, like the IDs parsed from a feed message.
+    std::vector<std::string> ids(nKeys);
+    std::vector<std::string> otherIds(nKeys);
+    for(size_t idx{0}; idx < nKeys; ++idx)
+    {
+        ids[idx] = "station_" + std::to_string(idx);
+        otherIds[idx] = "station_" + std::to_string(nKeys + idx);
+    }
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<size_t> pick{0, nKeys - 1};
+    std::string message{};
+    std::vector<std::pair<size_t, size_t>> hitOffsets(nLookups);
+    std::vector<std::pair<size_t, size_t>> missOffsets(nLookups);
+    for(size_t idx{0}; idx < nLookups; ++idx)
+    {
+        const auto& hit{ids[pick(rng)]};
+        hitOffsets[idx] = {message.size(), hit.size()};
+        message += hit;
+        const auto& miss{otherIds[pick(rng)]};
+        missOffsets[idx] = {message.size(), miss.size()};
+        message += miss;
+    }
+    std::vector<std::string_view> hits(nLookups);
+    std::vector<std::string_view> misses(nLookups);
+    for(size_t idx{0}; idx < nLookups; ++idx)
+    {
+        hits[idx] = std::string_view{message}.substr(hitOffsets[idx].first, hitOffsets[idx].second);
+        misses[idx] = std::string_view{message}.substr(missOffsets[idx].first, missOffsets[idx].second);
+    }
+    std::cout << "keys: " << nKeys << ", lookups: " << nLookups << std::endl;
+
+    std::unordered_map<std::string, size_t> stringMap{};
+    std::unordered_map<std::string_view, size_t> viewMap{};
+    FlatHashMap<std::string_view, size_t, StringViewHash> flatMap{};
+    for(size_t idx{0}; idx < nKeys; ++idx)
+    {
+        stringMap.emplace(ids[idx], idx);
+        viewMap.emplace(ids[idx], idx);
+        flatMap.emplace(ids[idx], idx);
+    }
+
+    BenchmarkAll("unordered_map<string>", stringMap, hits, misses);
+    BenchmarkAll("unordered_map<string_view>", viewMap, hits, misses);
+    BenchmarkAll("FlatHashMap<string_view>", flatMap, hits, misses);
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "ResidentSetSize.hpp"
+
+#include <NetworkLayoutGenerator.hpp>
+#include <TransportNetwork.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::GetResidentSetSize;
+using NetworkMonitor::MemoryMode;
+using NetworkMonitor::MemoryUsage;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::TransportNetwork;
+
+namespace {
+
+void PrintUsage(const MemoryUsage& usage)
+{
+    const auto mb{[](size_t bytes) { return static_cast<double>(bytes) / (1024 * 1024); }};
+    std::cout << "  stations:       " << mb(usage.stations) << " MB\n"
+              << "  lines:          " << mb(usage.lines) << " MB\n"
+              << "  edges:          " << mb(usage.edges) << " MB\n"
+              << "  route index:    " << mb(usage.routeIndex) << " MB\n"
+              << "  strings:        " << mb(usage.strings) << " MB\n"
+              << "  lookup tables:  " << mb(usage.lookupTables) << " MB\n"
+              << "  passenger flow: " << mb(usage.passengerFlow) << " MB\n"
+              << "  crowding:       " << mb(usage.crowding) << " MB\n"
+              << "  arena overhead: " << mb(usage.arenaOverhead) << " MB\n"
+              << "  total:          " << mb(usage.Total()) << " MB" << std::endl;
+}
+
+} // namespace
+
+// Usage: network_monitor_memory_bench [default|compact] [stations] [active %]
+// Loads a generated network, then records timestamped passenger events at the
+// given share of the stations. We measure one mode per process, as the RSS
+// would be skewed by the memory that the allocator keeps from a previous run.
+int main(int argc, char* argv[])
+{
+    const std::string modeName{argc > 1 ? argv[1] : "default"};
+    const size_t nStations{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000};
+    const size_t activePercent{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 10};
+    if(modeName != "default" && modeName != "compact")
+    {
+        std::cerr << "Unknown memory mode: " << modeName << std::endl;
+        return 1;
+    }
+    const auto mode{modeName == "compact" ? MemoryMode::Compact : MemoryMode::Default};
+
+    NetworkLayoutOptions options{};
+    options.nStations = nStations;
+    options.nLines = nStations / 50;
+    const auto layout{GenerateNetworkLayout(options)};
+    std::cout << "mode: " << modeName << ", stations: " << nStations << ", lines: " << options.nLines
+              << ", active stations: " << activePercent << "%" << std::endl;
+
+    const auto rssBefore{GetResidentSetSize()};
+    TransportNetwork nw{mode};
+    bool ok{true};
+    for(const auto& station : layout.stations)
+    {
+        ok &= nw.AddStation(station);
+    }
+    ok &= nw.AddLines(layout.lines);
+    if(!ok)
+    {
+        std::cerr << "Could not load the network" << std::endl;
+        return 1;
+    }
+    const auto rssLoaded{GetResidentSetSize()};
+    std::cout << "after load (RSS +" << (rssLoaded - rssBefore) / (1024 * 1024) << " MB):" << std::endl;
+    PrintUsage(nw.GetMemoryUsage());
+
+    const auto now{std::chrono::system_clock::now()};
+    const size_t nActive{nStations * activePercent / 100};
+    for(size_t idx{0}; idx < nActive; ++idx)
+    {
+        nw.RecordPassengerEvent({layout.stations[idx].id, PassengerEvent::Type::In, now});
+    }
+    const auto rssEvents{GetResidentSetSize()};
+    std::cout << "after events (RSS +" << (rssEvents - rssBefore) / (1024 * 1024) << " MB):" << std::endl;
+    PrintUsage(nw.GetMemoryUsage());
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <Metrics.hpp>
+#include <TransportNetwork.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using NetworkMonitor::Histogram;
+using NetworkMonitor::Id;
+using NetworkMonitor::MetricsRegistry;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::TransportNetwork;
+
+// Usage: network_monitor_metrics_bench [events]
+int main(int argc, char* argv[])
+{
+    const size_t nEvents{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000};
+    const size_t nStations{1000};
+
+    using Ns = std::chrono::duration<double, std::nano>;
+
+    TransportNetwork nw{};
+    std::vector<Id> stationIds{};
+    for(size_t idx{0}; idx < nStations; ++idx)
+    {
+        stationIds.push_back("station_" + std::to_string(idx));
+        nw.AddStation({stationIds.back(), "Station Name " + std::to_string(idx)});
+    }
+
+    // The instrumented hot path, with the metrics on and off.
+    auto& registry{MetricsRegistry::Default()};
+    for(bool enabled : {false, true, false, true})
+    {
+        registry.SetEnabled(enabled);
+        const auto start{std::chrono::steady_clock::now()};
+        for(size_t idx{0}; idx < nEvents; ++idx)
+        {
+            nw.RecordPassengerEvent({stationIds[idx % nStations], PassengerEvent::Type::In});
+        }
+        const auto elapsed{Ns{std::chrono::steady_clock::now() - start}.count()};
+        std::cout << "RecordPassengerEvent, metrics " << (enabled ? "on:  " : "off: ") << elapsed / nEvents
+                  << " ns/event" << std::endl;
+    }
+
+    // The metrics themselves.
+    auto& counter{registry.GetCounter("bench_total", "Benchmark counter.")};
+    auto start{std::chrono::steady_clock::now()};
+    for(size_t idx{0}; idx < nEvents; ++idx)
+    {
+        counter.Increment();
+    }
+    std::cout << "Counter::Increment: " << Ns{std::chrono::steady_clock::now() - start}.count() / nEvents
+              << " ns/call" << std::endl;
+
+    Histogram histogram{1e-9};
+    start = std::chrono::steady_clock::now();
+    for(size_t idx{0}; idx < nEvents; ++idx)
+    {
+        histogram.Record(idx);
+    }
+    std::cout << "Histogram::Record: " << Ns{std::chrono::steady_clock::now() - start}.count() / nEvents
+              << " ns/call" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    const auto text{registry.Export()};
+    std::cout << "Export: " << Ns{std::chrono::steady_clock::now() - start}.count() / 1000 << " us, "
+              << text.size() << " bytes" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <NetworkLayoutGenerator.hpp>
+#include <PassengerEventFanIn.hpp>
+#include <TransportNetwork.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::FanInMode;
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventFanIn;
+using NetworkMonitor::PassengerEventFanInOptions;
+using NetworkMonitor::TransportNetwork;
+
+namespace {
+
+// Run one thread per feed that calls `push` on each of its events, and report
+// the time per event.
+template <typename Push>
+double Benchmark(const std::vector<std::vector<PassengerEvent>>& feeds, Push&& push)
+{
+    size_t nEvents{0};
+    for(const auto& feed : feeds)
+    {
+        nEvents += feed.size();
+    }
+    const auto start{std::chrono::steady_clock::now()};
+    std::vector<std::thread> threads{};
+    for(size_t feed{0}; feed < feeds.size(); ++feed)
+    {
+        threads.emplace_back([&feeds, &push, feed]() {
+            for(const auto& event : feeds[feed])
+            {
+                push(feed, event);
+            }
+        });
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / nEvents;
+}
+
+void PrintStats(const PassengerEventFanIn& fanIn)
+{
+    const auto stats{fanIn.GetStats()};
+    std::cout << "  applied " << stats.applied << ", late " << stats.late << std::endl;
+    for(size_t feed{0}; feed < stats.feeds.size(); ++feed)
+    {
+        std::cout << "  feed " << feed << ": stalls " << stats.feeds[feed].stalls << std::endl;
+    }
+}
+
+} // namespace
+
+// Usage: network_monitor_passenger_event_fan_in_bench [feeds] [events per feed] [shards]
+// Each feed sends one event per millisecond, on random stations. We compare
+// calling RecordPassengerEvent from each feed thread, behind a lock as a
+// single writer would need, with the merged and sharded fan-ins.
+int main(int argc, char* argv[])
+{
+    const size_t nFeeds{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4};
+    const size_t nEvents{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000};
+    const size_t nShards{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 0};
+
+    NetworkLayoutOptions options{};
+    options.nStations = 10000;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<size_t> pickStation{0, layout.stations.size() - 1};
+    std::bernoulli_distribution enters{0.5};
+    const std::chrono::system_clock::time_point t0{std::chrono::seconds{1700000000}};
+    std::vector<std::vector<PassengerEvent>> feeds(nFeeds);
+    for(auto& feed : feeds)
+    {
+        feed.reserve(nEvents);
+        for(size_t idx{0}; idx < nEvents; ++idx)
+        {
+            feed.push_back({layout.stations[pickStation(rng)].id,
+                            enters(rng) ? PassengerEvent::Type::In : PassengerEvent::Type::Out,
+                            t0 + std::chrono::milliseconds{idx}});
+        }
+    }
+    std::cout << "feeds: " << nFeeds << ", events per feed: " << nEvents << std::endl;
+
+    const auto makeNetwork{[&layout]() {
+        auto nw{std::make_unique<TransportNetwork>()};
+        for(const auto& station : layout.stations)
+        {
+            nw->AddStation(station);
+        }
+        return nw;
+    }};
+
+    {
+        auto nw{makeNetwork()};
+        std::mutex mutex{};
+        const auto time{Benchmark(feeds, [&nw, &mutex](size_t, const PassengerEvent& event) {
+            std::lock_guard<std::mutex> lock{mutex};
+            nw->RecordPassengerEvent(event);
+        })};
+        std::cout << "direct, locked: " << time << " ns/event" << std::endl;
+    }
+
+    for(const auto mode : {FanInMode::Merged, FanInMode::Sharded})
+    {
+        auto nw{makeNetwork()};
+        PassengerEventFanInOptions fanInOptions{};
+        fanInOptions.mode = mode;
+        fanInOptions.nShards = nShards;
+        PassengerEventFanIn fanIn{*nw, nFeeds, fanInOptions};
+        const auto start{std::chrono::steady_clock::now()};
+        const auto pushTime{Benchmark(feeds, [&fanIn](size_t feed, const PassengerEvent& event) {
+            fanIn.Push(feed, event);
+        })};
+        fanIn.Flush();
+        const auto elapsed{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+        std::cout << (mode == FanInMode::Merged ? "merged" : "sharded") << ": push " << pushTime
+                  << " ns/event, applied " << nFeeds * nEvents / elapsed << " events/s" << std::endl;
+        PrintStats(fanIn);
+    }
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <NetworkLayoutGenerator.hpp>
+#include <PassengerEventFilter.hpp>
+#include <TransportNetwork.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventFilter;
+using NetworkMonitor::PassengerEventFilterOptions;
+using NetworkMonitor::TransportNetwork;
+
+namespace {
+
+// Feed all events to `push` and report the time per event.
+template <typename Push>
+double Benchmark(const char* name, const std::vector<PassengerEvent>& events, Push&& push)
+{
+    const auto start{std::chrono::steady_clock::now()};
+    for(const auto& event : events)
+    {
+        push(event);
+    }
+    const auto elapsed{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+    const auto nsPerEvent{elapsed * 1e9 / events.size()};
+    std::cout << name << ": " << nsPerEvent << " ns/event" << std::endl;
+    return nsPerEvent;
+}
+
+void PrintStats(const PassengerEventFilter& filter)
+{
+    const auto stats{filter.GetStats()};
+    std::cout << "  accepted " << stats.accepted << ", duplicates " << stats.duplicates << ", expired "
+              << stats.expired << ", reordered " << stats.reordered << ", late " << stats.late << ", "
+              << filter.GetMemorySize() / 1024 << " KiB" << std::endl;
+}
+
+} // namespace
+
+// Usage: network_monitor_passenger_event_filter_bench [events] [duplicate %] [late %] [max lateness ms]
+// A feed with one event per millisecond, where a fraction of the events are
+// sent twice, and a fraction arrive up to half the lateness bound late.
+int main(int argc, char* argv[])
+{
+    const size_t nEvents{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000};
+    const double duplicates{argc > 2 ? std::strtod(argv[2], nullptr) / 100.0 : 0.01};
+    const double late{argc > 3 ? std::strtod(argv[3], nullptr) / 100.0 : 0.01};
+    const long maxLateness{argc > 4 ? std::strtol(argv[4], nullptr, 10) : 1000};
+
+    NetworkLayoutOptions options{};
+    options.nStations = 10000;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<size_t> pickStation{0, layout.stations.size() - 1};
+    std::bernoulli_distribution enters{0.5};
+    std::bernoulli_distribution duplicate{duplicates};
+    std::bernoulli_distribution isLate{late};
+    std::uniform_int_distribution<long> delay{0, maxLateness / 2};
+    const std::chrono::system_clock::time_point t0{std::chrono::seconds{1700000000}};
+
+    // Each event goes out at its timestamp plus a random delay.
+    std::vector<std::pair<long, PassengerEvent>> sent{};
+    sent.reserve(nEvents + nEvents * duplicates * 2);
+    for(size_t idx{0}; idx < nEvents; ++idx)
+    {
+        const PassengerEvent event{layout.stations[pickStation(rng)].id,
+                                   enters(rng) ? PassengerEvent::Type::In : PassengerEvent::Type::Out,
+                                   t0 + std::chrono::milliseconds{idx}, idx + 1};
+        sent.emplace_back(static_cast<long>(idx) + (isLate(rng) ? delay(rng) : 0), event);
+        if(duplicate(rng))
+        {
+            sent.emplace_back(static_cast<long>(idx) + delay(rng), event);
+        }
+    }
+    std::stable_sort(sent.begin(), sent.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    std::vector<PassengerEvent> feed{};
+    feed.reserve(sent.size());
+    for(auto& [at, event] : sent)
+    {
+        feed.push_back(std::move(event));
+    }
+    sent = {};
+    std::cout << "events: " << nEvents << ", sent: " << feed.size() << ", late: " << late * 100
+              << "%, max lateness: " << maxLateness << " ms" << std::endl;
+
+    // The baseline reads each event, as the filter does.
+    std::uint64_t checksum{0};
+    const auto count{[&checksum](const PassengerEvent& event) { checksum += event.sequence; }};
+    const auto baseline{Benchmark("no filter", feed, count)};
+
+    PassengerEventFilter dedup{};
+    const auto dedupTime{Benchmark("dedup", feed, [&dedup, &count](const PassengerEvent& event) {
+        dedup.Push(event, count);
+    })};
+    PrintStats(dedup);
+
+    PassengerEventFilterOptions filterOptions{};
+    filterOptions.maxLateness = std::chrono::milliseconds{maxLateness};
+    PassengerEventFilter reorder{filterOptions};
+    const auto reorderTime{Benchmark("dedup + reorder", feed, [&reorder, &count](const PassengerEvent& event) {
+        reorder.Push(event, count);
+    })};
+    reorder.Flush(count);
+    PrintStats(reorder);
+
+    // The same, in front of the network.
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        nw.AddStation(station);
+    }
+    const auto record{[&nw](const PassengerEvent& event) { nw.RecordPassengerEvent(event); }};
+    const auto networkTime{Benchmark("network", feed, record)};
+    PassengerEventFilter filter{filterOptions};
+    const auto filteredTime{Benchmark("dedup + reorder + network", feed,
+                                      [&filter, &record](const PassengerEvent& event) { filter.Push(event, record); })};
+    filter.Flush(record);
+
+    std::cout << "filter cost: dedup " << dedupTime - baseline << " ns/event, dedup + reorder "
+              << reorderTime - baseline << " ns/event, in front of the network " << filteredTime - networkTime
+              << " ns/event" << std::endl;
+    std::cout << "checksum: " << checksum << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <NetworkLayoutGenerator.hpp>
+#include <PassengerEventLog.hpp>
+#include <TransportNetwork.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventLog;
+using NetworkMonitor::PassengerEventLogOptions;
+using NetworkMonitor::TransportNetwork;
+
+namespace {
+
+// Record all events and return the ingestion rate, in events/s.
+template <typename Record>
+double Ingest(const std::vector<PassengerEvent>& events, Record&& record)
+{
+    const auto start{std::chrono::steady_clock::now()};
+    for(const auto& event : events)
+    {
+        record(event);
+    }
+    const auto elapsed{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+    return events.size() / elapsed;
+}
+
+} // namespace
+
+// Usage: network_monitor_passenger_event_log_bench [events] [commit interval ms] [capacity] [directory]
+// Compares the ingestion rate of a network on its own with the rate of the
+// same network with every event appended to a durable log.
+int main(int argc, char* argv[])
+{
+    const size_t nEvents{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000};
+    const long commitInterval{argc > 2 ? std::strtol(argv[2], nullptr, 10) : 10};
+    const size_t capacity{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : PassengerEventLogOptions{}.capacity};
+    const std::filesystem::path directory{
+        argc > 4 ? std::filesystem::path{argv[4]}
+                 : std::filesystem::temp_directory_path() / "network_monitor_passenger_event_log_bench"};
+
+    NetworkLayoutOptions options{};
+    options.nStations = 10000;
+    const auto layout{GenerateNetworkLayout(options)};
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        nw.AddStation(station);
+    }
+
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<size_t> pickStation{0, layout.stations.size() - 1};
+    std::bernoulli_distribution enters{0.5};
+    std::vector<PassengerEvent> events{};
+    events.reserve(nEvents);
+    for(size_t idx{0}; idx < nEvents; ++idx)
+    {
+        events.push_back({layout.stations[pickStation(rng)].id,
+                          enters(rng) ? PassengerEvent::Type::In : PassengerEvent::Type::Out});
+    }
+
+    const auto inMemory{Ingest(events, [&nw](const PassengerEvent& event) { nw.RecordPassengerEvent(event); })};
+
+    std::filesystem::remove_all(directory);
+    PassengerEventLogOptions logOptions{};
+    logOptions.directory = directory;
+    logOptions.commitInterval = std::chrono::milliseconds{commitInterval};
+    logOptions.capacity = capacity;
+    double durable{0.0};
+    double commitTime{0.0};
+    {
+        PassengerEventLog log{logOptions};
+        durable = Ingest(events, [&nw, &log](const PassengerEvent& event) {
+            if(nw.RecordPassengerEvent(event))
+            {
+                log.Append(event);
+            }
+        });
+        const auto start{std::chrono::steady_clock::now()};
+        log.Commit();
+        commitTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const auto stats{log.GetStats()};
+        std::cout << "log: " << stats.commits << " commits, " << stats.events / stats.commits << " events/commit, "
+                  << stats.bytes / 1e6 << " MB, " << stats.stalls << " stalls, " << stats.errors << " errors"
+                  << std::endl;
+    }
+    std::filesystem::remove_all(directory);
+
+    std::cout << "in-memory: " << inMemory / 1e6 << " M events/s" << std::endl;
+    std::cout << "durable, " << commitInterval << " ms commits, " << capacity
+              << " events buffered: " << durable / 1e6 << " M events/s (" << 100.0 * durable / inMemory
+              << "% of in-memory), last commit " << commitTime * 1e3 << " ms" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include <NetworkLayoutGenerator.hpp>
+#include <PassengerShards.hpp>
+#include <TransportNetwork.hpp>
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerShardRouter;
+using NetworkMonitor::TransportNetwork;
+
+extern char** environ;
+
+namespace {
+
+// Spawn one shard worker per shard, and return their socket paths.
+std::vector<std::filesystem::path> SpawnShards(std::size_t nShards, std::size_t nStations, std::vector<pid_t>& pids)
+{
+    std::vector<std::filesystem::path> paths{};
+    for(std::size_t shard{0}; shard < nShards; ++shard)
+    {
+        paths.push_back(std::filesystem::temp_directory_path() /
+                        ("nm-bench-" + std::to_string(getpid()) + "-" + std::to_string(shard) + ".sock"));
+        std::vector<std::string> args{BENCHMARKS_SHARD_WORKER, paths.back().string(), std::to_string(shard),
+                                      std::to_string(nShards), std::to_string(nStations)};
+        std::vector<char*> argv{};
+        for(auto& arg : args)
+        {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+        pid_t pid{0};
+        if(posix_spawn(&pid, BENCHMARKS_SHARD_WORKER, nullptr, nullptr, argv.data(), environ) != 0)
+        {
+            std::cerr << "Could not spawn " << BENCHMARKS_SHARD_WORKER << std::endl;
+            std::exit(1);
+        }
+        pids.push_back(pid);
+    }
+    return paths;
+}
+
+// Run one thread per feed that calls `record(feed, event)` on each of its
+// events, and return the aggregate events/s.
+template <typename Record>
+double Benchmark(const std::vector<std::vector<PassengerEvent>>& feeds, Record&& record)
+{
+    std::size_t nEvents{0};
+    for(const auto& feed : feeds)
+    {
+        nEvents += feed.size();
+    }
+    const auto start{std::chrono::steady_clock::now()};
+    std::vector<std::thread> threads{};
+    for(std::size_t feed{0}; feed < feeds.size(); ++feed)
+    {
+        threads.emplace_back([&feeds, &record, feed]() { record(feed, feeds[feed]); });
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+    return nEvents / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+// Usage: network_monitor_passenger_shards_bench [max shards] [feeds] [events per feed] [stations]
+// Each feed thread has its own router, and sends its events to the shard
+// worker processes. We double the shards up to the maximum, and compare with
+// all feeds recording on one in-process network.
+int main(int argc, char* argv[])
+{
+    const std::size_t maxShards{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 8};
+    const std::size_t nFeeds{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4};
+    const std::size_t nEvents{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1000000};
+    const std::size_t nStations{argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 10000};
+
+    // The layout the shard workers load.
+    NetworkLayoutOptions options{};
+    options.nStations = nStations;
+    options.nLines = std::max<std::size_t>(nStations / 50, 1);
+    const auto layout{GenerateNetworkLayout(options)};
+
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<std::size_t> pickStation{0, layout.stations.size() - 1};
+    std::bernoulli_distribution enters{0.5};
+    std::vector<std::vector<PassengerEvent>> feeds(nFeeds);
+    for(auto& feed : feeds)
+    {
+        feed.reserve(nEvents);
+        for(std::size_t idx{0}; idx < nEvents; ++idx)
+        {
+            feed.push_back({layout.stations[pickStation(rng)].id,
+                            enters(rng) ? PassengerEvent::Type::In : PassengerEvent::Type::Out});
+        }
+    }
+    std::cout << "feeds: " << nFeeds << ", events per feed: " << nEvents << ", stations: " << nStations
+              << std::endl;
+
+    {
+        TransportNetwork nw{};
+        for(const auto& station : layout.stations)
+        {
+            nw.AddStation(station);
+        }
+        const auto rate{Benchmark(feeds, [&nw](std::size_t, const std::vector<PassengerEvent>& events) {
+            for(const auto& event : events)
+            {
+                nw.RecordPassengerEvent(event);
+            }
+        })};
+        std::cout << "in-process: " << rate << " events/s" << std::endl;
+    }
+
+    for(std::size_t nShards{1}; nShards <= maxShards; nShards *= 2)
+    {
+        std::vector<pid_t> pids{};
+        const auto paths{SpawnShards(nShards, nStations, pids)};
+
+        // Connect before we start the clock: The workers load the layout first.
+        std::vector<std::unique_ptr<PassengerShardRouter>> routers{};
+        for(std::size_t feed{0}; feed < nFeeds; ++feed)
+        {
+            routers.push_back(std::make_unique<PassengerShardRouter>(paths));
+        }
+        const auto rate{Benchmark(feeds, [&routers](std::size_t feed, const std::vector<PassengerEvent>& events) {
+            auto& router{*routers[feed]};
+            for(const auto& event : events)
+            {
+                router.RecordPassengerEvent(event);
+            }
+            router.Flush();
+        })};
+        std::uint64_t recorded{0};
+        for(const auto& stats : routers.front()->GetShardStats())
+        {
+            recorded += stats.recorded;
+        }
+        std::cout << "shards: " << nShards << ": " << rate << " events/s, recorded " << recorded << std::endl;
+
+        routers.clear();
+        for(const auto pid : pids)
+        {
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <NetworkLayoutGenerator.hpp>
+#include <TransportNetwork.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::RouteIdView;
+using NetworkMonitor::RouteTravelTimeQuery;
+using NetworkMonitor::TransportNetwork;
+using NetworkMonitor::TravelTimeProfile;
+using NetworkMonitor::TravelTimeQuery;
+
+// Count the heap allocations, to check that the queries do not allocate.
+namespace {
+std::atomic<size_t> nAllocations{0};
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    nAllocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* ptr{std::malloc(size)}; ptr != nullptr)
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+namespace {
+
+// Run a batch query on 1, 2, 4... threads, up to the hardware threads.
+template <typename Query>
+void Benchmark(const char* name, size_t nQueries, Query&& query)
+{
+    const size_t maxThreads{std::max(1u, std::thread::hardware_concurrency())};
+    double singleThread{0.0};
+    for(size_t nThreads{1}; nThreads <= maxThreads; nThreads *= 2)
+    {
+        const auto allocationsBefore{nAllocations.load()};
+        const auto start{std::chrono::steady_clock::now()};
+        query(nThreads);
+        const auto elapsed{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+        const auto allocations{nAllocations.load() - allocationsBefore};
+
+        const auto throughput{nQueries / elapsed};
+        if(nThreads == 1)
+        {
+            singleThread = throughput;
+        }
+        std::cout << name << ", " << nThreads << " threads: " << throughput / 1e6 << " M queries/s (x"
+                  << throughput / singleThread << "), " << allocations << " allocations" << std::endl;
+    }
+}
+
+} // namespace
+
+// Usage: network_monitor_query_bench [queries] [stations]
+int main(int argc, char* argv[])
+{
+    const size_t nQueries{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000};
+    const size_t nStations{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000};
+
+    NetworkLayoutOptions options{};
+    options.nStations = nStations;
+    options.nLines = nStations / 50;
+    options.routesPerLine = 4;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        nw.AddStation(station);
+    }
+    nw.AddLines(layout.lines);
+    for(const auto& travelTime : layout.travelTimes)
+    {
+        nw.SetTravelTime(travelTime.startStationId, travelTime.endStationId, travelTime.travelTime);
+    }
+
+    // Time-dependent queries run on a copy of the network where every station
+    // pair has a peak and off-peak profile.
+    TransportNetwork profiledNw{};
+    for(const auto& station : layout.stations)
+    {
+        profiledNw.AddStation(station);
+    }
+    profiledNw.AddLines(layout.lines);
+    for(const auto& travelTime : layout.travelTimes)
+    {
+        using std::chrono::hours;
+        const auto offPeak{travelTime.travelTime};
+        const TravelTimeProfile profile{{
+            {hours{0}, offPeak},
+            {hours{7}, 2 * offPeak},
+            {hours{10}, offPeak},
+            {hours{17}, 2 * offPeak},
+            {hours{19}, offPeak},
+        }};
+        profiledNw.SetTravelTime(travelTime.startStationId, travelTime.endStationId, offPeak);
+        profiledNw.SetTravelTimeProfile(travelTime.startStationId, travelTime.endStationId, profile);
+    }
+
+    // Random queries over random routes, both along and against the route.
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<size_t> pickLine{0, layout.lines.size() - 1};
+    std::uniform_int_distribution<size_t> pickStation{0, layout.stations.size() - 1};
+    std::vector<TravelTimeQuery> queries(nQueries);
+    std::vector<RouteTravelTimeQuery> routeQueries(nQueries);
+    std::vector<std::string_view> stations(nQueries);
+    std::uniform_int_distribution<long long int> pickDeparture{1, 24 * 60 * 60};
+    for(size_t idx{0}; idx < nQueries; ++idx)
+    {
+        const auto& line{layout.lines[pickLine(rng)]};
+        const auto& route{line.routes[idx % line.routes.size()]};
+        std::uniform_int_distribution<size_t> pickStop{0, route.stops.size() - 1};
+        const auto stopA{pickStop(rng)};
+        const auto stopB{pickStop(rng)};
+        queries[idx] = {route.stops[stopA], route.stops[stopA + 1 < route.stops.size() ? stopA + 1 : stopA - 1]};
+        routeQueries[idx] = {line.id, route.id, route.stops[stopA], route.stops[stopB]};
+        stations[idx] = layout.stations[pickStation(rng)].id;
+    }
+    auto timedQueries{queries};
+    auto timedRouteQueries{routeQueries};
+    for(size_t idx{0}; idx < nQueries; ++idx)
+    {
+        const std::chrono::system_clock::time_point departure{std::chrono::seconds{pickDeparture(rng)}};
+        timedQueries[idx].departure = departure;
+        timedRouteQueries[idx].departure = departure;
+    }
+
+    std::vector<unsigned int> travelTimes(nQueries);
+    std::vector<RouteIdView> routes(nQueries);
+    Benchmark("GetTravelTimes, adjacent", nQueries, [&](size_t nThreads) {
+        nw.GetTravelTimes(queries.data(), nQueries, travelTimes.data(), nThreads);
+    });
+    Benchmark("GetTravelTimes, route", nQueries, [&](size_t nThreads) {
+        nw.GetTravelTimes(routeQueries.data(), nQueries, travelTimes.data(), nThreads);
+    });
+    Benchmark("GetTravelTimes, adjacent, departure time", nQueries, [&](size_t nThreads) {
+        profiledNw.GetTravelTimes(timedQueries.data(), nQueries, travelTimes.data(), nThreads);
+    });
+    Benchmark("GetTravelTimes, route, departure time", nQueries, [&](size_t nThreads) {
+        profiledNw.GetTravelTimes(timedRouteQueries.data(), nQueries, travelTimes.data(), nThreads);
+    });
+    Benchmark("GetRoutesServingStations", nQueries, [&](size_t nThreads) {
+        nw.GetRoutesServingStations(stations.data(), nQueries, routes.data(), nThreads);
+    });
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <NetworkLayoutGenerator.hpp>
+#include <TransportNetwork.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::QueryCacheOptions;
+using NetworkMonitor::RouteTravelTimeQuery;
+using NetworkMonitor::TransportNetwork;
+
+namespace {
+
+// Draws ranks in [0, n) with probability proportional to 1 / (rank + 1)^s.
+class ZipfDistribution
+{
+public:
+    ZipfDistribution(size_t n, double s)
+        : cdf_(n)
+    {
+        double sum{0.0};
+        for(size_t rank{0}; rank < n; ++rank)
+        {
+            sum += 1.0 / std::pow(static_cast<double>(rank + 1), s);
+            cdf_[rank] = sum;
+        }
+        for(auto& value : cdf_)
+        {
+            value /= sum;
+        }
+    }
+
+    template <typename Rng>
+    size_t operator()(Rng& rng)
+    {
+        const auto rank{std::lower_bound(cdf_.begin(), cdf_.end(), uniform_(rng)) - cdf_.begin()};
+        return std::min(static_cast<size_t>(rank), cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_{};
+    std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+};
+
+// Run a batch query twice on a cold cache and report the second, warm run.
+template <typename Query>
+void Benchmark(const char* name, TransportNetwork& nw, size_t nQueries, size_t nThreads, Query&& query)
+{
+    query(nThreads);
+    const auto before{nw.GetQueryCacheStats()};
+    const auto start{std::chrono::steady_clock::now()};
+    query(nThreads);
+    const auto elapsed{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+    const auto after{nw.GetQueryCacheStats()};
+
+    std::cout << name << ", " << nThreads << " threads: " << nQueries / elapsed / 1e6 << " M queries/s";
+    if(after.capacity > 0)
+    {
+        const auto hits{after.hits - before.hits};
+        const auto misses{after.misses - before.misses};
+        std::cout << ", hit rate " << 100.0 * hits / (hits + misses) << "%, "
+                  << after.evictions - before.evictions << " evictions, " << after.memory / 1024 << " KiB";
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+// Usage: network_monitor_query_cache_bench [queries] [stations] [capacity] [zipf exponent]
+// Travel time queries over routes. Each query is drawn from a pool of distinct
+// station pairs, with a Zipf distribution over the pool, so that a few popular
+// pairs make up most of the queries.
+int main(int argc, char* argv[])
+{
+    const size_t nQueries{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000};
+    const size_t nStations{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000};
+    const size_t capacity{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 65536};
+    const double exponent{argc > 4 ? std::strtod(argv[4], nullptr) : 1.0};
+    const size_t nDistinct{nQueries};
+
+    NetworkLayoutOptions options{};
+    options.nStations = nStations;
+    options.nLines = nStations / 50;
+    options.routesPerLine = 4;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        nw.AddStation(station);
+    }
+    nw.AddLines(layout.lines);
+    for(const auto& travelTime : layout.travelTimes)
+    {
+        nw.SetTravelTime(travelTime.startStationId, travelTime.endStationId, travelTime.travelTime);
+    }
+
+    // The pool of distinct queries, in order of popularity.
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<size_t> pickLine{0, layout.lines.size() - 1};
+    std::vector<RouteTravelTimeQuery> pool(nDistinct);
+    for(size_t idx{0}; idx < nDistinct; ++idx)
+    {
+        const auto& line{layout.lines[pickLine(rng)]};
+        const auto& route{line.routes[idx % line.routes.size()]};
+        std::uniform_int_distribution<size_t> pickStop{0, route.stops.size() - 2};
+        const auto stopA{pickStop(rng)};
+        std::uniform_int_distribution<size_t> pickStopB{stopA + 1, route.stops.size() - 1};
+        pool[idx] = {line.id, route.id, route.stops[stopA], route.stops[pickStopB(rng)]};
+    }
+
+    ZipfDistribution zipf{nDistinct, exponent};
+    std::vector<RouteTravelTimeQuery> queries(nQueries);
+    for(auto& query : queries)
+    {
+        query = pool[zipf(rng)];
+    }
+
+    std::cout << "stations: " << nStations << ", queries: " << nQueries << ", distinct: " << nDistinct
+              << ", zipf exponent: " << exponent << ", cache capacity: " << capacity << std::endl;
+    std::vector<unsigned int> travelTimes(nQueries);
+    const size_t maxThreads{std::max(1u, std::thread::hardware_concurrency())};
+    for(const auto cacheCapacity : {size_t{0}, capacity})
+    {
+        QueryCacheOptions cacheOptions{};
+        cacheOptions.capacity = cacheCapacity;
+        for(size_t nThreads{1}; nThreads <= maxThreads; nThreads *= 2)
+        {
+            nw.SetQueryCacheOptions(cacheOptions);
+            Benchmark(cacheCapacity > 0 ? "cached" : "uncached", nw, nQueries, nThreads, [&](size_t threads) {
+                nw.GetTravelTimes(queries.data(), nQueries, travelTimes.data(), threads);
+            });
+        }
+    }
+
+    return 0;
+}
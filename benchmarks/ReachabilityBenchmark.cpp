@@ -0,0 +1,94 @@
+#include <NetworkLayoutGenerator.hpp>
+#include <TransportNetwork.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::ReachabilitySeed;
+using NetworkMonitor::TransportNetwork;
+
+// Usage: network_monitor_reachability_bench [stations] [budget minutes] [threads] [seconds]
+// Runs one-to-all reachability queries from random stations, on each thread,
+// and reports the aggregate query rate.
+int main(int argc, char* argv[])
+{
+    const size_t nStations{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000};
+    const unsigned int budget{argc > 2 ? static_cast<unsigned int>(std::strtoul(argv[2], nullptr, 10)) : 30};
+    const size_t nThreads{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1};
+    const double seconds{argc > 4 ? std::strtod(argv[4], nullptr) : 5.0};
+
+    NetworkLayoutOptions options{};
+    options.nStations = nStations;
+    options.nLines = nStations / 50;
+    options.routesPerLine = 4;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        nw.AddStation(station);
+    }
+    nw.AddLines(layout.lines);
+    for(const auto& travelTime : layout.travelTimes)
+    {
+        nw.SetTravelTime(travelTime.startStationId, travelTime.endStationId, travelTime.travelTime);
+    }
+
+    // Half of the queries start from a single station, half from 3 stations
+    // with a head start of up to 10 minutes.
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<size_t> pickStation{0, layout.stations.size() - 1};
+    std::uniform_int_distribution<unsigned int> headStart{0, 10};
+    std::vector<std::vector<ReachabilitySeed>> queries{};
+    for(size_t idx{0}; idx < 1000; ++idx)
+    {
+        auto& seeds{queries.emplace_back()};
+        for(size_t seed{0}; seed < (idx % 2 == 0 ? 1 : 3); ++seed)
+        {
+            seeds.push_back({layout.stations[pickStation(rng)].id, seed == 0 ? 0 : headStart(rng)});
+        }
+    }
+
+    // Build the routing graph before we start the clock.
+    nw.GetReachableStations(queries.front(), budget);
+
+    std::vector<size_t> nQueries(nThreads, 0);
+    std::vector<size_t> nReached(nThreads, 0);
+    std::vector<std::thread> threads{};
+    const auto start{std::chrono::steady_clock::now()};
+    for(size_t thread{0}; thread < nThreads; ++thread)
+    {
+        threads.emplace_back([&, thread]() {
+            std::chrono::duration<double> elapsed{0};
+            for(size_t idx{thread}; elapsed.count() < seconds; idx += nThreads)
+            {
+                nReached[thread] += nw.GetReachableStations(queries[idx % queries.size()], budget).size();
+                ++nQueries[thread];
+                elapsed = std::chrono::steady_clock::now() - start;
+            }
+        });
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+    const std::chrono::duration<double> elapsed{std::chrono::steady_clock::now() - start};
+
+    size_t totalQueries{0};
+    size_t totalReached{0};
+    for(size_t thread{0}; thread < nThreads; ++thread)
+    {
+        totalQueries += nQueries[thread];
+        totalReached += nReached[thread];
+    }
+    std::cout << "stations: " << nStations << ", budget: " << budget << " min, threads: " << nThreads << std::endl;
+    std::cout << "queries: " << totalQueries / elapsed.count() << " queries/s, "
+              << static_cast<double>(totalReached) / totalQueries << " stations/query" << std::endl;
+
+    return totalReached > 0 ? 0 : 1;
+}
@@ -0,0 +1,21 @@
+#include "ResidentSetSize.hpp"
+
+#include <cstddef>
+#include <fstream>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+std::size_t NetworkMonitor::GetResidentSetSize()
+{
+#if defined(__linux__)
+    std::ifstream statm{"/proc/self/statm"};
+    std::size_t totalPages{0};
+    std::size_t residentPages{0};
+    statm >> totalPages >> residentPages;
+    return residentPages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
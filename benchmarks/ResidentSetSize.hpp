@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+namespace NetworkMonitor {
+
+/*! \brief Resident set size of the current process, in bytes.
+ *
+ *  \returns 0 on platforms where we do not know how to measure it.
+ */
+std::size_t GetResidentSetSize();
+
+} // namespace NetworkMonitor
@@ -0,0 +1,79 @@
+#include "ResidentSetSize.hpp"
+
+#include <NetworkLayoutGenerator.hpp>
+#include <TransportNetwork.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::GetResidentSetSize;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::TransportNetwork;
+
+// Usage: network_monitor_bench [stations] [lines] [route length] [threads]
+// Lines are added one by one with AddLine, unless a number of threads is given
+// for AddLines (0 for one per hardware thread).
+int main(int argc, char* argv[])
+{
+    const size_t nStations{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000};
+    const size_t nLines{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : nStations / 10};
+    const size_t routeLength{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 40};
+    const std::optional<size_t> nThreads{argc > 4 ? std::optional<size_t>{std::strtoul(argv[4], nullptr, 10)}
+                                                  : std::nullopt};
+
+    // Each line has an inbound and an outbound route.
+    NetworkLayoutOptions options{};
+    options.nStations = nStations;
+    options.nLines = nLines;
+    options.routeLength = routeLength;
+    const auto generateStart{std::chrono::steady_clock::now()};
+    const auto layout{GenerateNetworkLayout(options)};
+    const auto generated{std::chrono::steady_clock::now()};
+    const auto& stations{layout.stations};
+    const auto& lines{layout.lines};
+
+    using Ms = std::chrono::duration<double, std::milli>;
+    std::cout << "stations: " << nStations << ", lines: " << nLines << ", route length: " << routeLength
+              << " (generated in " << Ms{generated - generateStart}.count() << " ms)" << std::endl;
+
+    // We run a single load per process, as the RSS measurement would be skewed
+    // by the memory that the allocator keeps around from a previous run.
+    const auto rssBefore{GetResidentSetSize()};
+    const auto start{std::chrono::steady_clock::now()};
+
+    std::optional<TransportNetwork> nw{};
+    nw.emplace();
+    bool ok{true};
+    for(const auto& station : stations)
+    {
+        ok &= nw->AddStation(station);
+    }
+    const auto linesStart{std::chrono::steady_clock::now()};
+    if(nThreads.has_value())
+    {
+        ok &= nw->AddLines(lines, *nThreads);
+    }
+    else
+    {
+        for(const auto& line : lines)
+        {
+            ok &= nw->AddLine(line);
+        }
+    }
+
+    const auto loaded{std::chrono::steady_clock::now()};
+    const auto rssAfter{GetResidentSetSize()};
+
+    nw.reset();
+    const auto destroyed{std::chrono::steady_clock::now()};
+
+    std::cout << (ok ? "ok" : "FAILED") << ": load " << Ms{loaded - start}.count() << " ms (lines "
+              << Ms{loaded - linesStart}.count() << " ms), destroy "
+              << Ms{destroyed - loaded}.count() << " ms, RSS +" << (rssAfter - rssBefore) / (1024.0 * 1024.0)
+              << " MiB" << std::endl;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include <LocalServer.hpp>
+#include <Metrics.hpp>
+#include <TlsContext.hpp>
+#include <WebSocketClient.hpp>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using NetworkMonitor::GetSharedTlsClientContext;
+using NetworkMonitor::Histogram;
+using NetworkMonitor::LocalServer;
+using NetworkMonitor::LocalServerOptions;
+using NetworkMonitor::WebSocketClient;
+
+namespace {
+
+using Seconds = std::chrono::duration<double>;
+
+// Send messages to the echo endpoint one at a time, and measure the round
+// trip of each.
+void BenchmarkEcho(size_t nMessages)
+{
+    boost::asio::io_context ioc{};
+    LocalServer server{ioc};
+    auto ctx{GetSharedTlsClientContext(TESTS_LOCAL_CA_PEM)};
+    WebSocketClient client{"localhost", "/echo", std::to_string(server.GetPort()), ioc, *ctx};
+
+    const std::string message(256, 'x');
+    Histogram latency{};
+    size_t nReceived{0};
+    auto sent{std::chrono::steady_clock::now()};
+    auto onConnect{[&](auto ec) {
+        if(ec)
+        {
+            std::cerr << "Could not connect: " << ec.message() << std::endl;
+            server.Stop();
+            return;
+        }
+        sent = std::chrono::steady_clock::now();
+        client.Send(message);
+    }};
+    auto onReceive{[&](auto ec, auto received) {
+        latency.Record(std::chrono::steady_clock::now() - sent);
+        if(++nReceived == nMessages)
+        {
+            client.Close([&server](auto ec) { server.Stop(); });
+            return;
+        }
+        sent = std::chrono::steady_clock::now();
+        client.Send(message);
+    }};
+    client.Connect(onConnect, onReceive);
+    ioc.run();
+
+    std::cout << "Echo round trip (" << nReceived << " messages): p50 " << latency.GetPercentile(0.5) / 1000
+              << " us, p99 " << latency.GetPercentile(0.99) / 1000 << " us, p99.9 "
+              << latency.GetPercentile(0.999) / 1000 << " us" << std::endl;
+}
+
+// Receive an unpaced STOMP feed.
+void BenchmarkFeed(size_t nEvents)
+{
+    LocalServerOptions options{};
+    options.feedEventsPerSecond = 1e9;
+    options.feedEvents = nEvents;
+
+    boost::asio::io_context ioc{};
+    LocalServer server{ioc, options};
+    auto ctx{GetSharedTlsClientContext(TESTS_LOCAL_CA_PEM)};
+    WebSocketClient client{"localhost", "/network-events", std::to_string(server.GetPort()), ioc, *ctx};
+
+    size_t nReceived{0};
+    auto start{std::chrono::steady_clock::now()};
+    auto onConnect{[&](auto ec) {
+        if(ec)
+        {
+            std::cerr << "Could not connect: " << ec.message() << std::endl;
+            server.Stop();
+            return;
+        }
+        const std::string stomp{"STOMP\naccept-version:1.2\nhost:localhost\nlogin:" + options.stompUsername +
+                                "\npasscode:" + options.stompPassword + "\n\n"};
+        client.Send({stomp.data(), stomp.size() + 1}, [&](auto ec) {
+            const std::string subscribe{"SUBSCRIBE\nid:0\ndestination:/passengers\n\n"};
+            start = std::chrono::steady_clock::now();
+            client.Send({subscribe.data(), subscribe.size() + 1});
+        });
+    }};
+    auto onReceive{[&](auto ec, auto received) {
+        // The first frame is CONNECTED.
+        if(++nReceived == nEvents + 1)
+        {
+            client.Close([&server](auto ec) { server.Stop(); });
+        }
+    }};
+    client.Connect(onConnect, onReceive);
+    ioc.run();
+
+    const auto elapsed{Seconds{std::chrono::steady_clock::now() - start}.count()};
+    std::cout << "STOMP feed (" << nEvents << " events): " << nEvents / elapsed << " events/s" << std::endl;
+}
+
+} // namespace
+
+// Usage: network_monitor_websocket_bench [messages]
+int main(int argc, char* argv[])
+{
+    const size_t nMessages{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000};
+    BenchmarkEcho(nMessages);
+    BenchmarkFeed(nMessages * 10);
+    return 0;
+}
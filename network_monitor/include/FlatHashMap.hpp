@@ -0,0 +1,460 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NETWORK_MONITOR_FLAT_HASH_MAP_SSE2 1
+#else
+#define NETWORK_MONITOR_FLAT_HASH_MAP_SSE2 0
+#endif
+
+namespace NetworkMonitor {
+
+/*! \brief Open-addressing hash map, Swiss-table style.
+ *
+ *  Elements are stored inline in one flat array, next to an array of 1-byte
+ *  control words that hold 7 bits of the hash of each element. A lookup loads
+ *  the control words of a group of 16 slots at once, and only compares the
+ *  keys of the slots whose control word matches. On x86 the group is matched
+ *  with SSE2 instructions.
+ *
+ *  Lookups take any type that `Hash` and `KeyEqual` accept, so a map keyed on
+ *  `std::string_view` can be queried with a view on the bytes of a message,
+ *  without building a key.
+ *
+ *  Erasing an element leaves a tombstone in its slot, unless its group still
+ *  has an empty slot, so that lookups keep probing past it. Tombstones are
+ *  reused by later insertions, and cleared when the map rehashes. Inserting
+ *  may move the elements and invalidates all iterators. Erasing only
+ *  invalidates the iterators to the erased element.
+ *
+ *  `Key` and `Value` must be default-constructible: Empty slots hold
+ *  value-initialized elements.
+ */
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<>,
+          typename Allocator = std::allocator<std::pair<Key, Value>>>
+class FlatHashMap
+{
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<Key, Value>;
+    using size_type = std::size_t;
+    using allocator_type = Allocator;
+
+    template <typename Element>
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::remove_const_t<Element>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Element*;
+        using reference = Element&;
+
+        Iterator() = default;
+
+        reference operator*() const
+        {
+            return *slot_;
+        }
+
+        pointer operator->() const
+        {
+            return slot_;
+        }
+
+        Iterator& operator++()
+        {
+            ++slot_;
+            ++control_;
+            SkipEmpty();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            auto copy{*this};
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const Iterator& other) const
+        {
+            return slot_ == other.slot_;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return slot_ != other.slot_;
+        }
+
+    private:
+        friend class FlatHashMap;
+
+        Element* slot_{nullptr};
+        const std::int8_t* control_{nullptr};
+        const std::int8_t* controlEnd_{nullptr};
+
+        Iterator(Element* slot, const std::int8_t* control, const std::int8_t* controlEnd)
+            : slot_{slot}
+            , control_{control}
+            , controlEnd_{controlEnd}
+        {
+        }
+
+        void SkipEmpty()
+        {
+            while(control_ != controlEnd_ && *control_ < 0)
+            {
+                ++slot_;
+                ++control_;
+            }
+        }
+    };
+
+    using iterator = Iterator<value_type>;
+    using const_iterator = Iterator<const value_type>;
+
+    FlatHashMap() = default;
+
+    explicit FlatHashMap(const Allocator& allocator)
+        : controls_{ControlAllocator{allocator}}
+        , slots_{allocator}
+    {
+    }
+
+    size_type size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    //! Number of slots. The map grows when it is 7/8 full.
+    size_type capacity() const
+    {
+        return slots_.size();
+    }
+
+    //! Bytes held by the slot and control arrays.
+    size_type GetMemorySize() const
+    {
+        return controls_.capacity() * sizeof(std::int8_t) + slots_.capacity() * sizeof(value_type);
+    }
+
+    /*! \brief Make room for `count` elements without growing.
+     */
+    void reserve(size_type count)
+    {
+        size_type capacity{kGroupWidth};
+        while(capacity - capacity / 8 < count)
+        {
+            capacity *= 2;
+        }
+        if(capacity > slots_.size())
+        {
+            Rehash(capacity);
+        }
+    }
+
+    /*! \brief Insert an element, unless the key is already in the map.
+     *
+     *  \returns An iterator to the element with the key, and whether we
+     *           inserted it.
+     */
+    std::pair<iterator, bool> emplace(Key key, Value value)
+    {
+        const auto hash{hash_(key)};
+        if(auto idx{FindIndex(key, hash)}; idx != kNotFound)
+        {
+            return {MakeIterator(idx), false};
+        }
+        if(size_ + nDeleted_ + 1 > slots_.size() - slots_.size() / 8)
+        {
+            // Only grow if the tombstones are not what fills the map.
+            Rehash(slots_.empty() ? kGroupWidth : size_ + 1 > slots_.size() / 2 ? 2 * slots_.size() : slots_.size());
+        }
+        const auto idx{FindEmptyIndex(hash)};
+        nDeleted_ -= controls_[idx] == kDeleted ? 1 : 0;
+        controls_[idx] = GetControl(hash);
+        slots_[idx] = value_type{std::move(key), std::move(value)};
+        ++size_;
+        return {MakeIterator(idx), true};
+    }
+
+    /*! \brief Erase the element with the key, if any.
+     *
+     *  \returns The number of elements erased: 0 or 1.
+     */
+    template <typename K>
+    size_type erase(const K& key)
+    {
+        const auto idx{FindIndex(key, hash_(key))};
+        if(idx == kNotFound)
+        {
+            return 0;
+        }
+
+        // Probes stop at the first group with an empty slot: If the group of
+        // the element has one, no probe goes past it, and the slot can be
+        // emptied.
+        const auto* group{controls_.data() + idx / kGroupWidth * kGroupWidth};
+        if(Match(group, kEmpty) != 0)
+        {
+            controls_[idx] = kEmpty;
+        }
+        else
+        {
+            controls_[idx] = kDeleted;
+            ++nDeleted_;
+        }
+        slots_[idx] = value_type{};
+        --size_;
+        return 1;
+    }
+
+    template <typename K>
+    iterator find(const K& key)
+    {
+        const auto idx{FindIndex(key, hash_(key))};
+        return idx == kNotFound ? end() : MakeIterator(idx);
+    }
+
+    template <typename K>
+    const_iterator find(const K& key) const
+    {
+        const auto idx{FindIndex(key, hash_(key))};
+        return idx == kNotFound ? end() : MakeIterator(idx);
+    }
+
+    template <typename K>
+    size_type count(const K& key) const
+    {
+        return FindIndex(key, hash_(key)) == kNotFound ? 0 : 1;
+    }
+
+    /*! \throws std::out_of_range if the key is not in the map.
+     */
+    template <typename K>
+    const Value& at(const K& key) const
+    {
+        const auto idx{FindIndex(key, hash_(key))};
+        if(idx == kNotFound)
+        {
+            throw std::out_of_range("FlatHashMap::at: Key not found");
+        }
+        return slots_[idx].second;
+    }
+
+    iterator begin()
+    {
+        return MakeIterator(0, true);
+    }
+
+    iterator end()
+    {
+        return MakeIterator(slots_.size());
+    }
+
+    const_iterator begin() const
+    {
+        return MakeIterator(0, true);
+    }
+
+    const_iterator end() const
+    {
+        return MakeIterator(slots_.size());
+    }
+
+private:
+    static constexpr size_type kGroupWidth{16};
+    static constexpr size_type kNotFound{static_cast<size_type>(-1)};
+
+    // A control word is kEmpty, kDeleted for the tombstone of an erased
+    // element, or the 7 lowest bits of the hash of the element in the slot.
+    // Only kEmpty and kDeleted are negative.
+    static constexpr std::int8_t kEmpty{-128};
+    static constexpr std::int8_t kDeleted{-2};
+
+    using ControlAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<std::int8_t>;
+
+    std::vector<std::int8_t, ControlAllocator> controls_{};
+    std::vector<value_type, Allocator> slots_{};
+    size_type size_{0};
+    size_type nDeleted_{0};
+    Hash hash_{};
+    KeyEqual equal_{};
+
+    static std::int8_t GetControl(std::size_t hash)
+    {
+        return static_cast<std::int8_t>(hash & 0x7F);
+    }
+
+    // Bit i is set if slot i of the group is empty or holds a tombstone.
+    static std::uint32_t MatchFree(const std::int8_t* group)
+    {
+#if NETWORK_MONITOR_FLAT_HASH_MAP_SSE2
+        // The mask of the sign bits.
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+        std::uint32_t mask{0};
+        for(size_type idx{0}; idx < kGroupWidth; ++idx)
+        {
+            mask |= static_cast<std::uint32_t>(group[idx] < 0) << idx;
+        }
+        return mask;
+#endif
+    }
+
+    // Bit i is set if control word i of the group equals `control`.
+    static std::uint32_t Match(const std::int8_t* group, std::int8_t control)
+    {
+#if NETWORK_MONITOR_FLAT_HASH_MAP_SSE2
+        const auto controls{_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))};
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(controls, _mm_set1_epi8(control))));
+#else
+        std::uint32_t mask{0};
+        for(size_type idx{0}; idx < kGroupWidth; ++idx)
+        {
+            mask |= static_cast<std::uint32_t>(group[idx] == control) << idx;
+        }
+        return mask;
+#endif
+    }
+
+    static int GetLowestBit(std::uint32_t mask)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctz(mask);
+#else
+        int bit{0};
+        while((mask & 1) == 0)
+        {
+            mask >>= 1;
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    // Groups are probed in triangular order, which visits each group once
+    // when the number of groups is a power of 2.
+    size_type GetFirstGroup(std::size_t hash) const
+    {
+        return (hash >> 7) & (slots_.size() / kGroupWidth - 1);
+    }
+
+    template <typename K>
+    size_type FindIndex(const K& key, std::size_t hash) const
+    {
+        if(slots_.empty())
+        {
+            return kNotFound;
+        }
+        const auto nGroups{slots_.size() / kGroupWidth};
+        const auto control{GetControl(hash)};
+        auto group{GetFirstGroup(hash)};
+        for(size_type probe{1}; probe <= nGroups; ++probe)
+        {
+            const auto* controls{controls_.data() + group * kGroupWidth};
+            for(auto mask{Match(controls, control)}; mask != 0; mask &= mask - 1)
+            {
+                const auto idx{group * kGroupWidth + GetLowestBit(mask)};
+                if(equal_(slots_[idx].first, key))
+                {
+                    return idx;
+                }
+            }
+            if(Match(controls, kEmpty) != 0)
+            {
+                return kNotFound;
+            }
+            group = (group + probe) & (nGroups - 1);
+        }
+        return kNotFound;
+    }
+
+    // Find an empty slot or a tombstone for a new element. There is always an
+    // empty slot, as the map rehashes before it is full.
+    size_type FindEmptyIndex(std::size_t hash) const
+    {
+        const auto nGroups{slots_.size() / kGroupWidth};
+        auto group{GetFirstGroup(hash)};
+        for(size_type probe{1};; ++probe)
+        {
+            if(const auto mask{MatchFree(controls_.data() + group * kGroupWidth)}; mask != 0)
+            {
+                return group * kGroupWidth + GetLowestBit(mask);
+            }
+            group = (group + probe) & (nGroups - 1);
+        }
+    }
+
+    void Rehash(size_type capacity)
+    {
+        std::vector<std::int8_t, ControlAllocator> controls(capacity, kEmpty, controls_.get_allocator());
+        std::vector<value_type, Allocator> slots(capacity, slots_.get_allocator());
+        controls_.swap(controls);
+        slots_.swap(slots);
+        nDeleted_ = 0;
+        for(size_type idx{0}; idx < controls.size(); ++idx)
+        {
+            if(controls[idx] >= 0)
+            {
+                const auto newIdx{FindEmptyIndex(hash_(slots[idx].first))};
+                controls_[newIdx] = controls[idx];
+                slots_[newIdx] = std::move(slots[idx]);
+            }
+        }
+    }
+
+    iterator MakeIterator(size_type idx, bool skipEmpty = false)
+    {
+        iterator it{slots_.data() + idx, controls_.data() + idx, controls_.data() + controls_.size()};
+        if(skipEmpty)
+        {
+            it.SkipEmpty();
+        }
+        return it;
+    }
+
+    const_iterator MakeIterator(size_type idx, bool skipEmpty = false) const
+    {
+        const_iterator it{slots_.data() + idx, controls_.data() + idx, controls_.data() + controls_.size()};
+        if(skipEmpty)
+        {
+            it.SkipEmpty();
+        }
+        return it;
+    }
+};
+
+/*! \brief Transparent hash for maps keyed on `std::string_view`.
+ */
+struct StringViewHash
+{
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view key) const
+    {
+        return std::hash<std::string_view>{}(key);
+    }
+};
+
+} // namespace NetworkMonitor
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "TransportNetwork.hpp"
+
+namespace NetworkMonitor {
+
+/*! \brief Transport network that can be replaced while it is being queried.
+ *
+ *  Readers access the current network through a Snapshot. Taking a snapshot
+ *  is lock-free and never waits for a network to be published.
+ *
+ *  A new network is built on the side, for example on a background thread
+ *  from a refreshed layout, and then published with Publish(). The network it
+ *  replaces is destroyed as soon as the last snapshot that can see it is gone.
+ *  Passenger counts are carried over from one network to the next for all
+ *  stations with the same ID.
+ *
+ *  Under the hood, this is a read-copy-update scheme with epoch-based
+ *  reclamation: Each reader announces the epoch it started in, and a publisher
+ *  waits for all readers of earlier epochs before freeing the old network.
+ */
+class LiveTransportNetwork
+{
+    struct Published;
+
+public:
+    /*! \brief Maximum number of snapshots that can be alive at the same time.
+     *
+     *  Taking a snapshot spins while all reader slots are in use.
+     */
+    static constexpr std::size_t kMaxReaders{64};
+
+    /*! \brief Read access to a published network.
+     *
+     *  The network cannot be destroyed while the snapshot is alive. Snapshots
+     *  are meant to be short-lived: A long-lived snapshot delays the next
+     *  Publish() call.
+     */
+    class Snapshot
+    {
+    public:
+        Snapshot(Snapshot&& other) noexcept;
+        Snapshot(const Snapshot& other) = delete;
+        Snapshot& operator=(const Snapshot& other) = delete;
+        Snapshot& operator=(Snapshot&& other) = delete;
+        ~Snapshot();
+
+        const TransportNetwork& operator*() const;
+        const TransportNetwork* operator->() const;
+
+        /*! \brief Version of the network seen by this snapshot.
+         *
+         *  The initial network has version 1. Each call to Publish() increments
+         *  the version by 1.
+         */
+        std::uint64_t GetVersion() const;
+
+    private:
+        friend class LiveTransportNetwork;
+
+        Snapshot(std::atomic<std::uint64_t>* slot, Published* published);
+
+        std::atomic<std::uint64_t>* slot_{nullptr};
+        Published* published_{nullptr};
+    };
+
+    /*! \brief Start with the given network as version 1.
+     */
+    explicit LiveTransportNetwork(TransportNetwork&& network = TransportNetwork{});
+
+    LiveTransportNetwork(const LiveTransportNetwork& other) = delete;
+    LiveTransportNetwork& operator=(const LiveTransportNetwork& other) = delete;
+
+    /*! \brief Destroy the current network.
+     *
+     *  No snapshot can be alive at this point.
+     */
+    ~LiveTransportNetwork();
+
+    /*! \brief Get read access to the current network.
+     */
+    Snapshot GetSnapshot() const;
+
+    /*! \brief Record a passenger event on the current network.
+     *
+     *  This function can be called concurrently with itself, with snapshot
+     *  readers and with Publish().
+     *
+     *  \returns false if the station is not in the current network or if the
+     *           passenger event is not recognized.
+     */
+    bool RecordPassengerEvent(const PassengerEvent& event);
+
+    /*! \brief Replace the current network.
+     *
+     *  The passenger counts of the current network are carried over to the new
+     *  one, by station ID, including the events recorded while this function
+     *  runs. Counts for stations that are not in the new network are dropped.
+     *  Windowed passenger flows are not carried over.
+     *
+     *  This function blocks until all readers of the old network are done with
+     *  it, and then destroys it. Concurrent calls to this function are
+     *  serialized.
+     *
+     *  \returns the version of the new network.
+     */
+    std::uint64_t Publish(TransportNetwork&& network);
+
+    /*! \brief Get the version of the current network.
+     */
+    std::uint64_t GetVersion() const;
+
+private:
+    // A network together with its version number.
+    struct Published
+    {
+        TransportNetwork network;
+        std::uint64_t version{0};
+    };
+
+    // A reader slot holds the epoch a reader started in, or 0 if unused.
+    // We align slots to a cache line to avoid false sharing between readers.
+    struct alignas(64) ReaderSlot
+    {
+        std::atomic<std::uint64_t> epoch{0};
+    };
+
+    std::atomic<Published*> current_{nullptr};
+    std::atomic<std::uint64_t> epoch_{1};
+    mutable std::array<ReaderSlot, kMaxReaders> readers_{};
+
+    // Serializes publishers. Readers never take it.
+    std::mutex publishMutex_{};
+
+    // Wait until no reader can still see a network that was replaced before
+    // this call.
+    void WaitForReaders();
+};
+
+} // namespace NetworkMonitor
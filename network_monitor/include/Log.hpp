@@ -1,16 +1,247 @@
 #pragma once
 
+#include <atomic>
 #include <boost/system/error_code.hpp>
-#include <iomanip>
-#include <iostream>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+
+/*! \brief Minimum log level compiled into the library.
+ *
+ *  Log calls below this level compile to nothing. Values follow LogLevel:
+ *  0 = Debug, 1 = Info, 2 = Warning, 3 = Error, 4 = Off.
+ */
+#ifndef NETWORK_MONITOR_LOG_LEVEL
+#define NETWORK_MONITOR_LOG_LEVEL 0
+#endif
 
 namespace NetworkMonitor {
 
-void Log(const std::string& where, boost::system::error_code ec)
+/*! \brief Log severity
+ */
+enum class LogLevel : std::uint8_t
+{
+    Debug = 0,
+    Info = 1,
+    Warning = 2,
+    Error = 3,
+    Off = 4
+};
+
+/*! \brief Minimum log level compiled into the library.
+ */
+constexpr LogLevel kCompiledLogLevel{static_cast<LogLevel>(NETWORK_MONITOR_LOG_LEVEL)};
+
+/*! \brief Asynchronous logger
+ *
+ *  Log calls encode a fixed-size binary record into a lock-free ring buffer
+ *  and return. A background thread drains the buffer, formats the records and
+ *  hands the formatted lines to the sink. Formatting, including error code
+ *  messages, is deferred to the background thread.
+ *
+ *  Any number of threads can log concurrently.
+ */
+class Logger
+{
+public:
+    /*! \brief What to do when the ring buffer is full.
+     */
+    enum class OverflowPolicy
+    {
+        Drop,  //!< Drop the record and count it. Logging never blocks.
+        Block, //!< Wait for the background thread to make room.
+    };
+
+    /*! \brief Sink for the formatted lines, without the trailing newline.
+     *
+     *  The sink is always called from the background thread.
+     */
+    using Sink = std::function<void(std::string_view line)>;
+
+    /*! \brief Maximum number of message bytes stored in a record.
+     *
+     *  Longer messages are truncated.
+     */
+    static constexpr std::size_t kMaxMessageSize{64};
+
+    /*! \brief Create a logger and start its background thread.
+     *
+     *  \param capacity The ring buffer size, in records. Rounded up to a power
+     *                  of 2.
+     *  \param policy   What to do when the ring buffer is full.
+     *  \param sink     Where to send the formatted lines. Defaults to stderr.
+     */
+    explicit Logger(std::size_t capacity = 8192,
+                    OverflowPolicy policy = OverflowPolicy::Drop,
+                    Sink sink = nullptr);
+
+    Logger(const Logger& other) = delete;
+    Logger& operator=(const Logger& other) = delete;
+
+    /*! \brief Flush all pending records and stop the background thread.
+     */
+    ~Logger();
+
+    /*! \brief Get the process-wide logger used by Log().
+     */
+    static Logger& Default();
+
+    /*! \brief Set the minimum level of the records to keep at runtime.
+     *
+     *  Defaults to LogLevel::Info. Records below kCompiledLogLevel are never
+     *  kept, whatever the runtime level.
+     */
+    void SetLevel(LogLevel level);
+
+    /*! \brief Check if records at this level are kept.
+     */
+    bool IsEnabled(LogLevel level) const;
+
+    /*! \brief Replace the sink. Pending records go to the new sink.
+     */
+    void SetSink(Sink sink);
+
+    /*! \brief Log the result of an operation.
+     *
+     *  `where` must point to a string with static storage duration, like
+     *  `__func__` or a string literal, as it is only read when formatting.
+     */
+    void Write(LogLevel level, const char* where, boost::system::error_code ec);
+
+    /*! \brief Log a message.
+     *
+     *  `where` must point to a string with static storage duration. The
+     *  message is copied, up to kMaxMessageSize bytes.
+     */
+    void Write(LogLevel level, const char* where, std::string_view message);
+
+    /*! \brief Wait until all records logged before this call reached the sink.
+     */
+    void Flush();
+
+    /*! \brief Number of records dropped because the ring buffer was full.
+     */
+    std::uint64_t GetDroppedCount() const;
+
+private:
+    // Binary log record
+    // Error codes are stored as their value and category: Both categories and
+    // `where` strings have static storage, so we can format them later.
+    struct Record
+    {
+        std::int64_t timestamp{0};
+        const char* where{nullptr};
+        const boost::system::error_category* category{nullptr};
+        int errorValue{0};
+        LogLevel level{LogLevel::Info};
+        bool hasErrorCode{false};
+        std::uint8_t messageSize{0};
+        char message[kMaxMessageSize]{};
+    };
+
+    // Ring buffer cell
+    // The sequence number tells producers and the consumer whose turn it is
+    // to use the cell (bounded MPMC queue by D. Vyukov, with one consumer).
+    struct alignas(64) Cell
+    {
+        std::atomic<std::uint64_t> sequence{0};
+        Record record{};
+    };
+
+    std::unique_ptr<Cell[]> cells_{nullptr};
+    std::uint64_t mask_{0};
+    OverflowPolicy policy_{OverflowPolicy::Drop};
+
+    alignas(64) std::atomic<std::uint64_t> enqueuePos_{0};
+    alignas(64) std::atomic<std::uint64_t> dequeuePos_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<LogLevel> level_{LogLevel::Info};
+
+    // The sink is only used by the background thread and SetSink().
+    std::mutex sinkMutex_{};
+    Sink sink_{nullptr};
+
+    // Used to wake up the background thread when it is idle. The thread sets
+    // sleeping_ before it waits: Producers only take the lock and notify when
+    // they see it set, so they stay lock-free while the thread is busy.
+    std::mutex wakeMutex_{};
+    std::condition_variable wake_{};
+    std::atomic<bool> sleeping_{false};
+    std::atomic<bool> stop_{false};
+    std::thread worker_{};
+
+    // Reserve a cell and fill it in, or drop the record, following the
+    // overflow policy.
+    template <typename Fill>
+    void Push(Fill&& fill);
+
+    // Wake up the background thread if it is waiting for records.
+    void Wake();
+
+    // Background thread loop.
+    void Run();
+
+    // Drain all available records. Returns the number of records drained.
+    std::size_t Drain();
+
+    // Format a record into `line`.
+    static void Format(const Record& record, std::string& line);
+};
+
+/*! \brief Log the result of an operation at the given level.
+ *
+ *  Compiles to nothing if `level` is below kCompiledLogLevel.
+ */
+template <LogLevel level>
+inline void Log(const char* where, boost::system::error_code ec)
+{
+    if constexpr(level >= kCompiledLogLevel && level != LogLevel::Off)
+    {
+        auto& logger{Logger::Default()};
+        if(logger.IsEnabled(level))
+        {
+            logger.Write(level, where, ec);
+        }
+    }
+}
+
+/*! \brief Log a message at the given level.
+ *
+ *  Compiles to nothing if `level` is below kCompiledLogLevel.
+ */
+template <LogLevel level>
+inline void Log(const char* where, std::string_view message)
+{
+    if constexpr(level >= kCompiledLogLevel && level != LogLevel::Off)
+    {
+        auto& logger{Logger::Default()};
+        if(logger.IsEnabled(level))
+        {
+            logger.Write(level, where, message);
+        }
+    }
+}
+
+/*! \brief Log the result of an operation: Errors are logged at the Error
+ *         level, successes at the Debug level.
+ */
+inline void Log(const char* where, boost::system::error_code ec)
 {
-    std::cerr << "[" << std::setw(20) << where << "] " << (ec ? "Error: " : "OK") << (ec ? ec.message() : "")
-              << std::endl;
+    if(ec)
+    {
+        Log<LogLevel::Error>(where, ec);
+    }
+    else
+    {
+        Log<LogLevel::Debug>(where, ec);
+    }
 }
 
-} // namespace NetworkMonitor
\ No newline at end of file
+} // namespace NetworkMonitor
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*! \brief Set to 0 to compile the library instrumentation out.
+ *
+ *  The metrics registry is always available. This only controls the
+ *  measurements the library itself takes.
+ */
+#ifndef NETWORK_MONITOR_METRICS
+#define NETWORK_MONITOR_METRICS 1
+#endif
+
+namespace NetworkMonitor {
+
+/*! \brief Monotonic counter
+ *
+ *  Increments go to one of several cache-line-sized shards, picked per
+ *  thread, so that threads that count concurrently do not contend.
+ */
+class Counter
+{
+public:
+    /*! \brief Add `n` to the counter.
+     */
+    void Increment(std::uint64_t n = 1);
+
+    /*! \brief Get the sum of all increments.
+     */
+    std::uint64_t Get() const;
+
+private:
+    static constexpr std::size_t kShards{16};
+
+    struct alignas(64) Shard
+    {
+        std::atomic<std::uint64_t> value{0};
+    };
+
+    std::array<Shard, kShards> shards_{};
+};
+
+/*! \brief Value that can go up and down
+ */
+class Gauge
+{
+public:
+    void Set(std::int64_t value);
+    void Add(std::int64_t n);
+    std::int64_t Get() const;
+
+private:
+    std::atomic<std::int64_t> value_{0};
+};
+
+/*! \brief Latency or size histogram with logarithmic buckets
+ *
+ *  Values are recorded as non-negative integers, for example durations in
+ *  nanoseconds or sizes in bytes. Like an HDR histogram, each power-of-2 range
+ *  is split in kSubBuckets linear buckets, which bounds the relative error of
+ *  a percentile to 1 / kSubBuckets for any value up to 2^64.
+ *
+ *  Recording a value is wait-free.
+ */
+class Histogram
+{
+public:
+    /*! \brief Number of linear buckets per power-of-2 range.
+     */
+    static constexpr std::size_t kSubBuckets{8};
+
+    /*! \brief Create an empty histogram.
+     *
+     *  \param unit Multiplier from recorded values to exported values, for
+     *              example 1e-9 to record nanoseconds and export seconds.
+     */
+    explicit Histogram(double unit = 1.0);
+
+    /*! \brief Record a value.
+     */
+    void Record(std::uint64_t value);
+
+    /*! \brief Record a duration in nanoseconds.
+     */
+    template <typename Rep, typename Period>
+    void Record(std::chrono::duration<Rep, Period> duration)
+    {
+        const auto ns{std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()};
+        Record(static_cast<std::uint64_t>(ns > 0 ? ns : 0));
+    }
+
+    /*! \brief Number of recorded values.
+     */
+    std::uint64_t GetCount() const;
+
+    /*! \brief Sum of the recorded values.
+     */
+    std::uint64_t GetSum() const;
+
+    /*! \brief Get an upper bound of the value at quantile `q`, in [0, 1].
+     *
+     *  \returns 0 if the histogram is empty.
+     */
+    std::uint64_t GetPercentile(double q) const;
+
+    /*! \brief Multiplier from recorded values to exported values.
+     */
+    double GetUnit() const;
+
+    /*! \brief Cumulative counts at every power of 2.
+     *
+     *  Entry `i` holds the number of recorded values smaller than 2^i, up to
+     *  the highest non-empty range. Used by the Prometheus exporter.
+     */
+    std::vector<std::uint64_t> GetCumulativeCounts() const;
+
+private:
+    static constexpr std::size_t kSubBucketBits{3};
+    static constexpr std::size_t kBuckets{kSubBuckets + (64 - kSubBucketBits) * kSubBuckets};
+
+    double unit_{1.0};
+    std::atomic<std::uint64_t> sum_{0};
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets_{};
+
+    // Bucket index of a value, and the smallest value above a bucket.
+    static std::size_t GetBucket(std::uint64_t value);
+    static std::uint64_t GetBucketEnd(std::size_t bucket);
+};
+
+/*! \brief Registry of named metrics, exported in the Prometheus text format
+ *
+ *  Metrics are created on first use and live as long as the registry: Callers
+ *  are expected to look a metric up once and keep the reference.
+ *
+ *  A metric is identified by its name and by an optional set of labels, in
+ *  the Prometheus syntax: `result="failed",phase="tls"`. Metrics with the same
+ *  name form a family, which must have a single type.
+ */
+class MetricsRegistry
+{
+public:
+    /*! \brief Callback that receives the exported text.
+     */
+    using ExportCallback = std::function<void(std::string_view text)>;
+
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry& other) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry& other) = delete;
+
+    /*! \brief Get the process-wide registry used by the library.
+     */
+    static MetricsRegistry& Default();
+
+    /*! \brief Turn the library instrumentation on or off at runtime.
+     *
+     *  Enabled by default. While disabled, the instrumented code skips its
+     *  clock reads and metric updates.
+     */
+    void SetEnabled(bool enabled);
+
+    /*! \brief Check if the instrumentation should take measurements.
+     */
+    bool IsEnabled() const
+    {
+        return NETWORK_MONITOR_METRICS != 0 && enabled_.load(std::memory_order_relaxed);
+    }
+
+    /*! \brief Get a counter, creating it if needed.
+     *
+     *  \throws std::logic_error if the name is already used by another type.
+     */
+    Counter& GetCounter(const std::string& name, const std::string& help, const std::string& labels = {});
+
+    /*! \brief Get a gauge, creating it if needed.
+     *
+     *  \throws std::logic_error if the name is already used by another type.
+     */
+    Gauge& GetGauge(const std::string& name, const std::string& help, const std::string& labels = {});
+
+    /*! \brief Get a histogram, creating it if needed.
+     *
+     *  The unit is only used when the histogram is created.
+     *
+     *  \throws std::logic_error if the name is already used by another type.
+     */
+    Histogram& GetHistogram(const std::string& name,
+                            const std::string& help,
+                            double unit = 1.0,
+                            const std::string& labels = {});
+
+    /*! \brief Write all metrics in the Prometheus text exposition format.
+     */
+    void Export(std::ostream& os) const;
+
+    /*! \brief Get all metrics in the Prometheus text exposition format.
+     */
+    std::string Export() const;
+
+    /*! \brief Send all metrics in the Prometheus text format to a callback.
+     */
+    void Export(const ExportCallback& callback) const;
+
+    /*! \brief Write all metrics in the Prometheus text format to a file.
+     *
+     *  The file is replaced atomically, so that a scraper never reads a
+     *  partial file (e.g. the node_exporter textfile collector).
+     *
+     *  \returns false if the file could not be written.
+     */
+    bool Export(const std::filesystem::path& destination) const;
+
+private:
+    enum class Type
+    {
+        Counter,
+        Gauge,
+        Histogram,
+    };
+
+    struct Family
+    {
+        Type type{Type::Counter};
+        std::string help{};
+        std::map<std::string, std::unique_ptr<Counter>> counters{};
+        std::map<std::string, std::unique_ptr<Gauge>> gauges{};
+        std::map<std::string, std::unique_ptr<Histogram>> histograms{};
+    };
+
+    std::atomic<bool> enabled_{true};
+
+    mutable std::mutex mutex_{};
+    std::map<std::string, Family> families_{};
+
+    Family& GetFamily(const std::string& name, const std::string& help, Type type);
+};
+
+/*! \brief Record the time spent in a scope into a histogram.
+ *
+ *  Does nothing if the default registry was disabled when the timer started.
+ */
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Histogram& histogram);
+    ScopedTimer(const ScopedTimer& other) = delete;
+    ScopedTimer& operator=(const ScopedTimer& other) = delete;
+    ~ScopedTimer();
+
+private:
+    Histogram* histogram_{nullptr};
+    std::chrono::steady_clock::time_point start_{};
+};
+
+} // namespace NetworkMonitor
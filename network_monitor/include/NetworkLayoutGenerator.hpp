@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <vector>
+
+#include "TransportNetwork.hpp"
+
+namespace NetworkMonitor {
+
+/*! \brief Parameters of a synthetic network layout.
+ *
+ *  The same options always generate the same layout.
+ */
+struct NetworkLayoutOptions
+{
+    std::size_t nStations{1000};
+    std::size_t nLines{20};
+
+    /*! \brief Routes of each line.
+     *
+     *  The first 2 routes run the whole line, in opposite directions. Further
+     *  routes run over a shorter stretch of the line, alternating directions,
+     *  like short-working or branch services.
+     */
+    std::size_t routesPerLine{2};
+
+    //! Number of stops of the full-line routes. At least 2.
+    std::size_t routeLength{40};
+
+    /*! \brief Probability, in [0, 1], that a stop of a line is a station
+     *         already served by another line.
+     *
+     *  A line also falls back to existing stations once all stations are in
+     *  use. Stations that no line reaches are left without routes.
+     */
+    double interchangeDensity{0.1};
+
+    //! Travel times are drawn uniformly in [minTravelTime, maxTravelTime].
+    unsigned int minTravelTime{1};
+    unsigned int maxTravelTime{5};
+
+    std::uint64_t seed{42};
+};
+
+/*! \brief Generate a synthetic network layout.
+ *
+ *  Stations are named `station_<n>`, lines `line_<n>` and routes `route_<n>`,
+ *  like in the layout files we get from the network operator. The layout is
+ *  well formed: It can be loaded into a TransportNetwork as-is.
+ *
+ *  Runs in time linear in the number of stations and stops.
+ *
+ *  \throws std::invalid_argument if the options cannot produce a well formed
+ *          layout, for example with a route length above the station count.
+ */
+NetworkLayout GenerateNetworkLayout(const NetworkLayoutOptions& options = {});
+
+/*! \brief Convert a network layout to the `network-layout.json` schema.
+ */
+nlohmann::json ToJson(const NetworkLayout& layout);
+
+} // namespace NetworkMonitor
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TransportNetwork.hpp"
+
+namespace NetworkMonitor {
+
+/*! \brief How a PassengerEventFanIn passes the events of its feeds on.
+ */
+enum class FanInMode
+{
+    //! One thread merges the feeds in timestamp order.
+    Merged,
+
+    //! Stations are split in shards, each with its own thread. Events keep the
+    //! order of their feed for each station, but are not ordered across feeds.
+    Sharded
+};
+
+/*! \brief Fan-in configuration.
+ */
+struct PassengerEventFanInOptions
+{
+    FanInMode mode{FanInMode::Merged};
+
+    //! Events each feed queue can hold. Rounded up to a power of 2.
+    std::size_t queueCapacity{8192};
+
+    //! Merged mode: How long an empty feed holds the merge back, waiting for
+    //! an event that could come before those of the other feeds.
+    std::chrono::milliseconds idleTimeout{50};
+
+    //! Sharded mode: Number of shards, 0 for one per hardware thread.
+    std::size_t nShards{0};
+};
+
+/*! \brief Statistics of one feed of a fan-in.
+ */
+struct PassengerEventFeedStats
+{
+    std::uint64_t pushed{0};
+    std::uint64_t applied{0};
+
+    //! Events waiting in the queues of the feed.
+    std::uint64_t depth{0};
+
+    //! Timestamp of the newest event pushed, minus that of the newest event
+    //! applied. 0 for feeds without timestamps.
+    std::chrono::milliseconds lag{0};
+
+    //! Times Push waited for room in a full queue.
+    std::uint64_t stalls{0};
+};
+
+/*! \brief Fan-in statistics.
+ */
+struct PassengerEventFanInStats
+{
+    std::vector<PassengerEventFeedStats> feeds{};
+
+    std::uint64_t applied{0};
+
+    //! Merged mode: Events applied after a newer event of another feed,
+    //! because their feed was idle when the newer event was merged.
+    std::uint64_t late{0};
+
+    //! Events applied per second since the previous call to GetStats.
+    double throughput{0.0};
+};
+
+/*! \brief Fan-in of several passenger event feeds into one network
+ *
+ *  Each feed pushes its events into its own bounded, lock-free queue with a
+ *  single producer and a single consumer. Push only takes a lock to wake up
+ *  a thread that ran out of events, and only waits when the queue is full.
+ *
+ *  In merged mode, one thread runs a k-way merge of the queues, with a
+ *  min-heap on the timestamps of their oldest events, and applies the events
+ *  in timestamp order. An empty feed holds the merge back until it has been
+ *  empty for `idleTimeout`, after which the merge goes on without it. Events
+ *  without a timestamp sort first.
+ *
+ *  In sharded mode, each feed has one queue per shard, and the shard of an
+ *  event is picked from its station ID. One thread per shard applies the
+ *  events of its queues as they come. The threads never touch the same
+ *  station, so they do not contend on its counters. With the default sink,
+ *  RecordPassengerEvent, they only share a lock for the stations with
+ *  crowding subscriptions, and for the first event of a station after each
+ *  crowding-aware journey or reachability query.
+ *
+ *  The events of each feed must be pushed from one thread at a time, such as
+ *  the thread that runs the WebSocketClient of the feed. Put a
+ *  PassengerEventFilter in front of Push to drop duplicate events.
+ */
+class PassengerEventFanIn
+{
+public:
+    /*! \brief Callback that applies an event.
+     *
+     *  In sharded mode, it is called concurrently from the shard threads.
+     */
+    using Sink = std::function<void(const PassengerEvent& event)>;
+
+    /*! \brief Fan `nFeeds` feeds in to RecordPassengerEvent on a network.
+     *
+     *  The network must outlive the fan-in.
+     */
+    PassengerEventFanIn(TransportNetwork& network,
+                        std::size_t nFeeds,
+                        const PassengerEventFanInOptions& options = {});
+
+    /*! \brief Fan `nFeeds` feeds in to a callback.
+     */
+    PassengerEventFanIn(Sink sink, std::size_t nFeeds, const PassengerEventFanInOptions& options = {});
+
+    PassengerEventFanIn(const PassengerEventFanIn& other) = delete;
+    PassengerEventFanIn& operator=(const PassengerEventFanIn& other) = delete;
+
+    /*! \brief Apply all queued events and stop the threads.
+     *
+     *  No feed can push while the fan-in is being destroyed.
+     */
+    ~PassengerEventFanIn();
+
+    /*! \brief Number of feeds.
+     */
+    std::size_t GetFeedCount() const;
+
+    /*! \brief Queue an event of a feed.
+     *
+     *  \returns false if the feed does not exist.
+     */
+    bool Push(std::size_t feed, const PassengerEvent& event);
+
+    /*! \brief Wait until all events pushed before this call are applied.
+     *
+     *  In merged mode, empty feeds do not hold the merge back while we wait.
+     */
+    void Flush();
+
+    /*! \brief Get the fan-in statistics.
+     *
+     *  The counters are read while the feeds run, so they can be off by the
+     *  events in flight.
+     */
+    PassengerEventFanInStats GetStats() const;
+
+private:
+    // Single-producer, single-consumer ring. Each side caches the position of
+    // the other, to only read the shared one when the ring looks full or
+    // empty.
+    struct alignas(64) Queue
+    {
+        std::unique_ptr<PassengerEvent[]> slots{nullptr};
+
+        // Consumer side.
+        alignas(64) std::atomic<std::uint64_t> head{0};
+        std::uint64_t cachedTail{0};
+        std::atomic<std::chrono::system_clock::rep> lastApplied{0};
+
+        // Producer side.
+        alignas(64) std::atomic<std::uint64_t> tail{0};
+        std::uint64_t cachedHead{0};
+    };
+
+    // Producer-side feed statistics.
+    struct alignas(64) Feed
+    {
+        std::atomic<std::uint64_t> stalls{0};
+        std::atomic<std::chrono::system_clock::rep> newestPushed{0};
+    };
+
+    // Worker thread, one per shard. The thread sets `sleeping` before it
+    // waits: Producers only take the lock and notify when they see it set,
+    // as in Logger.
+    struct alignas(64) Worker
+    {
+        std::atomic<bool> sleeping{false};
+        std::condition_variable wake{};
+    };
+
+    Sink sink_{};
+    PassengerEventFanInOptions options_{};
+    std::size_t nFeeds_{0};
+    std::size_t nShards_{1};
+    std::uint64_t mask_{0};
+    std::unique_ptr<Queue[]> queues_{nullptr};
+    std::unique_ptr<Feed[]> feeds_{nullptr};
+    std::unique_ptr<Worker[]> workerStates_{nullptr};
+    std::atomic<std::uint64_t> late_{0};
+
+    // Used to wake the threads up and to wait for them.
+    mutable std::mutex mutex_{};
+    std::condition_variable done_{};
+    std::atomic<bool> stop_{false};
+    std::atomic<int> flushRequests_{0};
+    std::vector<std::thread> workers_{};
+
+    mutable std::chrono::steady_clock::time_point lastStatsTime_{};
+    mutable std::uint64_t lastStatsApplied_{0};
+
+    Queue& GetQueue(std::size_t feed, std::size_t shard) const;
+
+    // Apply the oldest event of a queue, which must not be empty.
+    void ApplyOne(Queue& queue);
+
+    // Number of events in a queue, as seen by its consumer.
+    std::uint64_t GetAvailable(Queue& queue) const;
+
+    // Worker loops.
+    void RunMerged();
+    void RunShard(std::size_t shard);
+
+    // Wake up the thread of a shard if it is waiting for events.
+    void Wake(std::size_t shard);
+
+    // Wake up Flush, if anyone is waiting, and then sleep until someone wakes
+    // us up or until `deadline`, unless `hasEvents` finds events to apply.
+    template <typename HasEvents>
+    void Idle(std::size_t shard, std::chrono::steady_clock::time_point deadline, HasEvents&& hasEvents);
+};
+
+} // namespace NetworkMonitor
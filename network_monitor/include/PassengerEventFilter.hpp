@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "TransportNetwork.hpp"
+
+namespace NetworkMonitor {
+
+/*! \brief Passenger event filter configuration.
+ */
+struct PassengerEventFilterOptions
+{
+    //! Number of sequence numbers, behind the newest one, that the filter can
+    //! tell apart from duplicates. 0 to keep all events.
+    std::size_t dedupWindow{65536};
+
+    //! How far behind the newest timestamp an event can arrive and still be put
+    //! back in order. 0 to pass the events on in the order they arrive.
+    std::chrono::milliseconds maxLateness{0};
+
+    //! Most events held back to be reordered. When the buffer is full, the
+    //! oldest event is passed on early.
+    std::size_t maxBuffered{4096};
+};
+
+/*! \brief Passenger event filter statistics.
+ */
+struct PassengerEventFilterStats
+{
+    //! Events that were not dropped as duplicates.
+    std::uint64_t accepted{0};
+
+    //! Events dropped because their sequence number was already seen.
+    std::uint64_t duplicates{0};
+
+    //! Events dropped because their sequence number was too far behind the
+    //! newest one to tell whether it was already seen.
+    std::uint64_t expired{0};
+
+    //! Events that arrived out of order and were put back in order.
+    std::uint64_t reordered{0};
+
+    //! Events that arrived after newer events were passed on, and were passed
+    //! on out of order.
+    std::uint64_t late{0};
+
+    //! Events held back.
+    std::size_t buffered{0};
+};
+
+/*! \brief Drop duplicate passenger events and put late ones back in order.
+ *
+ *  A feed that reconnects can send some events twice, and out of order. This
+ *  filter sits in front of TransportNetwork::RecordPassengerEvent and fixes
+ *  both in constant memory:
+ *
+ *  - Dedup: Events with a sequence number are checked against a sliding
+ *    bitmap of the `dedupWindow` sequence numbers behind the newest one seen,
+ *    as in IPsec anti-replay. Events whose sequence number is behind the
+ *    window are dropped too, as we cannot tell if they were seen. Events
+ *    without a sequence number are all kept.
+ *  - Reorder: Events with a timestamp are held back until the newest
+ *    timestamp seen is `maxLateness` past them, and then passed on in order.
+ *    Events that arrive in order cost O(1), the others O(log n).
+ *    Events that arrive after newer ones were passed on cannot be put back in
+ *    order: They are passed on right away, so that no count is lost. Events
+ *    without a timestamp are passed on right away.
+ *
+ *  Sequence numbers are only comparable within a feed: Use one filter per
+ *  feed. This class is not thread-safe.
+ */
+class PassengerEventFilter
+{
+public:
+    /*! \brief Create a filter.
+     *
+     *  The dedup window is rounded up to a power of 2 number of 64-bit words.
+     */
+    explicit PassengerEventFilter(const PassengerEventFilterOptions& options = {});
+
+    /*! \brief Filter an event.
+     *
+     *  Calls `sink` with each event that can be passed on, as a
+     *  `const PassengerEvent&`: None, this event, or older buffered events.
+     */
+    template <typename Sink>
+    void Push(const PassengerEvent& event, Sink&& sink)
+    {
+        if(event.sequence != 0 && !IsNew(event.sequence))
+        {
+            return;
+        }
+        ++stats_.accepted;
+        if(options_.maxLateness.count() == 0 || event.timestamp == std::chrono::system_clock::time_point{})
+        {
+            sink(event);
+            return;
+        }
+        if(event.timestamp < released_)
+        {
+            ++stats_.late;
+            sink(event);
+            return;
+        }
+        // Copy assignments reuse the storage of the station ID held in the slot.
+        const auto slot{freeSlots_.back()};
+        freeSlots_.pop_back();
+        slots_[slot] = event;
+        if(event.timestamp < newest_)
+        {
+            ++stats_.reordered;
+            heap_.push_back({event.timestamp, slot});
+            std::push_heap(heap_.begin(), heap_.end(), IsLater{});
+        }
+        else
+        {
+            newest_ = event.timestamp;
+            queue_[(queueHead_ + queueSize_) % queue_.size()] = {event.timestamp, slot};
+            ++queueSize_;
+        }
+        ReleaseUntil(newest_ - options_.maxLateness, sink);
+        if(queueSize_ + heap_.size() == slots_.size())
+        {
+            ReleaseOldest(sink);
+        }
+    }
+
+    /*! \brief Pass on the buffered events that are `maxLateness` older than
+     *         `now`.
+     *
+     *  Buffered events otherwise only move on when newer events arrive. Call
+     *  this periodically to bound the delay when a feed goes quiet.
+     */
+    template <typename Sink>
+    void AdvanceTo(std::chrono::system_clock::time_point now, Sink&& sink)
+    {
+        ReleaseUntil(now - options_.maxLateness, sink);
+    }
+
+    /*! \brief Pass on all the buffered events, in order.
+     */
+    template <typename Sink>
+    void Flush(Sink&& sink)
+    {
+        while(queueSize_ + heap_.size() > 0)
+        {
+            ReleaseOldest(sink);
+        }
+    }
+
+    /*! \brief Get the filter statistics.
+     */
+    PassengerEventFilterStats GetStats() const;
+
+    /*! \brief Bytes held by the filter, not counting the station IDs of the
+     *         buffered events.
+     */
+    std::size_t GetMemorySize() const;
+
+private:
+    // Reorder buffer entry. The buffer only moves these around, not the events.
+    struct Entry
+    {
+        std::chrono::system_clock::time_point timestamp{};
+        std::size_t slot{0};
+    };
+
+    struct IsLater
+    {
+        bool operator()(const Entry& a, const Entry& b) const
+        {
+            return a.timestamp > b.timestamp;
+        }
+    };
+
+    PassengerEventFilterOptions options_{};
+    PassengerEventFilterStats stats_{};
+
+    // Dedup bitmap: Bit `sequence % 64` of word `sequence / 64`, modulo the
+    // number of words. The words past the one of newestSequence_ are clear.
+    std::vector<std::uint64_t> words_{};
+    std::uint64_t wordMask_{0};
+    std::uint64_t newestSequence_{0};
+
+    // Reorder buffer: The events are held in a fixed pool of slots. Events
+    // that arrive in order are queued, so the queue is sorted: Only the others
+    // go through the min-heap. The oldest event is at the head of either one.
+    // One slot is always free.
+    std::vector<PassengerEvent> slots_{};
+    std::vector<std::size_t> freeSlots_{};
+    std::vector<Entry> queue_{};
+    std::size_t queueHead_{0};
+    std::size_t queueSize_{0};
+    std::vector<Entry> heap_{};
+    std::chrono::system_clock::time_point newest_{};
+    std::chrono::system_clock::time_point released_{};
+
+    // Mark a sequence number as seen. Returns false if it was seen already, or
+    // if it is behind the window.
+    bool IsNew(std::uint64_t sequence);
+
+    // Whether the oldest buffered event is at the head of the heap rather
+    // than of the queue. At least one event must be buffered.
+    bool IsOldestInHeap() const
+    {
+        return queueSize_ == 0 || (!heap_.empty() && heap_.front().timestamp < queue_[queueHead_].timestamp);
+    }
+
+    template <typename Sink>
+    void ReleaseUntil(std::chrono::system_clock::time_point until, Sink& sink)
+    {
+        while(queueSize_ + heap_.size() > 0 &&
+              (IsOldestInHeap() ? heap_.front() : queue_[queueHead_]).timestamp <= until)
+        {
+            ReleaseOldest(sink);
+        }
+    }
+
+    template <typename Sink>
+    void ReleaseOldest(Sink& sink)
+    {
+        Entry entry{};
+        if(IsOldestInHeap())
+        {
+            std::pop_heap(heap_.begin(), heap_.end(), IsLater{});
+            entry = heap_.back();
+            heap_.pop_back();
+        }
+        else
+        {
+            entry = queue_[queueHead_];
+            queueHead_ = (queueHead_ + 1) % queue_.size();
+            --queueSize_;
+        }
+        released_ = std::max(released_, entry.timestamp);
+        sink(static_cast<const PassengerEvent&>(slots_[entry.slot]));
+        freeSlots_.push_back(entry.slot);
+    }
+};
+
+} // namespace NetworkMonitor
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FlatHashMap.hpp"
+#include "TransportNetwork.hpp"
+
+namespace NetworkMonitor {
+
+/*! \brief Passenger event log configuration.
+ */
+struct PassengerEventLogOptions
+{
+    //! Directory of the log segments and of the checkpoint. Created if needed.
+    std::filesystem::path directory{};
+
+    //! Interval between two group commits. Events are durable at most this
+    //! long after they were appended, plus the time of one `fdatasync`.
+    std::chrono::milliseconds commitInterval{10};
+
+    //! Interval between two checkpoints. 0 to only checkpoint on request.
+    std::chrono::seconds checkpointInterval{60};
+
+    //! Ring buffer size, in events. Rounded up to a power of 2.
+    std::size_t capacity{65536};
+};
+
+/*! \brief Passenger event log statistics.
+ */
+struct PassengerEventLogStats
+{
+    std::uint64_t events{0};
+    std::uint64_t commits{0};
+    std::uint64_t bytes{0};
+    std::uint64_t checkpoints{0};
+
+    //! Writes, syncs and checkpoints that failed. Failed writes are retried at
+    //! the next commit.
+    std::uint64_t errors{0};
+
+    //! Times Append waited for the background thread to make room.
+    std::uint64_t stalls{0};
+};
+
+/*! \brief Durable log of passenger events
+ *
+ *  Keeps the passenger counts of the stations across restarts. Append copies
+ *  an event into a lock-free ring buffer and returns. A background thread
+ *  drains the buffer into an append-only, binary log, and commits it with one
+ *  `write` and one `fdatasync` per commit interval (group commit). The
+ *  ingestion thread never waits for the disk, unless the buffer fills up.
+ *
+ *  The background thread also keeps the running count of each station. Every
+ *  checkpoint interval, it writes all counts to a compact checkpoint, starts a
+ *  new log segment and deletes the segments that the checkpoint covers. When
+ *  the log is opened, it loads the latest checkpoint and replays only the
+ *  segments written after it.
+ *
+ *  The records of each group commit are framed together with their size and
+ *  a CRC-32 of their content. A replay stops at the first torn or corrupt
+ *  frame of a segment. Files are written in the byte order of the host.
+ *
+ *  Any number of threads can append concurrently.
+ */
+class PassengerEventLog
+{
+public:
+    /*! \brief Longest station ID that can be logged.
+     */
+    static constexpr std::size_t kMaxStationIdSize{54};
+
+    /*! \brief Open the log, recover the counts and start the background
+     *         thread.
+     *
+     *  \throws std::filesystem::filesystem_error or std::runtime_error if the
+     *          directory or the new log segment cannot be created.
+     */
+    explicit PassengerEventLog(const PassengerEventLogOptions& options);
+
+    PassengerEventLog(const PassengerEventLog& other) = delete;
+    PassengerEventLog& operator=(const PassengerEventLog& other) = delete;
+
+    /*! \brief Commit all appended events and stop the background thread.
+     */
+    ~PassengerEventLog();
+
+    /*! \brief Passenger counts recovered when the log was opened, sorted by
+     *         station ID.
+     *
+     *  Stations whose count was 0 are left out. Restore them on a network with
+     *  TransportNetwork::SetPassengerCounts.
+     */
+    const std::vector<StationPassengerCount>& GetRecoveredCounts() const;
+
+    /*! \brief Append a passenger event to the log.
+     *
+     *  Only the station and the type of the event are logged. Events should be
+     *  appended once the network recorded them successfully.
+     *
+     *  \returns false if the station ID is longer than kMaxStationIdSize.
+     */
+    bool Append(const PassengerEvent& event);
+
+    /*! \brief Wait until all events appended before this call are durable.
+     *
+     *  \returns false if a write or a sync failed while we waited.
+     */
+    bool Commit();
+
+    /*! \brief Commit all appended events and write a checkpoint now.
+     *
+     *  \returns false if the commit or the checkpoint failed.
+     */
+    bool Checkpoint();
+
+    /*! \brief Get the log statistics.
+     */
+    PassengerEventLogStats GetStats() const;
+
+private:
+    // Log record, as appended to the ring buffer.
+    struct Record
+    {
+        PassengerEvent::Type type{PassengerEvent::Type::In};
+        std::uint8_t stationIdSize{0};
+        char stationId[kMaxStationIdSize]{};
+    };
+
+    // Ring buffer cell, as in Logger (bounded MPMC queue by D. Vyukov, with
+    // one consumer).
+    struct alignas(64) Cell
+    {
+        std::atomic<std::uint64_t> sequence{0};
+        Record record{};
+    };
+
+    PassengerEventLogOptions options_{};
+
+    std::unique_ptr<Cell[]> cells_{nullptr};
+    std::uint64_t mask_{0};
+    alignas(64) std::atomic<std::uint64_t> enqueuePos_{0};
+    alignas(64) std::atomic<std::uint64_t> dequeuePos_{0};
+    std::atomic<std::uint64_t> stalls_{0};
+
+    // State of the background thread. The counts are those of all the
+    // records drained so far, which are either committed or in `pending_`.
+    FlatHashMap<std::string, long long int, StringViewHash> counts_{};
+    std::vector<char> pending_{};
+    std::uint64_t segment_{0};
+    int fd_{-1};
+    std::chrono::steady_clock::time_point lastCommit_{};
+    std::chrono::steady_clock::time_point lastCheckpoint_{};
+
+    std::vector<StationPassengerCount> recoveredCounts_{};
+
+    // Used to wake up the background thread and to wait for it. The thread
+    // sets sleeping_ before it waits: Producers only take this lock when they
+    // see it set, as in Logger.
+    mutable std::mutex mutex_{};
+    std::condition_variable wake_{};
+    std::condition_variable done_{};
+    std::atomic<bool> sleeping_{false};
+    bool stop_{false};
+    std::uint64_t commitRequests_{0};
+    std::uint64_t checkpointRequests_{0};
+    std::uint64_t checkpointsDone_{0};
+    std::uint64_t committedPos_{0};
+    PassengerEventLogStats stats_{};
+    std::thread worker_{};
+
+    // Load the checkpoint and replay the segments after it into counts_, then
+    // open a new segment after all the existing ones.
+    void Recover();
+
+    // Wake up the background thread if it is waiting for records.
+    void Wake();
+
+    // Background thread loop.
+    void Run();
+
+    // Drain all available records into pending_. Returns the number of
+    // records drained.
+    std::size_t Drain();
+
+    // Write and sync pending_. Returns false on error.
+    bool WritePending();
+
+    // Write the counts to a new checkpoint, start a new segment and delete
+    // the segments the checkpoint covers. pending_ must be empty.
+    bool WriteCheckpoint();
+
+    // Path of a log segment and of the checkpoint.
+    std::filesystem::path GetSegmentPath(std::uint64_t segment) const;
+    std::filesystem::path GetCheckpointPath() const;
+};
+
+} // namespace NetworkMonitor
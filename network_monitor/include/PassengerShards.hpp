@@ -0,0 +1,252 @@
+#pragma once
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "TransportNetwork.hpp"
+
+namespace NetworkMonitor {
+
+/*! \brief Consistent hash ring that assigns stations to shards.
+ *
+ *  Each shard owns `nVirtualNodes` points on a 64-bit ring, and a station
+ *  belongs to the shard of the first point at or after the hash of its ID.
+ *  Adding a shard only moves the stations that the new shard takes over, about
+ *  1 in `nShards + 1`.
+ *
+ *  The hashes do not depend on the platform or on the build, so that every
+ *  process of a deployment agrees on the owner of each station.
+ */
+class ConsistentHashRing
+{
+public:
+    /*! \brief Build the ring of `nShards` shards, at least 1.
+     */
+    explicit ConsistentHashRing(std::size_t nShards, std::size_t nVirtualNodes = 128);
+
+    std::size_t GetShardCount() const;
+
+    /*! \brief Get the shard that owns a station.
+     */
+    std::size_t GetShard(std::string_view stationId) const;
+
+private:
+    std::size_t nShards_{1};
+
+    // Points sorted by hash, with the shard that owns them.
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> points_{};
+};
+
+/*! \brief Passenger event counters of a shard.
+ */
+struct PassengerShardStats
+{
+    //! Events recorded on the network of the shard.
+    std::uint64_t recorded{0};
+
+    //! Events for stations of the shard that are not in its network.
+    std::uint64_t failed{0};
+
+    //! Events for stations owned by another shard, which were dropped.
+    std::uint64_t misrouted{0};
+};
+
+/*! \brief One shard of a multi-process passenger state.
+ *
+ *  The shard serves a PassengerShardRouter over a UNIX domain socket. Its
+ *  network holds the full topology, but the shard only records the passenger
+ *  events of the stations it owns on the ring, and only answers for them.
+ *
+ *  Messages are framed in host byte order: Routers and shards must run on the
+ *  same machine.
+ *
+ *  All handlers run on the io_context passed to the constructor, which must be
+ *  run by a single thread. That thread is the only writer of the network.
+ */
+class PassengerShardServer
+{
+public:
+    /*! \brief Start listening on `socketPath` as shard `shard` of `ring`.
+     *
+     *  Replaces any file left at `socketPath`. The network must outlive the
+     *  server.
+     *
+     *  \throws boost::system::system_error if the socket cannot be bound.
+     */
+    PassengerShardServer(boost::asio::io_context& ioc,
+                         TransportNetwork& network,
+                         const ConsistentHashRing& ring,
+                         std::size_t shard,
+                         const std::filesystem::path& socketPath);
+
+    PassengerShardServer(const PassengerShardServer& other) = delete;
+    PassengerShardServer& operator=(const PassengerShardServer& other) = delete;
+
+    /*! \brief Remove the socket file.
+     */
+    ~PassengerShardServer();
+
+    /*! \brief Stop accepting routers and close their connections, so that
+     *         io_context::run can return. Must be called from the io_context
+     *         thread.
+     */
+    void Stop();
+
+    /*! \brief Get the counters of the shard. Can be called from any thread.
+     */
+    PassengerShardStats GetStats() const;
+
+private:
+    class Session;
+
+    TransportNetwork& network_;
+    ConsistentHashRing ring_;
+    std::size_t shard_{0};
+    std::filesystem::path socketPath_{};
+    boost::asio::local::stream_protocol::acceptor acceptor_;
+
+    std::atomic<std::uint64_t> recorded_{0};
+    std::atomic<std::uint64_t> failed_{0};
+    std::atomic<std::uint64_t> misrouted_{0};
+
+    // Sessions are owned by their pending operations. We keep an eye on them
+    // to close them on Stop().
+    std::list<std::weak_ptr<Session>> sessions_{};
+    bool stopped_{false};
+
+    void Accept();
+
+    // Record a passenger event if the shard owns its station.
+    void Record(const PassengerEvent& event);
+
+    // Passenger count of a station owned by the shard, 0 if it is not in the
+    // network.
+    long long int GetPassengerCount(const Id& station) const;
+
+    // The `k` busiest stations owned by the shard.
+    std::vector<StationPassengerCount> GetBusiestStations(std::size_t k) const;
+};
+
+/*! \brief Router configuration.
+ */
+struct PassengerShardRouterOptions
+{
+    //! Events are sent to a shard once this many bytes of them are pending.
+    //! At most 4 MiB: Shards close the connections that send larger frames.
+    std::size_t batchBytes{64 * 1024};
+
+    //! How long to keep trying to connect to a shard that is not listening
+    //! yet.
+    std::chrono::milliseconds connectTimeout{5000};
+
+    //! Must match the rings of the shards.
+    std::size_t nVirtualNodes{128};
+};
+
+/*! \brief Front end of a passenger state sharded across processes.
+ *
+ *  The router forwards each passenger event to the PassengerShardServer that
+ *  owns its station, in batches, and answers the queries on the whole network
+ *  by asking all shards at once and merging their answers.
+ *
+ *  Shard `i` listens on `socketPaths[i]`. All I/O is blocking. A router is
+ *  meant for a single thread: Feeds that run on several threads each use
+ *  their own router. Events of different routers are not ordered.
+ *
+ *  Every query sends the pending events first, so it sees all the events
+ *  recorded by this router before the call.
+ */
+class PassengerShardRouter
+{
+public:
+    /*! \brief Connect to all shards.
+     *
+     *  \throws std::invalid_argument if there are no shards, or if the batch
+     *          size is too large.
+     *  \throws boost::system::system_error if a shard cannot be reached
+     *          within the connect timeout.
+     */
+    explicit PassengerShardRouter(const std::vector<std::filesystem::path>& socketPaths,
+                                  const PassengerShardRouterOptions& options = {});
+
+    PassengerShardRouter(const PassengerShardRouter& other) = delete;
+    PassengerShardRouter& operator=(const PassengerShardRouter& other) = delete;
+
+    /*! \brief Send the pending events and disconnect.
+     */
+    ~PassengerShardRouter();
+
+    std::size_t GetShardCount() const;
+
+    /*! \brief Queue a passenger event for the shard that owns its station.
+     *
+     *  \throws boost::system::system_error if the shard connection fails.
+     */
+    void RecordPassengerEvent(const PassengerEvent& event);
+
+    /*! \brief Wait until all shards have recorded the events queued so far.
+     *
+     *  \throws boost::system::system_error if a shard connection fails.
+     */
+    void Flush();
+
+    /*! \brief Get the passenger count of a station, from its shard.
+     *
+     *  \returns 0 if the station is not in the network.
+     *
+     *  \throws boost::system::system_error if the shard connection fails.
+     */
+    long long int GetPassengerCount(const Id& station);
+
+    /*! \brief Get the `k` stations with the highest passenger count, across
+     *         all shards.
+     *
+     *  \throws boost::system::system_error if a shard connection fails.
+     */
+    std::vector<StationPassengerCount> GetBusiestStations(std::size_t k);
+
+    /*! \brief Get the counters of each shard.
+     *
+     *  \throws boost::system::system_error if a shard connection fails.
+     */
+    std::vector<PassengerShardStats> GetShardStats();
+
+private:
+    struct Shard
+    {
+        boost::asio::local::stream_protocol::socket socket;
+
+        // Events frame being filled.
+        std::string pending{};
+    };
+
+    PassengerShardRouterOptions options_{};
+    ConsistentHashRing ring_;
+    boost::asio::io_context ioc_{};
+    std::vector<Shard> shards_{};
+    std::string reply_{};
+
+    // Send the pending events of a shard, if any.
+    void Send(Shard& shard);
+
+    // Send a request to each shard in `targets`, then read their replies in
+    // the same order and pass each to `onReply`.
+    template <typename OnReply>
+    void ScatterGather(const std::vector<std::size_t>& targets,
+                       std::uint8_t type,
+                       std::string_view payload,
+                       OnReply&& onReply);
+};
+
+} // namespace NetworkMonitor
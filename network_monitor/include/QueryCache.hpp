@@ -0,0 +1,254 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+
+#include "Metrics.hpp"
+
+namespace NetworkMonitor {
+
+/*! \brief Query cache statistics.
+ */
+struct QueryCacheStats
+{
+    std::uint64_t hits{0};
+    std::uint64_t misses{0};
+
+    //! Valid entries overwritten to make room for another key.
+    std::uint64_t evictions{0};
+
+    //! Occupied slots, including the entries of older versions that have not
+    //! been overwritten yet.
+    std::size_t entries{0};
+
+    //! Slots the cache can hold.
+    std::size_t capacity{0};
+
+    //! Bytes held by the cache.
+    std::size_t memory{0};
+
+    /*! \brief Fraction of the lookups that hit, 0 if there were none.
+     */
+    double HitRate() const
+    {
+        const auto lookups{hits + misses};
+        return lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+    }
+};
+
+/*! \brief Bounded, versioned cache of query results.
+ *
+ *  Each entry is stamped with the version of the data its value was computed
+ *  from. A lookup only hits entries of the version it asks for, so the owner
+ *  of the data invalidates the whole cache in O(1) by bumping its version.
+ *  Entries of older versions are overwritten in place.
+ *
+ *  The cache is set-associative: A key can only live in one set of kWays
+ *  slots, and eviction runs the CLOCK algorithm over that set. A hit only sets
+ *  the reference bit of its slot, so lookups never reorder anything. Each set
+ *  starts with a cache line of 32-bit hash tags: A lookup only reads the key
+ *  of the slots whose tag matches, so it usually touches 2 cache lines.
+ *
+ *  The sets are split in shards, each behind its own reader-writer lock.
+ *  Lookups take the lock shared, so concurrent readers do not block each
+ *  other, and inserts only lock the shard they write to.
+ *
+ *  `Key` and `Value` must be default-constructible and copyable.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<>>
+class QueryCache
+{
+public:
+    //! Number of slots in a set.
+    static constexpr std::size_t kWays{8};
+
+    /*! \brief Create a cache of at least `capacity` slots, split in `nShards`
+     *         shards.
+     *
+     *  The number of sets is rounded up to a power of 2, and the number of
+     *  shards down to the number of sets.
+     */
+    QueryCache(std::size_t capacity, std::size_t nShards)
+    {
+        std::size_t nSets{1};
+        while(nSets * kWays < capacity)
+        {
+            nSets *= 2;
+        }
+        nShards_ = 1;
+        while(nShards_ * 2 <= nShards && nShards_ * 2 <= nSets)
+        {
+            nShards_ *= 2;
+        }
+        setMask_ = nSets - 1;
+        shards_ = std::make_unique<Shard[]>(nShards_);
+        sets_ = std::make_unique<Set[]>(nSets);
+    }
+
+    /*! \brief Look a key up.
+     *
+     *  \returns The cached value, or nothing if the key has no entry of this
+     *           version.
+     */
+    std::optional<Value> Find(const Key& key, std::uint64_t version) const
+    {
+        const auto hash{hash_(key)};
+        const auto tag{GetTag(hash)};
+        auto& set{sets_[hash & setMask_]};
+        {
+            std::shared_lock<std::shared_mutex> lock{GetShard(hash).mutex};
+            for(std::size_t way{0}; way < kWays; ++way)
+            {
+                const auto& slot{set.slots[way]};
+                if(set.tags[way] == tag && slot.version == version && equal_(slot.key, key))
+                {
+                    // Only write the reference bit if it changes, to keep the
+                    // cache line of a hot set shared between the readers.
+                    if(!set.referenced[way].load(std::memory_order_relaxed))
+                    {
+                        set.referenced[way].store(true, std::memory_order_relaxed);
+                    }
+                    hits_.Increment();
+                    return slot.value;
+                }
+            }
+        }
+        misses_.Increment();
+        return std::nullopt;
+    }
+
+    /*! \brief Cache the value of a key at a version.
+     *
+     *  Replaces the entry of the key if there is one. Otherwise, takes a free
+     *  slot or an entry of another version in the set of the key, if any, or
+     *  evicts the first entry of the set that CLOCK finds unreferenced.
+     */
+    void Insert(const Key& key, std::uint64_t version, Value value)
+    {
+        const auto hash{hash_(key)};
+        const auto tag{GetTag(hash)};
+        auto& set{sets_[hash & setMask_]};
+        std::lock_guard<std::shared_mutex> lock{GetShard(hash).mutex};
+        auto target{kWays};
+        for(std::size_t way{0}; way < kWays; ++way)
+        {
+            if(set.tags[way] == tag && equal_(set.slots[way].key, key))
+            {
+                target = way;
+                break;
+            }
+            if(target == kWays && (set.tags[way] == kEmpty || set.slots[way].version != version))
+            {
+                target = way;
+            }
+        }
+        if(target == kWays)
+        {
+            // Give referenced entries a second chance.
+            while(set.referenced[set.hand].exchange(false, std::memory_order_relaxed))
+            {
+                set.hand = (set.hand + 1) % kWays;
+            }
+            target = set.hand;
+            set.hand = (set.hand + 1) % kWays;
+            evictions_.Increment();
+        }
+        if(set.tags[target] == kEmpty)
+        {
+            ++GetShard(hash).size;
+        }
+        set.tags[target] = tag;
+        set.referenced[target].store(false, std::memory_order_relaxed);
+        auto& slot{set.slots[target]};
+        slot.key = key;
+        slot.value = std::move(value);
+        slot.version = version;
+    }
+
+    /*! \brief Get the cache statistics.
+     *
+     *  The counters are read without stopping the lookups, so they can be off
+     *  by the lookups in flight.
+     */
+    QueryCacheStats GetStats() const
+    {
+        QueryCacheStats stats{};
+        stats.hits = hits_.Get();
+        stats.misses = misses_.Get();
+        stats.evictions = evictions_.Get();
+        for(std::size_t idx{0}; idx < nShards_; ++idx)
+        {
+            std::shared_lock<std::shared_mutex> lock{shards_[idx].mutex};
+            stats.entries += shards_[idx].size;
+        }
+        stats.capacity = (setMask_ + 1) * kWays;
+        stats.memory = GetMemorySize();
+        return stats;
+    }
+
+    /*! \brief Bytes held by the cache.
+     */
+    std::size_t GetMemorySize() const
+    {
+        return sizeof(*this) + nShards_ * sizeof(Shard) + (setMask_ + 1) * sizeof(Set);
+    }
+
+private:
+    // Tag of the empty slots. The tags of the other slots are odd.
+    static constexpr std::uint32_t kEmpty{0};
+
+    struct Slot
+    {
+        Key key{};
+        Value value{};
+        std::uint64_t version{0};
+    };
+
+    struct alignas(64) Set
+    {
+        std::uint32_t tags[kWays]{};
+        std::atomic<bool> referenced[kWays]{};
+        std::size_t hand{0};
+        Slot slots[kWays]{};
+    };
+
+    // Each shard guards the sets whose index is equal to the shard index
+    // modulo the number of shards.
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex{};
+        std::size_t size{0};
+    };
+
+    std::size_t nShards_{1};
+    std::size_t setMask_{0};
+    std::unique_ptr<Shard[]> shards_{nullptr};
+    std::unique_ptr<Set[]> sets_{nullptr};
+    Hash hash_{};
+    KeyEqual equal_{};
+
+    mutable Counter hits_{};
+    mutable Counter misses_{};
+    Counter evictions_{};
+
+    // The set index comes from the low bits of the hash, the tag from the
+    // high bits.
+    static std::uint32_t GetTag(std::size_t hash)
+    {
+        return static_cast<std::uint32_t>(std::uint64_t{hash} >> 32) | 1;
+    }
+
+    Shard& GetShard(std::size_t hash) const
+    {
+        return shards_[hash & setMask_ & (nShards_ - 1)];
+    }
+};
+
+} // namespace NetworkMonitor
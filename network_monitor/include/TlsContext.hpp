@@ -0,0 +1,87 @@
+#pragma once
+
+#include <boost/asio/ssl.hpp>
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace NetworkMonitor {
+
+/*! \brief Get a TLS client context shared by all callers with the same CA file.
+ *
+ *  The context only accepts TLS 1.2 and above, verifies the peer against the
+ *  CA certificates in `caCertFile`, or in the system store if the path is
+ *  empty, and has TLS session resumption enabled.
+ *
+ *  The context is built on the first call and lives as long as someone holds
+ *  on to it.
+ *
+ *  \throws boost::system::system_error if the CA file cannot be loaded.
+ */
+std::shared_ptr<boost::asio::ssl::context> GetSharedTlsClientContext(const std::filesystem::path& caCertFile = {});
+
+/*! \brief Turn on client-side TLS session resumption for a context.
+ *
+ *  New sessions, including TLS 1.3 session tickets, negotiated by
+ *  connections that called PrepareTlsSessionResumption() are saved in the
+ *  default TlsSessionCache. It is safe to call this function more than once.
+ */
+void EnableTlsSessionResumption(boost::asio::ssl::context& ctx);
+
+/*! \brief Set a connection up to resume, and then save, the TLS session for
+ *         this host and port.
+ *
+ *  Call this before the TLS handshake.
+ *
+ *  \returns true if a saved session was found. The server may still decline
+ *           to resume it.
+ */
+bool PrepareTlsSessionResumption(SSL* ssl, const std::string& host, const std::string& port);
+
+/*! \brief Saved TLS client sessions, one per host, port and context.
+ *
+ *  All member functions are thread-safe.
+ */
+class TlsSessionCache
+{
+public:
+    TlsSessionCache() = default;
+    TlsSessionCache(const TlsSessionCache& other) = delete;
+    TlsSessionCache& operator=(const TlsSessionCache& other) = delete;
+    ~TlsSessionCache();
+
+    /*! \brief Get the process-wide session cache.
+     */
+    static TlsSessionCache& Default();
+
+    /*! \brief Save a session, replacing any session saved for the same key.
+     *
+     *  The cache takes ownership of the session reference.
+     */
+    void Store(const std::string& key, SSL_SESSION* session);
+
+    /*! \brief Get a new reference to the session saved for this key.
+     *
+     *  The caller must release it with SSL_SESSION_free.
+     *
+     *  \returns nullptr if there is no resumable session for this key.
+     */
+    SSL_SESSION* Get(const std::string& key) const;
+
+    /*! \brief Forget all sessions.
+     */
+    void Clear();
+
+    /*! \brief Number of saved sessions.
+     */
+    std::size_t GetSize() const;
+
+private:
+    mutable std::mutex mutex_{};
+    std::map<std::string, SSL_SESSION*> sessions_{};
+};
+
+} // namespace NetworkMonitor
@@ -1,10 +1,20 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
+#include "FlatHashMap.hpp"
+#include "QueryCache.hpp"
+
 namespace NetworkMonitor {
 
 /*! \brief A station, line, or route ID.
@@ -84,7 +94,69 @@ struct Line
     bool operator==(const Line& other) const;
 };
 
+/*! \brief Travel time between 2 adjacent stations, as listed in a network
+ *         layout.
+ */
+struct StationTravelTime
+{
+    Id startStationId{};
+    Id endStationId{};
+    unsigned int travelTime{0};
+};
+
+/*! \brief A full network layout: The contents of a `network-layout.json` file.
+ */
+struct NetworkLayout
+{
+    std::vector<Station> stations{};
+    std::vector<Line> lines{};
+
+    //! One entry per pair of adjacent stations, in either direction.
+    std::vector<StationTravelTime> travelTimes{};
+};
+
+/*! \brief Changes that turn the layout of a network into another layout.
+ *
+ *  See TransportNetwork::DiffLayout. A route whose stops changed is removed
+ *  and added again. Lines and stations that are kept but renamed are listed
+ *  with their new name.
+ */
+struct LayoutChangeSet
+{
+    //! Routes added to and removed from a line that stays in the network.
+    struct LineChange
+    {
+        Id lineId{};
+        std::string name{};
+        std::vector<Route> addedRoutes{};
+        std::vector<Id> removedRoutes{};
+    };
+
+    std::vector<Station> addedStations{};
+    std::vector<Station> renamedStations{};
+    std::vector<Id> removedStations{};
+
+    std::vector<Line> addedLines{};
+    std::vector<LineChange> modifiedLines{};
+    std::vector<Id> removedLines{};
+
+    //! Travel times to set once the topology changes are applied.
+    std::vector<StationTravelTime> travelTimes{};
+
+    /*! \brief Number of stations, lines, routes and travel times changed.
+     */
+    std::size_t size() const;
+
+    bool empty() const;
+};
+
 /*! \brief Passenger event
+ *
+ *  Events without a `timestamp` only count towards the running passenger
+ *  count of the station, not towards its windowed passenger flow.
+ *
+ *  Feeds that number their events set `sequence`, so that a
+ *  PassengerEventFilter can drop the events they send twice.
  */
 struct PassengerEvent
 {
@@ -96,13 +168,269 @@ struct PassengerEvent
 
     Id stationId{};
     Type type{Type::In};
+    std::chrono::system_clock::time_point timestamp{};
+
+    //! Sequence number of the event in its feed, 0 if the feed has none.
+    std::uint64_t sequence{0};
+};
+
+/*! \brief Sliding time window for passenger flow queries.
+ */
+enum class FlowWindow
+{
+    OneMinute,
+    FiveMinutes,
+    OneHour
+};
+
+/*! \brief Number of passengers that entered and exited over a time window.
+ */
+struct PassengerFlow
+{
+    unsigned long long int in{0};
+    unsigned long long int out{0};
+
+    /*! \brief Net passenger count over the time window.
+     */
+    long long int Net() const;
+};
+
+/*! \brief Passenger count at a station.
+ */
+struct StationPassengerCount
+{
+    Id stationId{};
+    long long int count{0};
+};
+
+/*! \brief Crowding alert callback.
+ *
+ *  Called with `crowded` set to true when the passenger count of a station
+ *  rises to the high threshold of a subscription, and with `crowded` set to
+ *  false when it falls back to the low threshold.
+ */
+using CrowdingCallback = std::function<void(const Id& station, long long int count, bool crowded)>;
+
+/*! \brief Read-only, non-owning view over a contiguous sequence of route IDs.
+ *
+ *  Each element is a view into the ID stored by the network for that route.
+ *  The view is only valid as long as the network it was obtained from is
+ *  alive and its topology is not modified.
+ */
+class RouteIdView
+{
+public:
+    using value_type = std::string_view;
+    using const_iterator = const std::string_view*;
+
+    RouteIdView() = default;
+    RouteIdView(const std::string_view* data, std::size_t size);
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    std::size_t size() const;
+    bool empty() const;
+    const std::string_view& operator[](std::size_t idx) const;
+
+private:
+    const std::string_view* data_{nullptr};
+    std::size_t size_{0};
+};
+
+/*! \brief Travel time between 2 adjacent stations over the day.
+ *
+ *  The profile is piecewise constant: Each step holds from its `start` time of
+ *  day, in UTC, until the `start` of the next step. The last step wraps around
+ *  midnight until the `start` of the first one.
+ *
+ *  A TravelTimeProfile is well formed if:
+ *  - `steps` has at least 1 step.
+ *  - The steps are sorted by strictly increasing `start`.
+ *  - Every `start` is in [0, 24h).
+ */
+struct TravelTimeProfile
+{
+    struct Step
+    {
+        std::chrono::seconds start{0};
+        unsigned int travelTime{0};
+    };
+
+    std::vector<Step> steps{};
+};
+
+/*! \brief Travel time query between 2 adjacent stations.
+ *
+ *  See TransportNetwork::GetTravelTimes. The query views the IDs: They must
+ *  outlive the query.
+ *
+ *  Queries without a `departure` time get the static travel time.
+ */
+struct TravelTimeQuery
+{
+    std::string_view stationA{};
+    std::string_view stationB{};
+    std::chrono::system_clock::time_point departure{};
+};
+
+/*! \brief Travel time query between 2 stations of a route.
+ *
+ *  See TransportNetwork::GetTravelTimes. The query views the IDs: They must
+ *  outlive the query.
+ *
+ *  Queries without a `departure` time get the static travel time.
+ */
+struct RouteTravelTimeQuery
+{
+    std::string_view line{};
+    std::string_view route{};
+    std::string_view stationA{};
+    std::string_view stationB{};
+    std::chrono::system_clock::time_point departure{};
+};
+
+/*! \brief How crowded stations weigh on crowding-aware journeys.
+ *
+ *  A station is crowded when its passenger count is above `threshold`. Each
+ *  leg leaving a crowded station costs `minutesPerPassenger` extra minutes per
+ *  passenger above the threshold, up to `maxPenalty` minutes. Changing routes
+ *  at a crowded station costs `interchangePenalty` extra minutes.
+ */
+struct CrowdingRoutingOptions
+{
+    long long int threshold{0};
+    double minutesPerPassenger{0.0};
+    unsigned int maxPenalty{60};
+    unsigned int interchangePenalty{0};
+};
+
+/*! \brief Query result cache configuration.
+ *
+ *  The cache holds the answers to the static travel time queries over routes,
+ *  which walk the route. Queries between adjacent stations only scan the
+ *  edges of a station, which is cheaper than a cache lookup, and queries with
+ *  a departure time depend on the time of day: Neither is cached.
+ *
+ *  A `capacity` of 0 disables the cache.
+ *
+ *  See QueryCache for how the `capacity` and `nShards` are rounded.
+ */
+struct QueryCacheOptions
+{
+    std::size_t capacity{0};
+    std::size_t nShards{64};
+};
+
+/*! \brief A journey between 2 stations, over one or more routes.
+ */
+struct Journey
+{
+    //! A stretch of the journey over a single route.
+    struct Leg
+    {
+        Id lineId{};
+        Id routeId{};
+        Id startStationId{};
+        Id endStationId{};
+    };
+
+    //! All stations of the journey, from the first to the last.
+    std::vector<Id> stops{};
+    std::vector<Leg> legs{};
+
+    //! Sum of the travel times of the journey, in minutes.
+    unsigned int travelTime{0};
+
+    //! Travel time plus the crowding penalties of the journey.
+    unsigned int cost{0};
+};
+
+/*! \brief Starting point of a reachability query.
+ *
+ *  See TransportNetwork::GetReachableStations. The seed views the station ID:
+ *  It must outlive the query.
+ */
+struct ReachabilitySeed
+{
+    std::string_view stationId{};
+
+    //! Time already spent when leaving the station, in minutes.
+    unsigned int travelTime{0};
+};
+
+/*! \brief A station reached by a reachability query.
+ */
+struct ReachableStation
+{
+    Id stationId{};
+
+    //! Shortest travel time to the station from the seeds, in minutes.
+    unsigned int travelTime{0};
+};
+
+/*! \brief How a TransportNetwork trades memory for speed.
+ */
+enum class MemoryMode
+{
+    //! All per-station state is allocated when the station is added.
+    Default,
+
+    /*! Passenger flow counters, by far the largest per-station state, are
+     *  only allocated for a station when it records its first timestamped
+     *  passenger event. Stations without timestamped events cost about 8 times
+     *  less memory, at the price of an extra indirection on each event.
+     */
+    Compact
+};
+
+/*! \brief Memory used by a TransportNetwork, in bytes, by category.
+ *
+ *  Sizes of the standard containers are estimated from their size and
+ *  capacity.
+ */
+struct MemoryUsage
+{
+    //! Station structs and the station index.
+    std::size_t stations{0};
+    //! Line and route structs, route stops and the route maps of each line.
+    std::size_t lines{0};
+    //! Graph edges.
+    std::size_t edges{0};
+    //! Routes serving each station.
+    std::size_t routeIndex{0};
+    //! Station, line, and route IDs and names.
+    std::size_t strings{0};
+    //! Station and line ID lookup tables.
+    std::size_t lookupTables{0};
+    //! Windowed passenger flow counters.
+    std::size_t passengerFlow{0};
+    //! Crowding heap and subscriptions.
+    std::size_t crowding{0};
+    //! Travel time profiles and their deduplication table.
+    std::size_t travelTimeProfiles{0};
+    //! Query result cache.
+    std::size_t queryCache{0};
+    //! Arena memory not used by the above, for example the buffers left
+    //! behind by containers that grew.
+    std::size_t arenaOverhead{0};
+
+    std::size_t Total() const;
 };
 
 /*! \brief Underground network representation
+ *
+ *  The network owns all its topology data in a single memory arena. A network
+ *  can be moved, but not copied.
  */
 class TransportNetwork
 {
 public:
+    TransportNetwork() = default;
+
+    /*! \brief Create an empty network with the given memory mode.
+     */
+    explicit TransportNetwork(MemoryMode mode);
+
     /*! \brief Add a station to the network.
      *
      *  \returns false if there was an error while adding the station to the
@@ -126,10 +454,67 @@ public:
      */
     bool AddLine(const Line& line);
 
+    /*! \brief Add several lines to the network at once.
+     *
+     *  \returns false if any of the lines could not be added. In that case,
+     *           none of the lines is added.
+     *
+     *  On success, the network is exactly the same as if the lines had been
+     *  added one by one with AddLine, in order. The stops are resolved and the
+     *  graph edges are built on `nThreads` threads, 0 for one per hardware
+     *  thread, which pays off for layouts with thousands of routes.
+     *
+     *  Same requirements as AddLine. A line cannot appear twice in `lines`.
+     */
+    bool AddLines(const std::vector<Line>& lines, std::size_t nThreads = 0);
+
+    /*! \brief Compare the network with a new layout.
+     *
+     *  \returns The changes that turn the network into the network built from
+     *           `layout` with AddStation, AddLines and SetTravelTime. An empty
+     *           change set if the network already matches the layout.
+     *
+     *  Only static travel times are compared. Pairs of adjacent stations that
+     *  the layout does not list keep their travel time.
+     *
+     *  This function reads the whole layout and the whole network. It assumes
+     *  that the layout is well formed.
+     */
+    LayoutChangeSet DiffLayout(const NetworkLayout& layout) const;
+
+    /*! \brief Apply a change set in place, usually one from DiffLayout.
+     *
+     *  \returns false if the change set does not apply to the network, for
+     *           example if it adds a route with a stop that is not in the
+     *           network, or removes a station that a remaining route serves.
+     *           In that case, the network is not modified. Travel times
+     *           between stations that are not adjacent once the topology
+     *           changes are applied are skipped, and also return false.
+     *
+     *  Stations that stay keep their passenger counts, passenger flows and
+     *  crowding subscriptions. Removed stations drop theirs: Their
+     *  subscriptions are cancelled. The busiest stations, the query cache and
+     *  the routing graph of the journey and reachability queries are kept up
+     *  to date, as after AddLine.
+     *
+     *  The cost scales with the size of the changes and of the stations and
+     *  lines they touch, not with the size of the network. Removed stations,
+     *  lines and routes keep their arena memory until the network is
+     *  destroyed.
+     *
+     *  Same requirements as AddLine for the added routes and lines. This
+     *  function cannot be called concurrently with the other member
+     *  functions.
+     */
+    bool ApplyLayoutChanges(const LayoutChangeSet& changes);
+
     /*! \brief Record a passenger event at a station.
      *
      *  \returns false if the station is not in the network or if the passenger
      *           event is not reconized.
+     *
+     *  This function can be called concurrently with itself and with the const
+     *  member functions, but not with the functions that modify the topology.
      */
     bool RecordPassengerEvent(const PassengerEvent& event);
 
@@ -143,15 +528,100 @@ public:
      */
     long long int GetPassengerCount(const Id& station) const;
 
+    /*! \brief Set the passenger counts of several stations at once.
+     *
+     *  Meant to restore counts that outlived the network, for example the
+     *  counts recovered by a PassengerEventLog. Stations that are not in the
+     *  network are skipped. The busiest stations and the crowding alerts are
+     *  updated as after a passenger event.
+     *
+     *  This function cannot be called concurrently with RecordPassengerEvent.
+     *
+     *  \returns The number of stations whose count was set.
+     */
+    std::size_t SetPassengerCounts(const std::vector<StationPassengerCount>& counts);
+
+    /*! \brief Get the passenger flow at a station over a sliding time window
+     *         ending at time `at`.
+     *
+     *  Passenger flows are aggregated in fixed-size time buckets, so the window
+     *  start is rounded down to the bucket size: 10 seconds for the windows up
+     *  to 5 minutes, 1 minute for the 1-hour window. Events older than the
+     *  longest window are forgotten.
+     *
+     *  \throws std::runtime_error if the station is not in the network.
+     */
+    PassengerFlow GetPassengerFlow(const Id& station,
+                                   FlowWindow window,
+                                   std::chrono::system_clock::time_point at) const;
+
+    /*! \brief Get the passenger flow over all stations served by a line, over a
+     *         sliding time window ending at time `at`.
+     *
+     *  See GetPassengerFlow for how the time window is handled.
+     *
+     *  \throws std::runtime_error if the line is not in the network.
+     */
+    PassengerFlow GetLinePassengerFlow(const Id& line,
+                                       FlowWindow window,
+                                       std::chrono::system_clock::time_point at) const;
+
+    /*! \brief Get the `k` stations with the highest passenger count.
+     *
+     *  \returns At most `k` stations, sorted by decreasing passenger count.
+     *
+     *  The stations are kept in a max-heap. RecordPassengerEvent only flags
+     *  its station, without taking a lock, and this function sifts the m
+     *  stations flagged since the previous call, so it runs in
+     *  O(m log n + k log k) and does not scan the network.
+     */
+    std::vector<StationPassengerCount> GetBusiestStations(std::size_t k) const;
+
+    /*! \brief Subscribe to crowding alerts for a station.
+     *
+     *  The callback fires once when the passenger count reaches `high`, and
+     *  then does not fire again until the count falls to `low`. This
+     *  hysteresis keeps a count that hovers around a threshold from flooding
+     *  the subscriber with alerts.
+     *
+     *  Callbacks are invoked synchronously from RecordPassengerEvent, on the
+     *  thread that recorded the event, without any lock held: A callback can
+     *  query the network, and subscribe or unsubscribe if no other thread
+     *  records events at the same time. Only the events of stations with
+     *  subscriptions take a lock.
+     *
+     *  This function cannot be called concurrently with RecordPassengerEvent.
+     *
+     *  \returns A subscription ID, or 0 if the station is not in the network
+     *           or if `low` is not lower than `high`.
+     */
+    std::size_t SubscribeToCrowding(const Id& station,
+                                    long long int high,
+                                    long long int low,
+                                    CrowdingCallback callback);
+
+    /*! \brief Cancel a crowding subscription.
+     *
+     *  This function cannot be called concurrently with RecordPassengerEvent.
+     *
+     *  \returns false if the subscription does not exist.
+     */
+    bool UnsubscribeFromCrowding(std::size_t subscription);
+
     /*! \brief Get list of routes serving a given station.
      *
-     *  \returns An empty vector if there was an error getting the list of
+     *  \returns An empty view if there was an error getting the list of
      *           routes serving the station, or if the station has legitimately
      *           no routes serving it.
      *
+     *  The routes are returned in the order they were added to the network.
+     *  This function does not allocate: The view points into an index that is
+     *  maintained when lines are added or changed. See RouteIdView for its
+     *  lifetime.
+     *
      *  The station must already be in the network.
      */
-    std::vector<Id> GetRoutesServingStation(const Id& station) const;
+    RouteIdView GetRoutesServingStation(const Id& station) const;
 
     /*! \brief Set the travel time between 2 adjacent stations.
      *
@@ -159,13 +629,32 @@ public:
      *           between the two stations.
      *
      *  The travel time is the same for all routes connecting the two stations
-     *  directly.
+     *  directly. It holds all day: It replaces any travel time profile set
+     *  between the two stations.
      *
      *  The two stations must be adjacent in at least one line route. The two
      *  stations must already be in the network.
      */
     bool SetTravelTime(const Id& stationA, const Id& stationB, const unsigned int travelTime);
 
+    /*! \brief Set the travel time profile between 2 adjacent stations.
+     *
+     *  \returns false if there was an error while setting the travel time
+     *           profile between the two stations, or if the profile is not
+     *           well formed.
+     *
+     *  The profile only applies to the queries that take a departure time. The
+     *  other queries keep returning the travel time set with SetTravelTime.
+     *
+     *  Identical profiles are stored once, however many station pairs they are
+     *  set on, so a network with a handful of peak and off-peak patterns costs
+     *  little more memory than one with static travel times. Profiles that are
+     *  replaced are not released until the network is destroyed.
+     *
+     *  Same requirements as SetTravelTime.
+     */
+    bool SetTravelTimeProfile(const Id& stationA, const Id& stationB, const TravelTimeProfile& profile);
+
     /*! \brief Get the travel time between 2 adjacent stations.
      *
      *  \returns 0 if the function could not find the travel time between the
@@ -193,70 +682,588 @@ public:
      */
     unsigned int GetTravelTime(const Id& line, const Id& route, const Id& stationA, const Id& stationB) const;
 
+    /*! \brief Get the travel time between 2 adjacent stations, when leaving
+     *         at time `departure`.
+     *
+     *  Same as the static GetTravelTime, but the travel time is read from the
+     *  travel time profile between the two stations, if any, at the time of day
+     *  of `departure`.
+     */
+    unsigned int GetTravelTime(const Id& stationA,
+                               const Id& stationB,
+                               std::chrono::system_clock::time_point departure) const;
+
+    /*! \brief Get the total travel time between any 2 stations, on a specific
+     *         route, when leaving station A at time `departure`.
+     *
+     *  Same as the static GetTravelTime over a route, but each leg is read from
+     *  its travel time profile, if any, at the time we reach its first
+     *  station. Travel times are in minutes.
+     */
+    unsigned int GetTravelTime(const Id& line,
+                               const Id& route,
+                               const Id& stationA,
+                               const Id& stationB,
+                               std::chrono::system_clock::time_point departure) const;
+
+    /*! \brief Answer a batch of travel time queries between adjacent
+     *         stations.
+     *
+     *  Writes the answer to `queries[i]` to `travelTimes[i]`, which must have
+     *  room for `nQueries` answers. Each answer is what GetTravelTime would
+     *  return.
+     *
+     *  The queries are split over `nThreads` threads, 0 for one per hardware
+     *  thread. Answering a query does not allocate.
+     *
+     *  Like the other const member functions, this function can run
+     *  concurrently with RecordPassengerEvent. To query a network that can be
+     *  replaced, use a LiveTransportNetwork::Snapshot.
+     */
+    void GetTravelTimes(const TravelTimeQuery* queries,
+                        std::size_t nQueries,
+                        unsigned int* travelTimes,
+                        std::size_t nThreads = 0) const;
+
+    /*! \brief Answer a batch of travel time queries over routes.
+     *
+     *  Same as the other overload, for GetTravelTime over a route.
+     */
+    void GetTravelTimes(const RouteTravelTimeQuery* queries,
+                        std::size_t nQueries,
+                        unsigned int* travelTimes,
+                        std::size_t nThreads = 0) const;
+
+    /*! \brief Get the routes serving a batch of stations.
+     *
+     *  Writes the routes serving `stations[i]` to `routes[i]`, which must have
+     *  room for `nStations` views. Each view is what GetRoutesServingStation
+     *  would return.
+     *
+     *  Same threading and allocation guarantees as GetTravelTimes.
+     */
+    void GetRoutesServingStations(const std::string_view* stations,
+                                  std::size_t nStations,
+                                  RouteIdView* routes,
+                                  std::size_t nThreads = 0) const;
+
+    /*! \brief Set how crowded stations weigh on crowding-aware journeys.
+     *
+     *  This function recomputes the penalty of every station. It cannot be
+     *  called concurrently with the other member functions.
+     */
+    void SetCrowdingRoutingOptions(const CrowdingRoutingOptions& options);
+
+    /*! \brief Get the `k` cheapest journeys between 2 stations, avoiding
+     *         crowded stations.
+     *
+     *  \returns At most `k` distinct journeys, sorted by increasing cost. An
+     *           empty vector if the stations are not in the network, if they
+     *           are the same station, or if they are not connected.
+     *
+     *  The cost of a journey is its travel time plus the penalties set with
+     *  SetCrowdingRoutingOptions. The static travel times are used. After the
+     *  cheapest journey, alternatives are found by making the legs of the
+     *  journeys found so far more expensive, and searching again.
+     *
+     *  The penalty of a station is cached: A query only recomputes the
+     *  penalties of the stations that recorded passenger events since the
+     *  previous query. A penalty can lag behind its station by the events
+     *  recorded during a query.
+     *
+     *  Like the other const member functions, this function can run
+     *  concurrently with RecordPassengerEvent.
+     */
+    std::vector<Journey> GetCrowdingAwareJourneys(const Id& stationA, const Id& stationB, std::size_t k) const;
+
+    /*! \brief Get all stations that can be reached from a station within a
+     *         travel time budget.
+     *
+     *  \returns The stations reached in at most `maxTravelTime` minutes,
+     *           including `station` itself, sorted by increasing travel time.
+     *           An empty vector if the station is not in the network.
+     *
+     *  The static travel times are used, without crowding penalties.
+     */
+    std::vector<ReachableStation> GetReachableStations(const Id& station, unsigned int maxTravelTime) const;
+
+    /*! \brief Get all stations that can be reached from any of several seeds
+     *         within a travel time budget.
+     *
+     *  Each station gets its shortest travel time from any seed, counting the
+     *  `travelTime` of the seed. Seeds that are not in the network, or that
+     *  are already over the budget, are skipped.
+     *
+     *  The search stops at the budget, so its cost depends on the number of
+     *  stations reached, not on the size of the network. Its scratch space is
+     *  kept per thread and reused across queries without being cleared.
+     *
+     *  Like the other const member functions, this function can run
+     *  concurrently with RecordPassengerEvent.
+     */
+    std::vector<ReachableStation> GetReachableStations(const std::vector<ReachabilitySeed>& seeds,
+                                                       unsigned int maxTravelTime) const;
+
+    /*! \brief Set up the query result cache.
+     *
+     *  Replaces the cache, if any, with an empty one.
+     *
+     *  Cached answers are stamped with a version of the network that AddLine,
+     *  AddLines, ApplyLayoutChanges and SetTravelTime bump, so a query never
+     *  gets an answer that predates a change to the topology or to the travel
+     *  times.
+     *
+     *  This function cannot be called concurrently with the other member
+     *  functions.
+     */
+    void SetQueryCacheOptions(const QueryCacheOptions& options);
+
+    /*! \brief Get the query result cache statistics.
+     *
+     *  \returns Empty statistics if the cache is disabled.
+     */
+    QueryCacheStats GetQueryCacheStats() const;
+
+    /*! \brief Get the memory used by the network, by category.
+     *
+     *  This function scans the whole network.
+     */
+    MemoryUsage GetMemoryUsage() const;
+
+    MemoryMode GetMemoryMode() const;
+
 private:
     // Forward-declare all internal structs.
     struct GraphNode;
+    struct FlowCounter;
     struct GraphEdge;
     struct RouteInternal;
     struct LineInternal;
 
-    // Graph node
-    // We use this as the internal station representation.
-    struct GraphNode
-    {
-        Id id{};
-        std::string name{};
-        long long int passengerCount{0};
-        std::vector<std::shared_ptr<GraphEdge>> edges{};
+    // Profile index of the edges without a travel time profile.
+    static constexpr std::uint32_t kNoTravelTimeProfile{0xFFFFFFFF};
 
-        // Find the edge for a specific line route.
-        std::vector<std::shared_ptr<GraphEdge>>::const_iterator FindEdgeForRoute(
-            const std::shared_ptr<RouteInternal>& route) const;
-    };
+    // Flag of the crowding penalties of crowded stations.
+    static constexpr std::uint32_t kCrowdedBit{0x80000000};
+
+    // All internal structs live in the network arena (see arena_ below). Their
+    // containers must allocate from the same arena: The structs are never
+    // destroyed individually, their memory is released at once with the arena.
+    // Their IDs and names view characters copied into the arena.
 
     // Graph edge
     // We keep one edge for each route going through a node, even if multiple
     // routes go through the same node.
+    // The profile index fits in the padding after the travel time, so edges
+    // with a profile are no larger than edges without.
     struct GraphEdge
     {
-        std::shared_ptr<RouteInternal> route{nullptr};
-        std::shared_ptr<GraphNode> nextStop{nullptr};
+        RouteInternal* route{nullptr};
+        GraphNode* nextStop{nullptr};
         unsigned int travelTime{0};
+        std::uint32_t profile{kNoTravelTimeProfile};
+    };
+
+    // Graph node
+    // We use this as the internal station representation.
+    struct GraphNode
+    {
+        std::string_view id{};
+        std::string_view name{};
+        std::atomic<long long int> passengerCount{0};
+        std::pmr::vector<GraphEdge> edges{};
+
+        // Inverted index of the routes stopping at this station, including
+        // the routes for which this station is the last stop (and hence has no
+        // outgoing edge). Each entry views the ID owned by the RouteInternal.
+        std::pmr::vector<std::string_view> routes{};
+
+        // Dense index of the station, in the order stations were added. When a
+        // station is removed, the last station takes its index.
+        std::size_t index{0};
+
+        // Crowding subscriptions for this station (indices into
+        // crowdingSubscriptions_).
+        std::pmr::vector<std::size_t> crowdingSubscriptions{};
+
+        // Flow counters of the station in compact mode. Allocated on the
+        // first timestamped passenger event.
+        std::atomic<FlowCounter*> flowCounters{nullptr};
+
+        // Set when the passenger count changed since the crowding penalty of
+        // the station was last computed. Stale stations are chained through
+        // `nextStaleInRouting`.
+        std::atomic<bool> crowdingPenaltyStale{false};
+        GraphNode* nextStaleInRouting{nullptr};
+
+        // Set when the passenger count changed since the crowding heap entry
+        // of the station was last sifted. Stale stations are chained through
+        // `nextStaleInCrowdingHeap`.
+        std::atomic<bool> crowdingHeapStale{false};
+        GraphNode* nextStaleInCrowdingHeap{nullptr};
+
+        // Find the edge for a specific line route.
+        std::pmr::vector<GraphEdge>::const_iterator FindEdgeForRoute(const RouteInternal* route) const;
     };
 
     // Internal route representation
     struct RouteInternal
     {
-        Id id{};
-        std::shared_ptr<LineInternal> line{nullptr};
-        std::vector<std::shared_ptr<GraphNode>> stops{};
+        std::string_view id{};
+        LineInternal* line{nullptr};
+        std::pmr::vector<GraphNode*> stops{};
     };
 
+    // Lookup table by ID, allocated from the network arena.
+    template <typename Value>
+    using ArenaIdMap = FlatHashMap<std::string_view,
+                                   Value,
+                                   StringViewHash,
+                                   std::equal_to<>,
+                                   std::pmr::polymorphic_allocator<std::pair<std::string_view, Value>>>;
+
     // Internal line representation
     // We map line routes by their ID.
     struct LineInternal
     {
-        Id id{};
-        std::string name{};
-        std::unordered_map<Id, std::shared_ptr<RouteInternal>> routes{};
+        std::string_view id{};
+        std::string_view name{};
+        ArenaIdMap<RouteInternal*> routes{};
+
+        // All stations served by the line, each listed once, sorted by index
+        // when the line was last changed.
+        std::pmr::vector<GraphNode*> stations{};
+    };
+
+    // Passenger flow counter
+    // A counter packs the time slot it belongs to (upper 32 bits) with the
+    // number of events in that slot (lower 32 bits). This lets us recycle the
+    // buckets of a ring in place: A counter found with an older slot is simply
+    // restarted, without any clean-up pass.
+    struct FlowCounter
+    {
+        std::atomic<std::uint64_t> packed{0};
+
+        FlowCounter() = default;
+        FlowCounter(const FlowCounter& other);
+
+        // Count one event in the given slot. Events for a slot older than the
+        // one currently held are dropped.
+        void Increment(std::uint32_t slot);
+
+        // Get the number of events if the counter holds the given slot.
+        std::uint32_t Get(std::uint32_t slot) const;
+    };
+
+    // Each station has two rings of flow buckets: A fine one for the windows
+    // up to 5 minutes, and a coarse one for the 1-hour window. Each bucket has
+    // an In counter followed by an Out counter.
+    static constexpr std::uint32_t kFlowFineBuckets{30};
+    static constexpr std::uint32_t kFlowFineSeconds{10};
+    static constexpr std::uint32_t kFlowCoarseBuckets{60};
+    static constexpr std::uint32_t kFlowCoarseSeconds{60};
+    static constexpr std::size_t kFlowCountersPerStation{2 * (kFlowFineBuckets + kFlowCoarseBuckets)};
+
+    // Heap memory resource that keeps track of the bytes it hands out.
+    class CountingResource : public std::pmr::memory_resource
+    {
+    public:
+        std::size_t GetSize() const;
+
+    private:
+        std::size_t size_{0};
+
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    // Monotonic arena holding all the topology data. It only grows while we
+    // add stations and lines, and it is released in one go when the network
+    // is destroyed or replaced.
+    struct Arena
+    {
+        CountingResource upstream{};
+        std::pmr::monotonic_buffer_resource resource{&upstream};
     };
 
+    // Travel time profiles
+    // The steps of all profiles are stored back to back in one array, and each
+    // profile is a range in that array. Edges refer to a profile by its index
+    // in profiles_. Identical profiles are deduplicated by hash: On the rare
+    // hash collision between different profiles we simply store both.
+    struct ProfileStep
+    {
+        std::uint32_t start{0};
+        std::uint32_t travelTime{0};
+    };
+    struct ProfileRange
+    {
+        std::uint32_t first{0};
+        std::uint32_t size{0};
+    };
+    std::vector<ProfileStep> profileSteps_{};
+    std::vector<ProfileRange> profiles_{};
+    FlatHashMap<std::uint64_t, std::uint32_t> profilesByHash_{};
+
+    MemoryMode memoryMode_{MemoryMode::Default};
+
+    // The arena must be declared before any member that points into it.
+    // We keep the arena on the heap so that the network can be moved without
+    // invalidating the pointers into it.
+    std::unique_ptr<Arena> arena_{std::make_unique<Arena>()};
+
     // Map station and lines by ID. We do not map line routes here, as they
     // are mapped within each line representation.
-    std::unordered_map<Id, std::shared_ptr<GraphNode>> stations_{};
-    std::unordered_map<Id, std::shared_ptr<LineInternal>> lines_{};
+    // The keys view the IDs stored in the arena objects, so lookups by a view
+    // on the bytes of a feed message do not allocate.
+    FlatHashMap<std::string_view, GraphNode*, StringViewHash> stations_{};
+    FlatHashMap<std::string_view, LineInternal*, StringViewHash> lines_{};
+
+    // Flow counters of all stations, stored contiguously and indexed by
+    // GraphNode::index, so that scans across stations stay cache-friendly.
+    // Only used in the default memory mode.
+    std::vector<FlowCounter> flowCounters_{};
+
+    // In compact mode, each station gets its own block of flow counters from
+    // this pool. Blocks are allocated concurrently by RecordPassengerEvent.
+    std::unique_ptr<std::pmr::synchronized_pool_resource> flowCounterPool_{nullptr};
+
+    // Stations by GraphNode::index.
+    std::vector<GraphNode*> stationsByIndex_{};
+
+    // Crowding tracking
+    // All stations are kept in an indexed max-heap keyed on their passenger
+    // count. Each heap entry caches the count it was sifted with, and we keep
+    // the position of each station in the heap so that we can sift it. Events
+    // do not touch the heap: They push their station, once, on a lock-free
+    // stack of stale stations, and GetBusiestStations sifts the stale
+    // stations before it reads the heap. The heap and the subscriptions are
+    // protected by crowdingMutex_.
+    struct CrowdingHeapEntry
+    {
+        long long int count{0};
+        std::size_t station{0};
+    };
+    // Subscription IDs pack the slot of the subscription (lower 32 bits) with
+    // the generation of the slot (upper 32 bits), so that the ID of a
+    // cancelled subscription does not match the next one in the same slot.
+    struct CrowdingSubscription
+    {
+        std::size_t station{0};
+        long long int high{0};
+        long long int low{0};
+        bool crowded{false};
+        CrowdingCallback callback{nullptr};
+        std::uint32_t generation{0};
+    };
+    mutable std::vector<CrowdingHeapEntry> crowdingHeap_{};
+    mutable std::vector<std::size_t> crowdingHeapPosition_{};
+    std::vector<CrowdingSubscription> crowdingSubscriptions_{};
+    std::vector<std::size_t> freeCrowdingSubscriptions_{};
+    std::unique_ptr<std::mutex> crowdingMutex_{std::make_unique<std::mutex>()};
+    std::unique_ptr<std::atomic<GraphNode*>> staleCrowdingStations_{std::make_unique<std::atomic<GraphNode*>>(nullptr)};
+
+    // Crowding-aware routing
+    // The searches run on a compact copy of the graph, in compressed sparse
+    // row form: The edges of station i are edges[edgeOffsets[i]] up to
+    // edges[edgeOffsets[i + 1]], in the order of GraphNode::edges. Unlike the
+    // arena graph, the copy stays in cache on large networks.
+    // The reversed edges, in the same form, lead the journey searches: They
+    // give the travel time left to the destination.
+    // The copy and the penalties are cleared when the topology, the travel
+    // times or the options change, and rebuilt by the next query. The const
+    // queries update this state under its mutex.
+    struct RoutingEdge
+    {
+        const RouteInternal* route{nullptr};
+        std::uint32_t nextStop{0};
+        std::uint32_t travelTime{0};
+    };
+    struct ReverseRoutingEdge
+    {
+        std::uint32_t previousStop{0};
+        std::uint32_t travelTime{0};
+    };
+    struct RoutingState
+    {
+        std::mutex mutex{};
+        CrowdingRoutingOptions options{};
+
+        std::vector<std::size_t> edgeOffsets{};
+        std::vector<RoutingEdge> edges{};
+        std::vector<std::size_t> reverseEdgeOffsets{};
+        std::vector<ReverseRoutingEdge> reverseEdges{};
+
+        // Crowding penalty of each station, by index, in minutes, with
+        // kCrowdedBit set if the station is crowded.
+        std::unique_ptr<std::atomic<std::uint32_t>[]> penalties{nullptr};
+
+        // Stations with a stale crowding penalty. The events push them
+        // without the mutex, the queries take them all at once.
+        std::atomic<GraphNode*> staleStations{nullptr};
+    };
+    std::unique_ptr<RoutingState> routing_{std::make_unique<RoutingState>()};
+
+    // Query result cache
+    // Stations are interned by their index and routes by their address, so a
+    // key is 16 bytes whatever the length of the IDs.
+    struct TravelTimeCacheKey
+    {
+        const RouteInternal* route{nullptr};
+        std::uint32_t stationA{0};
+        std::uint32_t stationB{0};
+
+        bool operator==(const TravelTimeCacheKey& other) const;
+    };
+    struct TravelTimeCacheKeyHash
+    {
+        std::size_t operator()(const TravelTimeCacheKey& key) const;
+    };
+    using TravelTimeCache = QueryCache<TravelTimeCacheKey, unsigned int, TravelTimeCacheKeyHash>;
+    std::unique_ptr<TravelTimeCache> travelTimeCache_{nullptr};
+
+    // Version of the topology and of the travel times, for the query cache.
+    std::uint64_t version_{0};
+
+    // Construct an object in the arena.
+    template <typename T, typename... Args>
+    T* MakeInArena(Args&&... args);
+
+    // Copy a string into the arena.
+    std::string_view CopyToArena(std::string_view text);
+
+    // Get the flow counters of a station: kFlowCountersPerStation counters.
+    // In compact mode, returns nullptr if the station has none yet, unless
+    // `create` is set.
+    FlowCounter* GetFlowCounters(GraphNode* station, bool create);
+    const FlowCounter* GetFlowCounters(const GraphNode* station) const;
 
     // Get station by ID.
-    std::shared_ptr<GraphNode> GetStation(const Id& stationId) const;
+    GraphNode* GetStation(std::string_view stationId) const;
 
     // Get line by ID.
-    std::shared_ptr<LineInternal> GetLine(const Id& lineId) const;
+    LineInternal* GetLine(std::string_view lineId) const;
 
     // Get route by ID.
-    std::shared_ptr<RouteInternal> GetRoute(const Id& lineId, const Id& routeId) const;
+    RouteInternal* GetRoute(std::string_view lineId, std::string_view routeId) const;
+
+    // Travel time queries on resolved stations. These do not allocate.
+    // A null `timeOfDay` asks for the static travel times.
+    unsigned int GetTravelTime(const GraphNode* stationA,
+                               const GraphNode* stationB,
+                               const std::uint32_t* timeOfDay) const;
+    unsigned int GetTravelTime(const RouteInternal* route,
+                               const GraphNode* stationA,
+                               const GraphNode* stationB,
+                               const std::uint32_t* timeOfDay) const;
+
+    // Static travel time query over a route, through the query cache if it is
+    // enabled.
+    unsigned int GetCachedTravelTime(const RouteInternal* route,
+                                     const GraphNode* stationA,
+                                     const GraphNode* stationB) const;
+
+    // Travel time of an edge at a time of day, in seconds since midnight.
+    unsigned int GetTravelTime(const GraphEdge& edge, std::uint32_t timeOfDay) const;
+
+    // Store a profile, or find an identical one, and return its index.
+    std::uint32_t AddTravelTimeProfile(const TravelTimeProfile& profile);
+
+    // Find the first edge between 2 stations, in either direction.
+    static const GraphEdge* FindEdge(const GraphNode* stationA, const GraphNode* stationB);
+
+    // Call `update` on all edges between 2 stations, in both directions.
+    // Returns false if there is no such edge.
+    template <typename Update>
+    static bool UpdateEdges(GraphNode* stationA, GraphNode* stationB, Update&& update);
 
     // This function adds a route to the internal line representation.
-    bool AddRouteToLine(const Route& route, const std::shared_ptr<LineInternal>& lineInternal);
+    bool AddRouteToLine(const Route& route, LineInternal* lineInternal);
+
+    // Remove a route from its line, with its edges and its inverted index
+    // entries.
+    void RemoveRoute(RouteInternal* route);
+
+    // Remove a station that no route serves. The last station takes its index.
+    void RemoveStation(GraphNode* station);
+
+    // List the stations served by the routes of a line.
+    void IndexLineStations(LineInternal* lineInternal);
+
+    // Flag the crowding heap entry of a station as stale and fire the crowding
+    // alerts after the passenger count of the station changed.
+    void UpdateCrowding(GraphNode* station);
+
+    // Sift the stale stations in the crowding heap.
+    // These must be called with crowdingMutex_ held, or while no other thread
+    // can access the network.
+    void RepairCrowdingHeap() const;
+
+    // Restore the heap property for the crowding heap entry at `position`.
+    void SiftCrowdingUp(std::size_t position) const;
+    void SiftCrowdingDown(std::size_t position) const;
+
+    // Flag the crowding penalty of a station as stale.
+    void MarkCrowdingPenaltyStale(GraphNode* station);
+
+    // Get the crowding penalty of a station, with the current options.
+    std::uint32_t GetCrowdingPenalty(const GraphNode* station) const;
+
+    // Bring the routing graph and the crowding penalties up to date.
+    // Must be called with the routing mutex held.
+    void UpdateRouting() const;
+
+    // Scratch space of the journey searches of a thread. Defined with the
+    // searches.
+    struct JourneySearch;
+
+    // Find the travel time to `stationB` of the stations up to `stationA`,
+    // by index, for the journey searches between them. Returns false if
+    // `stationA` cannot reach `stationB`.
+    bool FindJourneyBounds(std::size_t stationA, std::size_t stationB, JourneySearch& search) const;
+
+    // Find the cheapest journey between 2 stations, by index, as a sequence of
+    // routing edges. `search.extraCosts` are added to the edges.
+    bool FindCheapestJourney(std::size_t stationA,
+                             std::size_t stationB,
+                             JourneySearch& search,
+                             std::vector<std::size_t>& journey) const;
+
+    // Cost of a routing edge leaving `station`, without the extra costs.
+    unsigned int GetLegCost(std::size_t station, std::size_t edge) const;
+
+    // Count a passenger event in the flow buckets of a station.
+    void RecordPassengerFlow(GraphNode* station,
+                             PassengerEvent::Type type,
+                             std::chrono::system_clock::time_point timestamp);
+
+    // Add the flow of a station over a time window to `flow`.
+    void AddPassengerFlow(const GraphNode* station,
+                          FlowWindow window,
+                          std::chrono::system_clock::time_point at,
+                          PassengerFlow& flow) const;
+
+    // Passenger counts carried over from a station of another network with
+    // the same ID. The `baseline` is the count of the other station at the
+    // time we started carrying it over.
+    struct PassengerCountCarryOver
+    {
+        GraphNode* to{nullptr};
+        const GraphNode* from{nullptr};
+        long long int baseline{0};
+    };
+
+    // Copy the passenger counts of the stations of `other` onto the stations
+    // of this network with the same ID.
+    std::vector<PassengerCountCarryOver> BeginPassengerCountCarryOver(const TransportNetwork& other);
+
+    // Add the passenger events recorded on the other network since we started
+    // carrying the counts over. The other network must no longer be written
+    // to.
+    void EndPassengerCountCarryOver(const std::vector<PassengerCountCarryOver>& carryOver);
+
+    friend class LiveTransportNetwork;
 };
 
 } // namespace NetworkMonitor
@@ -5,48 +5,394 @@
 #include <boost/beast.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/system/error_code.hpp>
+#include <chrono>
+#include <cstddef>
 #include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace NetworkMonitor {
 
+class Histogram;
+
+/*! \brief Time limits for each phase of WebSocketClient::Connect.
+ *
+ *  A phase that takes longer than its limit fails with
+ *  boost::beast::error::timeout.
+ */
+struct ConnectionTimeouts
+{
+    std::chrono::milliseconds resolve{5000};
+    //! Limit for the TCP phase as a whole, across all connection attempts.
+    std::chrono::milliseconds connect{5000};
+    std::chrono::milliseconds tlsHandshake{5000};
+    std::chrono::milliseconds handshake{5000};
+
+    /*! \brief Delay before we start a connection attempt to the next resolved
+     *         address while the previous attempts are still pending.
+     *
+     *  Happy Eyeballs (RFC 8305) recommends 250 ms.
+     */
+    std::chrono::milliseconds connectionAttemptDelay{250};
+};
+
+/*! \brief Time spent in each phase of WebSocketClient::Connect.
+ *
+ *  A phase that failed reports the time until it failed. Phases that were
+ *  not reached are 0.
+ */
+struct ConnectionTiming
+{
+    std::chrono::nanoseconds resolve{0};
+    std::chrono::nanoseconds connect{0};
+    std::chrono::nanoseconds tlsHandshake{0};
+    std::chrono::nanoseconds handshake{0};
+
+    //! The resolved address we connected to, if any.
+    boost::asio::ip::tcp::endpoint endpoint{};
+
+    //! Number of TCP connection attempts we started.
+    std::size_t nAttempts{0};
+
+    //! Whether the TLS handshake resumed a saved session.
+    bool tlsSessionResumed{false};
+
+    /*! \brief Total time spent connecting.
+     */
+    std::chrono::nanoseconds Total() const;
+};
+
+/*! \brief Memory for the handler of one asynchronous operation at a time.
+ *
+ *  An operation that loops, like a read loop, can allocate its handler from
+ *  the same memory over and over, instead of from the heap. Requests that do
+ *  not fit, or that arrive while the memory is in use, go to the heap.
+ *
+ *  Not thread-safe: The operations that share a HandlerMemory must run on the
+ *  same strand.
+ */
+class HandlerMemory
+{
+public:
+    HandlerMemory() = default;
+
+    HandlerMemory(const HandlerMemory& other) = delete;
+    HandlerMemory& operator=(const HandlerMemory& other) = delete;
+
+    void* Allocate(std::size_t size);
+    void Deallocate(void* ptr);
+
+private:
+    static constexpr std::size_t kSize{1024};
+
+    alignas(std::max_align_t) unsigned char storage_[kSize];
+    bool inUse_{false};
+};
+
+/*! \brief Standard allocator over a HandlerMemory.
+ *
+ *  Asio allocates the state of an operation with the allocator associated to
+ *  its completion handler. A handler with an `allocator_type` and a
+ *  `get_allocator()` returning a HandlerAllocator recycles that memory.
+ */
+template <typename T>
+class HandlerAllocator
+{
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory)
+        : memory_{&memory}
+    {
+    }
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept
+        : memory_{other.memory_}
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(memory_->Allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* ptr, std::size_t /*n*/)
+    {
+        memory_->Deallocate(ptr);
+    }
+
+    bool operator==(const HandlerAllocator& other) const noexcept
+    {
+        return memory_ == other.memory_;
+    }
+
+    bool operator!=(const HandlerAllocator& other) const noexcept
+    {
+        return memory_ != other.memory_;
+    }
+
+private:
+    template <typename>
+    friend class HandlerAllocator;
+
+    HandlerMemory* memory_{nullptr};
+};
+
+/*! \brief Client for a WebSocket server over TLS.
+ *
+ *  The client has two interfaces:
+ *  - The callback interface (Connect, Send, Close) reads incoming messages in
+ *    a loop and forwards them to the onMessage callback.
+ *  - The asynchronous operations (AsyncConnect, AsyncRead, AsyncSend,
+ *    AsyncClose) take any Asio completion token. With
+ *    `boost::asio::use_awaitable`, a coroutine drives the client with
+ *    `co_await client.AsyncRead(boost::asio::use_awaitable)`. The caller
+ *    decides when to read.
+ *
+ *  The callback interface is built on the asynchronous operations. Its read
+ *  and write loops recycle the memory of their handlers: In the steady state,
+ *  the only allocation per received message is the string passed to
+ *  onMessage.
+ *
+ *  Do not mix the two interfaces on one connection. Like with any WebSocket
+ *  stream, only one read and one write can be pending at a time.
+ */
 class WebSocketClient
 {
 public:
+    /*! \brief Create a client. Does not connect yet.
+     *
+     *  TLS session resumption is enabled on `ctx`: Clients that connect to the
+     *  same host and port with the same context resume the TLS session of the
+     *  previous connection when the server allows it. See TlsContext.hpp.
+     */
     WebSocketClient(const std::string& url,
                     const std::string& endpoint,
                     const std::string& port,
                     boost::asio::io_context& ioc,
-                    boost::asio::ssl::context& ctx);
+                    boost::asio::ssl::context& ctx,
+                    const ConnectionTimeouts& timeouts = {});
 
     void Connect(std::function<void(boost::system::error_code)> onConnect = nullptr,
                  std::function<void(boost::system::error_code, std::string&&)> onMessage = nullptr,
                  std::function<void(boost::system::error_code)> onDisconnect = nullptr);
 
+    /*! \brief Connect, and report the time spent in each phase to onConnect.
+     *
+     *  The timing report is also delivered when the connection fails.
+     */
+    void ConnectWithTiming(std::function<void(boost::system::error_code, const ConnectionTiming&)> onConnect,
+                           std::function<void(boost::system::error_code, std::string&&)> onMessage = nullptr,
+                           std::function<void(boost::system::error_code)> onDisconnect = nullptr);
+
+    /*! \brief Send a message.
+     *
+     *  The message must stay alive until onSend is called.
+     */
     void Send(const std::string& message, std::function<void(boost::system::error_code)> onSend = nullptr);
+
     void Close(std::function<void(boost::system::error_code)> onClose = nullptr);
 
+    /*! \brief Connect to the server, without starting a read loop.
+     *
+     *  Completes with `void(boost::system::error_code, ConnectionTiming)`.
+     *  Read the incoming messages with AsyncRead.
+     */
+    template <typename CompletionToken>
+    auto AsyncConnect(CompletionToken&& token)
+    {
+        using Signature = void(boost::system::error_code, ConnectionTiming);
+        return boost::asio::async_initiate<CompletionToken, Signature>(
+            [this](auto handler) {
+                // The handler may be move-only: We share it to store it in
+                // onConnect_. Connecting is not on the hot path.
+                auto shared{std::make_shared<decltype(handler)>(std::move(handler))};
+                StartConnect(nullptr, nullptr, [this, shared](auto ec, const auto& timing) {
+                    auto executor{boost::asio::get_associated_executor(*shared, strand_)};
+                    boost::asio::dispatch(executor, [shared, ec, timing]() { (*shared)(ec, timing); });
+                });
+            },
+            token);
+    }
+
+    /*! \brief Read the next message.
+     *
+     *  Completes with `void(boost::system::error_code, std::string_view)`. The
+     *  view points into the read buffer of the client: It stays valid until
+     *  the next read.
+     */
+    template <typename CompletionToken>
+    auto AsyncRead(CompletionToken&& token)
+    {
+        using Signature = void(boost::system::error_code, std::string_view);
+        return boost::asio::async_compose<CompletionToken, Signature>(ReadOp{this}, token, ws_);
+    }
+
+    /*! \brief Send a message.
+     *
+     *  Completes with `void(boost::system::error_code)`. The message must stay
+     *  alive until then.
+     */
+    template <typename CompletionToken>
+    auto AsyncSend(std::string_view message, CompletionToken&& token)
+    {
+        using Signature = void(boost::system::error_code);
+        return boost::asio::async_compose<CompletionToken, Signature>(WriteOp{this, message}, token, ws_);
+    }
+
+    /*! \brief Close the connection.
+     *
+     *  Completes with `void(boost::system::error_code)`.
+     */
+    template <typename CompletionToken>
+    auto AsyncClose(CompletionToken&& token)
+    {
+        closed_ = true;
+        using Signature = void(boost::system::error_code);
+        return boost::asio::async_compose<CompletionToken, Signature>(CloseOp{this}, token, ws_);
+    }
+
 private:
-    void OnResolve(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator resolverIt);
+    // Composed operations behind AsyncRead, AsyncSend and AsyncClose.
+    // Their state is carried by value through the stream operations, so they
+    // do not allocate by themselves.
+    struct ReadOp
+    {
+        WebSocketClient* client{nullptr};
+        bool started{false};
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {}, std::size_t nBytes = 0)
+        {
+            if(!started)
+            {
+                // The previous message was handed out as a view: We only
+                // drop it now.
+                started = true;
+                client->rBuffer_.consume(client->rBuffer_.size());
+                client->ws_.async_read(client->rBuffer_, std::move(self));
+                return;
+            }
+            const auto data{client->rBuffer_.data()};
+            self.complete(ec, std::string_view{static_cast<const char*>(data.data()), ec ? 0 : nBytes});
+        }
+    };
+
+    struct WriteOp
+    {
+        WebSocketClient* client{nullptr};
+        std::string_view message{};
+        bool started{false};
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {}, std::size_t /*nBytes*/ = 0)
+        {
+            if(!started)
+            {
+                started = true;
+                client->ws_.async_write(boost::asio::buffer(message.data(), message.size()), std::move(self));
+                return;
+            }
+            self.complete(ec);
+        }
+    };
+
+    struct CloseOp
+    {
+        WebSocketClient* client{nullptr};
+        bool started{false};
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {})
+        {
+            if(!started)
+            {
+                started = true;
+                client->ws_.async_close(boost::beast::websocket::close_code::none, std::move(self));
+                return;
+            }
+            self.complete(ec);
+        }
+    };
+
+    // Completion handlers of the callback interface. They allocate from the
+    // memory of their loop.
+    struct ReadLoopHandler;
+    struct SendHandler;
+
+    void StartConnect(std::function<void(boost::system::error_code, std::string&&)> onMessage,
+                      std::function<void(boost::system::error_code)> onDisconnect,
+                      std::function<void(boost::system::error_code, const ConnectionTiming&)> onConnect);
+
+    void OnResolve(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results);
+    void StartConnectionAttempt();
+    void OnConnectionAttempt(const boost::system::error_code& ec, std::size_t attempt);
     void OnConnect(const boost::system::error_code& ec);
     void OnHandshake(const boost::system::error_code& ec);
     void OnTlsHandshake(const boost::system::error_code& ec);
     void ListenToIncomingMessage(const boost::system::error_code& ec);
-    void OnRead(const boost::system::error_code& ec, size_t nBytes);
+    void OnRead(const boost::system::error_code& ec, std::string_view message);
+
+    // Phase timeouts and timings.
+    // `duration` is the timing_ field of the phase.
+    void StartPhase(std::chrono::nanoseconds& duration,
+                    std::chrono::milliseconds timeout,
+                    std::function<void()> onTimeout);
+    void EndPhase(Histogram& histogram);
+    void OnConnectError(const boost::system::error_code& ec);
 
     std::string url_{};
     std::string endpoint_{};
     std::string port_{};
+    ConnectionTimeouts timeouts_{};
+
+    // All handlers run on this strand.
+    // The streams use the strand type as their executor type. Wrapping the
+    // strand in the type-erased executor of tcp::socket would allocate a copy
+    // of the strand for each asynchronous operation.
+    using Strand = boost::asio::strand<boost::asio::io_context::executor_type>;
+    using Socket = boost::asio::ip::tcp::socket::rebind_executor<Strand>::other;
+    using Stream = boost::beast::websocket::stream<
+        boost::beast::ssl_stream<boost::beast::basic_stream<boost::asio::ip::tcp, Strand> > >;
+
+    Strand strand_;
 
     boost::asio::ip::tcp::resolver resolver_;
-    boost::beast::websocket::stream<boost::beast::ssl_stream<boost::beast::tcp_stream> > ws_;
+    Stream ws_;
+
+    // Happy Eyeballs state: The resolved addresses, in the order we try them,
+    // and one socket per attempt. The first socket to connect is moved into
+    // ws_, the others are closed.
+    std::vector<boost::asio::ip::tcp::endpoint> endpoints_{};
+    std::vector<std::unique_ptr<Socket> > attempts_{};
+    std::size_t nPendingAttempts_{0};
+    bool connecting_{false};
+    boost::system::error_code lastAttemptError_{};
+    boost::asio::steady_timer attemptTimer_;
+
+    // Bounds the resolve and TCP phases. The TLS and WebSocket handshakes use
+    // the stream timeouts instead.
+    boost::asio::steady_timer phaseTimer_;
+    bool phaseTimedOut_{false};
+
+    std::chrono::steady_clock::time_point phaseStart_{};
+    std::chrono::nanoseconds* phaseDuration_{nullptr};
+    ConnectionTiming timing_{};
 
     boost::beast::flat_buffer rBuffer_{};
     bool closed_{true};
 
-    std::function<void(boost::system::error_code)> onConnect_{nullptr};
+    // Handler memory of the read loop and of Send.
+    HandlerMemory readMemory_{};
+    HandlerMemory writeMemory_{};
+
+    std::function<void(boost::system::error_code, const ConnectionTiming&)> onConnect_{nullptr};
     std::function<void(boost::system::error_code, std::string&&)> onMessage_{nullptr};
     std::function<void(boost::system::error_code)> onDisconnect_{nullptr};
 };
 
-} // namespace NetworkMonitor
\ No newline at end of file
+} // namespace NetworkMonitor
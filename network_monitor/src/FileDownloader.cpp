@@ -2,8 +2,42 @@
 
 #include <curl/curl.h>
 
+#include <chrono>
 #include <fstream>
 
+#include "Metrics.hpp"
+
+using NetworkMonitor::Counter;
+using NetworkMonitor::Histogram;
+using NetworkMonitor::MetricsRegistry;
+using NetworkMonitor::ScopedTimer;
+
+namespace {
+
+// Metrics shared by all downloads, looked up once.
+struct FileDownloaderMetrics
+{
+    Histogram& downloadTime;
+    Counter& downloadedBytes;
+    Counter& downloadErrors;
+    Histogram& parseTime;
+};
+
+const FileDownloaderMetrics& GetMetrics()
+{
+    static const FileDownloaderMetrics metrics{[]() {
+        auto& registry{MetricsRegistry::Default()};
+        return FileDownloaderMetrics{
+            registry.GetHistogram("network_monitor_download_seconds", "Time spent in DownloadFile.", 1e-9),
+            registry.GetCounter("network_monitor_downloaded_bytes_total", "Number of bytes downloaded."),
+            registry.GetCounter("network_monitor_download_errors_total", "Number of failed downloads."),
+            registry.GetHistogram("network_monitor_parse_json_seconds", "Time spent in ParseJsonFile.", 1e-9),
+        };
+    }()};
+    return metrics;
+}
+
+} // namespace
 
 bool NetworkMonitor::DownloadFile(const std::string& fileUrl,
                                   const std::filesystem::path& destination,
@@ -34,7 +68,23 @@ bool NetworkMonitor::DownloadFile(const std::string& fileUrl,
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
 
     // Perform the request.
+    const bool measure{MetricsRegistry::Default().IsEnabled()};
+    const auto start{measure ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{}};
     CURLcode res = curl_easy_perform(curl);
+    if(measure)
+    {
+        const auto& metrics{GetMetrics()};
+        metrics.downloadTime.Record(std::chrono::steady_clock::now() - start);
+        curl_off_t nBytes{0};
+        if(curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &nBytes) == CURLE_OK && nBytes > 0)
+        {
+            metrics.downloadedBytes.Increment(static_cast<std::uint64_t>(nBytes));
+        }
+        if(res != CURLE_OK)
+        {
+            metrics.downloadErrors.Increment();
+        }
+    }
     curl_easy_cleanup(curl);
 
     // Close the file.
@@ -45,6 +95,7 @@ bool NetworkMonitor::DownloadFile(const std::string& fileUrl,
 
 nlohmann::json NetworkMonitor::ParseJsonFile(const std::filesystem::path& source)
 {
+    ScopedTimer timer{GetMetrics().parseTime};
     nlohmann::json parsed{};
     if(!std::filesystem::exists(source))
     {
@@ -0,0 +1,135 @@
+#include "LiveTransportNetwork.hpp"
+
+#include <functional>
+#include <thread>
+#include <utility>
+
+using NetworkMonitor::LiveTransportNetwork;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::TransportNetwork;
+
+// LiveTransportNetwork::Snapshot
+
+LiveTransportNetwork::Snapshot::Snapshot(std::atomic<std::uint64_t>* slot, Published* published)
+    : slot_{slot}
+    , published_{published}
+{
+}
+
+LiveTransportNetwork::Snapshot::Snapshot(Snapshot&& other) noexcept
+    : slot_{std::exchange(other.slot_, nullptr)}
+    , published_{std::exchange(other.published_, nullptr)}
+{
+}
+
+LiveTransportNetwork::Snapshot::~Snapshot()
+{
+    if(slot_ != nullptr)
+    {
+        slot_->store(0, std::memory_order_release);
+    }
+}
+
+const TransportNetwork& LiveTransportNetwork::Snapshot::operator*() const
+{
+    return published_->network;
+}
+
+const TransportNetwork* LiveTransportNetwork::Snapshot::operator->() const
+{
+    return &published_->network;
+}
+
+std::uint64_t LiveTransportNetwork::Snapshot::GetVersion() const
+{
+    return published_->version;
+}
+
+// LiveTransportNetwork
+
+LiveTransportNetwork::LiveTransportNetwork(TransportNetwork&& network)
+    : current_{new Published{std::move(network), 1}}
+{
+}
+
+LiveTransportNetwork::~LiveTransportNetwork()
+{
+    delete current_.load();
+}
+
+LiveTransportNetwork::Snapshot LiveTransportNetwork::GetSnapshot() const
+{
+    // Start from a different slot on each thread to limit contention.
+    const auto start{std::hash<std::thread::id>{}(std::this_thread::get_id()) % kMaxReaders};
+    for(std::size_t attempt{0};; ++attempt)
+    {
+        // We must announce our epoch before we load the current network. A
+        // publisher that replaces the network after we loaded it will then see
+        // our slot, and wait for us.
+        auto& slot{readers_[(start + attempt) % kMaxReaders].epoch};
+        std::uint64_t unused{0};
+        if(slot.load(std::memory_order_relaxed) == unused && slot.compare_exchange_strong(unused, epoch_.load()))
+        {
+            return Snapshot{&slot, current_.load()};
+        }
+
+        // All slots are taken: Give the other readers a chance to finish.
+        if((attempt + 1) % kMaxReaders == 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool LiveTransportNetwork::RecordPassengerEvent(const PassengerEvent& event)
+{
+    // Passenger counts are atomic, so we can update them from a snapshot.
+    auto snapshot{GetSnapshot()};
+    return snapshot.published_->network.RecordPassengerEvent(event);
+}
+
+std::uint64_t LiveTransportNetwork::Publish(TransportNetwork&& network)
+{
+    std::lock_guard<std::mutex> lock{publishMutex_};
+
+    // Only publishers modify current_, and we hold the lock.
+    auto* old{current_.load(std::memory_order_relaxed)};
+    auto* next{new Published{std::move(network), old->version + 1}};
+
+    // We copy the counts before we publish the new network, so that readers
+    // never see it without them. Events recorded on the old network in the
+    // meantime are added after the grace period, when no one can write to the
+    // old network anymore.
+    auto carryOver{next->network.BeginPassengerCountCarryOver(old->network)};
+    current_.store(next);
+    WaitForReaders();
+    next->network.EndPassengerCountCarryOver(carryOver);
+
+    delete old;
+    return next->version;
+}
+
+std::uint64_t LiveTransportNetwork::GetVersion() const
+{
+    return GetSnapshot().GetVersion();
+}
+
+void LiveTransportNetwork::WaitForReaders()
+{
+    // Any reader that started in an epoch before this one might have loaded
+    // the network we just replaced. Readers that start from now on can only
+    // load the new one.
+    const auto epoch{epoch_.fetch_add(1) + 1};
+    for(auto& reader : readers_)
+    {
+        while(true)
+        {
+            const auto readerEpoch{reader.epoch.load()};
+            if(readerEpoch == 0 || readerEpoch >= epoch)
+            {
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,283 @@
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <utility>
+
+using NetworkMonitor::LogLevel;
+using NetworkMonitor::Logger;
+
+namespace {
+
+const char* ToString(LogLevel level)
+{
+    switch(level)
+    {
+        case LogLevel::Debug:
+            return "DEBUG";
+        case LogLevel::Info:
+            return "INFO";
+        case LogLevel::Warning:
+            return "WARNING";
+        case LogLevel::Error:
+            return "ERROR";
+        default:
+            return "";
+    }
+}
+
+void WriteToStderr(std::string_view line)
+{
+    std::cerr << line << '\n';
+}
+
+} // namespace
+
+Logger::Logger(std::size_t capacity, OverflowPolicy policy, Sink sink)
+    : policy_{policy}
+    , sink_{sink ? std::move(sink) : WriteToStderr}
+{
+    std::size_t size{1};
+    while(size < std::max<std::size_t>(capacity, 2))
+    {
+        size *= 2;
+    }
+    cells_ = std::make_unique<Cell[]>(size);
+    for(std::size_t idx{0}; idx < size; ++idx)
+    {
+        cells_[idx].sequence.store(idx, std::memory_order_relaxed);
+    }
+    mask_ = size - 1;
+
+    worker_ = std::thread{[this]() { Run(); }};
+}
+
+Logger::~Logger()
+{
+    {
+        std::lock_guard<std::mutex> lock{wakeMutex_};
+        stop_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+}
+
+Logger& Logger::Default()
+{
+    static Logger logger{};
+    return logger;
+}
+
+void Logger::SetLevel(LogLevel level)
+{
+    level_.store(level, std::memory_order_relaxed);
+}
+
+bool Logger::IsEnabled(LogLevel level) const
+{
+    return level >= kCompiledLogLevel && level >= level_.load(std::memory_order_relaxed) && level != LogLevel::Off;
+}
+
+void Logger::SetSink(Sink sink)
+{
+    std::lock_guard<std::mutex> lock{sinkMutex_};
+    sink_ = sink ? std::move(sink) : WriteToStderr;
+}
+
+void Logger::Write(LogLevel level, const char* where, boost::system::error_code ec)
+{
+    Push([level, where, &ec](Record& record) {
+        record.level = level;
+        record.where = where;
+        record.hasErrorCode = true;
+        record.errorValue = ec.value();
+        record.category = &ec.category();
+        record.messageSize = 0;
+    });
+}
+
+void Logger::Write(LogLevel level, const char* where, std::string_view message)
+{
+    Push([level, where, message](Record& record) {
+        record.level = level;
+        record.where = where;
+        record.hasErrorCode = false;
+        record.messageSize = static_cast<std::uint8_t>(std::min(message.size(), kMaxMessageSize));
+        std::memcpy(record.message, message.data(), record.messageSize);
+    });
+}
+
+void Logger::Flush()
+{
+    const auto target{enqueuePos_.load(std::memory_order_acquire)};
+    Wake();
+    while(dequeuePos_.load(std::memory_order_acquire) < target)
+    {
+        std::this_thread::yield();
+    }
+
+    // The last record was dequeued, but it might still be in the sink.
+    std::lock_guard<std::mutex> lock{sinkMutex_};
+}
+
+std::uint64_t Logger::GetDroppedCount() const
+{
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+template <typename Fill>
+void Logger::Push(Fill&& fill)
+{
+    const auto timestamp{std::chrono::system_clock::now().time_since_epoch()};
+    auto pos{enqueuePos_.load(std::memory_order_relaxed)};
+    while(true)
+    {
+        auto& cell{cells_[pos & mask_]};
+        const auto sequence{cell.sequence.load(std::memory_order_acquire)};
+        const auto diff{static_cast<std::int64_t>(sequence - pos)};
+        if(diff == 0)
+        {
+            // The cell is free for this position: Try to claim it.
+            if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                cell.record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp).count();
+                fill(cell.record);
+
+                // Sequentially consistent, like sleeping_: Either the
+                // background thread sees the record before it waits, or we
+                // see it sleeping.
+                cell.sequence.store(pos + 1);
+                Wake();
+                return;
+            }
+        }
+        else if(diff < 0)
+        {
+            // The buffer is full.
+            if(policy_ == OverflowPolicy::Drop)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            Wake();
+            std::this_thread::yield();
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            // Another producer claimed this position.
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::Wake()
+{
+    if(!sleeping_.load())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{wakeMutex_};
+        sleeping_.store(false, std::memory_order_relaxed);
+    }
+    wake_.notify_one();
+}
+
+void Logger::Run()
+{
+    while(true)
+    {
+        if(Drain() > 0)
+        {
+            continue;
+        }
+        if(stop_)
+        {
+            // Records logged right before the stop request are still drained.
+            Drain();
+            return;
+        }
+
+        // Nothing to do: Wait until a producer wakes us up. We check for a
+        // record once more after setting sleeping_, to catch the records
+        // whose producers did not see it set.
+        std::unique_lock<std::mutex> lock{wakeMutex_};
+        sleeping_.store(true);
+        const auto pos{dequeuePos_.load(std::memory_order_relaxed)};
+        if(cells_[pos & mask_].sequence.load() != pos + 1)
+        {
+            wake_.wait(lock, [this]() { return !sleeping_.load(std::memory_order_relaxed) || stop_; });
+        }
+        sleeping_.store(false, std::memory_order_relaxed);
+    }
+}
+
+std::size_t Logger::Drain()
+{
+    std::lock_guard<std::mutex> lock{sinkMutex_};
+    std::string line{};
+    std::size_t nDrained{0};
+    auto pos{dequeuePos_.load(std::memory_order_relaxed)};
+    while(true)
+    {
+        auto& cell{cells_[pos & mask_]};
+        if(cell.sequence.load(std::memory_order_acquire) != pos + 1)
+        {
+            break;
+        }
+        Format(cell.record, line);
+
+        // Hand the cell back to the producers before calling the sink, so
+        // that a slow sink does not hold on to it.
+        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        ++pos;
+        ++nDrained;
+        sink_(line);
+        dequeuePos_.store(pos, std::memory_order_release);
+    }
+    return nDrained;
+}
+
+void Logger::Format(const Record& record, std::string& line)
+{
+    const std::chrono::system_clock::time_point timestamp{
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds{record.timestamp})};
+    const auto time{std::chrono::system_clock::to_time_t(timestamp)};
+    const auto micros{std::chrono::duration_cast<std::chrono::microseconds>(timestamp.time_since_epoch()).count() %
+                      1000000};
+    std::tm tm{};
+#if defined(_WIN32)
+    gmtime_s(&tm, &time);
+#else
+    gmtime_r(&time, &tm);
+#endif
+
+    // We format into a fixed buffer to keep the background thread cheap.
+    char prefix[96]{};
+    const auto prefixSize{std::snprintf(prefix,
+                                        sizeof(prefix),
+                                        "%04d-%02d-%02dT%02d:%02d:%02d.%06dZ %7s [%20s] ",
+                                        tm.tm_year + 1900,
+                                        tm.tm_mon + 1,
+                                        tm.tm_mday,
+                                        tm.tm_hour,
+                                        tm.tm_min,
+                                        tm.tm_sec,
+                                        static_cast<int>(micros),
+                                        ToString(record.level),
+                                        record.where)};
+    line.assign(prefix, static_cast<std::size_t>(std::clamp(prefixSize, 0, static_cast<int>(sizeof(prefix) - 1))));
+    if(record.hasErrorCode)
+    {
+        const boost::system::error_code ec{record.errorValue, *record.category};
+        line += ec ? "Error: " + ec.message() : "OK";
+    }
+    else
+    {
+        line.append(record.message, record.messageSize);
+    }
+}
@@ -0,0 +1,428 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+using NetworkMonitor::Counter;
+using NetworkMonitor::Gauge;
+using NetworkMonitor::Histogram;
+using NetworkMonitor::MetricsRegistry;
+using NetworkMonitor::ScopedTimer;
+
+namespace {
+
+// Index of the most significant bit set. `value` must not be 0.
+std::size_t GetMostSignificantBit(std::uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - static_cast<std::size_t>(__builtin_clzll(value));
+#else
+    std::size_t msb{0};
+    while(value >>= 1)
+    {
+        ++msb;
+    }
+    return msb;
+#endif
+}
+
+// Each thread always increments the same counter shard. We hand out shards
+// round-robin, which spreads threads more evenly than hashing their IDs.
+std::size_t GetThreadShard()
+{
+    static std::atomic<std::size_t> nextShard{0};
+    thread_local const std::size_t shard{nextShard.fetch_add(1, std::memory_order_relaxed)};
+    return shard;
+}
+
+// Print a sample value: integers as such, everything else with enough digits
+// to tell neighbouring buckets apart.
+void WriteValue(std::ostream& os, double value)
+{
+    if(value == std::floor(value) && std::abs(value) < 1e15)
+    {
+        os << static_cast<long long>(value);
+        return;
+    }
+    char buffer[32]{};
+    std::snprintf(buffer, sizeof(buffer), "%.10g", value);
+    os << buffer;
+}
+
+// HELP lines must escape backslashes and new lines.
+std::string EscapeHelp(const std::string& help)
+{
+    std::string escaped{};
+    escaped.reserve(help.size());
+    for(auto c : help)
+    {
+        switch(c)
+        {
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            default:
+                escaped += c;
+        }
+    }
+    return escaped;
+}
+
+// Write `name{labels,extra}`, leaving the braces out if there are no labels.
+void WriteSeries(std::ostream& os, const std::string& name, const std::string& labels, const std::string& extra = {})
+{
+    os << name;
+    if(labels.empty() && extra.empty())
+    {
+        return;
+    }
+    os << '{' << labels;
+    if(!labels.empty() && !extra.empty())
+    {
+        os << ',';
+    }
+    os << extra << '}';
+}
+
+} // namespace
+
+// Counter
+
+void Counter::Increment(std::uint64_t n)
+{
+    shards_[GetThreadShard() % kShards].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+std::uint64_t Counter::Get() const
+{
+    std::uint64_t total{0};
+    for(const auto& shard : shards_)
+    {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+// Gauge
+
+void Gauge::Set(std::int64_t value)
+{
+    value_.store(value, std::memory_order_relaxed);
+}
+
+void Gauge::Add(std::int64_t n)
+{
+    value_.fetch_add(n, std::memory_order_relaxed);
+}
+
+std::int64_t Gauge::Get() const
+{
+    return value_.load(std::memory_order_relaxed);
+}
+
+// Histogram
+
+Histogram::Histogram(double unit)
+    : unit_{unit}
+{
+}
+
+void Histogram::Record(std::uint64_t value)
+{
+    buckets_[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+std::uint64_t Histogram::GetCount() const
+{
+    std::uint64_t count{0};
+    for(const auto& bucket : buckets_)
+    {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+std::uint64_t Histogram::GetSum() const
+{
+    return sum_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Histogram::GetPercentile(double q) const
+{
+    const auto count{GetCount()};
+    if(count == 0)
+    {
+        return 0;
+    }
+    const auto rank{std::max<std::uint64_t>(
+        1, static_cast<std::uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count))))};
+    std::uint64_t seen{0};
+    for(std::size_t bucket{0}; bucket < kBuckets; ++bucket)
+    {
+        seen += buckets_[bucket].load(std::memory_order_relaxed);
+        if(seen >= rank)
+        {
+            return GetBucketEnd(bucket) - 1;
+        }
+    }
+
+    // Values recorded while we were reading the buckets can push the rank
+    // past what we have seen.
+    return std::numeric_limits<std::uint64_t>::max();
+}
+
+double Histogram::GetUnit() const
+{
+    return unit_;
+}
+
+std::vector<std::uint64_t> Histogram::GetCumulativeCounts() const
+{
+    std::array<std::uint64_t, kBuckets> counts{};
+    std::size_t last{0};
+    bool empty{true};
+    for(std::size_t bucket{0}; bucket < kBuckets; ++bucket)
+    {
+        counts[bucket] = buckets_[bucket].load(std::memory_order_relaxed);
+        if(counts[bucket] != 0)
+        {
+            last = bucket;
+            empty = false;
+        }
+    }
+    if(empty)
+    {
+        return {};
+    }
+
+    // Bucket boundaries fall on every power of 2, so the counts below 2^i are
+    // exact.
+    const auto highest{GetMostSignificantBit(GetBucketEnd(last) - 1) + 1};
+    std::vector<std::uint64_t> cumulative(highest + 1, 0);
+    std::uint64_t seen{0};
+    std::size_t bucket{0};
+    for(std::size_t power{0}; power <= highest; ++power)
+    {
+        const auto end{power < 64 ? GetBucket(std::uint64_t{1} << power) : kBuckets};
+        for(; bucket < end; ++bucket)
+        {
+            seen += counts[bucket];
+        }
+        cumulative[power] = seen;
+    }
+    return cumulative;
+}
+
+std::size_t Histogram::GetBucket(std::uint64_t value)
+{
+    if(value < kSubBuckets)
+    {
+        return static_cast<std::size_t>(value);
+    }
+    const auto msb{GetMostSignificantBit(value)};
+    const auto subBucket{static_cast<std::size_t>(value >> (msb - kSubBucketBits)) - kSubBuckets};
+    return kSubBuckets + (msb - kSubBucketBits) * kSubBuckets + subBucket;
+}
+
+std::uint64_t Histogram::GetBucketEnd(std::size_t bucket)
+{
+    if(bucket < kSubBuckets)
+    {
+        return bucket + 1;
+    }
+    if(bucket == kBuckets - 1)
+    {
+        return std::numeric_limits<std::uint64_t>::max();
+    }
+    const auto shift{(bucket - kSubBuckets) / kSubBuckets};
+    const auto subBucket{(bucket - kSubBuckets) % kSubBuckets};
+    return (std::uint64_t{kSubBuckets + subBucket + 1}) << shift;
+}
+
+// MetricsRegistry
+
+MetricsRegistry& MetricsRegistry::Default()
+{
+    static MetricsRegistry registry{};
+    return registry;
+}
+
+void MetricsRegistry::SetEnabled(bool enabled)
+{
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+Counter& MetricsRegistry::GetCounter(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& metric{GetFamily(name, help, Type::Counter).counters[labels]};
+    if(metric == nullptr)
+    {
+        metric = std::make_unique<Counter>();
+    }
+    return *metric;
+}
+
+Gauge& MetricsRegistry::GetGauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& metric{GetFamily(name, help, Type::Gauge).gauges[labels]};
+    if(metric == nullptr)
+    {
+        metric = std::make_unique<Gauge>();
+    }
+    return *metric;
+}
+
+Histogram& MetricsRegistry::GetHistogram(const std::string& name,
+                                         const std::string& help,
+                                         double unit,
+                                         const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& metric{GetFamily(name, help, Type::Histogram).histograms[labels]};
+    if(metric == nullptr)
+    {
+        metric = std::make_unique<Histogram>(unit);
+    }
+    return *metric;
+}
+
+void MetricsRegistry::Export(std::ostream& os) const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    for(const auto& [name, family] : families_)
+    {
+        os << "# HELP " << name << ' ' << EscapeHelp(family.help) << '\n';
+        switch(family.type)
+        {
+            case Type::Counter:
+                os << "# TYPE " << name << " counter\n";
+                for(const auto& [labels, counter] : family.counters)
+                {
+                    WriteSeries(os, name, labels);
+                    os << ' ' << counter->Get() << '\n';
+                }
+                break;
+            case Type::Gauge:
+                os << "# TYPE " << name << " gauge\n";
+                for(const auto& [labels, gauge] : family.gauges)
+                {
+                    WriteSeries(os, name, labels);
+                    os << ' ' << gauge->Get() << '\n';
+                }
+                break;
+            case Type::Histogram:
+                os << "# TYPE " << name << " histogram\n";
+                for(const auto& [labels, histogram] : family.histograms)
+                {
+                    // Values are integers, so "below 2^i" is "at most 2^i - 1".
+                    const auto unit{histogram->GetUnit()};
+                    const auto cumulative{histogram->GetCumulativeCounts()};
+                    for(std::size_t power{1}; power < cumulative.size(); ++power)
+                    {
+                        std::ostringstream le{};
+                        le << "le=\"";
+                        WriteValue(le, (std::ldexp(1.0, static_cast<int>(power)) - 1.0) * unit);
+                        le << '"';
+                        WriteSeries(os, name + "_bucket", labels, le.str());
+                        os << ' ' << cumulative[power] << '\n';
+                    }
+
+                    // The count and the +Inf bucket must match, even if values
+                    // were recorded while we exported the other buckets.
+                    const auto count{cumulative.empty() ? 0 : cumulative.back()};
+                    WriteSeries(os, name + "_bucket", labels, "le=\"+Inf\"");
+                    os << ' ' << count << '\n';
+                    WriteSeries(os, name + "_sum", labels);
+                    os << ' ';
+                    WriteValue(os, static_cast<double>(histogram->GetSum()) * unit);
+                    os << '\n';
+                    WriteSeries(os, name + "_count", labels);
+                    os << ' ' << count << '\n';
+                }
+                break;
+        }
+    }
+}
+
+std::string MetricsRegistry::Export() const
+{
+    std::ostringstream os{};
+    Export(os);
+    return os.str();
+}
+
+void MetricsRegistry::Export(const ExportCallback& callback) const
+{
+    if(callback)
+    {
+        callback(Export());
+    }
+}
+
+bool MetricsRegistry::Export(const std::filesystem::path& destination) const
+{
+    auto temporary{destination};
+    temporary += ".tmp";
+    {
+        std::ofstream file{temporary, std::ios::trunc};
+        if(!file)
+        {
+            return false;
+        }
+        Export(file);
+        if(!file.flush())
+        {
+            return false;
+        }
+    }
+    std::error_code ec{};
+    std::filesystem::rename(temporary, destination, ec);
+    return !ec;
+}
+
+MetricsRegistry::Family& MetricsRegistry::GetFamily(const std::string& name, const std::string& help, Type type)
+{
+    auto [it, inserted]{families_.try_emplace(name)};
+    auto& family{it->second};
+    if(inserted)
+    {
+        family.type = type;
+        family.help = help;
+    }
+    else if(family.type != type)
+    {
+        throw std::logic_error("Metric already registered with another type: " + name);
+    }
+    return family;
+}
+
+// ScopedTimer
+
+ScopedTimer::ScopedTimer(Histogram& histogram)
+{
+    if(MetricsRegistry::Default().IsEnabled())
+    {
+        histogram_ = &histogram;
+        start_ = std::chrono::steady_clock::now();
+    }
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    if(histogram_ != nullptr)
+    {
+        histogram_->Record(std::chrono::steady_clock::now() - start_);
+    }
+}
@@ -0,0 +1,288 @@
+#include "NetworkLayoutGenerator.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using NetworkMonitor::Id;
+using NetworkMonitor::Line;
+using NetworkMonitor::NetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::Route;
+using NetworkMonitor::Station;
+using NetworkMonitor::StationTravelTime;
+
+namespace {
+
+// Number of digits we pad IDs to, so that they sort in creation order. We use
+// at least 3, like the layout files of the network operator.
+std::size_t GetIdWidth(std::size_t count)
+{
+    std::size_t width{1};
+    for(auto max{count > 0 ? count - 1 : 0}; max >= 10; max /= 10)
+    {
+        ++width;
+    }
+    return std::max<std::size_t>(width, 3);
+}
+
+std::string MakeId(const std::string& prefix, std::size_t idx, std::size_t width)
+{
+    auto number{std::to_string(idx)};
+    if(number.size() < width)
+    {
+        number.insert(0, width - number.size(), '0');
+    }
+    return prefix + number;
+}
+
+void CheckOptions(const NetworkLayoutOptions& options)
+{
+    if(options.routeLength < 2)
+    {
+        throw std::invalid_argument("Routes need at least 2 stops");
+    }
+    if(options.nLines > 0 && options.routeLength > options.nStations)
+    {
+        throw std::invalid_argument("Routes cannot have more stops than the network has stations");
+    }
+    if(options.nLines > 0 && options.routesPerLine == 0)
+    {
+        throw std::invalid_argument("Lines need at least 1 route");
+    }
+    if(!(options.interchangeDensity >= 0.0 && options.interchangeDensity <= 1.0))
+    {
+        throw std::invalid_argument("The interchange density must be in [0, 1]");
+    }
+    if(options.minTravelTime == 0 || options.minTravelTime > options.maxTravelTime)
+    {
+        throw std::invalid_argument("Travel times must be in [1, maxTravelTime]");
+    }
+}
+
+// Pick the stations of each line, in order. A line only visits a station once.
+class LinePlanner
+{
+public:
+    LinePlanner(const NetworkLayoutOptions& options, std::mt19937_64& rng)
+        : options_{options}
+        , rng_{rng}
+        , order_(options.nStations)
+        , lineOf_(options.nStations, kNoLine)
+    {
+        // Lines take fresh stations in a random order, so that station IDs do
+        // not follow the lines.
+        std::iota(order_.begin(), order_.end(), std::size_t{0});
+        std::shuffle(order_.begin(), order_.end(), rng_);
+        served_.reserve(std::min(options.nStations, options.nLines * options.routeLength));
+    }
+
+    std::vector<std::size_t> PlanLine(std::size_t line)
+    {
+        std::bernoulli_distribution interchange{options_.interchangeDensity};
+        std::vector<std::size_t> stops{};
+        stops.reserve(options_.routeLength);
+        while(stops.size() < options_.routeLength)
+        {
+            const bool freshLeft{nextFresh_ < order_.size()};
+            std::size_t station{kNoLine};
+            if(!served_.empty() && (!freshLeft || interchange(rng_)))
+            {
+                station = PickServed(line, !freshLeft);
+            }
+            if(station == kNoLine)
+            {
+                station = order_[nextFresh_++];
+                served_.push_back(station);
+            }
+            lineOf_[station] = line;
+            stops.push_back(station);
+        }
+        return stops;
+    }
+
+private:
+    static constexpr std::size_t kNoLine{std::numeric_limits<std::size_t>::max()};
+    static constexpr std::size_t kMaxPicks{8};
+
+    const NetworkLayoutOptions& options_;
+    std::mt19937_64& rng_;
+
+    // All stations, in the order lines take them.
+    std::vector<std::size_t> order_{};
+    std::size_t nextFresh_{0};
+
+    // Stations served by at least one line.
+    std::vector<std::size_t> served_{};
+
+    // Last line that picked each station.
+    std::vector<std::size_t> lineOf_{};
+
+    // Pick a served station that is not on this line yet.
+    // Returns kNoLine if we cannot find one quickly, unless `mustFind` is set.
+    std::size_t PickServed(std::size_t line, bool mustFind)
+    {
+        std::uniform_int_distribution<std::size_t> pick{0, served_.size() - 1};
+        for(std::size_t attempt{0}; attempt < kMaxPicks; ++attempt)
+        {
+            const auto station{served_[pick(rng_)]};
+            if(lineOf_[station] != line)
+            {
+                return station;
+            }
+        }
+        if(!mustFind)
+        {
+            return kNoLine;
+        }
+
+        // All stations are served and this line is long compared to the
+        // network: Scan for a station it does not visit yet. There is one, as
+        // the route length is at most the number of stations.
+        const auto start{pick(rng_)};
+        for(std::size_t offset{0}; offset < served_.size(); ++offset)
+        {
+            const auto station{served_[(start + offset) % served_.size()]};
+            if(lineOf_[station] != line)
+            {
+                return station;
+            }
+        }
+        return kNoLine;
+    }
+};
+
+} // namespace
+
+NetworkLayout NetworkMonitor::GenerateNetworkLayout(const NetworkLayoutOptions& options)
+{
+    CheckOptions(options);
+
+    std::mt19937_64 rng{options.seed};
+    NetworkLayout layout{};
+
+    const auto stationIdWidth{GetIdWidth(options.nStations)};
+    layout.stations.reserve(options.nStations);
+    for(std::size_t idx{0}; idx < options.nStations; ++idx)
+    {
+        auto suffix{MakeId("", idx, stationIdWidth)};
+        layout.stations.push_back(Station{"station_" + suffix, "Station Name " + suffix});
+    }
+
+    const auto lineIdWidth{GetIdWidth(options.nLines)};
+    const auto routeIdWidth{GetIdWidth(options.nLines * options.routesPerLine)};
+    std::size_t nRoutes{0};
+    LinePlanner planner{options, rng};
+    std::uniform_int_distribution<unsigned int> travelTime{options.minTravelTime, options.maxTravelTime};
+
+    // Adjacent station pairs that already have a travel time, as
+    // (smaller index) * nStations + (larger index).
+    std::unordered_set<std::uint64_t> pairs{};
+    pairs.reserve(options.nLines * options.routeLength);
+
+    layout.lines.reserve(options.nLines);
+    for(std::size_t lineIdx{0}; lineIdx < options.nLines; ++lineIdx)
+    {
+        const auto stops{planner.PlanLine(lineIdx)};
+
+        auto suffix{MakeId("", lineIdx, lineIdWidth)};
+        Line line{"line_" + suffix, "Line Name " + suffix, {}};
+        line.routes.reserve(options.routesPerLine);
+        for(std::size_t routeIdx{0}; routeIdx < options.routesPerLine; ++routeIdx)
+        {
+            // Full-line routes first, then shorter ones.
+            std::size_t first{0};
+            std::size_t length{stops.size()};
+            if(routeIdx >= 2 && stops.size() > 2)
+            {
+                length = std::uniform_int_distribution<std::size_t>{2, stops.size() - 1}(rng);
+                first = std::uniform_int_distribution<std::size_t>{0, stops.size() - length}(rng);
+            }
+            const bool inbound{routeIdx % 2 == 0};
+
+            Route route{MakeId("route_", nRoutes++, routeIdWidth), inbound ? "inbound" : "outbound", line.id};
+            route.stops.reserve(length);
+            for(std::size_t idx{0}; idx < length; ++idx)
+            {
+                const auto stop{inbound ? stops[first + idx] : stops[first + length - 1 - idx]};
+                route.stops.push_back(layout.stations[stop].id);
+            }
+            route.startStationId = route.stops.front();
+            route.endStationId = route.stops.back();
+            line.routes.push_back(std::move(route));
+        }
+        layout.lines.push_back(std::move(line));
+
+        // All routes run over stretches of the full line, so its adjacent
+        // stops are all the pairs we need travel times for.
+        for(std::size_t idx{1}; idx < stops.size(); ++idx)
+        {
+            const auto a{std::min(stops[idx - 1], stops[idx])};
+            const auto b{std::max(stops[idx - 1], stops[idx])};
+            if(pairs.insert(static_cast<std::uint64_t>(a) * options.nStations + b).second)
+            {
+                layout.travelTimes.push_back(
+                    StationTravelTime{layout.stations[stops[idx - 1]].id, layout.stations[stops[idx]].id,
+                                      travelTime(rng)});
+            }
+        }
+    }
+
+    return layout;
+}
+
+nlohmann::json NetworkMonitor::ToJson(const NetworkLayout& layout)
+{
+    nlohmann::json stations = nlohmann::json::array();
+    for(const auto& station : layout.stations)
+    {
+        stations.push_back({
+            {"station_id", station.id},
+            {"name", station.name},
+        });
+    }
+
+    nlohmann::json lines = nlohmann::json::array();
+    for(const auto& line : layout.lines)
+    {
+        nlohmann::json routes = nlohmann::json::array();
+        for(const auto& route : line.routes)
+        {
+            routes.push_back({
+                {"route_id", route.id},
+                {"direction", route.direction},
+                {"line_id", route.lineId},
+                {"start_station_id", route.startStationId},
+                {"end_station_id", route.endStationId},
+                {"route_stops", route.stops},
+            });
+        }
+        lines.push_back({
+            {"line_id", line.id},
+            {"name", line.name},
+            {"routes", std::move(routes)},
+        });
+    }
+
+    nlohmann::json travelTimes = nlohmann::json::array();
+    for(const auto& travelTime : layout.travelTimes)
+    {
+        travelTimes.push_back({
+            {"start_station_id", travelTime.startStationId},
+            {"end_station_id", travelTime.endStationId},
+            {"travel_time", travelTime.travelTime},
+        });
+    }
+
+    return {
+        {"stations", std::move(stations)},
+        {"lines", std::move(lines)},
+        {"travel_times", std::move(travelTimes)},
+    };
+}
@@ -0,0 +1,423 @@
+#include "PassengerEventFanIn.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "FlatHashMap.hpp"
+
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventFanIn;
+using NetworkMonitor::PassengerEventFanInOptions;
+using NetworkMonitor::PassengerEventFanInStats;
+using NetworkMonitor::StringViewHash;
+using NetworkMonitor::TransportNetwork;
+
+namespace {
+
+// Most events a shard thread applies from one queue before it moves on to the
+// next one, so that a busy feed does not starve the others.
+constexpr std::uint64_t kShardBatchSize{256};
+
+// Most events the merge applies before it looks at the empty feeds again.
+constexpr std::size_t kMergeBatchSize{4096};
+
+std::chrono::system_clock::rep GetTimestamp(const PassengerEvent& event)
+{
+    return event.timestamp.time_since_epoch().count();
+}
+
+} // namespace
+
+PassengerEventFanIn::PassengerEventFanIn(TransportNetwork& network,
+                                         std::size_t nFeeds,
+                                         const PassengerEventFanInOptions& options)
+    : PassengerEventFanIn{[&network](const PassengerEvent& event) { network.RecordPassengerEvent(event); },
+                          nFeeds,
+                          options}
+{
+}
+
+PassengerEventFanIn::PassengerEventFanIn(Sink sink, std::size_t nFeeds, const PassengerEventFanInOptions& options)
+    : sink_{std::move(sink)}, options_{options}, nFeeds_{nFeeds}
+{
+    if(options_.mode == FanInMode::Sharded)
+    {
+        nShards_ = options_.nShards > 0 ? options_.nShards
+                                        : std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    std::size_t capacity{2};
+    while(capacity < options_.queueCapacity)
+    {
+        capacity *= 2;
+    }
+    mask_ = capacity - 1;
+    queues_ = std::make_unique<Queue[]>(nFeeds_ * nShards_);
+    for(std::size_t idx{0}; idx < nFeeds_ * nShards_; ++idx)
+    {
+        queues_[idx].slots = std::make_unique<PassengerEvent[]>(capacity);
+    }
+    feeds_ = std::make_unique<Feed[]>(nFeeds_);
+    workerStates_ = std::make_unique<Worker[]>(nShards_);
+    lastStatsTime_ = std::chrono::steady_clock::now();
+
+    if(options_.mode == FanInMode::Merged)
+    {
+        workers_.emplace_back([this]() { RunMerged(); });
+    }
+    else
+    {
+        for(std::size_t shard{0}; shard < nShards_; ++shard)
+        {
+            workers_.emplace_back([this, shard]() { RunShard(shard); });
+        }
+    }
+}
+
+PassengerEventFanIn::~PassengerEventFanIn()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stop_.store(true, std::memory_order_release);
+        for(std::size_t shard{0}; shard < nShards_; ++shard)
+        {
+            workerStates_[shard].sleeping.store(false);
+            workerStates_[shard].wake.notify_one();
+        }
+    }
+    for(auto& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+std::size_t PassengerEventFanIn::GetFeedCount() const
+{
+    return nFeeds_;
+}
+
+bool PassengerEventFanIn::Push(std::size_t feed, const PassengerEvent& event)
+{
+    if(feed >= nFeeds_)
+    {
+        return false;
+    }
+    const auto shard{nShards_ > 1 ? StringViewHash{}(event.stationId) % nShards_ : 0};
+    auto& queue{GetQueue(feed, shard)};
+    const auto tail{queue.tail.load(std::memory_order_relaxed)};
+    if(tail - queue.cachedHead > mask_)
+    {
+        queue.cachedHead = queue.head.load(std::memory_order_acquire);
+        if(tail - queue.cachedHead > mask_)
+        {
+            // The queue is full: We cannot drop events, so we wait.
+            feeds_[feed].stalls.fetch_add(1, std::memory_order_relaxed);
+            Wake(shard);
+            do
+            {
+                std::this_thread::yield();
+                queue.cachedHead = queue.head.load(std::memory_order_acquire);
+            } while(tail - queue.cachedHead > mask_);
+        }
+    }
+
+    // Copy assignments reuse the storage of the station ID held in the slot.
+    queue.slots[tail & mask_] = event;
+
+    // Sequentially consistent, to pair with the sleeping flag as in Logger.
+    queue.tail.store(tail + 1);
+    Wake(shard);
+
+    const auto timestamp{GetTimestamp(event)};
+    if(timestamp > feeds_[feed].newestPushed.load(std::memory_order_relaxed))
+    {
+        feeds_[feed].newestPushed.store(timestamp, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void PassengerEventFanIn::Flush()
+{
+    std::vector<std::uint64_t> targets(nFeeds_ * nShards_);
+    for(std::size_t idx{0}; idx < targets.size(); ++idx)
+    {
+        targets[idx] = queues_[idx].tail.load(std::memory_order_acquire);
+    }
+    std::unique_lock<std::mutex> lock{mutex_};
+    flushRequests_.fetch_add(1, std::memory_order_relaxed);
+    for(std::size_t shard{0}; shard < nShards_; ++shard)
+    {
+        workerStates_[shard].sleeping.store(false);
+        workerStates_[shard].wake.notify_one();
+    }
+    done_.wait(lock, [this, &targets]() {
+        for(std::size_t idx{0}; idx < targets.size(); ++idx)
+        {
+            if(queues_[idx].head.load(std::memory_order_acquire) < targets[idx])
+            {
+                return false;
+            }
+        }
+        return true;
+    });
+    flushRequests_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+PassengerEventFanInStats PassengerEventFanIn::GetStats() const
+{
+    PassengerEventFanInStats stats{};
+    stats.feeds.resize(nFeeds_);
+    for(std::size_t feed{0}; feed < nFeeds_; ++feed)
+    {
+        auto& feedStats{stats.feeds[feed]};
+        std::chrono::system_clock::rep lastApplied{0};
+        for(std::size_t shard{0}; shard < nShards_; ++shard)
+        {
+            // Read the head first: It never passes the tail.
+            const auto& queue{GetQueue(feed, shard)};
+            feedStats.applied += queue.head.load(std::memory_order_acquire);
+            lastApplied = std::max(lastApplied, queue.lastApplied.load(std::memory_order_relaxed));
+            feedStats.pushed += queue.tail.load(std::memory_order_acquire);
+        }
+        feedStats.depth = feedStats.pushed - feedStats.applied;
+        const auto newestPushed{feeds_[feed].newestPushed.load(std::memory_order_relaxed)};
+        if(lastApplied > 0 && newestPushed > lastApplied)
+        {
+            feedStats.lag = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::duration{newestPushed - lastApplied});
+        }
+        feedStats.stalls = feeds_[feed].stalls.load(std::memory_order_relaxed);
+        stats.applied += feedStats.applied;
+    }
+    stats.late = late_.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    const auto now{std::chrono::steady_clock::now()};
+    const auto elapsed{std::chrono::duration<double>(now - lastStatsTime_).count()};
+    if(elapsed > 0.0)
+    {
+        stats.throughput = (stats.applied - lastStatsApplied_) / elapsed;
+    }
+    lastStatsTime_ = now;
+    lastStatsApplied_ = stats.applied;
+    return stats;
+}
+
+PassengerEventFanIn::Queue& PassengerEventFanIn::GetQueue(std::size_t feed, std::size_t shard) const
+{
+    return queues_[feed * nShards_ + shard];
+}
+
+void PassengerEventFanIn::Wake(std::size_t shard)
+{
+    auto& worker{workerStates_[shard]};
+    if(!worker.sleeping.load())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        worker.sleeping.store(false);
+    }
+    worker.wake.notify_one();
+}
+
+template <typename HasEvents>
+void PassengerEventFanIn::Idle(std::size_t shard,
+                               std::chrono::steady_clock::time_point deadline,
+                               HasEvents&& hasEvents)
+{
+    std::unique_lock<std::mutex> lock{mutex_};
+    if(flushRequests_.load(std::memory_order_relaxed) > 0)
+    {
+        done_.notify_all();
+    }
+
+    // We look for events once more after setting the flag, to catch the
+    // events whose producers did not see it set.
+    auto& worker{workerStates_[shard]};
+    worker.sleeping.store(true);
+    if(!stop_.load(std::memory_order_acquire) && !hasEvents())
+    {
+        auto isWoken{[&worker]() { return !worker.sleeping.load(); }};
+        if(deadline == std::chrono::steady_clock::time_point::max())
+        {
+            worker.wake.wait(lock, isWoken);
+        }
+        else
+        {
+            worker.wake.wait_until(lock, deadline, isWoken);
+        }
+    }
+    worker.sleeping.store(false);
+}
+
+void PassengerEventFanIn::ApplyOne(Queue& queue)
+{
+    const auto head{queue.head.load(std::memory_order_relaxed)};
+    const auto& event{queue.slots[head & mask_]};
+    sink_(event);
+    const auto timestamp{GetTimestamp(event)};
+    if(timestamp > 0)
+    {
+        queue.lastApplied.store(timestamp, std::memory_order_relaxed);
+    }
+    queue.head.store(head + 1, std::memory_order_release);
+}
+
+std::uint64_t PassengerEventFanIn::GetAvailable(Queue& queue) const
+{
+    const auto head{queue.head.load(std::memory_order_relaxed)};
+    if(queue.cachedTail == head)
+    {
+        queue.cachedTail = queue.tail.load(std::memory_order_acquire);
+    }
+    return queue.cachedTail - head;
+}
+
+void PassengerEventFanIn::RunMerged()
+{
+    // Min-heap of the feeds that have events, on the timestamp of their oldest
+    // event. Ties go to the lowest feed, so that the merge is deterministic.
+    using Entry = std::pair<std::chrono::system_clock::rep, std::size_t>;
+    const auto isLater{[](const Entry& a, const Entry& b) { return a > b; }};
+    std::vector<Entry> heap{};
+    heap.reserve(nFeeds_);
+    std::vector<bool> inHeap(nFeeds_, false);
+    std::vector<std::chrono::steady_clock::time_point> emptySince(nFeeds_, std::chrono::steady_clock::now());
+    auto lastMerged{std::numeric_limits<std::chrono::system_clock::rep>::min()};
+
+    const auto getOldest{[this](std::size_t feed) {
+        auto& queue{GetQueue(feed, 0)};
+        return GetTimestamp(queue.slots[queue.head.load(std::memory_order_relaxed) & mask_]);
+    }};
+    while(true)
+    {
+        // Feeds that are empty, but not for long enough to be left out, hold
+        // the merge back: Their next event could be the oldest one.
+        // We check for stop before we poll: Once stopping, the poll sees all
+        // the events that will ever be pushed.
+        const auto now{std::chrono::steady_clock::now()};
+        const auto stopping{stop_.load(std::memory_order_acquire)};
+        const auto draining{stopping || flushRequests_.load(std::memory_order_relaxed) > 0};
+        std::size_t nWaiting{0};
+        auto firstTimeout{std::chrono::steady_clock::time_point::max()};
+        for(std::size_t feed{0}; feed < nFeeds_; ++feed)
+        {
+            if(inHeap[feed])
+            {
+                continue;
+            }
+            if(GetAvailable(GetQueue(feed, 0)) > 0)
+            {
+                heap.emplace_back(getOldest(feed), feed);
+                std::push_heap(heap.begin(), heap.end(), isLater);
+                inHeap[feed] = true;
+            }
+            else if(!draining && now - emptySince[feed] < options_.idleTimeout)
+            {
+                ++nWaiting;
+                firstTimeout = std::min(firstTimeout, emptySince[feed] + options_.idleTimeout);
+            }
+        }
+
+        std::size_t nApplied{0};
+        while(nWaiting == 0 && !heap.empty() && nApplied < kMergeBatchSize)
+        {
+            std::pop_heap(heap.begin(), heap.end(), isLater);
+            const auto [timestamp, feed]{heap.back()};
+            heap.pop_back();
+            if(timestamp < lastMerged && timestamp > 0)
+            {
+                late_.fetch_add(1, std::memory_order_relaxed);
+            }
+            lastMerged = std::max(lastMerged, timestamp);
+
+            auto& queue{GetQueue(feed, 0)};
+            ApplyOne(queue);
+            ++nApplied;
+            if(GetAvailable(queue) > 0)
+            {
+                heap.emplace_back(getOldest(feed), feed);
+                std::push_heap(heap.begin(), heap.end(), isLater);
+            }
+            else
+            {
+                inHeap[feed] = false;
+                emptySince[feed] = now;
+                nWaiting += draining ? 0 : 1;
+            }
+        }
+
+        if(nApplied == 0)
+        {
+            if(heap.empty() && stopping)
+            {
+                return;
+            }
+
+            // The events in the heap wait for the first empty feed to time
+            // out, or for an event of an empty feed.
+            const auto deadline{heap.empty() ? std::chrono::steady_clock::time_point::max() : firstTimeout};
+            Idle(0, deadline, [this, &inHeap]() {
+                for(std::size_t feed{0}; feed < nFeeds_; ++feed)
+                {
+                    if(!inHeap[feed] && GetQueue(feed, 0).tail.load() != GetQueue(feed, 0).head.load())
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            });
+        }
+        else if(flushRequests_.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            done_.notify_all();
+        }
+    }
+}
+
+void PassengerEventFanIn::RunShard(std::size_t shard)
+{
+    while(true)
+    {
+        // We check for stop before we poll: Once stopping, the poll sees all
+        // the events that will ever be pushed.
+        const auto stopping{stop_.load(std::memory_order_acquire)};
+        std::uint64_t nApplied{0};
+        for(std::size_t feed{0}; feed < nFeeds_; ++feed)
+        {
+            auto& queue{GetQueue(feed, shard)};
+            const auto nEvents{std::min(GetAvailable(queue), kShardBatchSize)};
+            for(std::uint64_t idx{0}; idx < nEvents; ++idx)
+            {
+                ApplyOne(queue);
+            }
+            nApplied += nEvents;
+        }
+
+        if(nApplied == 0)
+        {
+            if(stopping)
+            {
+                return;
+            }
+            Idle(shard, std::chrono::steady_clock::time_point::max(), [this, shard]() {
+                for(std::size_t feed{0}; feed < nFeeds_; ++feed)
+                {
+                    if(GetQueue(feed, shard).tail.load() != GetQueue(feed, shard).head.load())
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            });
+        }
+        else if(flushRequests_.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            done_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#include "PassengerEventFilter.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+using NetworkMonitor::PassengerEventFilter;
+using NetworkMonitor::PassengerEventFilterOptions;
+using NetworkMonitor::PassengerEventFilterStats;
+
+PassengerEventFilter::PassengerEventFilter(const PassengerEventFilterOptions& options)
+    : options_{options}
+{
+    if(options_.dedupWindow > 0)
+    {
+        // The word of the newest sequence number is only partly behind it, so
+        // we need one more word than the window covers.
+        std::size_t nWords{1};
+        while(nWords < (options_.dedupWindow + 63) / 64 + 1)
+        {
+            nWords *= 2;
+        }
+        words_.resize(nWords, 0);
+        wordMask_ = nWords - 1;
+    }
+    if(options_.maxLateness.count() > 0)
+    {
+        slots_.resize(std::max<std::size_t>(options_.maxBuffered, 1) + 1);
+        freeSlots_.reserve(slots_.size());
+        for(auto slot{slots_.size()}; slot > 0; --slot)
+        {
+            freeSlots_.push_back(slot - 1);
+        }
+        queue_.resize(slots_.size());
+        heap_.reserve(slots_.size());
+    }
+}
+
+PassengerEventFilterStats PassengerEventFilter::GetStats() const
+{
+    auto stats{stats_};
+    stats.buffered = queueSize_ + heap_.size();
+    return stats;
+}
+
+std::size_t PassengerEventFilter::GetMemorySize() const
+{
+    return sizeof(*this) + words_.capacity() * sizeof(std::uint64_t) + slots_.capacity() * sizeof(PassengerEvent) +
+           freeSlots_.capacity() * sizeof(std::size_t) + (queue_.capacity() + heap_.capacity()) * sizeof(Entry);
+}
+
+bool PassengerEventFilter::IsNew(std::uint64_t sequence)
+{
+    if(words_.empty())
+    {
+        return true;
+    }
+    const auto word{sequence / 64};
+    const auto newestWord{newestSequence_ / 64};
+    if(sequence > newestSequence_)
+    {
+        // Slide the window forward: The words it moves over now stand for
+        // sequence numbers we have not seen.
+        const auto nWords{std::min<std::uint64_t>(word - newestWord, words_.size())};
+        for(std::uint64_t idx{1}; idx <= nWords; ++idx)
+        {
+            words_[(newestWord + idx) & wordMask_] = 0;
+        }
+        newestSequence_ = sequence;
+    }
+    else if(newestWord - word > wordMask_)
+    {
+        ++stats_.expired;
+        return false;
+    }
+
+    auto& bits{words_[word & wordMask_]};
+    const auto bit{std::uint64_t{1} << (sequence % 64)};
+    if((bits & bit) != 0)
+    {
+        ++stats_.duplicates;
+        return false;
+    }
+    bits |= bit;
+    return true;
+}
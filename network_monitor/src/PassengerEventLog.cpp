@@ -0,0 +1,783 @@
+#include "PassengerEventLog.hpp"
+
+#include <boost/system/error_code.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "Log.hpp"
+
+using NetworkMonitor::Log;
+using NetworkMonitor::LogLevel;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventLog;
+using NetworkMonitor::PassengerEventLogOptions;
+using NetworkMonitor::PassengerEventLogStats;
+using NetworkMonitor::StationPassengerCount;
+
+namespace {
+
+// Log frame: Payload size, CRC-32 of the payload, payload. Each group commit
+// writes one frame, whose payload is the records of the commit. A record is the
+// event type, the size of the station ID and the station ID.
+//
+// One CRC per commit, rather than per record, keeps the checksum off the
+// per-event cost. A torn frame was never acknowledged by Commit, so losing it
+// whole loses nothing that was promised to be durable.
+constexpr std::size_t kFrameHeaderSize{2 * sizeof(std::uint32_t)};
+
+// Checkpoint: Magic, format version, first segment not covered by the
+// checkpoint, number of stations, then for each station the size of its ID,
+// its ID and its count. A CRC-32 of everything before it closes the file.
+constexpr std::uint32_t kCheckpointMagic{0x43504D4E}; // "NMPC"
+constexpr std::uint32_t kCheckpointVersion{1};
+
+// Commit early when this much data is pending, to bound the memory we hold.
+constexpr std::size_t kMaxPendingBytes{4 << 20};
+
+// CRC-32 lookup tables for slicing-by-8: kCrcTables[k][b] is the CRC of byte b
+// followed by k zero bytes.
+constexpr auto kCrcTables{[]() {
+    std::array<std::array<std::uint32_t, 256>, 8> tables{};
+    for(std::uint32_t byte{0}; byte < 256; ++byte)
+    {
+        auto crc{byte};
+        for(int bit{0}; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) != 0 ? 0xEDB88320 : 0);
+        }
+        tables[0][byte] = crc;
+    }
+    for(std::size_t table{1}; table < tables.size(); ++table)
+    {
+        for(std::size_t byte{0}; byte < 256; ++byte)
+        {
+            const auto previous{tables[table - 1][byte]};
+            tables[table][byte] = (previous >> 8) ^ tables[0][previous & 0xFF];
+        }
+    }
+    return tables;
+}()};
+
+// CRC-32, as boost::crc_32_type. The boost implementation reads one byte at a
+// time, which made the checksum the largest cost of a commit: Slicing-by-8
+// reads 8.
+std::uint32_t GetCrc(const char* data, std::size_t size)
+{
+    const auto* bytes{reinterpret_cast<const unsigned char*>(data)};
+    std::uint32_t crc{0xFFFFFFFF};
+    for(; size >= 8; bytes += 8, size -= 8)
+    {
+        const auto low{crc ^ (bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<std::uint32_t>(bytes[3]) << 24)};
+        crc = kCrcTables[7][low & 0xFF] ^ kCrcTables[6][(low >> 8) & 0xFF] ^ kCrcTables[5][(low >> 16) & 0xFF] ^
+              kCrcTables[4][low >> 24] ^ kCrcTables[3][bytes[4]] ^ kCrcTables[2][bytes[5]] ^
+              kCrcTables[1][bytes[6]] ^ kCrcTables[0][bytes[7]];
+    }
+    for(; size > 0; ++bytes, --size)
+    {
+        crc = (crc >> 8) ^ kCrcTables[0][(crc ^ *bytes) & 0xFF];
+    }
+    return ~crc;
+}
+
+template <typename T>
+void Put(std::vector<char>& buffer, const T& value)
+{
+    const auto* bytes{reinterpret_cast<const char*>(&value)};
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+// Read a value at `offset` and move past it. Returns false if the buffer is
+// too short.
+template <typename T>
+bool Get(const std::vector<char>& buffer, std::size_t& offset, T& value)
+{
+    if(buffer.size() - offset < sizeof(T))
+    {
+        return false;
+    }
+    std::memcpy(&value, buffer.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+std::vector<char> ReadFile(const std::filesystem::path& path)
+{
+    std::ifstream file{path, std::ios::binary};
+    return std::vector<char>(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+}
+
+void LogLastError(const char* where)
+{
+    Log<LogLevel::Error>(where, boost::system::error_code{errno, boost::system::system_category()});
+}
+
+// Thin wrappers over the POSIX file API: The standard streams cannot sync.
+int OpenFile(const std::filesystem::path& path, bool truncate)
+{
+#if defined(_WIN32)
+    const auto flags{_O_WRONLY | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : _O_APPEND)};
+    return _wopen(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+    const auto flags{O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : O_APPEND)};
+    return open(path.c_str(), flags, 0644);
+#endif
+}
+
+bool WriteAll(int fd, const char* data, std::size_t size)
+{
+    while(size > 0)
+    {
+#if defined(_WIN32)
+        const auto written{_write(fd, data, static_cast<unsigned int>(std::min<std::size_t>(size, 1 << 30)))};
+#else
+        const auto written{write(fd, data, size)};
+#endif
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+// Sync the file data, and its metadata too if `metadata` is set.
+bool SyncFile(int fd, bool metadata)
+{
+#if defined(_WIN32)
+    (void)metadata;
+    return _commit(fd) == 0;
+#elif defined(__APPLE__)
+    (void)metadata;
+    return fsync(fd) == 0;
+#else
+    return (metadata ? fsync(fd) : fdatasync(fd)) == 0;
+#endif
+}
+
+// Returns -1 on failure.
+long long int GetFileSize(int fd)
+{
+#if defined(_WIN32)
+    return _lseeki64(fd, 0, SEEK_END);
+#else
+    return lseek(fd, 0, SEEK_END);
+#endif
+}
+
+bool TruncateFile(int fd, long long int size)
+{
+#if defined(_WIN32)
+    return _chsize_s(fd, size) == 0;
+#else
+    return ftruncate(fd, size) == 0;
+#endif
+}
+
+void CloseFile(int fd)
+{
+#if defined(_WIN32)
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+// Make a rename in a directory durable. Not needed on Windows.
+bool SyncDirectory(const std::filesystem::path& directory)
+{
+#if defined(_WIN32)
+    (void)directory;
+    return true;
+#else
+    const auto fd{open(directory.c_str(), O_RDONLY | O_CLOEXEC)};
+    if(fd < 0)
+    {
+        return false;
+    }
+    const auto ok{fsync(fd) == 0};
+    close(fd);
+    return ok;
+#endif
+}
+
+// Get the number of a log segment from its file name.
+bool ParseSegmentName(const std::string& name, std::uint64_t& segment)
+{
+    constexpr std::string_view prefix{"events-"};
+    constexpr std::string_view suffix{".log"};
+    if(name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+       name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+    {
+        return false;
+    }
+    const auto digits{name.substr(prefix.size(), name.size() - prefix.size() - suffix.size())};
+    if(!std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; }))
+    {
+        return false;
+    }
+    segment = std::stoull(digits);
+    return true;
+}
+
+} // namespace
+
+PassengerEventLog::PassengerEventLog(const PassengerEventLogOptions& options)
+    : options_{options}
+{
+    std::size_t size{1};
+    while(size < std::max<std::size_t>(options_.capacity, 2))
+    {
+        size *= 2;
+    }
+    cells_ = std::make_unique<Cell[]>(size);
+    for(std::size_t idx{0}; idx < size; ++idx)
+    {
+        cells_[idx].sequence.store(idx, std::memory_order_relaxed);
+    }
+    mask_ = size - 1;
+
+    std::filesystem::create_directories(options_.directory);
+    Recover();
+    lastCommit_ = std::chrono::steady_clock::now();
+    lastCheckpoint_ = lastCommit_;
+
+    worker_ = std::thread{[this]() { Run(); }};
+}
+
+PassengerEventLog::~PassengerEventLog()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stop_ = true;
+        sleeping_.store(false);
+    }
+    wake_.notify_one();
+    worker_.join();
+    if(fd_ >= 0)
+    {
+        CloseFile(fd_);
+    }
+}
+
+const std::vector<StationPassengerCount>& PassengerEventLog::GetRecoveredCounts() const
+{
+    return recoveredCounts_;
+}
+
+bool PassengerEventLog::Append(const PassengerEvent& event)
+{
+    if(event.stationId.size() > kMaxStationIdSize ||
+       (event.type != PassengerEvent::Type::In && event.type != PassengerEvent::Type::Out))
+    {
+        return false;
+    }
+    bool stalled{false};
+    auto pos{enqueuePos_.load(std::memory_order_relaxed)};
+    while(true)
+    {
+        auto& cell{cells_[pos & mask_]};
+        const auto sequence{cell.sequence.load(std::memory_order_acquire)};
+        const auto diff{static_cast<std::int64_t>(sequence - pos)};
+        if(diff == 0)
+        {
+            // The cell is free for this position: Try to claim it.
+            if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                cell.record.type = event.type;
+                cell.record.stationIdSize = static_cast<std::uint8_t>(event.stationId.size());
+                std::memcpy(cell.record.stationId, event.stationId.data(), event.stationId.size());
+
+                // Sequentially consistent, to pair with sleeping_ as in Logger.
+                cell.sequence.store(pos + 1);
+                Wake();
+                return true;
+            }
+        }
+        else if(diff < 0)
+        {
+            // The buffer is full: We cannot drop events, so we wait.
+            if(!stalled)
+            {
+                stalled = true;
+                stalls_.fetch_add(1, std::memory_order_relaxed);
+            }
+            Wake();
+            std::this_thread::yield();
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            // Another producer claimed this position.
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool PassengerEventLog::Commit()
+{
+    std::unique_lock<std::mutex> lock{mutex_};
+    const auto target{enqueuePos_.load(std::memory_order_acquire)};
+    const auto errors{stats_.errors};
+    ++commitRequests_;
+    sleeping_.store(false);
+    wake_.notify_one();
+    done_.wait(lock, [this, target, errors]() { return committedPos_ >= target || stats_.errors > errors; });
+    --commitRequests_;
+    return committedPos_ >= target;
+}
+
+bool PassengerEventLog::Checkpoint()
+{
+    if(!Commit())
+    {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock{mutex_};
+    const auto request{++checkpointRequests_};
+    const auto errors{stats_.errors};
+    sleeping_.store(false);
+    wake_.notify_one();
+    done_.wait(lock, [this, request]() { return checkpointsDone_ >= request; });
+    return stats_.errors == errors;
+}
+
+PassengerEventLogStats PassengerEventLog::GetStats() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto stats{stats_};
+    stats.stalls = stalls_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void PassengerEventLog::Recover()
+{
+    // The checkpoint holds the counts up to the start of a segment.
+    std::uint64_t firstSegment{0};
+    if(std::filesystem::exists(GetCheckpointPath()))
+    {
+        const auto data{ReadFile(GetCheckpointPath())};
+        std::size_t offset{0};
+        std::uint32_t magic{0};
+        std::uint32_t version{0};
+        std::uint64_t nStations{0};
+        std::uint32_t crc{0};
+        bool ok{data.size() >= sizeof(crc) && Get(data, offset, magic) && magic == kCheckpointMagic &&
+                Get(data, offset, version) && version == kCheckpointVersion && Get(data, offset, firstSegment) &&
+                Get(data, offset, nStations)};
+        if(ok)
+        {
+            std::memcpy(&crc, data.data() + data.size() - sizeof(crc), sizeof(crc));
+            ok = crc == GetCrc(data.data(), data.size() - sizeof(crc));
+        }
+        for(std::uint64_t idx{0}; ok && idx < nStations; ++idx)
+        {
+            std::uint8_t idSize{0};
+            long long int count{0};
+            ok = Get(data, offset, idSize) && data.size() - offset >= idSize;
+            if(ok)
+            {
+                std::string id(data.data() + offset, idSize);
+                offset += idSize;
+                ok = Get(data, offset, count);
+                counts_.emplace(std::move(id), count);
+            }
+        }
+        if(!ok)
+        {
+            // Without a checkpoint, we replay all the segments we still have.
+            Log<LogLevel::Warning>(__func__, "Ignoring corrupt checkpoint");
+            counts_ = {};
+            firstSegment = 0;
+        }
+    }
+
+    std::vector<std::uint64_t> segments{};
+    for(const auto& entry : std::filesystem::directory_iterator{options_.directory})
+    {
+        std::uint64_t segment{0};
+        if(entry.is_regular_file() && ParseSegmentName(entry.path().filename().string(), segment))
+        {
+            segments.push_back(segment);
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+
+    std::uint64_t nextSegment{std::max<std::uint64_t>(firstSegment, 1)};
+    for(const auto segment : segments)
+    {
+        // A crash can leave behind segments the checkpoint already covers.
+        if(segment < firstSegment)
+        {
+            std::error_code ec{};
+            std::filesystem::remove(GetSegmentPath(segment), ec);
+            continue;
+        }
+        nextSegment = segment + 1;
+
+        // Replay up to the first frame that is torn or corrupt: Usually the
+        // tail of the last segment, written while we crashed.
+        const auto data{ReadFile(GetSegmentPath(segment))};
+        std::size_t offset{0};
+        while(data.size() - offset >= kFrameHeaderSize)
+        {
+            std::uint32_t size{0};
+            std::uint32_t crc{0};
+            std::memcpy(&size, data.data() + offset, sizeof(size));
+            std::memcpy(&crc, data.data() + offset + sizeof(size), sizeof(crc));
+            const auto* payload{data.data() + offset + kFrameHeaderSize};
+            if(data.size() - offset - kFrameHeaderSize < size || GetCrc(payload, size) != crc)
+            {
+                break;
+            }
+            std::size_t recordOffset{0};
+            while(size - recordOffset >= 2)
+            {
+                const auto type{payload[recordOffset]};
+                const auto idSize{static_cast<std::uint8_t>(payload[recordOffset + 1])};
+                if(type > 1 || idSize > kMaxStationIdSize || size - recordOffset - 2 < idSize)
+                {
+                    break;
+                }
+                const std::string_view id{payload + recordOffset + 2, idSize};
+                auto it{counts_.find(id)};
+                if(it == counts_.end())
+                {
+                    it = counts_.emplace(std::string{id}, 0).first;
+                }
+                it->second += type == 0 ? 1 : -1;
+                recordOffset += 2 + idSize;
+            }
+            if(recordOffset != size)
+            {
+                break;
+            }
+            offset += kFrameHeaderSize + size;
+        }
+        if(offset != data.size())
+        {
+            Log<LogLevel::Warning>(__func__, "Stopped replaying a segment at a torn frame");
+        }
+    }
+
+    for(const auto& [id, count] : counts_)
+    {
+        if(count != 0)
+        {
+            recoveredCounts_.push_back(StationPassengerCount{id, count});
+        }
+    }
+    std::sort(recoveredCounts_.begin(), recoveredCounts_.end(), [](const auto& a, const auto& b) {
+        return a.stationId < b.stationId;
+    });
+
+    // Appending after a torn frame would hide the frames that follow it, so
+    // we always start a new segment.
+    fd_ = OpenFile(GetSegmentPath(nextSegment), false);
+    if(fd_ < 0)
+    {
+        throw std::runtime_error("PassengerEventLog: Cannot create log segment " +
+                                 GetSegmentPath(nextSegment).string());
+    }
+    segment_ = nextSegment;
+}
+
+void PassengerEventLog::Wake()
+{
+    if(!sleeping_.load())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        sleeping_.store(false);
+    }
+    wake_.notify_one();
+}
+
+void PassengerEventLog::Run()
+{
+    std::unique_lock<std::mutex> lock{mutex_};
+    while(true)
+    {
+        lock.unlock();
+        const auto nDrained{Drain()};
+        const auto drainedPos{dequeuePos_.load(std::memory_order_relaxed)};
+        const auto now{std::chrono::steady_clock::now()};
+        lock.lock();
+
+        const auto checkpointDue{
+            checkpointRequests_ > checkpointsDone_ ||
+            (options_.checkpointInterval.count() > 0 && now - lastCheckpoint_ >= options_.checkpointInterval)};
+        const auto commitDue{stop_ || commitRequests_ > 0 || checkpointDue ||
+                             now - lastCommit_ >= options_.commitInterval || pending_.size() >= kMaxPendingBytes};
+        bool committed{pending_.empty()};
+        if(commitDue && !pending_.empty())
+        {
+            // Group commit: One write and one sync for all the records drained
+            // since the last commit.
+            const auto nBytes{pending_.size()};
+            lock.unlock();
+            committed = WritePending();
+            lock.lock();
+            if(committed)
+            {
+                ++stats_.commits;
+                stats_.bytes += nBytes;
+                stats_.events += drainedPos - committedPos_;
+                committedPos_ = drainedPos;
+            }
+            else
+            {
+                ++stats_.errors;
+            }
+            lastCommit_ = now;
+            done_.notify_all();
+        }
+        if(checkpointDue)
+        {
+            // A checkpoint must not cover records that are not in the log yet,
+            // so we skip it if the commit failed.
+            const auto requests{checkpointRequests_};
+            lock.unlock();
+            const auto ok{committed && WriteCheckpoint()};
+            lock.lock();
+            if(ok)
+            {
+                ++stats_.checkpoints;
+            }
+            else if(committed)
+            {
+                ++stats_.errors;
+            }
+            checkpointsDone_ = requests;
+            lastCheckpoint_ = now;
+            done_.notify_all();
+        }
+
+        if(stop_ && nDrained == 0)
+        {
+            // On a failed commit we give up: Nobody is left to retry.
+            return;
+        }
+        if(nDrained == 0)
+        {
+            // Nothing to do: Wait until someone wakes us up, or until the
+            // pending records or the next checkpoint are due. We check for a
+            // record once more after setting sleeping_, to catch the records
+            // whose producers did not see it set.
+            sleeping_.store(true);
+            const auto pos{dequeuePos_.load(std::memory_order_relaxed)};
+            if(cells_[pos & mask_].sequence.load() != pos + 1)
+            {
+                auto isWoken{[this]() { return !sleeping_.load(); }};
+                if(!pending_.empty())
+                {
+                    wake_.wait_until(lock, lastCommit_ + options_.commitInterval, isWoken);
+                }
+                else if(options_.checkpointInterval.count() > 0)
+                {
+                    wake_.wait_until(lock, lastCheckpoint_ + options_.checkpointInterval, isWoken);
+                }
+                else
+                {
+                    wake_.wait(lock, isWoken);
+                }
+            }
+            sleeping_.store(false);
+        }
+    }
+}
+
+std::size_t PassengerEventLog::Drain()
+{
+    std::size_t nDrained{0};
+    auto pos{dequeuePos_.load(std::memory_order_relaxed)};
+    while(nDrained <= mask_)
+    {
+        auto& cell{cells_[pos & mask_]};
+        if(cell.sequence.load(std::memory_order_acquire) != pos + 1)
+        {
+            break;
+        }
+        const auto& record{cell.record};
+        const std::string_view id{record.stationId, record.stationIdSize};
+        const auto type{static_cast<char>(record.type == PassengerEvent::Type::In ? 0 : 1)};
+
+        // The frame header is filled in by WritePending.
+        const auto offset{pending_.empty() ? kFrameHeaderSize : pending_.size()};
+        pending_.resize(offset + 2 + id.size());
+        auto* data{pending_.data() + offset};
+        data[0] = type;
+        data[1] = static_cast<char>(id.size());
+        std::memcpy(data + 2, id.data(), id.size());
+
+        auto it{counts_.find(id)};
+        if(it == counts_.end())
+        {
+            it = counts_.emplace(std::string{id}, 0).first;
+        }
+        it->second += type == 0 ? 1 : -1;
+
+        // Hand the cell back to the producers.
+        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        ++pos;
+        ++nDrained;
+    }
+    dequeuePos_.store(pos, std::memory_order_release);
+    return nDrained;
+}
+
+bool PassengerEventLog::WritePending()
+{
+    const auto size{static_cast<std::uint32_t>(pending_.size() - kFrameHeaderSize)};
+    const auto crc{GetCrc(pending_.data() + kFrameHeaderSize, size)};
+    std::memcpy(pending_.data(), &size, sizeof(size));
+    std::memcpy(pending_.data() + sizeof(size), &crc, sizeof(crc));
+    const auto segmentSize{GetFileSize(fd_)};
+    const auto written{WriteAll(fd_, pending_.data(), pending_.size())};
+    if(!written || !SyncFile(fd_, false))
+    {
+        LogLastError(__func__);
+
+        // Cut the segment back to its last commit, so that the retry neither
+        // lands after a torn frame nor writes the frame a second time. The
+        // segment is opened for appending: The retry goes to the new end.
+        if(segmentSize >= 0 && TruncateFile(fd_, segmentSize))
+        {
+            return false;
+        }
+        LogLastError(__func__);
+
+        // The segment may now end with a partial write. We move on to a new
+        // segment, so that the next commit does not land after a torn frame.
+        const auto fd{OpenFile(GetSegmentPath(segment_ + 1), false)};
+        if(fd >= 0)
+        {
+            CloseFile(fd_);
+            fd_ = fd;
+            ++segment_;
+        }
+        if(written)
+        {
+            // The whole frame is in the old segment, only its sync failed:
+            // Recovery replays it, so writing it again would count its events
+            // twice. They are lost only if the data never reaches the disk.
+            pending_.clear();
+        }
+        return false;
+    }
+    pending_.clear();
+    return true;
+}
+
+bool PassengerEventLog::WriteCheckpoint()
+{
+    // Start a new segment first: The checkpoint covers all the segments before
+    // it.
+    const auto fd{OpenFile(GetSegmentPath(segment_ + 1), false)};
+    if(fd < 0)
+    {
+        LogLastError(__func__);
+        return false;
+    }
+    CloseFile(fd_);
+    fd_ = fd;
+    ++segment_;
+
+    std::vector<char> data{};
+    Put(data, kCheckpointMagic);
+    Put(data, kCheckpointVersion);
+    Put(data, segment_);
+    const auto nStationsOffset{data.size()};
+    Put(data, std::uint64_t{0});
+    std::uint64_t nStations{0};
+    for(const auto& [id, count] : counts_)
+    {
+        if(count != 0)
+        {
+            Put(data, static_cast<std::uint8_t>(id.size()));
+            data.insert(data.end(), id.begin(), id.end());
+            Put(data, count);
+            ++nStations;
+        }
+    }
+    std::memcpy(data.data() + nStationsOffset, &nStations, sizeof(nStations));
+    Put(data, GetCrc(data.data(), data.size()));
+
+    // Write the checkpoint on the side and rename it over the previous one, so
+    // that a crash leaves either checkpoint behind, never half of one.
+    auto tmpPath{GetCheckpointPath()};
+    tmpPath += ".tmp";
+    const auto tmpFd{OpenFile(tmpPath, true)};
+    if(tmpFd < 0)
+    {
+        LogLastError(__func__);
+        return false;
+    }
+    const auto ok{WriteAll(tmpFd, data.data(), data.size()) && SyncFile(tmpFd, true)};
+    CloseFile(tmpFd);
+    if(!ok)
+    {
+        LogLastError(__func__);
+        return false;
+    }
+    std::error_code ec{};
+    std::filesystem::rename(tmpPath, GetCheckpointPath(), ec);
+    if(ec)
+    {
+        Log<LogLevel::Error>(__func__, boost::system::error_code{ec.value(), boost::system::system_category()});
+        return false;
+    }
+    if(!SyncDirectory(options_.directory))
+    {
+        LogLastError(__func__);
+        return false;
+    }
+
+    for(const auto& entry : std::filesystem::directory_iterator{options_.directory, ec})
+    {
+        std::uint64_t segment{0};
+        if(ParseSegmentName(entry.path().filename().string(), segment) && segment < segment_)
+        {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+    return true;
+}
+
+std::filesystem::path PassengerEventLog::GetSegmentPath(std::uint64_t segment) const
+{
+    char name[32]{};
+    std::snprintf(name, sizeof(name), "events-%012llu.log", static_cast<unsigned long long>(segment));
+    return options_.directory / name;
+}
+
+std::filesystem::path PassengerEventLog::GetCheckpointPath() const
+{
+    return options_.directory / "checkpoint.bin";
+}
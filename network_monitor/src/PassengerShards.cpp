@@ -0,0 +1,675 @@
+#include "PassengerShards.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+#include "Log.hpp"
+
+using NetworkMonitor::ConsistentHashRing;
+using NetworkMonitor::Id;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerShardRouter;
+using NetworkMonitor::PassengerShardRouterOptions;
+using NetworkMonitor::PassengerShardServer;
+using NetworkMonitor::PassengerShardStats;
+using NetworkMonitor::StationPassengerCount;
+using NetworkMonitor::TransportNetwork;
+
+using local = boost::asio::local::stream_protocol;
+
+namespace {
+
+// Wire format
+// Each message is a frame: A 4-byte payload size and a 1-byte message type,
+// followed by the payload. Requests that expect a reply get exactly one reply
+// frame, in the order of the requests.
+enum class MessageType : std::uint8_t
+{
+    // Router to shard, no reply. Payload: Any number of encoded events.
+    Events = 1,
+
+    // Empty request, empty reply. Sent after events, the reply tells the
+    // router that the shard recorded them.
+    Sync = 2,
+
+    // Request: The station ID. Reply: The count, as an int64.
+    PassengerCount = 3,
+
+    // Request: k, as a uint64. Reply: The number of stations as a uint32,
+    // then for each station its count as an int64 and its encoded ID.
+    BusiestStations = 4,
+
+    // Empty request. Reply: The shard counters, as 3 uint64.
+    Stats = 5
+};
+
+constexpr std::size_t kHeaderSize{5};
+
+// Shards close the connections that announce a larger payload, rather than
+// allocate whatever the size field says. Routers batch at most a quarter of
+// it, which leaves room for the event that crosses the batch size.
+constexpr std::size_t kMaxPayloadSize{16 * 1024 * 1024};
+constexpr std::size_t kMaxBatchBytes{kMaxPayloadSize / 4};
+
+template <typename T>
+void Append(std::string& buffer, T value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto offset{buffer.size()};
+    buffer.resize(offset + sizeof(T));
+    std::memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+void AppendString(std::string& buffer, std::string_view text)
+{
+    Append(buffer, static_cast<std::uint32_t>(text.size()));
+    buffer.append(text);
+}
+
+// Reads advance `data`. They return false, and leave `data` alone, if the
+// value runs past `end`.
+template <typename T>
+bool Read(const char*& data, const char* end, T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    if(static_cast<std::size_t>(end - data) < sizeof(T))
+    {
+        return false;
+    }
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return true;
+}
+
+bool ReadString(const char*& data, const char* end, std::string& text)
+{
+    auto cursor{data};
+    std::uint32_t size{0};
+    if(!Read(cursor, end, size) || static_cast<std::size_t>(end - cursor) < size)
+    {
+        return false;
+    }
+    text.assign(cursor, size);
+    data = cursor + size;
+    return true;
+}
+
+void StartFrame(std::string& buffer, MessageType type)
+{
+    buffer.clear();
+    buffer.resize(kHeaderSize);
+    buffer[4] = static_cast<char>(type);
+}
+
+// Fill in the payload size of a frame started with StartFrame.
+void EndFrame(std::string& buffer)
+{
+    const auto size{static_cast<std::uint32_t>(buffer.size() - kHeaderSize)};
+    std::memcpy(buffer.data(), &size, sizeof(size));
+}
+
+void AppendEvent(std::string& buffer, const PassengerEvent& event)
+{
+    Append(buffer, static_cast<std::uint8_t>(event.type));
+    Append(buffer, static_cast<std::int64_t>(event.timestamp.time_since_epoch().count()));
+    Append(buffer, event.sequence);
+    AppendString(buffer, event.stationId);
+}
+
+bool ReadEvent(const char*& data, const char* end, PassengerEvent& event)
+{
+    std::uint8_t type{0};
+    std::int64_t timestamp{0};
+    if(!Read(data, end, type) || type > static_cast<std::uint8_t>(PassengerEvent::Type::Out) ||
+       !Read(data, end, timestamp) || !Read(data, end, event.sequence) || !ReadString(data, end, event.stationId))
+    {
+        return false;
+    }
+    event.type = static_cast<PassengerEvent::Type>(type);
+    event.timestamp = std::chrono::system_clock::time_point{std::chrono::system_clock::duration{timestamp}};
+    return true;
+}
+
+boost::system::system_error MakeProtocolError()
+{
+    return boost::system::system_error{make_error_code(boost::system::errc::protocol_error)};
+}
+
+// Hashes must agree across processes and builds: We do not use std::hash.
+std::uint64_t Mix(std::uint64_t value)
+{
+    // splitmix64 finalizer.
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+std::uint64_t HashStationId(std::string_view stationId)
+{
+    // FNV-1a, mixed so that similar IDs spread over the ring.
+    std::uint64_t hash{14695981039346656037ull};
+    for(const auto byte : stationId)
+    {
+        hash = (hash ^ static_cast<std::uint8_t>(byte)) * 1099511628211ull;
+    }
+    return Mix(hash);
+}
+
+} // namespace
+
+// ConsistentHashRing
+
+ConsistentHashRing::ConsistentHashRing(std::size_t nShards, std::size_t nVirtualNodes)
+    : nShards_{std::max<std::size_t>(nShards, 1)}
+{
+    nVirtualNodes = std::max<std::size_t>(nVirtualNodes, 1);
+    points_.reserve(nShards_ * nVirtualNodes);
+    for(std::uint32_t shard{0}; shard < nShards_; ++shard)
+    {
+        for(std::uint64_t node{0}; node < nVirtualNodes; ++node)
+        {
+            points_.emplace_back(Mix((static_cast<std::uint64_t>(shard) << 32) | node), shard);
+        }
+    }
+    std::sort(points_.begin(), points_.end());
+}
+
+std::size_t ConsistentHashRing::GetShardCount() const
+{
+    return nShards_;
+}
+
+std::size_t ConsistentHashRing::GetShard(std::string_view stationId) const
+{
+    const auto hash{HashStationId(stationId)};
+    auto point{std::lower_bound(points_.begin(), points_.end(), std::make_pair(hash, std::uint32_t{0}))};
+    if(point == points_.end())
+    {
+        point = points_.begin();
+    }
+    return point->second;
+}
+
+// PassengerShardServer
+
+class PassengerShardServer::Session : public std::enable_shared_from_this<Session>
+{
+public:
+    Session(PassengerShardServer& server, local::socket&& socket) : server_{server}, socket_{std::move(socket)}
+    {
+    }
+
+    void Start()
+    {
+        ReadHeader();
+    }
+
+    void Close()
+    {
+        boost::system::error_code ignored{};
+        socket_.close(ignored);
+    }
+
+private:
+    PassengerShardServer& server_;
+    local::socket socket_;
+    char header_[kHeaderSize]{};
+    std::string payload_{};
+    std::string reply_{};
+
+    // Reused across events, so that recording an event does not allocate.
+    PassengerEvent event_{};
+
+    void ReadHeader()
+    {
+        boost::asio::async_read(socket_, boost::asio::buffer(header_), [self = shared_from_this()](auto ec, auto) {
+            self->OnHeader(ec);
+        });
+    }
+
+    void OnHeader(const boost::system::error_code& ec)
+    {
+        if(ec)
+        {
+            // Routers disconnect at end of file. Stop closes the sessions.
+            if(ec != boost::asio::error::eof && !server_.stopped_)
+            {
+                NetworkMonitor::Log(__func__, ec);
+            }
+            return;
+        }
+        std::uint32_t size{0};
+        std::memcpy(&size, header_, sizeof(size));
+        if(size > kMaxPayloadSize)
+        {
+            NetworkMonitor::Log(__func__, MakeProtocolError().code());
+            Close();
+            return;
+        }
+        payload_.resize(size);
+        boost::asio::async_read(socket_, boost::asio::buffer(payload_), [self = shared_from_this()](auto ec, auto) {
+            self->OnPayload(ec);
+        });
+    }
+
+    void OnPayload(const boost::system::error_code& ec)
+    {
+        if(ec)
+        {
+            if(!server_.stopped_)
+            {
+                NetworkMonitor::Log(__func__, ec);
+            }
+            return;
+        }
+        if(!Handle(static_cast<MessageType>(header_[4])))
+        {
+            NetworkMonitor::Log(__func__, MakeProtocolError().code());
+            Close();
+            return;
+        }
+        if(reply_.empty())
+        {
+            ReadHeader();
+            return;
+        }
+        boost::asio::async_write(socket_, boost::asio::buffer(reply_), [self = shared_from_this()](auto ec, auto) {
+            if(ec)
+            {
+                NetworkMonitor::Log("OnWrite", ec);
+                return;
+            }
+            self->ReadHeader();
+        });
+    }
+
+    // Handle the message in payload_, and fill reply_ if it needs a reply.
+    // Returns false if the message is malformed.
+    bool Handle(MessageType type)
+    {
+        reply_.clear();
+        const auto* data{payload_.data()};
+        const auto* end{data + payload_.size()};
+        switch(type)
+        {
+        case MessageType::Events:
+            while(data < end)
+            {
+                if(!ReadEvent(data, end, event_))
+                {
+                    return false;
+                }
+                server_.Record(event_);
+            }
+            return true;
+        case MessageType::Sync:
+            StartFrame(reply_, type);
+            break;
+        case MessageType::PassengerCount: {
+            StartFrame(reply_, type);
+            Append(reply_, static_cast<std::int64_t>(server_.GetPassengerCount(payload_)));
+            break;
+        }
+        case MessageType::BusiestStations: {
+            std::uint64_t k{0};
+            if(!Read(data, end, k))
+            {
+                return false;
+            }
+            const auto busiest{server_.GetBusiestStations(k)};
+            StartFrame(reply_, type);
+            Append(reply_, static_cast<std::uint32_t>(busiest.size()));
+            for(const auto& station : busiest)
+            {
+                Append(reply_, static_cast<std::int64_t>(station.count));
+                AppendString(reply_, station.stationId);
+            }
+            break;
+        }
+        case MessageType::Stats: {
+            const auto stats{server_.GetStats()};
+            StartFrame(reply_, type);
+            Append(reply_, stats.recorded);
+            Append(reply_, stats.failed);
+            Append(reply_, stats.misrouted);
+            break;
+        }
+        default:
+            return false;
+        }
+        EndFrame(reply_);
+        return true;
+    }
+};
+
+PassengerShardServer::PassengerShardServer(boost::asio::io_context& ioc,
+                                           TransportNetwork& network,
+                                           const ConsistentHashRing& ring,
+                                           std::size_t shard,
+                                           const std::filesystem::path& socketPath)
+    : network_{network}, ring_{ring}, shard_{shard}, socketPath_{socketPath}, acceptor_{ioc}
+{
+    std::error_code ignored{};
+    std::filesystem::remove(socketPath_, ignored);
+    const local::endpoint endpoint{socketPath_.string()};
+    acceptor_.open(endpoint.protocol());
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+    Accept();
+}
+
+PassengerShardServer::~PassengerShardServer()
+{
+    std::error_code ignored{};
+    std::filesystem::remove(socketPath_, ignored);
+}
+
+void PassengerShardServer::Stop()
+{
+    stopped_ = true;
+    boost::system::error_code ignored{};
+    acceptor_.close(ignored);
+    for(auto& weak : sessions_)
+    {
+        if(auto session{weak.lock()})
+        {
+            session->Close();
+        }
+    }
+    sessions_.clear();
+}
+
+PassengerShardStats PassengerShardServer::GetStats() const
+{
+    return PassengerShardStats{
+        recorded_.load(std::memory_order_relaxed),
+        failed_.load(std::memory_order_relaxed),
+        misrouted_.load(std::memory_order_relaxed),
+    };
+}
+
+void PassengerShardServer::Accept()
+{
+    acceptor_.async_accept([this](auto ec, local::socket socket) {
+        if(ec || stopped_)
+        {
+            if(ec != boost::asio::error::operation_aborted)
+            {
+                Log("OnAccept", ec);
+            }
+            return;
+        }
+        sessions_.remove_if([](const auto& weak) { return weak.expired(); });
+        auto session{std::make_shared<Session>(*this, std::move(socket))};
+        sessions_.push_back(session);
+        session->Start();
+        Accept();
+    });
+}
+
+void PassengerShardServer::Record(const PassengerEvent& event)
+{
+    if(ring_.GetShard(event.stationId) != shard_)
+    {
+        misrouted_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    (network_.RecordPassengerEvent(event) ? recorded_ : failed_).fetch_add(1, std::memory_order_relaxed);
+}
+
+long long int PassengerShardServer::GetPassengerCount(const Id& station) const
+{
+    if(ring_.GetShard(station) != shard_)
+    {
+        return 0;
+    }
+    try
+    {
+        return network_.GetPassengerCount(station);
+    }
+    catch(const std::runtime_error&)
+    {
+        // Not in the network.
+        return 0;
+    }
+}
+
+std::vector<StationPassengerCount> PassengerShardServer::GetBusiestStations(std::size_t k) const
+{
+    // The network ranks the stations of the other shards too, at 0
+    // passengers: We ask for more until we have k of ours, or all of them.
+    std::vector<StationPassengerCount> owned{};
+    auto request{k};
+    while(k > 0)
+    {
+        auto busiest{network_.GetBusiestStations(request)};
+        owned.clear();
+        for(auto& station : busiest)
+        {
+            if(owned.size() < k && ring_.GetShard(station.stationId) == shard_)
+            {
+                owned.push_back(std::move(station));
+            }
+        }
+        if(owned.size() == k || busiest.size() < request)
+        {
+            break;
+        }
+        request *= 2;
+    }
+    return owned;
+}
+
+// PassengerShardRouter
+
+PassengerShardRouter::PassengerShardRouter(const std::vector<std::filesystem::path>& socketPaths,
+                                           const PassengerShardRouterOptions& options)
+    : options_{options}, ring_{socketPaths.size(), options.nVirtualNodes}
+{
+    if(socketPaths.empty())
+    {
+        throw std::invalid_argument{"PassengerShardRouter needs at least one shard"};
+    }
+    if(options.batchBytes > kMaxBatchBytes)
+    {
+        throw std::invalid_argument{"PassengerShardRouter batch size exceeds the shard frame limit"};
+    }
+    const auto deadline{std::chrono::steady_clock::now() + options_.connectTimeout};
+    shards_.reserve(socketPaths.size());
+    for(const auto& path : socketPaths)
+    {
+        auto& shard{shards_.emplace_back(Shard{local::socket{ioc_}})};
+        const local::endpoint endpoint{path.string()};
+        boost::system::error_code ec{};
+        while(shard.socket.connect(endpoint, ec))
+        {
+            // The shard may still be starting up.
+            boost::system::error_code ignored{};
+            shard.socket.close(ignored);
+            if(std::chrono::steady_clock::now() >= deadline)
+            {
+                throw boost::system::system_error{ec};
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+    }
+}
+
+PassengerShardRouter::~PassengerShardRouter()
+{
+    for(auto& shard : shards_)
+    {
+        try
+        {
+            Send(shard);
+        }
+        catch(const boost::system::system_error& error)
+        {
+            Log(__func__, error.code());
+        }
+    }
+}
+
+std::size_t PassengerShardRouter::GetShardCount() const
+{
+    return shards_.size();
+}
+
+void PassengerShardRouter::RecordPassengerEvent(const PassengerEvent& event)
+{
+    auto& shard{shards_[ring_.GetShard(event.stationId)]};
+    if(shard.pending.empty())
+    {
+        StartFrame(shard.pending, MessageType::Events);
+    }
+    AppendEvent(shard.pending, event);
+    if(shard.pending.size() >= options_.batchBytes)
+    {
+        Send(shard);
+    }
+}
+
+void PassengerShardRouter::Flush()
+{
+    std::vector<std::size_t> targets(shards_.size());
+    for(std::size_t idx{0}; idx < targets.size(); ++idx)
+    {
+        targets[idx] = idx;
+    }
+    ScatterGather(targets, static_cast<std::uint8_t>(MessageType::Sync), {}, [](std::size_t, std::string_view) {});
+}
+
+long long int PassengerShardRouter::GetPassengerCount(const Id& station)
+{
+    long long int count{0};
+    ScatterGather({ring_.GetShard(station)},
+                  static_cast<std::uint8_t>(MessageType::PassengerCount),
+                  station,
+                  [&count](std::size_t, std::string_view reply) {
+                      std::int64_t value{0};
+                      const auto* data{reply.data()};
+                      if(!Read(data, data + reply.size(), value))
+                      {
+                          throw MakeProtocolError();
+                      }
+                      count = value;
+                  });
+    return count;
+}
+
+std::vector<StationPassengerCount> PassengerShardRouter::GetBusiestStations(std::size_t k)
+{
+    // Each shard answers with its own k busiest stations: The k busiest
+    // overall are among them.
+    std::vector<StationPassengerCount> busiest{};
+    std::vector<std::size_t> targets(shards_.size());
+    for(std::size_t idx{0}; idx < targets.size(); ++idx)
+    {
+        targets[idx] = idx;
+    }
+    std::string request{};
+    Append(request, static_cast<std::uint64_t>(k));
+    ScatterGather(targets,
+                  static_cast<std::uint8_t>(MessageType::BusiestStations),
+                  request,
+                  [&busiest](std::size_t, std::string_view reply) {
+                      const auto* data{reply.data()};
+                      const auto* end{data + reply.size()};
+                      std::uint32_t nStations{0};
+                      if(!Read(data, end, nStations))
+                      {
+                          throw MakeProtocolError();
+                      }
+                      for(std::uint32_t idx{0}; idx < nStations; ++idx)
+                      {
+                          auto& station{busiest.emplace_back()};
+                          std::int64_t count{0};
+                          if(!Read(data, end, count) || !ReadString(data, end, station.stationId))
+                          {
+                              throw MakeProtocolError();
+                          }
+                          station.count = count;
+                      }
+                  });
+    const auto isBusier{[](const auto& a, const auto& b) {
+        return a.count != b.count ? a.count > b.count : a.stationId < b.stationId;
+    }};
+    const auto nBusiest{std::min(k, busiest.size())};
+    std::partial_sort(busiest.begin(), busiest.begin() + nBusiest, busiest.end(), isBusier);
+    busiest.resize(nBusiest);
+    return busiest;
+}
+
+std::vector<PassengerShardStats> PassengerShardRouter::GetShardStats()
+{
+    std::vector<PassengerShardStats> stats(shards_.size());
+    std::vector<std::size_t> targets(shards_.size());
+    for(std::size_t idx{0}; idx < targets.size(); ++idx)
+    {
+        targets[idx] = idx;
+    }
+    ScatterGather(targets,
+                  static_cast<std::uint8_t>(MessageType::Stats),
+                  {},
+                  [&stats](std::size_t shard, std::string_view reply) {
+                      const auto* data{reply.data()};
+                      const auto* end{data + reply.size()};
+                      auto& shardStats{stats[shard]};
+                      if(!Read(data, end, shardStats.recorded) || !Read(data, end, shardStats.failed) ||
+                         !Read(data, end, shardStats.misrouted))
+                      {
+                          throw MakeProtocolError();
+                      }
+                  });
+    return stats;
+}
+
+void PassengerShardRouter::Send(Shard& shard)
+{
+    if(shard.pending.empty())
+    {
+        return;
+    }
+    EndFrame(shard.pending);
+    boost::asio::write(shard.socket, boost::asio::buffer(shard.pending));
+    shard.pending.clear();
+}
+
+template <typename OnReply>
+void PassengerShardRouter::ScatterGather(const std::vector<std::size_t>& targets,
+                                         std::uint8_t type,
+                                         std::string_view payload,
+                                         OnReply&& onReply)
+{
+    // All requests go out before we wait for the first reply, so that the
+    // shards work on them in parallel.
+    std::string request{};
+    StartFrame(request, static_cast<MessageType>(type));
+    request.append(payload);
+    EndFrame(request);
+    for(const auto target : targets)
+    {
+        auto& shard{shards_[target]};
+        Send(shard);
+        boost::asio::write(shard.socket, boost::asio::buffer(request));
+    }
+    for(const auto target : targets)
+    {
+        auto& socket{shards_[target].socket};
+        char header[kHeaderSize]{};
+        boost::asio::read(socket, boost::asio::buffer(header));
+        std::uint32_t size{0};
+        std::memcpy(&size, header, sizeof(size));
+        if(static_cast<std::uint8_t>(header[4]) != type)
+        {
+            throw MakeProtocolError();
+        }
+        reply_.resize(size);
+        boost::asio::read(socket, boost::asio::buffer(reply_));
+        onReply(target, std::string_view{reply_});
+    }
+}
@@ -0,0 +1,177 @@
+#include "TlsContext.hpp"
+
+#include <openssl/ssl.h>
+
+#include <cstdint>
+#include <utility>
+
+using NetworkMonitor::TlsSessionCache;
+
+namespace {
+
+// The session cache key of a connection is stored in its SSL object, so that
+// we can find it when a new session comes in. OpenSSL frees it with the SSL
+// object.
+void FreeSessionKey(void* /*parent*/,
+                    void* key,
+                    CRYPTO_EX_DATA* /*data*/,
+                    int /*index*/,
+                    long /*argl*/,
+                    void* /*argp*/)
+{
+    delete static_cast<std::string*>(key);
+}
+
+int GetSessionKeyIndex()
+{
+    static const int index{SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, FreeSessionKey)};
+    return index;
+}
+
+// Sessions from different contexts must not mix: A context may verify its
+// peers more strictly than another.
+std::string MakeSessionKey(SSL* ssl, const std::string& host, const std::string& port)
+{
+    return host + ":" + port + "@" + std::to_string(reinterpret_cast<std::uintptr_t>(SSL_get_SSL_CTX(ssl)));
+}
+
+// Called by OpenSSL when a connection negotiates a new session: At the end of
+// a TLS 1.2 handshake, or when a TLS 1.3 session ticket arrives.
+int OnNewSession(SSL* ssl, SSL_SESSION* session)
+{
+    const auto* key{static_cast<std::string*>(SSL_get_ex_data(ssl, GetSessionKeyIndex()))};
+    if(key == nullptr)
+    {
+        // Not a connection we manage: OpenSSL keeps the reference.
+        return 0;
+    }
+    TlsSessionCache::Default().Store(*key, session);
+    return 1;
+}
+
+} // namespace
+
+std::shared_ptr<boost::asio::ssl::context> NetworkMonitor::GetSharedTlsClientContext(
+    const std::filesystem::path& caCertFile)
+{
+    static std::mutex mutex{};
+    static std::map<std::filesystem::path, std::weak_ptr<boost::asio::ssl::context>> contexts{};
+
+    std::lock_guard<std::mutex> lock{mutex};
+    auto& shared{contexts[caCertFile]};
+    if(auto ctx{shared.lock()}; ctx != nullptr)
+    {
+        return ctx;
+    }
+
+    auto ctx{std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls_client)};
+    ctx->set_options(boost::asio::ssl::context::default_workarounds | boost::asio::ssl::context::no_sslv2 |
+                     boost::asio::ssl::context::no_sslv3 | boost::asio::ssl::context::no_tlsv1 |
+                     boost::asio::ssl::context::no_tlsv1_1);
+    ctx->set_verify_mode(boost::asio::ssl::verify_peer);
+    if(caCertFile.empty())
+    {
+        ctx->set_default_verify_paths();
+    }
+    else
+    {
+        ctx->load_verify_file(caCertFile.string());
+    }
+    EnableTlsSessionResumption(*ctx);
+    shared = ctx;
+    return ctx;
+}
+
+void NetworkMonitor::EnableTlsSessionResumption(boost::asio::ssl::context& ctx)
+{
+    // Contexts are often shared by clients created on different threads.
+    static std::mutex mutex{};
+    std::lock_guard<std::mutex> lock{mutex};
+
+    auto* native{ctx.native_handle()};
+    if(SSL_CTX_sess_get_new_cb(native) == OnNewSession)
+    {
+        return;
+    }
+
+    // We keep the sessions in our own cache, by host and port: OpenSSL's
+    // internal cache is only useful to servers.
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(native, OnNewSession);
+}
+
+bool NetworkMonitor::PrepareTlsSessionResumption(SSL* ssl, const std::string& host, const std::string& port)
+{
+    auto key{MakeSessionKey(ssl, host, port)};
+    auto* session{TlsSessionCache::Default().Get(key)};
+
+    // The SSL object owns the key from now on.
+    delete static_cast<std::string*>(SSL_get_ex_data(ssl, GetSessionKeyIndex()));
+    SSL_set_ex_data(ssl, GetSessionKeyIndex(), new std::string{std::move(key)});
+
+    if(session == nullptr)
+    {
+        return false;
+    }
+    const auto ok{SSL_set_session(ssl, session) == 1};
+    SSL_SESSION_free(session);
+    return ok;
+}
+
+// TlsSessionCache
+
+TlsSessionCache::~TlsSessionCache()
+{
+    Clear();
+}
+
+TlsSessionCache& TlsSessionCache::Default()
+{
+    static TlsSessionCache cache{};
+    return cache;
+}
+
+void TlsSessionCache::Store(const std::string& key, SSL_SESSION* session)
+{
+    SSL_SESSION* replaced{nullptr};
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto& saved{sessions_[key]};
+        replaced = std::exchange(saved, session);
+    }
+    if(replaced != nullptr)
+    {
+        SSL_SESSION_free(replaced);
+    }
+}
+
+SSL_SESSION* TlsSessionCache::Get(const std::string& key) const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it{sessions_.find(key)};
+    if(it == sessions_.end() || SSL_SESSION_is_resumable(it->second) != 1)
+    {
+        return nullptr;
+    }
+    SSL_SESSION_up_ref(it->second);
+    return it->second;
+}
+
+void TlsSessionCache::Clear()
+{
+    std::map<std::string, SSL_SESSION*> sessions{};
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        sessions.swap(sessions_);
+    }
+    for(auto& [key, session] : sessions)
+    {
+        SSL_SESSION_free(session);
+    }
+}
+
+std::size_t TlsSessionCache::GetSize() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return sessions_.size();
+}
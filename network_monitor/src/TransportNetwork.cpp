@@ -1,161 +1,2485 @@
 #include "TransportNetwork.hpp"
 
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <queue>
 #include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "Metrics.hpp"
+
+using NetworkMonitor::Counter;
+using NetworkMonitor::CrowdingRoutingOptions;
+using NetworkMonitor::FlowWindow;
 using NetworkMonitor::Id;
+using NetworkMonitor::Journey;
+using NetworkMonitor::LayoutChangeSet;
 using NetworkMonitor::Line;
+using NetworkMonitor::MemoryMode;
+using NetworkMonitor::MemoryUsage;
+using NetworkMonitor::MetricsRegistry;
+using NetworkMonitor::NetworkLayout;
 using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerFlow;
+using NetworkMonitor::QueryCacheOptions;
+using NetworkMonitor::QueryCacheStats;
+using NetworkMonitor::ReachabilitySeed;
+using NetworkMonitor::ReachableStation;
 using NetworkMonitor::Route;
+using NetworkMonitor::RouteIdView;
+using NetworkMonitor::RouteTravelTimeQuery;
 using NetworkMonitor::Station;
+using NetworkMonitor::StationPassengerCount;
 using NetworkMonitor::TransportNetwork;
+using NetworkMonitor::TravelTimeProfile;
+using NetworkMonitor::TravelTimeQuery;
 
-bool Station::operator==(const Station& other) const
+namespace {
+
+// Passenger event counters, looked up once.
+struct PassengerEventMetrics
 {
-    return id == other.id;
+    Counter& recorded;
+    Counter& failed;
+};
+
+const PassengerEventMetrics& GetPassengerEventMetrics()
+{
+    static const PassengerEventMetrics metrics{[]() {
+        auto& registry{MetricsRegistry::Default()};
+        const std::string name{"network_monitor_passenger_events_total"};
+        const std::string help{"Number of passenger events, by result."};
+        return PassengerEventMetrics{
+            registry.GetCounter(name, help, "result=\"recorded\""),
+            registry.GetCounter(name, help, "result=\"failed\""),
+        };
+    }()};
+    return metrics;
 }
 
-bool Route::operator==(const Route& other) const
+// Count a passenger event and pass the result through.
+bool CountPassengerEvent(bool recorded)
 {
-    return id == other.id;
+    if(MetricsRegistry::Default().IsEnabled())
+    {
+        const auto& metrics{GetPassengerEventMetrics()};
+        (recorded ? metrics.recorded : metrics.failed).Increment();
+    }
+    return recorded;
 }
 
-bool Line::operator==(const Line& other) const
+// Minimum number of routes worth a thread of their own in AddLines.
+constexpr std::size_t kMinRoutesPerChunk{256};
+
+// Minimum number of queries worth a thread of their own in the batch queries.
+constexpr std::size_t kMinQueriesPerChunk{4096};
+
+std::size_t GetThreadCount(std::size_t nThreads)
 {
-    return id == other.id;
+    return nThreads > 0 ? nThreads : std::max(1u, std::thread::hardware_concurrency());
 }
 
-bool TransportNetwork::AddStation(const Station& station)
+// Items [first, last) of chunk `chunk`, when splitting `size` items in
+// `nChunks` chunks of about the same size.
+std::pair<std::size_t, std::size_t> GetChunk(std::size_t size, std::size_t nChunks, std::size_t chunk)
 {
-    if(GetStation(station.id) != nullptr)
+    return {size * chunk / nChunks, size * (chunk + 1) / nChunks};
+}
+
+// Run `task(chunk)` for each chunk in [0, nChunks), in parallel if there is
+// more than one chunk, and wait for all of them. The calling thread runs the
+// first chunk.
+// Rethrows the first exception thrown by a task.
+void RunChunks(std::size_t nChunks, const std::function<void(std::size_t)>& task)
+{
+    if(nChunks == 1)
     {
-        return false;
+        task(0);
+        return;
+    }
+    boost::asio::thread_pool pool{nChunks - 1};
+    std::mutex mutex{};
+    std::exception_ptr error{nullptr};
+    for(std::size_t chunk{1}; chunk < nChunks; ++chunk)
+    {
+        boost::asio::post(pool, [&task, &mutex, &error, chunk]() {
+            try
+            {
+                task(chunk);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                if(error == nullptr)
+                {
+                    error = std::current_exception();
+                }
+            }
+        });
+    }
+    try
+    {
+        task(0);
+    }
+    catch(...)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if(error == nullptr)
+        {
+            error = std::current_exception();
+        }
+    }
+    pool.join();
+    if(error != nullptr)
+    {
+        std::rethrow_exception(error);
     }
+}
 
-    stations_.emplace(station.id, std::make_shared<GraphNode>(GraphNode{station.id, station.name, 0, {}}));
-    return true;
+constexpr std::uint32_t kSecondsPerDay{24 * 60 * 60};
+
+// Time of day of a time point, in seconds since midnight UTC.
+std::uint32_t GetTimeOfDay(std::chrono::system_clock::time_point time)
+{
+    const auto seconds{std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count()};
+    const auto timeOfDay{seconds % kSecondsPerDay};
+    return static_cast<std::uint32_t>(timeOfDay < 0 ? timeOfDay + kSecondsPerDay : timeOfDay);
 }
 
-bool TransportNetwork::AddLine(const Line& line)
+bool IsWellFormed(const TravelTimeProfile& profile)
 {
-    if(GetLine(line.id) != nullptr)
+    if(profile.steps.empty())
     {
         return false;
     }
-
-    auto lineInternal{std::make_shared<LineInternal>(LineInternal{line.id, line.name, {}})};
-    for(const auto& route : line.routes)
+    for(std::size_t idx{0}; idx < profile.steps.size(); ++idx)
     {
-        bool ok{AddRouteToLine(route, lineInternal)};
-        if(!ok)
+        const auto start{profile.steps[idx].start};
+        if(start.count() < 0 || start.count() >= kSecondsPerDay ||
+           (idx > 0 && start <= profile.steps[idx - 1].start))
         {
             return false;
         }
     }
-    lines_.emplace(line.id, std::move(lineInternal));
-
     return true;
 }
 
-bool TransportNetwork::RecordPassengerEvent(const PassengerEvent& event)
+// FNV-1a over the steps of a profile.
+std::uint64_t Hash(const TravelTimeProfile& profile)
 {
-    return false;
+    std::uint64_t hash{14695981039346656037ull};
+    auto add{[&hash](std::uint64_t value) {
+        for(int byte{0}; byte < 8; ++byte)
+        {
+            hash = (hash ^ ((value >> (8 * byte)) & 0xFF)) * 1099511628211ull;
+        }
+    }};
+    for(const auto& step : profile.steps)
+    {
+        add(static_cast<std::uint64_t>(step.start.count()));
+        add(step.travelTime);
+    }
+    return hash;
 }
 
-long long int TransportNetwork::GetPassengerCount(const Id& station) const
+// Scratch space of the reachability searches of a thread, by station index.
+// A travel time only holds if its station is stamped with the epoch of the
+// current search, so nothing needs clearing between searches.
+struct ReachabilitySearch
+{
+    std::vector<std::uint32_t> epochs{};
+    std::vector<unsigned int> travelTimes{};
+    std::vector<std::pair<unsigned int, std::uint32_t>> heap{};
+    std::uint32_t epoch{0};
+
+    // Start a search over `nStations` stations.
+    void Begin(std::size_t nStations)
+    {
+        if(epochs.size() < nStations)
+        {
+            epochs.resize(nStations, 0);
+            travelTimes.resize(nStations, 0);
+        }
+        if(++epoch == 0)
+        {
+            // The epoch wrapped around: Older stamps could look current.
+            std::fill(epochs.begin(), epochs.end(), 0);
+            epoch = 1;
+        }
+        heap.clear();
+    }
+
+    // Lower the travel time of a station, if shorter than what we have.
+    void Relax(std::uint32_t station, unsigned int travelTime)
+    {
+        if(epochs[station] == epoch && travelTimes[station] <= travelTime)
+        {
+            return;
+        }
+        epochs[station] = epoch;
+        travelTimes[station] = travelTime;
+        heap.emplace_back(travelTime, station);
+        std::push_heap(heap.begin(), heap.end(), std::greater<>{});
+    }
+};
+
+ReachabilitySearch& GetReachabilitySearch()
+{
+    thread_local ReachabilitySearch search{};
+    return search;
+}
+
+// Pair of adjacent stations, in either direction.
+using StationPair = std::pair<std::string_view, std::string_view>;
+
+StationPair MakeStationPair(std::string_view stationA, std::string_view stationB)
 {
-    return 0;
+    return stationA < stationB ? StationPair{stationA, stationB} : StationPair{stationB, stationA};
 }
 
-std::vector<Id> TransportNetwork::GetRoutesServingStation(const Id& station) const
+struct StationPairHash
+{
+    std::size_t operator()(const StationPair& pair) const
+    {
+        const auto hashA{std::hash<std::string_view>{}(pair.first)};
+        return hashA ^ (std::hash<std::string_view>{}(pair.second) + 0x9E3779B97F4A7C15ull + (hashA << 6) + (hashA >> 2));
+    }
+};
+
+// Add the pairs of adjacent stops of a route.
+void AddStationPairs(const Route& route, std::unordered_set<StationPair, StationPairHash>& pairs)
 {
-    return std::vector<Id>{};
+    for(std::size_t idx{0}; idx + 1 < route.stops.size(); ++idx)
+    {
+        pairs.insert(MakeStationPair(route.stops[idx], route.stops[idx + 1]));
+    }
 }
 
-bool TransportNetwork::SetTravelTime(const Id& stationA, const Id& stationB, const unsigned int travelTime)
+} // namespace
+
+bool Station::operator==(const Station& other) const
 {
-    return false;
+    return id == other.id;
 }
 
-unsigned int TransportNetwork::GetTravelTime(const Id& stationA, const Id& stationB) const
+bool Route::operator==(const Route& other) const
 {
-    return 0;
+    return id == other.id;
 }
 
-unsigned int TransportNetwork::GetTravelTime(const Id& line,
-                                             const Id& route,
-                                             const Id& stationA,
-                                             const Id& stationB) const
+bool Line::operator==(const Line& other) const
 {
-    return 0;
+    return id == other.id;
 }
 
-// TransportNetwork — Private methods
+long long int PassengerFlow::Net() const
+{
+    return static_cast<long long int>(in) - static_cast<long long int>(out);
+}
 
-std::vector<std::shared_ptr<TransportNetwork::GraphEdge>>::const_iterator TransportNetwork::GraphNode::FindEdgeForRoute(
-    const std::shared_ptr<RouteInternal>& route) const
+RouteIdView::RouteIdView(const std::string_view* data, std::size_t size)
+    : data_{data}
+    , size_{size}
 {
-    return std::vector<std::shared_ptr<TransportNetwork::GraphEdge>>::const_iterator{};
 }
 
-std::shared_ptr<TransportNetwork::GraphNode> TransportNetwork::GetStation(const Id& stationId) const
+RouteIdView::const_iterator RouteIdView::begin() const
 {
-    auto stationIt = stations_.find(stationId);
-    if(stationIt == end(stations_))
+    return data_;
+}
+
+RouteIdView::const_iterator RouteIdView::end() const
+{
+    return data_ + size_;
+}
+
+std::size_t RouteIdView::size() const
+{
+    return size_;
+}
+
+bool RouteIdView::empty() const
+{
+    return size_ == 0;
+}
+
+const std::string_view& RouteIdView::operator[](std::size_t idx) const
+{
+    return data_[idx];
+}
+
+std::size_t MemoryUsage::Total() const
+{
+    return stations + lines + edges + routeIndex + strings + lookupTables + passengerFlow + crowding +
+           travelTimeProfiles + queryCache + arenaOverhead;
+}
+
+std::size_t LayoutChangeSet::size() const
+{
+    auto size{addedStations.size() + renamedStations.size() + removedStations.size() + addedLines.size() +
+              removedLines.size() + travelTimes.size()};
+    for(const auto& line : modifiedLines)
     {
-        return nullptr;
+        size += 1 + line.addedRoutes.size() + line.removedRoutes.size();
     }
+    return size;
+}
 
-    return stationIt->second;
+bool LayoutChangeSet::empty() const
+{
+    return size() == 0;
 }
 
-std::shared_ptr<TransportNetwork::LineInternal> TransportNetwork::GetLine(const Id& lineId) const
+TransportNetwork::TransportNetwork(MemoryMode mode)
+    : memoryMode_{mode}
 {
-    auto lineIt = lines_.find(lineId);
-    if(lineIt == end(lines_))
+    if(memoryMode_ == MemoryMode::Compact)
     {
-        return nullptr;
+        flowCounterPool_ = std::make_unique<std::pmr::synchronized_pool_resource>();
     }
-    return lineIt->second;
 }
 
-std::shared_ptr<TransportNetwork::RouteInternal> TransportNetwork::GetRoute(const Id& lineId, const Id& routeId) const
+bool TransportNetwork::AddStation(const Station& station)
 {
-    return nullptr;
+    if(GetStation(station.id) != nullptr)
+    {
+        return false;
+    }
+
+    auto* arena{&arena_->resource};
+    auto* node{MakeInArena<GraphNode>(CopyToArena(station.id),
+                                      CopyToArena(station.name),
+                                      0,
+                                      std::pmr::vector<GraphEdge>(arena),
+                                      std::pmr::vector<std::string_view>(arena),
+                                      stations_.size(),
+                                      std::pmr::vector<std::size_t>(arena))};
+    stations_.emplace(node->id, node);
+    stationsByIndex_.push_back(node);
+    routing_->edgeOffsets.clear();
+    if(memoryMode_ == MemoryMode::Default)
+    {
+        flowCounters_.resize(flowCounters_.size() + kFlowCountersPerStation);
+    }
+
+    // New stations start with no passengers.
+    crowdingHeapPosition_.push_back(crowdingHeap_.size());
+    crowdingHeap_.push_back(CrowdingHeapEntry{0, node->index});
+    SiftCrowdingUp(crowdingHeap_.size() - 1);
+    return true;
 }
 
-bool TransportNetwork::AddRouteToLine(const Route& route, const std::shared_ptr<LineInternal>& lineInternal)
+bool TransportNetwork::AddLine(const Line& line)
 {
-    if(lineInternal->routes.find(route.id) != end(lineInternal->routes))
+    if(GetLine(line.id) != nullptr)
     {
         return false;
     }
+    routing_->edgeOffsets.clear();
+    ++version_;
 
-    std::vector<std::shared_ptr<GraphNode>> stops{};
-    stops.reserve(route.stops.size());
+    auto* arena{&arena_->resource};
+    auto* lineInternal{MakeInArena<LineInternal>(CopyToArena(line.id),
+                                                 CopyToArena(line.name),
+                                                 ArenaIdMap<RouteInternal*>(arena),
+                                                 std::pmr::vector<GraphNode*>(arena))};
+    lineInternal->routes.reserve(line.routes.size());
+    for(const auto& route : line.routes)
+    {
+        bool ok{AddRouteToLine(route, lineInternal)};
+        if(!ok)
+        {
+            return false;
+        }
+    }
 
-    for(const auto& stopsId : route.stops)
+    // Update the inverted index only once all routes were added, so that it
+    // never refers to a route of a line that did not make it into the network.
+    // The route ID lives in the arena, so its address is stable.
+    for(const auto& route : line.routes)
     {
-        const auto station{GetStation(stopsId)};
-        if(station == nullptr)
+        const auto* routeInternal{lineInternal->routes.at(route.id)};
+        for(auto* stop : routeInternal->stops)
+        {
+            stop->routes.emplace_back(routeInternal->id);
+        }
+    }
+    IndexLineStations(lineInternal);
+    lines_.emplace(lineInternal->id, lineInternal);
+
+    return true;
+}
+
+bool TransportNetwork::RecordPassengerEvent(const PassengerEvent& event)
+{
+    auto* station{GetStation(event.stationId)};
+    if(station == nullptr)
+    {
+        return CountPassengerEvent(false);
+    }
+
+    // The count update must be ordered before the check of the crowding heap
+    // flag in UpdateCrowding (see RepairCrowdingHeap). On x86 a sequentially
+    // consistent read-modify-write costs the same as a relaxed one.
+    switch(event.type)
+    {
+        case PassengerEvent::Type::In:
+            station->passengerCount.fetch_add(1);
+            break;
+        case PassengerEvent::Type::Out:
+            station->passengerCount.fetch_sub(1);
+            break;
+        default:
+            return CountPassengerEvent(false);
+    }
+
+    UpdateCrowding(station);
+    MarkCrowdingPenaltyStale(station);
+    if(event.timestamp != std::chrono::system_clock::time_point{})
+    {
+        RecordPassengerFlow(station, event.type, event.timestamp);
+    }
+    return CountPassengerEvent(true);
+}
+
+bool TransportNetwork::AddLines(const std::vector<Line>& lines, std::size_t nThreads)
+{
+    // Check everything that could make AddLine fail before we touch the
+    // network, so that we can add all lines or none.
+    // Routes are numbered across all lines, in order.
+    std::vector<const Route*> routes{};
+    std::unordered_set<std::string_view> lineIds{};
+    for(const auto& line : lines)
+    {
+        if(GetLine(line.id) != nullptr || !lineIds.insert(line.id).second)
         {
             return false;
         }
-        stops.push_back(station);
+        std::unordered_set<std::string_view> routeIds{};
+        for(const auto& route : line.routes)
+        {
+            if(!routeIds.insert(route.id).second || route.stops.empty())
+            {
+                return false;
+            }
+            routes.push_back(&route);
+        }
     }
 
-    auto routeInternal{std::make_shared<RouteInternal>(RouteInternal{route.id, lineInternal, std::move(stops)})};
+    nThreads = GetThreadCount(nThreads);
+    const auto nChunks{std::clamp<std::size_t>(routes.size() / kMinRoutesPerChunk, 1, nThreads)};
 
-    for(size_t idx{0}; idx < routeInternal->stops.size() - 1; ++idx)
+    // Resolve the stops. The station map is only read from here on.
+    std::vector<std::vector<GraphNode*>> resolved(routes.size());
+    std::atomic<bool> ok{true};
+    RunChunks(nChunks, [this, &routes, &resolved, &ok, nChunks](std::size_t chunk) {
+        const auto [first, last]{GetChunk(routes.size(), nChunks, chunk)};
+        for(std::size_t idx{first}; idx < last && ok.load(std::memory_order_relaxed); ++idx)
+        {
+            auto& stops{resolved[idx]};
+            stops.reserve(routes[idx]->stops.size());
+            for(const auto& stopId : routes[idx]->stops)
+            {
+                auto* station{GetStation(stopId)};
+                if(station == nullptr)
+                {
+                    ok.store(false, std::memory_order_relaxed);
+                    return;
+                }
+                stops.push_back(station);
+            }
+        }
+    });
+    if(!ok)
+    {
+        return false;
+    }
+
+    // Count the edges and the inverted index entries that each chunk adds to
+    // each station, by station index. The counts are then turned into the
+    // position at which each chunk writes its first entry for a station, so
+    // that the entries end up in the same order as with AddLine.
+    const auto nStations{stationsByIndex_.size()};
+    std::vector<std::vector<std::uint32_t>> edgeOffsets(nChunks);
+    std::vector<std::vector<std::uint32_t>> routeOffsets(nChunks);
+    RunChunks(nChunks, [&resolved, &edgeOffsets, &routeOffsets, nChunks, nStations](std::size_t chunk) {
+        auto& edgeCounts{edgeOffsets[chunk]};
+        auto& routeCounts{routeOffsets[chunk]};
+        edgeCounts.resize(nStations, 0);
+        routeCounts.resize(nStations, 0);
+        const auto [first, last]{GetChunk(resolved.size(), nChunks, chunk)};
+        for(std::size_t idx{first}; idx < last; ++idx)
+        {
+            const auto& stops{resolved[idx]};
+            for(std::size_t stop{0}; stop < stops.size(); ++stop)
+            {
+                ++routeCounts[stops[stop]->index];
+                edgeCounts[stops[stop]->index] += stop + 1 < stops.size() ? 1 : 0;
+            }
+        }
+    });
+
+    // From here on we modify the network. Arena allocations are not
+    // thread-safe, so we allocate everything up front.
+    routing_->edgeOffsets.clear();
+    ++version_;
+    for(std::size_t station{0}; station < nStations; ++station)
+    {
+        auto* node{stationsByIndex_[station]};
+        auto nEdges{node->edges.size()};
+        auto nRoutes{node->routes.size()};
+        for(std::size_t chunk{0}; chunk < nChunks; ++chunk)
+        {
+            nEdges += std::exchange(edgeOffsets[chunk][station], static_cast<std::uint32_t>(nEdges));
+            nRoutes += std::exchange(routeOffsets[chunk][station], static_cast<std::uint32_t>(nRoutes));
+        }
+        node->edges.resize(nEdges);
+        node->routes.resize(nRoutes);
+    }
+
+    auto* arena{&arena_->resource};
+    std::vector<LineInternal*> linesInternal{};
+    linesInternal.reserve(lines.size());
+    std::vector<RouteInternal*> routesInternal{};
+    routesInternal.reserve(routes.size());
+    for(const auto& line : lines)
     {
-        const auto& thisStop{routeInternal->stops[idx]};
-        const auto& nextStop{routeInternal->stops[idx + 1]};
+        auto* lineInternal{MakeInArena<LineInternal>(CopyToArena(line.id),
+                                                     CopyToArena(line.name),
+                                                     ArenaIdMap<RouteInternal*>(arena),
+                                                     std::pmr::vector<GraphNode*>(arena))};
+        lineInternal->routes.reserve(line.routes.size());
+        for(std::size_t idx{0}; idx < line.routes.size(); ++idx)
+        {
+            const auto& resolvedStops{resolved[routesInternal.size()]};
+            std::pmr::vector<GraphNode*> stops(resolvedStops.begin(), resolvedStops.end(), arena);
+            auto* routeInternal{MakeInArena<RouteInternal>(
+                CopyToArena(line.routes[idx].id), lineInternal, std::move(stops))};
+            lineInternal->routes.emplace(routeInternal->id, routeInternal);
+            routesInternal.push_back(routeInternal);
+        }
+        linesInternal.push_back(lineInternal);
+    }
+
+    // Scatter the edges and the inverted index entries. Chunks write to
+    // different elements of the station vectors.
+    RunChunks(nChunks, [&routesInternal, &edgeOffsets, &routeOffsets, nChunks](std::size_t chunk) {
+        auto& edgeOffset{edgeOffsets[chunk]};
+        auto& routeOffset{routeOffsets[chunk]};
+        const auto [first, last]{GetChunk(routesInternal.size(), nChunks, chunk)};
+        for(std::size_t idx{first}; idx < last; ++idx)
+        {
+            const auto* routeInternal{routesInternal[idx]};
+            const auto& stops{routeInternal->stops};
+            for(std::size_t stop{0}; stop < stops.size(); ++stop)
+            {
+                auto* node{stops[stop]};
+                node->routes[routeOffset[node->index]++] = routeInternal->id;
+                if(stop + 1 < stops.size())
+                {
+                    node->edges[edgeOffset[node->index]++] = GraphEdge{routesInternal[idx], stops[stop + 1], 0};
+                }
+            }
+        }
+    });
 
-        thisStop->edges.emplace_back(std::make_shared<GraphEdge>(GraphEdge{routeInternal, nextStop, 0}));
+    // Stations served by each line, each listed once, sorted by index.
+    std::vector<std::vector<GraphNode*>> lineStations(lines.size());
+    const auto nLineChunks{std::clamp<std::size_t>(lines.size() / kMinRoutesPerChunk, 1, nThreads)};
+    RunChunks(nLineChunks, [&linesInternal, &lineStations, nLineChunks](std::size_t chunk) {
+        const auto [first, last]{GetChunk(linesInternal.size(), nLineChunks, chunk)};
+        for(std::size_t idx{first}; idx < last; ++idx)
+        {
+            auto& stations{lineStations[idx]};
+            for(const auto& [routeId, routeInternal] : linesInternal[idx]->routes)
+            {
+                stations.insert(stations.end(), routeInternal->stops.begin(), routeInternal->stops.end());
+            }
+            std::sort(stations.begin(), stations.end(), [](const auto* a, const auto* b) {
+                return a->index < b->index;
+            });
+            stations.erase(std::unique(stations.begin(), stations.end()), stations.end());
+        }
+    });
+    lines_.reserve(lines_.size() + linesInternal.size());
+    for(std::size_t idx{0}; idx < linesInternal.size(); ++idx)
+    {
+        auto* lineInternal{linesInternal[idx]};
+        lineInternal->stations.assign(lineStations[idx].begin(), lineStations[idx].end());
+        lines_.emplace(lineInternal->id, lineInternal);
     }
 
-    lineInternal->routes[route.id] = std::move(routeInternal);
     return true;
-}
\ No newline at end of file
+}
+
+LayoutChangeSet TransportNetwork::DiffLayout(const NetworkLayout& layout) const
+{
+    LayoutChangeSet changes{};
+
+    // Stations in the layout, by index.
+    std::vector<bool> kept(stationsByIndex_.size(), false);
+    for(const auto& station : layout.stations)
+    {
+        const auto* node{GetStation(station.id)};
+        if(node == nullptr)
+        {
+            changes.addedStations.push_back(station);
+            continue;
+        }
+        kept[node->index] = true;
+        if(node->name != station.name)
+        {
+            changes.renamedStations.push_back(station);
+        }
+    }
+    for(std::size_t idx{0}; idx < kept.size(); ++idx)
+    {
+        if(!kept[idx])
+        {
+            changes.removedStations.emplace_back(stationsByIndex_[idx]->id);
+        }
+    }
+
+    // The edges of the added routes take the travel time and the profile of
+    // the edges already between their stops. Only the stops with no edges
+    // between them yet need their travel time set, even if it did not change.
+    std::unordered_set<StationPair, StationPairHash> newPairs{};
+    std::unordered_set<std::string_view> lineIds{};
+    lineIds.reserve(layout.lines.size());
+    for(const auto& line : layout.lines)
+    {
+        lineIds.insert(line.id);
+        const auto* lineInternal{GetLine(line.id)};
+        if(lineInternal == nullptr)
+        {
+            changes.addedLines.push_back(line);
+            for(const auto& route : line.routes)
+            {
+                AddStationPairs(route, newPairs);
+            }
+            continue;
+        }
+
+        LayoutChangeSet::LineChange change{line.id, line.name, {}, {}};
+        std::unordered_set<std::string_view> routeIds{};
+        for(const auto& route : line.routes)
+        {
+            routeIds.insert(route.id);
+            auto routeIt{lineInternal->routes.find(route.id)};
+            if(routeIt != end(lineInternal->routes))
+            {
+                const auto& stops{routeIt->second->stops};
+                if(std::equal(stops.begin(), stops.end(), route.stops.begin(), route.stops.end(),
+                              [](const auto* stop, const auto& stopId) { return stop->id == stopId; }))
+                {
+                    continue;
+                }
+                change.removedRoutes.push_back(route.id);
+            }
+            change.addedRoutes.push_back(route);
+            AddStationPairs(route, newPairs);
+        }
+        for(const auto& [routeId, routeInternal] : lineInternal->routes)
+        {
+            if(routeIds.count(routeId) == 0)
+            {
+                change.removedRoutes.emplace_back(routeId);
+            }
+        }
+        if(lineInternal->name != line.name || !change.addedRoutes.empty() || !change.removedRoutes.empty())
+        {
+            changes.modifiedLines.push_back(std::move(change));
+        }
+    }
+    for(const auto& [lineId, lineInternal] : lines_)
+    {
+        if(lineIds.count(lineId) == 0)
+        {
+            changes.removedLines.emplace_back(lineId);
+        }
+    }
+
+    for(const auto& travelTime : layout.travelTimes)
+    {
+        const auto& [stationA, stationB, minutes]{travelTime};
+        const auto* nodeA{GetStation(stationA)};
+        const auto* nodeB{GetStation(stationB)};
+        const auto isNewPair{newPairs.count(MakeStationPair(stationA, stationB)) != 0 &&
+                             FindEdge(nodeA, nodeB) == nullptr};
+        if(isNewPair || GetTravelTime(nodeA, nodeB, nullptr) != minutes)
+        {
+            changes.travelTimes.push_back(travelTime);
+        }
+    }
+    return changes;
+}
+
+bool TransportNetwork::ApplyLayoutChanges(const LayoutChangeSet& changes)
+{
+    // Check everything that could make a change fail before we touch the
+    // network, so that we apply all changes or none.
+    std::unordered_set<std::string_view> removedStationIds{};
+    std::vector<GraphNode*> removedStations{};
+    for(const auto& stationId : changes.removedStations)
+    {
+        auto* station{GetStation(stationId)};
+        if(station == nullptr || !removedStationIds.insert(stationId).second)
+        {
+            return false;
+        }
+        removedStations.push_back(station);
+    }
+    // Added stations and lines may reuse the IDs of removed ones.
+    std::unordered_set<std::string_view> addedStationIds{};
+    for(const auto& station : changes.addedStations)
+    {
+        const auto isFree{GetStation(station.id) == nullptr || removedStationIds.count(station.id) != 0};
+        if(!isFree || !addedStationIds.insert(station.id).second)
+        {
+            return false;
+        }
+    }
+    auto isKept{[this, &removedStationIds](const Id& stationId) {
+        return GetStation(stationId) != nullptr && removedStationIds.count(stationId) == 0;
+    }};
+    auto isInNetwork{[&isKept, &addedStationIds](const Id& stationId) {
+        return isKept(stationId) || addedStationIds.count(stationId) != 0;
+    }};
+    for(const auto& station : changes.renamedStations)
+    {
+        if(!isKept(station.id))
+        {
+            return false;
+        }
+    }
+    auto isAddable{[&isInNetwork](const Route& route) {
+        return route.stops.size() >= 2 && std::all_of(route.stops.begin(), route.stops.end(), isInNetwork);
+    }};
+
+    std::unordered_set<std::string_view> lineIds{};
+    std::unordered_set<std::string_view> removedLineIds{};
+    std::unordered_set<std::string_view> removedRouteIds{};
+    std::vector<RouteInternal*> removedRoutes{};
+    std::vector<LineInternal*> removedLines{};
+    for(const auto& lineId : changes.removedLines)
+    {
+        auto* lineInternal{GetLine(lineId)};
+        if(lineInternal == nullptr || !lineIds.insert(lineId).second)
+        {
+            return false;
+        }
+        for(const auto& [routeId, routeInternal] : lineInternal->routes)
+        {
+            removedRouteIds.insert(routeId);
+            removedRoutes.push_back(routeInternal);
+        }
+        removedLineIds.insert(lineId);
+        removedLines.push_back(lineInternal);
+    }
+    std::vector<LineInternal*> modifiedLines{};
+    for(const auto& change : changes.modifiedLines)
+    {
+        auto* lineInternal{GetLine(change.lineId)};
+        if(lineInternal == nullptr || !lineIds.insert(change.lineId).second)
+        {
+            return false;
+        }
+        std::unordered_set<std::string_view> lineRemovedRouteIds{};
+        for(const auto& routeId : change.removedRoutes)
+        {
+            auto routeIt{lineInternal->routes.find(routeId)};
+            if(routeIt == end(lineInternal->routes) || !lineRemovedRouteIds.insert(routeId).second)
+            {
+                return false;
+            }
+            removedRouteIds.insert(routeId);
+            removedRoutes.push_back(routeIt->second);
+        }
+        std::unordered_set<std::string_view> addedRouteIds{};
+        for(const auto& route : change.addedRoutes)
+        {
+            const auto isFree{lineInternal->routes.count(route.id) == 0 || lineRemovedRouteIds.count(route.id) != 0};
+            if(!isFree || !addedRouteIds.insert(route.id).second || !isAddable(route))
+            {
+                return false;
+            }
+        }
+        modifiedLines.push_back(lineInternal);
+    }
+    std::unordered_set<std::string_view> addedLineIds{};
+    for(const auto& line : changes.addedLines)
+    {
+        const auto isFree{GetLine(line.id) == nullptr || removedLineIds.count(line.id) != 0};
+        if(!isFree || !addedLineIds.insert(line.id).second)
+        {
+            return false;
+        }
+        std::unordered_set<std::string_view> routeIds{};
+        for(const auto& route : line.routes)
+        {
+            if(!routeIds.insert(route.id).second || !isAddable(route))
+            {
+                return false;
+            }
+        }
+    }
+
+    // A station can only go once no route serves it.
+    for(const auto* station : removedStations)
+    {
+        for(const auto& routeId : station->routes)
+        {
+            if(removedRouteIds.count(routeId) == 0)
+            {
+                return false;
+            }
+        }
+    }
+    for(const auto& [stationA, stationB, travelTime] : changes.travelTimes)
+    {
+        if(!isInNetwork(stationA) || !isInNetwork(stationB))
+        {
+            return false;
+        }
+    }
+
+    // The edges of the added routes take the travel time and the profile of
+    // the edges already between their stops, which the removals may take
+    // away, so we note them first.
+    struct EdgeTiming
+    {
+        std::string_view stationA{};
+        std::string_view stationB{};
+        unsigned int travelTime{0};
+        std::uint32_t profile{kNoTravelTimeProfile};
+    };
+    std::vector<EdgeTiming> edgeTimings{};
+    auto noteEdgeTimings{[this, &removedStationIds, &edgeTimings](const Route& route) {
+        for(std::size_t idx{0}; idx + 1 < route.stops.size(); ++idx)
+        {
+            const auto& stationA{route.stops[idx]};
+            const auto& stationB{route.stops[idx + 1]};
+            if(removedStationIds.count(stationA) != 0 || removedStationIds.count(stationB) != 0)
+            {
+                continue;
+            }
+            const auto* edge{FindEdge(GetStation(stationA), GetStation(stationB))};
+            if(edge != nullptr)
+            {
+                edgeTimings.push_back({stationA, stationB, edge->travelTime, edge->profile});
+            }
+        }
+    }};
+    for(const auto& change : changes.modifiedLines)
+    {
+        for(const auto& route : change.addedRoutes)
+        {
+            noteEdgeTimings(route);
+        }
+    }
+    for(const auto& line : changes.addedLines)
+    {
+        for(const auto& route : line.routes)
+        {
+            noteEdgeTimings(route);
+        }
+    }
+
+    // From here on we modify the network. Removals go first, so that the
+    // added stations and routes can reuse the IDs of the removed ones.
+    routing_->edgeOffsets.clear();
+    ++version_;
+    for(auto* routeInternal : removedRoutes)
+    {
+        RemoveRoute(routeInternal);
+    }
+    for(const auto* lineInternal : removedLines)
+    {
+        lines_.erase(lineInternal->id);
+    }
+    for(auto* station : removedStations)
+    {
+        RemoveStation(station);
+    }
+    for(const auto& station : changes.renamedStations)
+    {
+        GetStation(station.id)->name = CopyToArena(station.name);
+    }
+    for(const auto& station : changes.addedStations)
+    {
+        AddStation(station);
+    }
+
+    for(std::size_t idx{0}; idx < modifiedLines.size(); ++idx)
+    {
+        const auto& change{changes.modifiedLines[idx]};
+        auto* lineInternal{modifiedLines[idx]};
+        if(lineInternal->name != change.name)
+        {
+            lineInternal->name = CopyToArena(change.name);
+        }
+        for(const auto& route : change.addedRoutes)
+        {
+            AddRouteToLine(route, lineInternal);
+            const auto* routeInternal{lineInternal->routes.at(route.id)};
+            for(auto* stop : routeInternal->stops)
+            {
+                stop->routes.emplace_back(routeInternal->id);
+            }
+        }
+        if(!change.addedRoutes.empty() || !change.removedRoutes.empty())
+        {
+            IndexLineStations(lineInternal);
+        }
+    }
+    for(const auto& line : changes.addedLines)
+    {
+        AddLine(line);
+    }
+    for(const auto& timing : edgeTimings)
+    {
+        UpdateEdges(GetStation(timing.stationA), GetStation(timing.stationB), [&timing](auto& edge) {
+            edge.travelTime = timing.travelTime;
+            edge.profile = timing.profile;
+        });
+    }
+
+    bool ok{true};
+    for(const auto& [stationA, stationB, travelTime] : changes.travelTimes)
+    {
+        ok = SetTravelTime(stationA, stationB, travelTime) && ok;
+    }
+    return ok;
+}
+
+long long int TransportNetwork::GetPassengerCount(const Id& station) const
+{
+    const auto* node{GetStation(station)};
+    if(node == nullptr)
+    {
+        throw std::runtime_error("Could not find station in the network: " + station);
+    }
+    return node->passengerCount.load(std::memory_order_relaxed);
+}
+
+std::size_t TransportNetwork::SetPassengerCounts(const std::vector<StationPassengerCount>& counts)
+{
+    std::size_t nSet{0};
+    for(const auto& [stationId, count] : counts)
+    {
+        auto* station{GetStation(stationId)};
+        if(station == nullptr)
+        {
+            continue;
+        }
+        station->passengerCount.store(count);
+        UpdateCrowding(station);
+        MarkCrowdingPenaltyStale(station);
+        ++nSet;
+    }
+    return nSet;
+}
+
+std::vector<StationPassengerCount> TransportNetwork::GetBusiestStations(std::size_t k) const
+{
+    std::vector<StationPassengerCount> busiest{};
+    std::lock_guard<std::mutex> lock{*crowdingMutex_};
+    RepairCrowdingHeap();
+    if(k == 0 || crowdingHeap_.empty())
+    {
+        return busiest;
+    }
+    busiest.reserve(std::min(k, crowdingHeap_.size()));
+
+    // The k largest entries of a heap are found by walking it from the root,
+    // always expanding the largest entry seen so far. The frontier holds heap
+    // positions, and never grows beyond k + 1 entries.
+    auto compare{[this](std::size_t a, std::size_t b) { return crowdingHeap_[a].count < crowdingHeap_[b].count; }};
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(compare)> frontier{compare};
+    frontier.push(0);
+    while(!frontier.empty() && busiest.size() < k)
+    {
+        const auto position{frontier.top()};
+        frontier.pop();
+        const auto& entry{crowdingHeap_[position]};
+        busiest.push_back(StationPassengerCount{Id{stationsByIndex_[entry.station]->id}, entry.count});
+        for(auto child : {2 * position + 1, 2 * position + 2})
+        {
+            if(child < crowdingHeap_.size())
+            {
+                frontier.push(child);
+            }
+        }
+    }
+    return busiest;
+}
+
+std::size_t TransportNetwork::SubscribeToCrowding(const Id& station,
+                                                  long long int high,
+                                                  long long int low,
+                                                  CrowdingCallback callback)
+{
+    auto* node{GetStation(station)};
+    if(node == nullptr || low >= high || callback == nullptr)
+    {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock{*crowdingMutex_};
+    const auto count{node->passengerCount.load(std::memory_order_relaxed)};
+
+    // Reuse the slot of a cancelled subscription, if any, under a new
+    // generation.
+    std::size_t slot{crowdingSubscriptions_.size()};
+    std::uint32_t generation{0};
+    if(!freeCrowdingSubscriptions_.empty())
+    {
+        slot = freeCrowdingSubscriptions_.back();
+        freeCrowdingSubscriptions_.pop_back();
+        generation = crowdingSubscriptions_[slot].generation + 1;
+    }
+    else
+    {
+        crowdingSubscriptions_.emplace_back();
+    }
+    crowdingSubscriptions_[slot] =
+        CrowdingSubscription{node->index, high, low, count >= high, std::move(callback), generation};
+    node->crowdingSubscriptions.push_back(slot);
+
+    // Slots are numbered from 1 in the ID, so that 0 can signal an error.
+    return static_cast<std::size_t>(generation) << 32 | (slot + 1);
+}
+
+bool TransportNetwork::UnsubscribeFromCrowding(std::size_t subscription)
+{
+    std::lock_guard<std::mutex> lock{*crowdingMutex_};
+    const auto slot{(subscription & 0xFFFFFFFF) - 1};
+    if((subscription & 0xFFFFFFFF) == 0 || slot >= crowdingSubscriptions_.size() ||
+       crowdingSubscriptions_[slot].generation != subscription >> 32 ||
+       crowdingSubscriptions_[slot].callback == nullptr)
+    {
+        return false;
+    }
+
+    auto& subscriptions{stationsByIndex_[crowdingSubscriptions_[slot].station]->crowdingSubscriptions};
+    subscriptions.erase(std::find(subscriptions.begin(), subscriptions.end(), slot));
+    crowdingSubscriptions_[slot].callback = nullptr;
+    freeCrowdingSubscriptions_.push_back(slot);
+    return true;
+}
+
+PassengerFlow TransportNetwork::GetPassengerFlow(const Id& station,
+                                                FlowWindow window,
+                                                std::chrono::system_clock::time_point at) const
+{
+    const auto* node{GetStation(station)};
+    if(node == nullptr)
+    {
+        throw std::runtime_error("Could not find station in the network: " + station);
+    }
+
+    PassengerFlow flow{};
+    AddPassengerFlow(node, window, at, flow);
+    return flow;
+}
+
+PassengerFlow TransportNetwork::GetLinePassengerFlow(const Id& line,
+                                                    FlowWindow window,
+                                                    std::chrono::system_clock::time_point at) const
+{
+    const auto* lineInternal{GetLine(line)};
+    if(lineInternal == nullptr)
+    {
+        throw std::runtime_error("Could not find line in the network: " + line);
+    }
+
+    PassengerFlow flow{};
+    for(const auto* station : lineInternal->stations)
+    {
+        AddPassengerFlow(station, window, at, flow);
+    }
+    return flow;
+}
+
+RouteIdView TransportNetwork::GetRoutesServingStation(const Id& station) const
+{
+    auto stationIt = stations_.find(station);
+    if(stationIt == end(stations_))
+    {
+        return RouteIdView{};
+    }
+
+    const auto& routes{stationIt->second->routes};
+    return RouteIdView{routes.data(), routes.size()};
+}
+
+bool TransportNetwork::SetTravelTime(const Id& stationA, const Id& stationB, const unsigned int travelTime)
+{
+    routing_->edgeOffsets.clear();
+    ++version_;
+    return UpdateEdges(GetStation(stationA), GetStation(stationB), [travelTime](auto& edge) {
+        edge.travelTime = travelTime;
+        edge.profile = kNoTravelTimeProfile;
+    });
+}
+
+bool TransportNetwork::SetTravelTimeProfile(const Id& stationA,
+                                            const Id& stationB,
+                                            const TravelTimeProfile& profile)
+{
+    auto* nodeA{GetStation(stationA)};
+    auto* nodeB{GetStation(stationB)};
+
+    // Only store the profile once we know that some edge will use it.
+    if(!IsWellFormed(profile) || !UpdateEdges(nodeA, nodeB, [](auto& /*edge*/) {}))
+    {
+        return false;
+    }
+    const auto profileIdx{AddTravelTimeProfile(profile)};
+    return UpdateEdges(nodeA, nodeB, [profileIdx](auto& edge) { edge.profile = profileIdx; });
+}
+
+unsigned int TransportNetwork::GetTravelTime(const Id& stationA, const Id& stationB) const
+{
+    return GetTravelTime(GetStation(stationA), GetStation(stationB), nullptr);
+}
+
+unsigned int TransportNetwork::GetTravelTime(const Id& line,
+                                             const Id& route,
+                                             const Id& stationA,
+                                             const Id& stationB) const
+{
+    return GetCachedTravelTime(GetRoute(line, route), GetStation(stationA), GetStation(stationB));
+}
+
+unsigned int TransportNetwork::GetTravelTime(const Id& stationA,
+                                             const Id& stationB,
+                                             std::chrono::system_clock::time_point departure) const
+{
+    const auto timeOfDay{GetTimeOfDay(departure)};
+    return GetTravelTime(GetStation(stationA), GetStation(stationB), &timeOfDay);
+}
+
+unsigned int TransportNetwork::GetTravelTime(const Id& line,
+                                             const Id& route,
+                                             const Id& stationA,
+                                             const Id& stationB,
+                                             std::chrono::system_clock::time_point departure) const
+{
+    const auto timeOfDay{GetTimeOfDay(departure)};
+    return GetTravelTime(GetRoute(line, route), GetStation(stationA), GetStation(stationB), &timeOfDay);
+}
+
+void TransportNetwork::GetTravelTimes(const TravelTimeQuery* queries,
+                                      std::size_t nQueries,
+                                      unsigned int* travelTimes,
+                                      std::size_t nThreads) const
+{
+    const auto nChunks{std::clamp<std::size_t>(nQueries / kMinQueriesPerChunk, 1, GetThreadCount(nThreads))};
+    RunChunks(nChunks, [this, queries, nQueries, travelTimes, nChunks](std::size_t chunk) {
+        const auto [first, last]{GetChunk(nQueries, nChunks, chunk)};
+        for(std::size_t idx{first}; idx < last; ++idx)
+        {
+            const auto& query{queries[idx]};
+            const auto timeOfDay{GetTimeOfDay(query.departure)};
+            const auto* departure{query.departure != std::chrono::system_clock::time_point{} ? &timeOfDay : nullptr};
+            travelTimes[idx] = GetTravelTime(GetStation(query.stationA), GetStation(query.stationB), departure);
+        }
+    });
+}
+
+void TransportNetwork::GetTravelTimes(const RouteTravelTimeQuery* queries,
+                                      std::size_t nQueries,
+                                      unsigned int* travelTimes,
+                                      std::size_t nThreads) const
+{
+    const auto nChunks{std::clamp<std::size_t>(nQueries / kMinQueriesPerChunk, 1, GetThreadCount(nThreads))};
+    RunChunks(nChunks, [this, queries, nQueries, travelTimes, nChunks](std::size_t chunk) {
+        const auto [first, last]{GetChunk(nQueries, nChunks, chunk)};
+        for(std::size_t idx{first}; idx < last; ++idx)
+        {
+            const auto& query{queries[idx]};
+            const auto* route{GetRoute(query.line, query.route)};
+            if(query.departure == std::chrono::system_clock::time_point{})
+            {
+                travelTimes[idx] = GetCachedTravelTime(route, GetStation(query.stationA), GetStation(query.stationB));
+                continue;
+            }
+            const auto timeOfDay{GetTimeOfDay(query.departure)};
+            travelTimes[idx] = GetTravelTime(route, GetStation(query.stationA), GetStation(query.stationB), &timeOfDay);
+        }
+    });
+}
+
+void TransportNetwork::GetRoutesServingStations(const std::string_view* stations,
+                                                std::size_t nStations,
+                                                RouteIdView* routes,
+                                                std::size_t nThreads) const
+{
+    const auto nChunks{std::clamp<std::size_t>(nStations / kMinQueriesPerChunk, 1, GetThreadCount(nThreads))};
+    RunChunks(nChunks, [this, stations, nStations, routes, nChunks](std::size_t chunk) {
+        const auto [first, last]{GetChunk(nStations, nChunks, chunk)};
+        for(std::size_t idx{first}; idx < last; ++idx)
+        {
+            const auto* station{GetStation(stations[idx])};
+            routes[idx] = station == nullptr ? RouteIdView{}
+                                             : RouteIdView{station->routes.data(), station->routes.size()};
+        }
+    });
+}
+
+void TransportNetwork::SetCrowdingRoutingOptions(const CrowdingRoutingOptions& options)
+{
+    routing_->options = options;
+    routing_->edgeOffsets.clear();
+}
+
+void TransportNetwork::SetQueryCacheOptions(const QueryCacheOptions& options)
+{
+    travelTimeCache_.reset();
+    if(options.capacity > 0)
+    {
+        travelTimeCache_ = std::make_unique<TravelTimeCache>(options.capacity, options.nShards);
+    }
+}
+
+QueryCacheStats TransportNetwork::GetQueryCacheStats() const
+{
+    return travelTimeCache_ != nullptr ? travelTimeCache_->GetStats() : QueryCacheStats{};
+}
+
+// Scratch space of the crowding-aware journey searches of a thread. A cost
+// only holds if its routing edge is stamped with the epoch of the current
+// search, and a station is only expanded if it is stamped with it, so nothing
+// needs clearing between searches.
+struct TransportNetwork::JourneySearch
+{
+    using Entry = std::pair<unsigned long long int, std::size_t>;
+
+    // Lower bounds of the cost left to the destination of the query, of the
+    // stations up to the origin.
+    ReachabilitySearch bounds{};
+    unsigned int boundLimit{0};
+
+    std::vector<std::uint32_t> edgeEpochs{};
+    std::vector<unsigned long long int> costs{};
+    std::vector<std::size_t> previous{};
+    std::vector<std::uint32_t> expanded{};
+    std::vector<Entry> queue{};
+    std::uint32_t epoch{0};
+
+    // Added to the cost of the edges of the journeys found so far by the
+    // query. Only the edges in `raisedEdges` are not 0.
+    std::vector<unsigned int> extraCosts{};
+    std::vector<std::size_t> raisedEdges{};
+
+    // Start a query over `nEdges` routing edges and `nStations` stations.
+    void BeginQuery(std::size_t nEdges, std::size_t nStations)
+    {
+        for(auto edge : raisedEdges)
+        {
+            extraCosts[edge] = 0;
+        }
+        raisedEdges.clear();
+        if(edgeEpochs.size() < nEdges)
+        {
+            edgeEpochs.resize(nEdges, 0);
+            costs.resize(nEdges, 0);
+            previous.resize(nEdges, 0);
+            extraCosts.resize(nEdges, 0);
+        }
+        if(expanded.size() < nStations)
+        {
+            expanded.resize(nStations, 0);
+        }
+    }
+
+    // Start a search of the query.
+    void Begin()
+    {
+        if(++epoch == 0)
+        {
+            // The epoch wrapped around: Older stamps could look current.
+            std::fill(edgeEpochs.begin(), edgeEpochs.end(), 0);
+            std::fill(expanded.begin(), expanded.end(), 0);
+            epoch = 1;
+        }
+        queue.clear();
+    }
+
+    // Lower bound of the cost from a station to the destination. The stations
+    // that the bounds search did not reach are at least as far as the
+    // origin.
+    unsigned int GetBound(std::uint32_t station) const
+    {
+        if(bounds.epochs[station] != bounds.epoch)
+        {
+            return boundLimit;
+        }
+        return std::min(bounds.travelTimes[station], boundLimit);
+    }
+
+    void Raise(std::size_t edge, unsigned int extraCost)
+    {
+        if(extraCosts[edge] == 0)
+        {
+            raisedEdges.push_back(edge);
+        }
+        extraCosts[edge] += extraCost;
+    }
+
+    // Lower the cost of an edge to `nextStop`, if cheaper than what we have.
+    // The queue is on the cost plus the bound of the next stop (A*).
+    void Relax(std::size_t edge, std::uint32_t nextStop, unsigned long long int cost, std::size_t previousEdge)
+    {
+        if(edgeEpochs[edge] == epoch && costs[edge] <= cost)
+        {
+            return;
+        }
+        edgeEpochs[edge] = epoch;
+        costs[edge] = cost;
+        previous[edge] = previousEdge;
+        queue.emplace_back(cost + GetBound(nextStop), edge);
+        std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+    }
+};
+
+std::vector<Journey> TransportNetwork::GetCrowdingAwareJourneys(const Id& stationA,
+                                                                const Id& stationB,
+                                                                std::size_t k) const
+{
+    std::vector<Journey> journeys{};
+    const auto* nodeA{GetStation(stationA)};
+    const auto* nodeB{GetStation(stationB)};
+    if(nodeA == nullptr || nodeB == nullptr || nodeA == nodeB || k == 0)
+    {
+        return journeys;
+    }
+    {
+        std::lock_guard<std::mutex> lock{routing_->mutex};
+        UpdateRouting();
+    }
+
+    // Penalty method: Each journey found makes its legs more expensive for the
+    // next searches, by half their cost, until we find a journey we did not
+    // have yet. We give up after a few searches that only find known journeys.
+    const auto& edges{routing_->edges};
+    thread_local JourneySearch search{};
+    search.BeginQuery(edges.size(), stationsByIndex_.size());
+    if(!FindJourneyBounds(nodeA->index, nodeB->index, search))
+    {
+        return journeys;
+    }
+    std::vector<std::vector<std::size_t>> found{};
+    std::vector<std::size_t> journey{};
+    for(std::size_t attempt{0}; attempt < 4 * k && found.size() < k; ++attempt)
+    {
+        if(!FindCheapestJourney(nodeA->index, nodeB->index, search, journey))
+        {
+            break;
+        }
+        auto station{nodeA->index};
+        for(auto edge : journey)
+        {
+            search.Raise(edge, std::max(1u, GetLegCost(station, edge) / 2));
+            station = edges[edge].nextStop;
+        }
+        if(std::find(found.begin(), found.end(), journey) == found.end())
+        {
+            found.push_back(journey);
+        }
+    }
+
+    const auto interchangePenalty{routing_->options.interchangePenalty};
+    for(const auto& legs : found)
+    {
+        auto& result{journeys.emplace_back()};
+        result.stops.emplace_back(nodeA->id);
+        auto station{nodeA->index};
+        const RouteInternal* route{nullptr};
+        for(auto edgeIdx : legs)
+        {
+            const auto& edge{edges[edgeIdx]};
+            if(edge.route != route)
+            {
+                const auto penalty{routing_->penalties[station].load(std::memory_order_relaxed)};
+                if(route != nullptr && (penalty & kCrowdedBit) != 0)
+                {
+                    result.cost += interchangePenalty;
+                }
+                route = edge.route;
+                result.legs.push_back(
+                    Journey::Leg{Id{route->line->id}, Id{route->id}, Id{stationsByIndex_[station]->id}, Id{}});
+            }
+            const auto& nextStop{stationsByIndex_[edge.nextStop]->id};
+            result.legs.back().endStationId = nextStop;
+            result.stops.emplace_back(nextStop);
+            result.travelTime += edge.travelTime;
+            result.cost += GetLegCost(station, edgeIdx);
+            station = edge.nextStop;
+        }
+    }
+    std::stable_sort(journeys.begin(), journeys.end(), [](const auto& a, const auto& b) { return a.cost < b.cost; });
+    return journeys;
+}
+
+std::vector<ReachableStation> TransportNetwork::GetReachableStations(const Id& station,
+                                                                    unsigned int maxTravelTime) const
+{
+    return GetReachableStations(std::vector<ReachabilitySeed>{{station, 0}}, maxTravelTime);
+}
+
+std::vector<ReachableStation> TransportNetwork::GetReachableStations(const std::vector<ReachabilitySeed>& seeds,
+                                                                    unsigned int maxTravelTime) const
+{
+    std::vector<ReachableStation> reached{};
+    {
+        std::lock_guard<std::mutex> lock{routing_->mutex};
+        UpdateRouting();
+    }
+
+    // Dijkstra over the stations, from all seeds at once, that stops at the
+    // budget.
+    const auto& offsets{routing_->edgeOffsets};
+    const auto& edges{routing_->edges};
+    auto& search{GetReachabilitySearch()};
+    search.Begin(stationsByIndex_.size());
+    for(const auto& seed : seeds)
+    {
+        const auto* node{GetStation(seed.stationId)};
+        if(node != nullptr && seed.travelTime <= maxTravelTime)
+        {
+            search.Relax(static_cast<std::uint32_t>(node->index), seed.travelTime);
+        }
+    }
+
+    auto& heap{search.heap};
+    while(!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<>{});
+        const auto [travelTime, station]{heap.back()};
+        heap.pop_back();
+        if(travelTime > search.travelTimes[station])
+        {
+            continue;
+        }
+        reached.push_back(ReachableStation{Id{stationsByIndex_[station]->id}, travelTime});
+        for(auto idx{offsets[station]}; idx < offsets[station + 1]; ++idx)
+        {
+            const auto& edge{edges[idx]};
+            if(edge.travelTime <= maxTravelTime - travelTime)
+            {
+                search.Relax(edge.nextStop, travelTime + edge.travelTime);
+            }
+        }
+    }
+    return reached;
+}
+
+MemoryUsage TransportNetwork::GetMemoryUsage() const
+{
+    MemoryUsage usage{};
+    for(const auto* station : stationsByIndex_)
+    {
+        usage.stations += sizeof(GraphNode) + station->crowdingSubscriptions.capacity() * sizeof(std::size_t);
+        usage.edges += station->edges.capacity() * sizeof(GraphEdge);
+        usage.routeIndex += station->routes.capacity() * sizeof(std::string_view);
+        usage.strings += station->id.size() + station->name.size();
+    }
+    for(const auto& [lineId, line] : lines_)
+    {
+        usage.lines += sizeof(LineInternal) + line->routes.GetMemorySize();
+        usage.lines += line->stations.capacity() * sizeof(GraphNode*);
+        usage.strings += line->id.size() + line->name.size();
+        for(const auto& [routeId, route] : line->routes)
+        {
+            usage.lines += sizeof(RouteInternal) + route->stops.capacity() * sizeof(GraphNode*);
+            usage.strings += route->id.size();
+        }
+    }
+
+    // Everything so far lives in the arena. The rest of the arena was lost to
+    // containers that grew, to lines that failed to be added, and to the
+    // slack at the end of each arena block.
+    const auto arenaSize{arena_ != nullptr ? arena_->upstream.GetSize() : 0};
+    const auto inArena{usage.stations + usage.lines + usage.edges + usage.routeIndex + usage.strings};
+    usage.arenaOverhead = arenaSize > inArena ? arenaSize - inArena : 0;
+
+    usage.stations += stationsByIndex_.capacity() * sizeof(GraphNode*);
+    usage.lookupTables = stations_.GetMemorySize() + lines_.GetMemorySize();
+    usage.passengerFlow = flowCounters_.capacity() * sizeof(FlowCounter);
+    if(memoryMode_ == MemoryMode::Compact)
+    {
+        for(const auto* station : stationsByIndex_)
+        {
+            if(station->flowCounters.load(std::memory_order_relaxed) != nullptr)
+            {
+                usage.passengerFlow += kFlowCountersPerStation * sizeof(FlowCounter);
+            }
+        }
+    }
+    usage.crowding = crowdingHeap_.capacity() * sizeof(CrowdingHeapEntry) +
+                     crowdingHeapPosition_.capacity() * sizeof(std::size_t) +
+                     crowdingSubscriptions_.capacity() * sizeof(CrowdingSubscription) +
+                     freeCrowdingSubscriptions_.capacity() * sizeof(std::size_t);
+    usage.travelTimeProfiles = profileSteps_.capacity() * sizeof(ProfileStep) +
+                               profiles_.capacity() * sizeof(ProfileRange) + profilesByHash_.GetMemorySize();
+    usage.queryCache = travelTimeCache_ != nullptr ? travelTimeCache_->GetMemorySize() : 0;
+    return usage;
+}
+
+MemoryMode TransportNetwork::GetMemoryMode() const
+{
+    return memoryMode_;
+}
+
+// TransportNetwork — Private methods
+
+std::size_t TransportNetwork::CountingResource::GetSize() const
+{
+    return size_;
+}
+
+void* TransportNetwork::CountingResource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    auto* ptr{std::pmr::new_delete_resource()->allocate(bytes, alignment)};
+    size_ += bytes;
+    return ptr;
+}
+
+void TransportNetwork::CountingResource::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    size_ -= bytes;
+}
+
+bool TransportNetwork::CountingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+std::pmr::vector<TransportNetwork::GraphEdge>::const_iterator TransportNetwork::GraphNode::FindEdgeForRoute(
+    const RouteInternal* route) const
+{
+    return std::find_if(edges.begin(), edges.end(), [route](const auto& edge) { return edge.route == route; });
+}
+
+TransportNetwork::FlowCounter::FlowCounter(const FlowCounter& other)
+    : packed{other.packed.load(std::memory_order_relaxed)}
+{
+}
+
+void TransportNetwork::FlowCounter::Increment(std::uint32_t slot)
+{
+    auto value{packed.load(std::memory_order_relaxed)};
+    while(true)
+    {
+        const auto currentSlot{static_cast<std::uint32_t>(value >> 32)};
+        if(currentSlot > slot)
+        {
+            return;
+        }
+        const auto next{currentSlot == slot ? value + 1 : (std::uint64_t{slot} << 32) | 1};
+        if(packed.compare_exchange_weak(value, next, std::memory_order_relaxed))
+        {
+            return;
+        }
+    }
+}
+
+std::uint32_t TransportNetwork::FlowCounter::Get(std::uint32_t slot) const
+{
+    const auto value{packed.load(std::memory_order_relaxed)};
+    if(static_cast<std::uint32_t>(value >> 32) != slot)
+    {
+        return 0;
+    }
+    return static_cast<std::uint32_t>(value);
+}
+
+template <typename T, typename... Args>
+T* TransportNetwork::MakeInArena(Args&&... args)
+{
+    void* ptr{arena_->resource.allocate(sizeof(T), alignof(T))};
+    return new(ptr) T{std::forward<Args>(args)...};
+}
+
+std::string_view TransportNetwork::CopyToArena(std::string_view text)
+{
+    if(text.empty())
+    {
+        return {};
+    }
+    // Strings are packed back to back.
+    auto* data{static_cast<char*>(arena_->resource.allocate(text.size(), 1))};
+    std::memcpy(data, text.data(), text.size());
+    return {data, text.size()};
+}
+
+TransportNetwork::FlowCounter* TransportNetwork::GetFlowCounters(GraphNode* station, bool create)
+{
+    if(memoryMode_ == MemoryMode::Default)
+    {
+        return &flowCounters_[station->index * kFlowCountersPerStation];
+    }
+
+    auto* counters{station->flowCounters.load(std::memory_order_acquire)};
+    if(counters != nullptr || !create)
+    {
+        return counters;
+    }
+
+    // Another thread may be allocating counters for the same station: The
+    // first one to publish its block wins.
+    constexpr auto size{kFlowCountersPerStation * sizeof(FlowCounter)};
+    auto* block{static_cast<FlowCounter*>(flowCounterPool_->allocate(size, alignof(FlowCounter)))};
+    std::uninitialized_value_construct_n(block, kFlowCountersPerStation);
+    if(station->flowCounters.compare_exchange_strong(
+           counters, block, std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+        return block;
+    }
+    flowCounterPool_->deallocate(block, size, alignof(FlowCounter));
+    return counters;
+}
+
+const TransportNetwork::FlowCounter* TransportNetwork::GetFlowCounters(const GraphNode* station) const
+{
+    if(memoryMode_ == MemoryMode::Default)
+    {
+        return &flowCounters_[station->index * kFlowCountersPerStation];
+    }
+    return station->flowCounters.load(std::memory_order_acquire);
+}
+
+TransportNetwork::GraphNode* TransportNetwork::GetStation(std::string_view stationId) const
+{
+    auto stationIt = stations_.find(stationId);
+    if(stationIt == end(stations_))
+    {
+        return nullptr;
+    }
+
+    return stationIt->second;
+}
+
+TransportNetwork::LineInternal* TransportNetwork::GetLine(std::string_view lineId) const
+{
+    auto lineIt = lines_.find(lineId);
+    if(lineIt == end(lines_))
+    {
+        return nullptr;
+    }
+    return lineIt->second;
+}
+
+TransportNetwork::RouteInternal* TransportNetwork::GetRoute(std::string_view lineId, std::string_view routeId) const
+{
+    const auto* line{GetLine(lineId)};
+    if(line == nullptr)
+    {
+        return nullptr;
+    }
+    auto routeIt{line->routes.find(routeId)};
+    if(routeIt == end(line->routes))
+    {
+        return nullptr;
+    }
+    return routeIt->second;
+}
+
+unsigned int TransportNetwork::GetTravelTime(const GraphNode* stationA,
+                                             const GraphNode* stationB,
+                                             const std::uint32_t* timeOfDay) const
+{
+    if(stationA == nullptr || stationB == nullptr)
+    {
+        return 0;
+    }
+    // All edges between the two stations have the same travel time.
+    const auto* edge{FindEdge(stationA, stationB)};
+    if(edge == nullptr)
+    {
+        return 0;
+    }
+    return timeOfDay != nullptr ? GetTravelTime(*edge, *timeOfDay) : edge->travelTime;
+}
+
+unsigned int TransportNetwork::GetTravelTime(const RouteInternal* route,
+                                             const GraphNode* stationA,
+                                             const GraphNode* stationB,
+                                             const std::uint32_t* timeOfDay) const
+{
+    if(route == nullptr || stationA == nullptr || stationB == nullptr)
+    {
+        return 0;
+    }
+
+    // Walk the route from station A until we reach station B. Station B must
+    // come after station A.
+    // With a departure time, the clock moves on by the travel time of each
+    // leg, in minutes.
+    const auto& stops{route->stops};
+    auto stop{std::find(stops.begin(), stops.end(), stationA)};
+    if(stop == stops.end())
+    {
+        return 0;
+    }
+    unsigned int travelTime{0};
+    for(; stop + 1 != stops.end(); ++stop)
+    {
+        if(*stop == stationB)
+        {
+            return travelTime;
+        }
+        auto edge{(*stop)->FindEdgeForRoute(route)};
+        if(edge == (*stop)->edges.end())
+        {
+            return 0;
+        }
+        if(timeOfDay == nullptr)
+        {
+            travelTime += edge->travelTime;
+            continue;
+        }
+        const auto now{static_cast<std::uint32_t>((*timeOfDay + std::uint64_t{travelTime} * 60) % kSecondsPerDay)};
+        travelTime += GetTravelTime(*edge, now);
+    }
+    return *stop == stationB ? travelTime : 0;
+}
+
+bool TransportNetwork::TravelTimeCacheKey::operator==(const TravelTimeCacheKey& other) const
+{
+    return route == other.route && stationA == other.stationA && stationB == other.stationB;
+}
+
+std::size_t TransportNetwork::TravelTimeCacheKeyHash::operator()(const TravelTimeCacheKey& key) const
+{
+    // The cache picks sets with the low bits of the hash, so we mix all the
+    // input bits into them (the finalizer of MurmurHash3).
+    std::uint64_t hash{reinterpret_cast<std::uintptr_t>(key.route)};
+    hash ^= std::uint64_t{key.stationA} << 32 | key.stationB;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return static_cast<std::size_t>(hash);
+}
+
+unsigned int TransportNetwork::GetCachedTravelTime(const RouteInternal* route,
+                                                   const GraphNode* stationA,
+                                                   const GraphNode* stationB) const
+{
+    // Unknown IDs are not cached: They cannot be interned, and we do not want
+    // bad queries to evict good answers.
+    if(travelTimeCache_ == nullptr || route == nullptr || stationA == nullptr || stationB == nullptr)
+    {
+        return GetTravelTime(route, stationA, stationB, nullptr);
+    }
+    const TravelTimeCacheKey key{
+        route,
+        static_cast<std::uint32_t>(stationA->index),
+        static_cast<std::uint32_t>(stationB->index),
+    };
+    if(const auto travelTime{travelTimeCache_->Find(key, version_)})
+    {
+        return *travelTime;
+    }
+    const auto travelTime{GetTravelTime(route, stationA, stationB, nullptr)};
+    travelTimeCache_->Insert(key, version_, travelTime);
+    return travelTime;
+}
+
+unsigned int TransportNetwork::GetTravelTime(const GraphEdge& edge, std::uint32_t timeOfDay) const
+{
+    if(edge.profile == kNoTravelTimeProfile)
+    {
+        return edge.travelTime;
+    }
+
+    // Find the last step that starts at or before the time of day. Before the
+    // first step, we are still in the last step of the previous day.
+    const auto& range{profiles_[edge.profile]};
+    const auto* first{profileSteps_.data() + range.first};
+    const auto* last{first + range.size};
+    const auto* step{std::upper_bound(
+        first, last, timeOfDay, [](std::uint32_t time, const ProfileStep& step) { return time < step.start; })};
+    return (step == first ? last : step)[-1].travelTime;
+}
+
+std::uint32_t TransportNetwork::AddTravelTimeProfile(const TravelTimeProfile& profile)
+{
+    const auto hash{Hash(profile)};
+    auto profileIt{profilesByHash_.find(hash)};
+    if(profileIt != end(profilesByHash_))
+    {
+        const auto& range{profiles_[profileIt->second]};
+        const bool same{range.size == profile.steps.size() &&
+                        std::equal(profile.steps.begin(),
+                                   profile.steps.end(),
+                                   profileSteps_.begin() + range.first,
+                                   [](const auto& step, const auto& stored) {
+                                       return step.start.count() == stored.start &&
+                                              step.travelTime == stored.travelTime;
+                                   })};
+        if(same)
+        {
+            return profileIt->second;
+        }
+    }
+
+    const auto profileIdx{static_cast<std::uint32_t>(profiles_.size())};
+    profiles_.push_back(ProfileRange{static_cast<std::uint32_t>(profileSteps_.size()),
+                                     static_cast<std::uint32_t>(profile.steps.size())});
+    for(const auto& step : profile.steps)
+    {
+        profileSteps_.push_back(ProfileStep{static_cast<std::uint32_t>(step.start.count()), step.travelTime});
+    }
+    if(profileIt == end(profilesByHash_))
+    {
+        profilesByHash_.emplace(hash, profileIdx);
+    }
+    return profileIdx;
+}
+
+const TransportNetwork::GraphEdge* TransportNetwork::FindEdge(const GraphNode* stationA,
+                                                              const GraphNode* stationB)
+{
+    if(stationA == nullptr || stationB == nullptr)
+    {
+        return nullptr;
+    }
+    for(auto [from, to] : {std::pair{stationA, stationB}, std::pair{stationB, stationA}})
+    {
+        for(const auto& edge : from->edges)
+        {
+            if(edge.nextStop == to)
+            {
+                return &edge;
+            }
+        }
+    }
+    return nullptr;
+}
+
+template <typename Update>
+bool TransportNetwork::UpdateEdges(GraphNode* stationA, GraphNode* stationB, Update&& update)
+{
+    if(stationA == nullptr || stationB == nullptr)
+    {
+        return false;
+    }
+    bool found{false};
+    for(auto [from, to] : {std::pair{stationA, stationB}, std::pair{stationB, stationA}})
+    {
+        for(auto& edge : from->edges)
+        {
+            if(edge.nextStop == to)
+            {
+                update(edge);
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+std::vector<TransportNetwork::PassengerCountCarryOver> TransportNetwork::BeginPassengerCountCarryOver(
+    const TransportNetwork& other)
+{
+    std::vector<PassengerCountCarryOver> carryOver{};
+    carryOver.reserve(std::min(stations_.size(), other.stations_.size()));
+    for(const auto& [id, station] : stations_)
+    {
+        auto otherIt = other.stations_.find(id);
+        if(otherIt == end(other.stations_))
+        {
+            continue;
+        }
+        const auto* from{otherIt->second};
+        auto baseline{from->passengerCount.load(std::memory_order_relaxed)};
+        station->passengerCount.fetch_add(baseline, std::memory_order_relaxed);
+        MarkCrowdingPenaltyStale(station);
+        carryOver.push_back(PassengerCountCarryOver{station, from, baseline});
+    }
+
+    // Most counts changed: It is cheaper to rebuild the crowding heap than to
+    // sift each station.
+    std::lock_guard<std::mutex> lock{*crowdingMutex_};
+    for(auto& entry : crowdingHeap_)
+    {
+        entry.count = stationsByIndex_[entry.station]->passengerCount.load(std::memory_order_relaxed);
+    }
+    for(auto position{crowdingHeap_.size() / 2}; position > 0; --position)
+    {
+        SiftCrowdingDown(position - 1);
+    }
+    return carryOver;
+}
+
+void TransportNetwork::EndPassengerCountCarryOver(const std::vector<PassengerCountCarryOver>& carryOver)
+{
+    for(const auto& [to, from, baseline] : carryOver)
+    {
+        auto delta{from->passengerCount.load(std::memory_order_relaxed) - baseline};
+        if(delta != 0)
+        {
+            to->passengerCount.fetch_add(delta);
+            UpdateCrowding(to);
+            MarkCrowdingPenaltyStale(to);
+        }
+    }
+}
+
+void TransportNetwork::UpdateCrowding(GraphNode* station)
+{
+    // A station is only pushed once until GetBusiestStations picks it up.
+    // Reading the flag first saves busy stations a write on each event.
+    if(!station->crowdingHeapStale.load() && !station->crowdingHeapStale.exchange(true))
+    {
+        auto& stale{*staleCrowdingStations_};
+        station->nextStaleInCrowdingHeap = stale.load(std::memory_order_relaxed);
+        while(!stale.compare_exchange_weak(
+            station->nextStaleInCrowdingHeap, station, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Subscriptions do not change while events are recorded, so the stations
+    // without any can skip the lock.
+    if(station->crowdingSubscriptions.empty())
+    {
+        return;
+    }
+
+    // We copy the callbacks of the alerts to fire while we hold the lock, and
+    // fire them after we released it, so that callbacks can use the network.
+    std::vector<std::pair<CrowdingCallback, bool>> alerts{};
+    long long int count{0};
+    {
+        std::lock_guard<std::mutex> lock{*crowdingMutex_};
+        count = station->passengerCount.load(std::memory_order_relaxed);
+        for(auto subscriptionIdx : station->crowdingSubscriptions)
+        {
+            auto& subscription{crowdingSubscriptions_[subscriptionIdx]};
+            if(!subscription.crowded && count >= subscription.high)
+            {
+                subscription.crowded = true;
+                alerts.emplace_back(subscription.callback, true);
+            }
+            else if(subscription.crowded && count <= subscription.low)
+            {
+                subscription.crowded = false;
+                alerts.emplace_back(subscription.callback, false);
+            }
+        }
+    }
+
+    for(const auto& [callback, crowded] : alerts)
+    {
+        callback(Id{station->id}, count, crowded);
+    }
+}
+
+void TransportNetwork::RepairCrowdingHeap() const
+{
+    // An event that finds the flag of its station set relies on us to read
+    // its count: Clearing the flag before reading the count, with the count
+    // update and the flag check of UpdateCrowding all sequentially
+    // consistent, makes sure that we see it.
+    auto* station{staleCrowdingStations_->exchange(nullptr, std::memory_order_acquire)};
+    while(station != nullptr)
+    {
+        auto* next{station->nextStaleInCrowdingHeap};
+        station->crowdingHeapStale.store(false);
+        const auto count{station->passengerCount.load()};
+        const auto position{crowdingHeapPosition_[station->index]};
+        auto& entry{crowdingHeap_[position]};
+        if(entry.count != count)
+        {
+            const auto increased{count > entry.count};
+            entry.count = count;
+            increased ? SiftCrowdingUp(position) : SiftCrowdingDown(position);
+        }
+        station = next;
+    }
+}
+
+void TransportNetwork::SiftCrowdingUp(std::size_t position) const
+{
+    auto entry{crowdingHeap_[position]};
+    while(position > 0)
+    {
+        const auto parent{(position - 1) / 2};
+        if(crowdingHeap_[parent].count >= entry.count)
+        {
+            break;
+        }
+        crowdingHeap_[position] = crowdingHeap_[parent];
+        crowdingHeapPosition_[crowdingHeap_[position].station] = position;
+        position = parent;
+    }
+    crowdingHeap_[position] = entry;
+    crowdingHeapPosition_[entry.station] = position;
+}
+
+void TransportNetwork::SiftCrowdingDown(std::size_t position) const
+{
+    auto entry{crowdingHeap_[position]};
+    const auto size{crowdingHeap_.size()};
+    while(true)
+    {
+        auto largest{2 * position + 1};
+        if(largest >= size)
+        {
+            break;
+        }
+        if(largest + 1 < size && crowdingHeap_[largest + 1].count > crowdingHeap_[largest].count)
+        {
+            ++largest;
+        }
+        if(crowdingHeap_[largest].count <= entry.count)
+        {
+            break;
+        }
+        crowdingHeap_[position] = crowdingHeap_[largest];
+        crowdingHeapPosition_[crowdingHeap_[position].station] = position;
+        position = largest;
+    }
+    crowdingHeap_[position] = entry;
+    crowdingHeapPosition_[entry.station] = position;
+}
+
+bool TransportNetwork::AddRouteToLine(const Route& route, LineInternal* lineInternal)
+{
+    if(lineInternal->routes.find(route.id) != end(lineInternal->routes))
+    {
+        return false;
+    }
+
+    auto* arena{&arena_->resource};
+    std::pmr::vector<GraphNode*> stops(arena);
+    stops.reserve(route.stops.size());
+
+    for(const auto& stopsId : route.stops)
+    {
+        auto* station{GetStation(stopsId)};
+        if(station == nullptr)
+        {
+            return false;
+        }
+        stops.push_back(station);
+    }
+
+    auto* routeInternal{
+        MakeInArena<RouteInternal>(CopyToArena(route.id), lineInternal, std::move(stops))};
+
+    for(size_t idx{0}; idx < routeInternal->stops.size() - 1; ++idx)
+    {
+        auto* thisStop{routeInternal->stops[idx]};
+        auto* nextStop{routeInternal->stops[idx + 1]};
+
+        thisStop->edges.push_back(GraphEdge{routeInternal, nextStop, 0});
+    }
+
+    lineInternal->routes.emplace(routeInternal->id, routeInternal);
+    return true;
+}
+
+void TransportNetwork::RemoveRoute(RouteInternal* route)
+{
+    for(auto* stop : route->stops)
+    {
+        auto& edges{stop->edges};
+        edges.erase(std::remove_if(edges.begin(), edges.end(), [route](const auto& edge) { return edge.route == route; }),
+                    edges.end());
+        auto& routes{stop->routes};
+        routes.erase(std::find(routes.begin(), routes.end(), route->id));
+    }
+    route->line->routes.erase(route->id);
+}
+
+void TransportNetwork::RemoveStation(GraphNode* station)
+{
+    stations_.erase(station->id);
+    const auto index{station->index};
+    auto* last{stationsByIndex_.back()};
+    {
+        std::lock_guard<std::mutex> lock{*crowdingMutex_};
+
+        // No station must be left stale under its old index.
+        RepairCrowdingHeap();
+
+        // The last heap entry takes the place of the entry of the station, and
+        // is sifted from there.
+        const auto position{crowdingHeapPosition_[index]};
+        crowdingHeap_[position] = crowdingHeap_.back();
+        crowdingHeap_.pop_back();
+        if(position < crowdingHeap_.size())
+        {
+            const auto moved{crowdingHeap_[position].station};
+            crowdingHeapPosition_[moved] = position;
+            SiftCrowdingUp(position);
+            SiftCrowdingDown(crowdingHeapPosition_[moved]);
+        }
+
+        // The last station takes the index of the removed one.
+        if(last != station)
+        {
+            crowdingHeapPosition_[index] = crowdingHeapPosition_[last->index];
+            crowdingHeap_[crowdingHeapPosition_[index]].station = index;
+            for(auto subscriptionIdx : last->crowdingSubscriptions)
+            {
+                crowdingSubscriptions_[subscriptionIdx].station = index;
+            }
+        }
+        crowdingHeapPosition_.pop_back();
+        for(auto subscriptionIdx : station->crowdingSubscriptions)
+        {
+            crowdingSubscriptions_[subscriptionIdx].callback = nullptr;
+            freeCrowdingSubscriptions_.push_back(subscriptionIdx);
+        }
+        station->crowdingSubscriptions.clear();
+    }
+
+    if(memoryMode_ == MemoryMode::Default)
+    {
+        if(last != station)
+        {
+            auto* to{&flowCounters_[index * kFlowCountersPerStation]};
+            const auto* from{&flowCounters_[last->index * kFlowCountersPerStation]};
+            for(std::size_t idx{0}; idx < kFlowCountersPerStation; ++idx)
+            {
+                to[idx].packed.store(from[idx].packed.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+        }
+        flowCounters_.resize(flowCounters_.size() - kFlowCountersPerStation);
+    }
+    else if(auto* counters{station->flowCounters.exchange(nullptr, std::memory_order_relaxed)}; counters != nullptr)
+    {
+        flowCounterPool_->deallocate(counters, kFlowCountersPerStation * sizeof(FlowCounter), alignof(FlowCounter));
+    }
+
+    stationsByIndex_[index] = last;
+    last->index = index;
+    stationsByIndex_.pop_back();
+}
+
+void TransportNetwork::IndexLineStations(LineInternal* lineInternal)
+{
+    auto& stations{lineInternal->stations};
+    stations.clear();
+    for(const auto& [routeId, routeInternal] : lineInternal->routes)
+    {
+        stations.insert(stations.end(), routeInternal->stops.begin(), routeInternal->stops.end());
+    }
+    std::sort(stations.begin(), stations.end(), [](const auto* a, const auto* b) { return a->index < b->index; });
+    stations.erase(std::unique(stations.begin(), stations.end()), stations.end());
+}
+
+void TransportNetwork::MarkCrowdingPenaltyStale(GraphNode* station)
+{
+    // A station is only pushed once until the next query picks it up. Reading
+    // the flag first saves busy stations a write on each event.
+    if(!station->crowdingPenaltyStale.load() && !station->crowdingPenaltyStale.exchange(true))
+    {
+        auto& stale{routing_->staleStations};
+        station->nextStaleInRouting = stale.load(std::memory_order_relaxed);
+        while(!stale.compare_exchange_weak(
+            station->nextStaleInRouting, station, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
+std::uint32_t TransportNetwork::GetCrowdingPenalty(const GraphNode* station) const
+{
+    const auto& options{routing_->options};
+    const auto excess{station->passengerCount.load() - options.threshold};
+    if(excess <= 0)
+    {
+        return 0;
+    }
+    const auto minutes{std::ceil(static_cast<double>(excess) * options.minutesPerPassenger)};
+    const auto maxPenalty{static_cast<double>(std::min<unsigned int>(options.maxPenalty, ~kCrowdedBit))};
+    return kCrowdedBit | static_cast<std::uint32_t>(std::clamp(minutes, 0.0, maxPenalty));
+}
+
+void TransportNetwork::UpdateRouting() const
+{
+    // An event that finds the flag of its station set relies on us to read
+    // its count: As in RepairCrowdingHeap, we clear the flag before we read
+    // the count, and both sides are sequentially consistent.
+    auto& routing{*routing_};
+    auto* stale{routing.staleStations.exchange(nullptr, std::memory_order_acquire)};
+    if(routing.edgeOffsets.empty())
+    {
+        routing.edgeOffsets.reserve(stationsByIndex_.size() + 1);
+        routing.edgeOffsets.push_back(0);
+        routing.edges.clear();
+        for(const auto* station : stationsByIndex_)
+        {
+            for(const auto& edge : station->edges)
+            {
+                routing.edges.push_back(RoutingEdge{
+                    edge.route, static_cast<std::uint32_t>(edge.nextStop->index), edge.travelTime});
+            }
+            routing.edgeOffsets.push_back(routing.edges.size());
+        }
+
+        // Counting sort of the edges on their next stop.
+        auto& reverseOffsets{routing.reverseEdgeOffsets};
+        reverseOffsets.assign(stationsByIndex_.size() + 1, 0);
+        for(const auto& edge : routing.edges)
+        {
+            ++reverseOffsets[edge.nextStop + 1];
+        }
+        for(std::size_t idx{1}; idx < reverseOffsets.size(); ++idx)
+        {
+            reverseOffsets[idx] += reverseOffsets[idx - 1];
+        }
+        auto positions{reverseOffsets};
+        routing.reverseEdges.resize(routing.edges.size());
+        for(std::size_t station{0}; station < stationsByIndex_.size(); ++station)
+        {
+            for(auto idx{routing.edgeOffsets[station]}; idx < routing.edgeOffsets[station + 1]; ++idx)
+            {
+                const auto& edge{routing.edges[idx]};
+                routing.reverseEdges[positions[edge.nextStop]++] =
+                    ReverseRoutingEdge{static_cast<std::uint32_t>(station), edge.travelTime};
+            }
+        }
+
+        // The topology changed since the stale stations were pushed, and some
+        // may have been removed: We only clear their flags.
+        while(stale != nullptr)
+        {
+            auto* next{stale->nextStaleInRouting};
+            stale->crowdingPenaltyStale.store(false);
+            stale = next;
+        }
+        routing.penalties = std::make_unique<std::atomic<std::uint32_t>[]>(stationsByIndex_.size());
+        for(const auto* station : stationsByIndex_)
+        {
+            routing.penalties[station->index].store(GetCrowdingPenalty(station), std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    // Only the stations that changed since the previous query.
+    while(stale != nullptr)
+    {
+        auto* next{stale->nextStaleInRouting};
+        stale->crowdingPenaltyStale.store(false);
+        routing.penalties[stale->index].store(GetCrowdingPenalty(stale), std::memory_order_relaxed);
+        stale = next;
+    }
+}
+
+bool TransportNetwork::FindJourneyBounds(std::size_t stationA, std::size_t stationB, JourneySearch& search) const
+{
+    // Dijkstra back from stationB over the leg costs, that stops once it
+    // reaches stationA. The bounds leave out the extra costs and the
+    // interchange penalties, which only add to the cost.
+    const auto& offsets{routing_->reverseEdgeOffsets};
+    const auto& edges{routing_->reverseEdges};
+    const auto& penalties{routing_->penalties};
+    auto& bounds{search.bounds};
+    bounds.Begin(stationsByIndex_.size());
+    bounds.Relax(static_cast<std::uint32_t>(stationB), 0);
+    auto& heap{bounds.heap};
+    while(!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<>{});
+        const auto [travelTime, station]{heap.back()};
+        heap.pop_back();
+        if(travelTime > bounds.travelTimes[station])
+        {
+            continue;
+        }
+        if(station == stationA)
+        {
+            search.boundLimit = travelTime;
+            return true;
+        }
+        for(auto idx{offsets[station]}; idx < offsets[station + 1]; ++idx)
+        {
+            const auto& edge{edges[idx]};
+            const auto penalty{penalties[edge.previousStop].load(std::memory_order_relaxed) & ~kCrowdedBit};
+            bounds.Relax(edge.previousStop, travelTime + edge.travelTime + penalty);
+        }
+    }
+    return false;
+}
+
+bool TransportNetwork::FindCheapestJourney(std::size_t stationA,
+                                           std::size_t stationB,
+                                           JourneySearch& search,
+                                           std::vector<std::size_t>& journey) const
+{
+    // A* over the edges: The label of an edge is the cost of reaching its
+    // next stop through it. This lets us charge the interchanges. The bounds
+    // are consistent, so the first label popped for an edge is its cheapest.
+    // Leaving a station that is not crowded costs the same whatever edge we
+    // arrived by, so we only expand such a station from its cheapest edge.
+    constexpr auto kNone{std::numeric_limits<std::size_t>::max()};
+    const auto& offsets{routing_->edgeOffsets};
+    const auto& edges{routing_->edges};
+    const auto& penalties{routing_->penalties};
+    const auto& costs{search.costs};
+    const auto& previous{search.previous};
+    auto& expanded{search.expanded};
+    const auto& extraCosts{search.extraCosts};
+    auto& queue{search.queue};
+    search.Begin();
+
+    for(auto idx{offsets[stationA]}; idx < offsets[stationA + 1]; ++idx)
+    {
+        search.Relax(idx, edges[idx].nextStop, GetLegCost(stationA, idx) + extraCosts[idx], kNone);
+    }
+    expanded[stationA] = search.epoch;
+
+    const auto interchangePenalty{routing_->options.interchangePenalty};
+    while(!queue.empty())
+    {
+        std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+        const auto [priority, idx]{queue.back()};
+        queue.pop_back();
+        const auto& edge{edges[idx]};
+        const auto station{edge.nextStop};
+        const auto cost{costs[idx]};
+        if(priority > cost + search.GetBound(station))
+        {
+            continue;
+        }
+        if(station == stationB)
+        {
+            journey.clear();
+            for(auto step{idx}; step != kNone; step = previous[step])
+            {
+                journey.push_back(step);
+            }
+            std::reverse(journey.begin(), journey.end());
+            return true;
+        }
+
+        const bool crowded{(penalties[station].load(std::memory_order_relaxed) & kCrowdedBit) != 0};
+        if(!crowded)
+        {
+            if(expanded[station] == search.epoch)
+            {
+                continue;
+            }
+            expanded[station] = search.epoch;
+        }
+        for(auto nextIdx{offsets[station]}; nextIdx < offsets[station + 1]; ++nextIdx)
+        {
+            // Reaching an expanded station that is not crowded again is no use.
+            const auto nextStop{edges[nextIdx].nextStop};
+            if(expanded[nextStop] == search.epoch && nextStop != stationB &&
+               (penalties[nextStop].load(std::memory_order_relaxed) & kCrowdedBit) == 0)
+            {
+                continue;
+            }
+            auto nextCost{cost + GetLegCost(station, nextIdx) + extraCosts[nextIdx]};
+            if(crowded && edges[nextIdx].route != edge.route)
+            {
+                nextCost += interchangePenalty;
+            }
+            search.Relax(nextIdx, nextStop, nextCost, idx);
+        }
+    }
+    return false;
+}
+
+unsigned int TransportNetwork::GetLegCost(std::size_t station, std::size_t edge) const
+{
+    const auto penalty{routing_->penalties[station].load(std::memory_order_relaxed)};
+    return routing_->edges[edge].travelTime + (penalty & ~kCrowdedBit);
+}
+
+void TransportNetwork::RecordPassengerFlow(GraphNode* station,
+                                           PassengerEvent::Type type,
+                                           std::chrono::system_clock::time_point timestamp)
+{
+    const auto seconds{std::chrono::duration_cast<std::chrono::seconds>(timestamp.time_since_epoch()).count()};
+    if(seconds < 0)
+    {
+        return;
+    }
+    const auto direction{type == PassengerEvent::Type::In ? 0 : 1};
+    auto* counters{GetFlowCounters(station, true)};
+
+    const auto fineSlot{static_cast<std::uint32_t>(seconds / kFlowFineSeconds)};
+    counters[2 * (fineSlot % kFlowFineBuckets) + direction].Increment(fineSlot);
+
+    const auto coarseSlot{static_cast<std::uint32_t>(seconds / kFlowCoarseSeconds)};
+    counters[2 * (kFlowFineBuckets + coarseSlot % kFlowCoarseBuckets) + direction].Increment(coarseSlot);
+}
+
+void TransportNetwork::AddPassengerFlow(const GraphNode* station,
+                                        FlowWindow window,
+                                        std::chrono::system_clock::time_point at,
+                                        PassengerFlow& flow) const
+{
+    const auto seconds{std::chrono::duration_cast<std::chrono::seconds>(at.time_since_epoch()).count()};
+    if(seconds < 0)
+    {
+        return;
+    }
+
+    // Pick the ring and the number of buckets that cover the window.
+    std::uint32_t ringOffset{0};
+    std::uint32_t ringBuckets{kFlowFineBuckets};
+    std::uint32_t bucketSeconds{kFlowFineSeconds};
+    std::uint32_t nBuckets{0};
+    switch(window)
+    {
+        case FlowWindow::OneMinute:
+            nBuckets = 60 / kFlowFineSeconds;
+            break;
+        case FlowWindow::FiveMinutes:
+            nBuckets = 5 * 60 / kFlowFineSeconds;
+            break;
+        case FlowWindow::OneHour:
+            ringOffset = kFlowFineBuckets;
+            ringBuckets = kFlowCoarseBuckets;
+            bucketSeconds = kFlowCoarseSeconds;
+            nBuckets = 60 * 60 / kFlowCoarseSeconds;
+            break;
+        default:
+            return;
+    }
+
+    const auto* counters{GetFlowCounters(station)};
+    if(counters == nullptr)
+    {
+        return;
+    }
+    const auto lastSlot{static_cast<std::uint32_t>(seconds / bucketSeconds)};
+    for(std::uint32_t idx{0}; idx < nBuckets && idx <= lastSlot; ++idx)
+    {
+        const auto slot{lastSlot - idx};
+        const auto bucket{ringOffset + slot % ringBuckets};
+        flow.in += counters[2 * bucket].Get(slot);
+        flow.out += counters[2 * bucket + 1].Get(slot);
+    }
+}
@@ -2,45 +2,220 @@
 
 #include <openssl/ssl.h>
 
+#include <algorithm>
 #include <chrono>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "Log.hpp"
+#include "Metrics.hpp"
+#include "TlsContext.hpp"
 
 using tcp = boost::asio::ip::tcp;
 namespace websocket = boost::beast::websocket;
 
 namespace NetworkMonitor {
 
+namespace {
+
+// Metrics shared by all clients, looked up once.
+struct WebSocketClientMetrics
+{
+    Histogram& resolveTime;
+    Histogram& connectTime;
+    Histogram& tlsHandshakeTime;
+    Histogram& handshakeTime;
+    Counter& connectErrors;
+    Counter& fullTlsHandshakes;
+    Counter& resumedTlsHandshakes;
+    Histogram& messageSize;
+    Histogram& onMessageTime;
+};
+
+const WebSocketClientMetrics& GetMetrics()
+{
+    static const WebSocketClientMetrics metrics{[]() {
+        auto& registry{MetricsRegistry::Default()};
+        const std::string phaseHelp{"Time spent in each WebSocket connection phase."};
+        const std::string phaseName{"network_monitor_websocket_connect_phase_seconds"};
+        const std::string tlsHelp{"Number of successful TLS handshakes, by session type."};
+        const std::string tlsName{"network_monitor_websocket_tls_handshakes_total"};
+        return WebSocketClientMetrics{
+            registry.GetHistogram(phaseName, phaseHelp, 1e-9, "phase=\"resolve\""),
+            registry.GetHistogram(phaseName, phaseHelp, 1e-9, "phase=\"connect\""),
+            registry.GetHistogram(phaseName, phaseHelp, 1e-9, "phase=\"tls_handshake\""),
+            registry.GetHistogram(phaseName, phaseHelp, 1e-9, "phase=\"handshake\""),
+            registry.GetCounter("network_monitor_websocket_connect_errors_total",
+                                "Number of failed WebSocket connection attempts."),
+            registry.GetCounter(tlsName, tlsHelp, "session=\"full\""),
+            registry.GetCounter(tlsName, tlsHelp, "session=\"resumed\""),
+            registry.GetHistogram("network_monitor_websocket_message_size_bytes",
+                                  "Size of the received WebSocket messages."),
+            registry.GetHistogram("network_monitor_websocket_on_message_seconds",
+                                  "Time spent in the onMessage callback.",
+                                  1e-9),
+        };
+    }()};
+    return metrics;
+}
+
+// Order the resolved addresses for the connection attempts.
+// RFC 8305, section 4: We alternate between address families, starting with
+// the family of the first address, which the resolver ranked highest.
+std::vector<tcp::endpoint> SortForHappyEyeballs(const tcp::resolver::results_type& results)
+{
+    std::vector<tcp::endpoint> preferred{};
+    std::vector<tcp::endpoint> other{};
+    for(const auto& entry : results)
+    {
+        const auto endpoint{entry.endpoint()};
+        if(preferred.empty() || endpoint.protocol() == preferred.front().protocol())
+        {
+            preferred.push_back(endpoint);
+        }
+        else
+        {
+            other.push_back(endpoint);
+        }
+    }
+    std::vector<tcp::endpoint> sorted{};
+    sorted.reserve(preferred.size() + other.size());
+    for(std::size_t idx{0}; idx < std::max(preferred.size(), other.size()); ++idx)
+    {
+        if(idx < preferred.size())
+        {
+            sorted.push_back(preferred[idx]);
+        }
+        if(idx < other.size())
+        {
+            sorted.push_back(other[idx]);
+        }
+    }
+    return sorted;
+}
+
+} // namespace
+
+void* HandlerMemory::Allocate(std::size_t size)
+{
+    if(!inUse_ && size <= kSize)
+    {
+        inUse_ = true;
+        return storage_;
+    }
+    return ::operator new(size);
+}
+
+void HandlerMemory::Deallocate(void* ptr)
+{
+    if(ptr == storage_)
+    {
+        inUse_ = false;
+        return;
+    }
+    ::operator delete(ptr);
+}
+
+struct WebSocketClient::ReadLoopHandler
+{
+    using allocator_type = HandlerAllocator<void>;
+
+    WebSocketClient* client{nullptr};
+
+    allocator_type get_allocator() const noexcept
+    {
+        return allocator_type{client->readMemory_};
+    }
+
+    void operator()(boost::system::error_code ec, std::string_view message)
+    {
+        client->OnRead(ec, message);
+        client->ListenToIncomingMessage(ec);
+    }
+};
+
+struct WebSocketClient::SendHandler
+{
+    using allocator_type = HandlerAllocator<void>;
+
+    WebSocketClient* client{nullptr};
+    std::function<void(boost::system::error_code)> onSend{nullptr};
+
+    allocator_type get_allocator() const noexcept
+    {
+        return allocator_type{client->writeMemory_};
+    }
+
+    void operator()(boost::system::error_code ec)
+    {
+        if(onSend)
+        {
+            onSend(ec);
+        }
+    }
+};
+
+std::chrono::nanoseconds ConnectionTiming::Total() const
+{
+    return resolve + connect + tlsHandshake + handshake;
+}
+
 WebSocketClient::WebSocketClient(const std::string& url,
                                  const std::string& endpoint,
                                  const std::string& port,
                                  boost::asio::io_context& ioc,
-                                 boost::asio::ssl::context& ctx)
+                                 boost::asio::ssl::context& ctx,
+                                 const ConnectionTimeouts& timeouts)
     : url_{url}
     , endpoint_{endpoint}
     , port_{port}
-    , resolver_{boost::asio::make_strand(ioc)}
-    , ws_{boost::asio::make_strand(ioc), ctx}
+    , timeouts_{timeouts}
+    , strand_{boost::asio::make_strand(ioc)}
+    , resolver_{strand_}
+    , ws_{strand_, ctx}
+    , attemptTimer_{strand_}
+    , phaseTimer_{strand_}
 {
+    EnableTlsSessionResumption(ctx);
 }
 
 void WebSocketClient::Connect(std::function<void(boost::system::error_code)> onConnect,
                               std::function<void(boost::system::error_code, std::string&&)> onMessage,
                               std::function<void(boost::system::error_code)> onDisconnect)
 {
-    onConnect_ = onConnect;
-    onMessage_ = onMessage;
-    onDisconnect_ = onDisconnect;
-
-    closed_ = false;
+    std::function<void(boost::system::error_code, const ConnectionTiming&)> onConnectWithTiming{nullptr};
+    if(onConnect)
+    {
+        onConnectWithTiming = [onConnect](auto ec, const auto&) { onConnect(ec); };
+    }
+    ConnectWithTiming(onConnectWithTiming, onMessage, onDisconnect);
+}
 
-    resolver_.async_resolve(url_, port_, [this](auto ec, auto resolverIt) { OnResolve(ec, resolverIt); });
+void WebSocketClient::ConnectWithTiming(
+    std::function<void(boost::system::error_code, const ConnectionTiming&)> onConnect,
+    std::function<void(boost::system::error_code, std::string&&)> onMessage,
+    std::function<void(boost::system::error_code)> onDisconnect)
+{
+    // The read loop starts before the user hears about the connection, so
+    // that no message can arrive unread.
+    StartConnect(onMessage, onDisconnect, [this, onConnect](auto ec, const auto& timing) {
+        if(!ec)
+        {
+            ListenToIncomingMessage(ec);
+        }
+        if(onConnect)
+        {
+            onConnect(ec, timing);
+        }
+    });
 }
 
 void WebSocketClient::Close(std::function<void(boost::system::error_code)> onClose)
 {
-    closed_ = true;
-    ws_.async_close(websocket::close_code::none, [onClose](auto ec) {
+    AsyncClose([onClose](auto ec) {
         if(onClose)
         {
             onClose(ec);
@@ -50,30 +225,138 @@ void WebSocketClient::Close(std::function<void(boost::system::error_code)> onClo
 
 void WebSocketClient::Send(const std::string& message, std::function<void(boost::system::error_code)> onSend)
 {
-    ws_.async_write(boost::asio::buffer(message), [onSend](auto ec, auto) {
-        if(onSend)
+    AsyncSend(message, SendHandler{this, std::move(onSend)});
+}
+
+void WebSocketClient::StartConnect(std::function<void(boost::system::error_code, std::string&&)> onMessage,
+                                   std::function<void(boost::system::error_code)> onDisconnect,
+                                   std::function<void(boost::system::error_code, const ConnectionTiming&)> onConnect)
+{
+    onConnect_ = onConnect;
+    onMessage_ = onMessage;
+    onDisconnect_ = onDisconnect;
+
+    closed_ = false;
+    timing_ = {};
+
+    // The resolver has no timeout of its own: We cancel it.
+    StartPhase(timing_.resolve, timeouts_.resolve, [this]() { resolver_.cancel(); });
+    resolver_.async_resolve(url_, port_, [this](auto ec, auto results) { OnResolve(ec, results); });
+}
+
+void WebSocketClient::OnResolve(const boost::system::error_code& ec, tcp::resolver::results_type results)
+{
+    if(ec)
+    {
+        auto error{phaseTimedOut_ ? boost::beast::error::timeout : ec};
+        Log(__func__, error);
+        OnConnectError(error);
+        return;
+    }
+    EndPhase(GetMetrics().resolveTime);
+
+    endpoints_ = SortForHappyEyeballs(results);
+    if(endpoints_.empty())
+    {
+        auto error{make_error_code(boost::asio::error::host_not_found)};
+        Log(__func__, error);
+        OnConnectError(error);
+        return;
+    }
+
+    // The TCP phase ends with the first successful attempt, or when all
+    // attempts failed, or on timeout, whichever comes first.
+    attempts_.clear();
+    attempts_.reserve(endpoints_.size());
+    nPendingAttempts_ = 0;
+    connecting_ = true;
+    StartPhase(timing_.connect, timeouts_.connect, [this]() {
+        if(!connecting_)
         {
-            onSend(ec);
+            return;
         }
+        connecting_ = false;
+        attemptTimer_.cancel();
+        for(auto& socket : attempts_)
+        {
+            boost::system::error_code ignored{};
+            socket->close(ignored);
+        }
+        auto error{make_error_code(boost::beast::error::timeout)};
+        Log("OnConnect", error);
+        OnConnectError(error);
     });
+    StartConnectionAttempt();
 }
 
-void WebSocketClient::OnResolve(const boost::system::error_code& ec,
-                                boost::asio::ip::tcp::resolver::iterator resolverIt)
+void WebSocketClient::StartConnectionAttempt()
 {
+    const auto attempt{attempts_.size()};
+    if(attempt >= endpoints_.size())
+    {
+        return;
+    }
+    attempts_.push_back(std::make_unique<Socket>(strand_));
+    ++nPendingAttempts_;
+    ++timing_.nAttempts;
+    attempts_.back()->async_connect(endpoints_[attempt],
+                                    [this, attempt](auto ec) { OnConnectionAttempt(ec, attempt); });
+
+    // If this attempt is slow, we start the next one in parallel.
+    if(attempt + 1 < endpoints_.size())
+    {
+        attemptTimer_.expires_after(timeouts_.connectionAttemptDelay);
+        attemptTimer_.async_wait([this](auto ec) {
+            if(!ec && connecting_)
+            {
+                StartConnectionAttempt();
+            }
+        });
+    }
+}
+
+void WebSocketClient::OnConnectionAttempt(const boost::system::error_code& ec, std::size_t attempt)
+{
+    // Another attempt won, or the phase timed out.
+    if(!connecting_)
+    {
+        return;
+    }
+    --nPendingAttempts_;
+
     if(ec)
     {
-        Log(__func__, ec);
-        if(onConnect_)
+        // A failed attempt lets the next one start right away.
+        lastAttemptError_ = ec;
+        if(attempts_.size() < endpoints_.size())
+        {
+            StartConnectionAttempt();
+        }
+        else if(nPendingAttempts_ == 0)
         {
-            onConnect_(ec);
+            connecting_ = false;
+            attemptTimer_.cancel();
+            Log("OnConnect", lastAttemptError_);
+            OnConnectError(lastAttemptError_);
         }
         return;
     }
 
-    boost::beast::get_lowest_layer(ws_).expires_after(std::chrono::seconds(5));
-
-    boost::beast::get_lowest_layer(ws_).async_connect(*resolverIt, [this](auto ec) { OnConnect(ec); });
+    // We have a winner: The other attempts are dropped.
+    connecting_ = false;
+    attemptTimer_.cancel();
+    for(std::size_t idx{0}; idx < attempts_.size(); ++idx)
+    {
+        if(idx != attempt)
+        {
+            boost::system::error_code ignored{};
+            attempts_[idx]->close(ignored);
+        }
+    }
+    timing_.endpoint = endpoints_[attempt];
+    boost::beast::get_lowest_layer(ws_).socket() = std::move(*attempts_[attempt]);
+    EndPhase(GetMetrics().connectTime);
+    OnConnect(ec);
 }
 
 void WebSocketClient::OnConnect(const boost::system::error_code& ec)
@@ -81,20 +364,25 @@ void WebSocketClient::OnConnect(const boost::system::error_code& ec)
     if(ec)
     {
         Log(__func__, ec);
-        if(onConnect_)
-        {
-            onConnect_(ec);
-        }
+        OnConnectError(ec);
         return;
     }
 
-    boost::beast::get_lowest_layer(ws_).expires_never();
-    ws_.set_option(websocket::stream_base::timeout::suggested(boost::beast::role_type::client));
-
     // Some clients require that we set the host name before the TLS handshake
     // or the connection will fail. We use an OpenSSL function for that.
     SSL_set_tlsext_host_name(ws_.next_layer().native_handle(), url_.c_str());
 
+    // The host name is also checked against the server certificate, if the
+    // context verifies its peers.
+    ws_.next_layer().set_verify_callback(boost::asio::ssl::host_name_verification(url_));
+
+    // If we connected to this server before, we try to skip the full
+    // handshake.
+    PrepareTlsSessionResumption(ws_.next_layer().native_handle(), url_, port_);
+
+    // The TLS handshake runs on the TCP stream, so the stream timeout bounds it.
+    StartPhase(timing_.tlsHandshake, timeouts_.tlsHandshake, nullptr);
+    boost::beast::get_lowest_layer(ws_).expires_after(timeouts_.tlsHandshake);
     ws_.next_layer().async_handshake(boost::asio::ssl::stream_base::client, [this](auto ec) { OnTlsHandshake(ec); });
 }
 
@@ -103,19 +391,15 @@ void WebSocketClient::OnHandshake(const boost::system::error_code& ec)
     if(ec)
     {
         Log(__func__, ec);
-        if(onConnect_)
-        {
-            onConnect_(ec);
-        }
+        OnConnectError(ec);
         return;
     }
+    EndPhase(GetMetrics().handshakeTime);
 
     ws_.text(true);
-    ListenToIncomingMessage(ec);
-
     if(onConnect_)
     {
-        onConnect_(ec);
+        onConnect_(ec, timing_);
     }
 }
 
@@ -124,13 +408,26 @@ void WebSocketClient::OnTlsHandshake(const boost::system::error_code& ec)
     if(ec)
     {
         Log("OnTlsHandshake", ec);
-        if(onConnect_)
-        {
-            onConnect_(ec);
-        }
+        OnConnectError(ec);
         return;
     }
+    EndPhase(GetMetrics().tlsHandshakeTime);
+    timing_.tlsSessionResumed = SSL_session_reused(ws_.next_layer().native_handle()) == 1;
+    if(MetricsRegistry::Default().IsEnabled())
+    {
+        const auto& metrics{GetMetrics()};
+        (timing_.tlsSessionResumed ? metrics.resumedTlsHandshakes : metrics.fullTlsHandshakes).Increment();
+    }
+
+    // From now on, the WebSocket stream manages the timeouts: It must be the
+    // only one to do so.
+    boost::beast::get_lowest_layer(ws_).expires_never();
+    auto timeout{websocket::stream_base::timeout::suggested(boost::beast::role_type::client)};
+    timeout.handshake_timeout = timeouts_.handshake;
+    ws_.set_option(timeout);
+
     // Attempt a WebSocket handshake.
+    StartPhase(timing_.handshake, timeouts_.handshake, nullptr);
     ws_.async_handshake(url_, endpoint_, [this](auto ec) { OnHandshake(ec); });
 }
 
@@ -145,12 +442,10 @@ void WebSocketClient::ListenToIncomingMessage(const boost::system::error_code& e
         return;
     }
 
-    ws_.async_read(rBuffer_, [this](auto ec, auto nBytes) {
-        OnRead(ec, nBytes);
-        ListenToIncomingMessage(ec);
-    });
+    AsyncRead(ReadLoopHandler{this});
 }
-void WebSocketClient::OnRead(const boost::system::error_code& ec, size_t nBytes)
+
+void WebSocketClient::OnRead(const boost::system::error_code& ec, std::string_view view)
 {
     // We just ignore messages that failed to read.
     if(ec)
@@ -160,11 +455,72 @@ void WebSocketClient::OnRead(const boost::system::error_code& ec, size_t nBytes)
 
     // Parse the message and forward it to the user callback.
     // Note: This call is synchronous and will block the WebSocket strand.
-    std::string message{boost::beast::buffers_to_string(rBuffer_.data())};
-    rBuffer_.consume(nBytes);
+    const auto nBytes{view.size()};
+    std::string message{view};
+    if(!MetricsRegistry::Default().IsEnabled())
+    {
+        if(onMessage_)
+        {
+            onMessage_(ec, std::move(message));
+        }
+        return;
+    }
+
+    const auto& metrics{GetMetrics()};
+    metrics.messageSize.Record(nBytes);
     if(onMessage_)
     {
+        ScopedTimer timer{metrics.onMessageTime};
         onMessage_(ec, std::move(message));
     }
 }
+
+void WebSocketClient::StartPhase(std::chrono::nanoseconds& duration,
+                                 std::chrono::milliseconds timeout,
+                                 std::function<void()> onTimeout)
+{
+    phaseStart_ = std::chrono::steady_clock::now();
+    phaseDuration_ = &duration;
+    phaseTimedOut_ = false;
+    if(!onTimeout)
+    {
+        return;
+    }
+    phaseTimer_.expires_after(timeout);
+    phaseTimer_.async_wait([this, onTimeout](auto ec) {
+        // The timer is cancelled when the phase ends, but the handler might
+        // have been queued already.
+        if(ec || phaseTimer_.expiry() == std::chrono::steady_clock::time_point::max())
+        {
+            return;
+        }
+        phaseTimedOut_ = true;
+        onTimeout();
+    });
+}
+
+void WebSocketClient::EndPhase(Histogram& histogram)
+{
+    phaseTimer_.expires_at(std::chrono::steady_clock::time_point::max());
+    *phaseDuration_ = std::chrono::steady_clock::now() - phaseStart_;
+    if(MetricsRegistry::Default().IsEnabled())
+    {
+        histogram.Record(*phaseDuration_);
+    }
+}
+
+void WebSocketClient::OnConnectError(const boost::system::error_code& ec)
+{
+    // The report includes the time we spent in the phase that failed.
+    phaseTimer_.expires_at(std::chrono::steady_clock::time_point::max());
+    *phaseDuration_ = std::chrono::steady_clock::now() - phaseStart_;
+    if(MetricsRegistry::Default().IsEnabled())
+    {
+        GetMetrics().connectErrors.Increment();
+    }
+    if(onConnect_)
+    {
+        onConnect_(ec, timing_);
+    }
+}
 } // namespace NetworkMonitor
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "AllocationCounter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+using NetworkMonitor::AllocationCounter;
+
+namespace {
+
+// Counter of the current thread, if started.
+thread_local std::size_t* threadCounter{nullptr};
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    if(threadCounter != nullptr)
+    {
+        ++*threadCounter;
+    }
+    if(void* ptr{std::malloc(size)}; ptr != nullptr)
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+AllocationCounter::~AllocationCounter()
+{
+    Stop();
+}
+
+void AllocationCounter::Start()
+{
+    count_ = 0;
+    counting_ = true;
+    threadCounter = &count_;
+}
+
+void AllocationCounter::Stop()
+{
+    if(counting_ && threadCounter == &count_)
+    {
+        threadCounter = nullptr;
+    }
+    counting_ = false;
+}
+
+std::size_t AllocationCounter::Get() const
+{
+    return count_;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+namespace NetworkMonitor {
+
+/*! \brief Count the heap allocations of the current thread.
+ *
+ *  The test executable replaces the global operator new to count the
+ *  allocations of the threads that have a counter started. Other threads are
+ *  not counted, so a test can run a server on another thread.
+ */
+class AllocationCounter
+{
+public:
+    AllocationCounter() = default;
+
+    AllocationCounter(const AllocationCounter& other) = delete;
+    AllocationCounter& operator=(const AllocationCounter& other) = delete;
+
+    ~AllocationCounter();
+
+    /*! \brief Start counting from 0 on this thread.
+     */
+    void Start();
+
+    /*! \brief Stop counting on this thread.
+     */
+    void Stop();
+
+    /*! \brief Number of allocations between Start and Stop.
+     */
+    std::size_t Get() const;
+
+private:
+    std::size_t count_{0};
+    bool counting_{false};
+};
+
+} // namespace NetworkMonitor
@@ -1,17 +1,63 @@
 #include <gtest/gtest.h>
 
 #include <FileDownloader.hpp>
+#include <boost/asio.hpp>
 #include <filesystem>
 #include <fstream>
 #include <string>
+#include <thread>
+
+#include "LocalServer.hpp"
+
+using NetworkMonitor::LocalServer;
+using NetworkMonitor::LocalServerOptions;
+
+namespace {
+
+// Serve the test files over HTTPS from a background thread.
+class LocalFileServer
+{
+public:
+    LocalFileServer()
+        : server_{ioc_, MakeOptions()}
+        , thread_{[this]() { ioc_.run(); }}
+    {
+    }
+
+    ~LocalFileServer()
+    {
+        server_.Stop();
+        thread_.join();
+    }
+
+    std::string GetUrl(const std::string& path) const
+    {
+        return "https://localhost:" + std::to_string(server_.GetPort()) + path;
+    }
+
+private:
+    static LocalServerOptions MakeOptions()
+    {
+        LocalServerOptions options{};
+        options.documentRoot = TESTS_WWW_DIR;
+        return options;
+    }
+
+    boost::asio::io_context ioc_{};
+    LocalServer server_;
+    std::thread thread_;
+};
+
+} // namespace
 
 TEST(FileDownloaderTest, basic)
 {
-    const std::string fileUrl{"https://ltnm.learncppthroughprojects.com/network-layout.json"};
+    LocalFileServer server{};
+    const std::string fileUrl{server.GetUrl("/network-layout.json")};
     const auto destination{std::filesystem::temp_directory_path() / "network-layout.json"};
 
     // Download the file.
-    bool downloaded{NetworkMonitor::DownloadFile(fileUrl, destination, TESTS_CACERT_PEM)};
+    bool downloaded{NetworkMonitor::DownloadFile(fileUrl, destination, TESTS_LOCAL_CA_PEM)};
     EXPECT_TRUE(downloaded);
     EXPECT_TRUE(std::filesystem::exists(destination));
 
@@ -40,10 +86,11 @@ TEST(FileDownloaderTest, basic)
 
 TEST(FileDownloaderTest, downloadAndParseFile)
 {
-    const std::string fileUrl{"https://ltnm.learncppthroughprojects.com/network-layout.json"};
+    LocalFileServer server{};
+    const std::string fileUrl{server.GetUrl("/network-layout.json")};
     const auto destination{TESTS_NETWORK_LAYOUT_JSON};
 
-    bool downloaded{NetworkMonitor::DownloadFile(fileUrl, destination, TESTS_CACERT_PEM)};
+    bool downloaded{NetworkMonitor::DownloadFile(fileUrl, destination, TESTS_LOCAL_CA_PEM)};
     EXPECT_TRUE(downloaded);
     EXPECT_TRUE(std::filesystem::exists(destination));
 
@@ -59,3 +106,14 @@ TEST(FileDownloaderTest, downloadAndParseFile)
 
     std::filesystem::remove(destination);
 }
+
+TEST(FileDownloaderTest, untrustedServer)
+{
+    LocalFileServer server{};
+    const auto destination{std::filesystem::temp_directory_path() / "network-layout.json"};
+
+    // The local CA is not in the public CA bundle.
+    bool downloaded{NetworkMonitor::DownloadFile(server.GetUrl("/network-layout.json"), destination, TESTS_CACERT_PEM)};
+    EXPECT_FALSE(downloaded);
+    std::filesystem::remove(destination);
+}
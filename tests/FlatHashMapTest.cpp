@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+
+#include <FlatHashMap.hpp>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using NetworkMonitor::FlatHashMap;
+using NetworkMonitor::StringViewHash;
+
+namespace {
+
+// Sends all keys to the same group, to exercise probing.
+struct ConstantHash
+{
+    std::size_t operator()(int) const
+    {
+        return 42;
+    }
+};
+
+} // namespace
+
+TEST(FlatHashMapTest, emplace_find)
+{
+    FlatHashMap<int, int> map{};
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.find(1), map.end());
+    EXPECT_EQ(map.count(1), 0);
+
+    auto [it, inserted]{map.emplace(1, 10)};
+    EXPECT_TRUE(inserted);
+    EXPECT_EQ(it->first, 1);
+    EXPECT_EQ(it->second, 10);
+    EXPECT_EQ(map.size(), 1);
+
+    // Existing keys are not replaced.
+    std::tie(it, inserted) = map.emplace(1, 20);
+    EXPECT_FALSE(inserted);
+    EXPECT_EQ(it->second, 10);
+    EXPECT_EQ(map.size(), 1);
+
+    EXPECT_EQ(map.at(1), 10);
+    EXPECT_THROW(map.at(2), std::out_of_range);
+}
+
+TEST(FlatHashMapTest, grow)
+{
+    // Compare against std::map over random keys, across many rehashes.
+    FlatHashMap<int, int> map{};
+    std::map<int, int> expected{};
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<int> key{0, 100000};
+    for(int idx{0}; idx < 50000; ++idx)
+    {
+        const auto k{key(rng)};
+        EXPECT_EQ(map.emplace(k, idx).second, expected.emplace(k, idx).second);
+    }
+    ASSERT_EQ(map.size(), expected.size());
+    EXPECT_LE(map.size(), map.capacity() - map.capacity() / 8);
+    for(int k{0}; k <= 100000; ++k)
+    {
+        auto it{expected.find(k)};
+        if(it == expected.end())
+        {
+            EXPECT_EQ(map.find(k), map.end());
+        }
+        else
+        {
+            ASSERT_NE(map.find(k), map.end());
+            EXPECT_EQ(map.find(k)->second, it->second);
+        }
+    }
+}
+
+TEST(FlatHashMapTest, collisions)
+{
+    // More keys than a group holds, all with the same hash.
+    FlatHashMap<int, int, ConstantHash> map{};
+    for(int k{0}; k < 100; ++k)
+    {
+        EXPECT_TRUE(map.emplace(k, -k).second);
+    }
+    for(int k{0}; k < 100; ++k)
+    {
+        EXPECT_EQ(map.at(k), -k);
+    }
+    EXPECT_EQ(map.find(100), map.end());
+}
+
+TEST(FlatHashMapTest, erase)
+{
+    // Compare against std::map over random inserts and erases, across many
+    // rehashes and tombstone clean-ups.
+    FlatHashMap<int, int> map{};
+    std::map<int, int> expected{};
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<int> key{0, 2000};
+    std::bernoulli_distribution erases{0.4};
+    for(int idx{0}; idx < 50000; ++idx)
+    {
+        const auto k{key(rng)};
+        if(erases(rng))
+        {
+            EXPECT_EQ(map.erase(k), expected.erase(k));
+        }
+        else
+        {
+            EXPECT_EQ(map.emplace(k, idx).second, expected.emplace(k, idx).second);
+        }
+    }
+    ASSERT_EQ(map.size(), expected.size());
+    std::size_t count{0};
+    for(const auto& [k, value] : map)
+    {
+        ASSERT_EQ(expected.count(k), 1);
+        EXPECT_EQ(expected.at(k), value);
+        ++count;
+    }
+    EXPECT_EQ(count, expected.size());
+
+    // Erasing from a long probe sequence keeps the keys behind it reachable.
+    FlatHashMap<int, int, ConstantHash> collisions{};
+    for(int k{0}; k < 100; ++k)
+    {
+        collisions.emplace(k, -k);
+    }
+    for(int k{0}; k < 100; k += 2)
+    {
+        EXPECT_EQ(collisions.erase(k), 1);
+    }
+    EXPECT_EQ(collisions.erase(0), 0);
+    for(int k{0}; k < 100; ++k)
+    {
+        EXPECT_EQ(collisions.count(k), k % 2);
+    }
+    EXPECT_TRUE(collisions.emplace(0, 1).second);
+    EXPECT_EQ(collisions.at(0), 1);
+    EXPECT_EQ(collisions.size(), 51);
+}
+
+TEST(FlatHashMapTest, iterate)
+{
+    FlatHashMap<int, int> map{};
+    int expectedSum{0};
+    for(int k{0}; k < 1000; ++k)
+    {
+        map.emplace(k * 7, k);
+        expectedSum += k;
+    }
+    std::size_t count{0};
+    int sum{0};
+    for(const auto& [key, value] : map)
+    {
+        EXPECT_EQ(key, value * 7);
+        sum += value;
+        ++count;
+    }
+    EXPECT_EQ(count, map.size());
+    EXPECT_EQ(sum, expectedSum);
+
+    const FlatHashMap<int, int> empty{};
+    EXPECT_EQ(empty.begin(), empty.end());
+}
+
+TEST(FlatHashMapTest, string_view_lookup)
+{
+    // Keys view strings owned elsewhere, lookups take any string type.
+    const std::vector<std::string> ids{"station_000", "station_001", "station_002"};
+    FlatHashMap<std::string_view, std::size_t, StringViewHash> map{};
+    for(std::size_t idx{0}; idx < ids.size(); ++idx)
+    {
+        map.emplace(ids[idx], idx);
+    }
+    const std::string message{"{\"station_id\":\"station_001\"}"};
+    EXPECT_EQ(map.at(std::string_view{message}.substr(15, 11)), 1);
+    EXPECT_EQ(map.at(std::string{"station_002"}), 2);
+    EXPECT_EQ(map.at("station_000"), 0);
+    EXPECT_EQ(map.count("station_003"), 0);
+}
+
+TEST(FlatHashMapTest, allocator)
+{
+    std::pmr::monotonic_buffer_resource arena{};
+    using Map = FlatHashMap<int,
+                            int,
+                            std::hash<int>,
+                            std::equal_to<>,
+                            std::pmr::polymorphic_allocator<std::pair<int, int>>>;
+    Map map(&arena);
+    map.reserve(100);
+    const auto capacity{map.capacity()};
+    for(int k{0}; k < 100; ++k)
+    {
+        map.emplace(k, k);
+    }
+    EXPECT_EQ(map.capacity(), capacity);
+    EXPECT_GE(map.GetMemorySize(), capacity * (1 + sizeof(std::pair<int, int>)));
+    EXPECT_EQ(map.at(99), 99);
+}
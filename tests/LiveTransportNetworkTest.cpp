@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+
+#include <LiveTransportNetwork.hpp>
+#include <TransportNetwork.hpp>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::Id;
+using NetworkMonitor::Line;
+using NetworkMonitor::LiveTransportNetwork;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::Route;
+using NetworkMonitor::Station;
+using NetworkMonitor::TransportNetwork;
+
+namespace {
+
+// Build a network with stations 0 to nStations - 1 and a single line with one
+// route going through all the stations, starting at `firstStop`.
+TransportNetwork MakeNetwork(size_t nStations, size_t firstStop, const Id& routeId)
+{
+    TransportNetwork nw{};
+    std::vector<Id> stops{};
+    for(size_t idx{0}; idx < nStations; ++idx)
+    {
+        Station station{"station_" + std::to_string(idx), "Station Name " + std::to_string(idx)};
+        EXPECT_TRUE(nw.AddStation(station));
+    }
+    for(size_t idx{0}; idx < nStations; ++idx)
+    {
+        stops.push_back("station_" + std::to_string((firstStop + idx) % nStations));
+    }
+    Route route{routeId, "inbound", "line_000", stops.front(), stops.back(), stops};
+    Line line{"line_000", "Line Name", {route}};
+    EXPECT_TRUE(nw.AddLine(line));
+    return nw;
+}
+
+} // namespace
+
+TEST(LiveTransportNetworkTest, Publish_basic)
+{
+    LiveTransportNetwork live{MakeNetwork(3, 0, "route_000")};
+    EXPECT_EQ(live.GetVersion(), 1);
+    {
+        auto snapshot{live.GetSnapshot()};
+        auto routes{snapshot->GetRoutesServingStation("station_0")};
+        ASSERT_EQ(routes.size(), 1);
+        EXPECT_TRUE(routes[0] == "route_000");
+    }
+
+    auto version{live.Publish(MakeNetwork(3, 1, "route_001"))};
+    EXPECT_EQ(version, 2);
+    EXPECT_EQ(live.GetVersion(), 2);
+    {
+        auto snapshot{live.GetSnapshot()};
+        EXPECT_EQ(snapshot.GetVersion(), 2);
+        auto routes{snapshot->GetRoutesServingStation("station_0")};
+        ASSERT_EQ(routes.size(), 1);
+        EXPECT_TRUE(routes[0] == "route_001");
+    }
+}
+
+TEST(LiveTransportNetworkTest, Publish_carries_passenger_counts)
+{
+    using EventType = PassengerEvent::Type;
+
+    LiveTransportNetwork live{MakeNetwork(3, 0, "route_000")};
+    bool ok{true};
+    ok &= live.RecordPassengerEvent({"station_0", EventType::In});
+    ok &= live.RecordPassengerEvent({"station_2", EventType::In});
+    ok &= live.RecordPassengerEvent({"station_2", EventType::In});
+    ASSERT_TRUE(ok);
+
+    // The new network drops station 2 and adds station 3.
+    live.Publish(MakeNetwork(4, 0, "route_000"));
+    live.Publish(MakeNetwork(2, 0, "route_000"));
+    ok = live.RecordPassengerEvent({"station_0", EventType::In});
+    ASSERT_TRUE(ok);
+    ok = live.RecordPassengerEvent({"station_2", EventType::In});
+    EXPECT_FALSE(ok);
+
+    auto snapshot{live.GetSnapshot()};
+    EXPECT_EQ(snapshot->GetPassengerCount("station_0"), 2);
+    EXPECT_EQ(snapshot->GetPassengerCount("station_1"), 0);
+    EXPECT_THROW(snapshot->GetPassengerCount("station_2"), std::runtime_error);
+
+    // The carried-over counts are ranked, too.
+    auto busiest{snapshot->GetBusiestStations(1)};
+    ASSERT_EQ(busiest.size(), 1);
+    EXPECT_EQ(busiest[0].stationId, "station_0");
+    EXPECT_EQ(busiest[0].count, 2);
+}
+
+TEST(LiveTransportNetworkTest, Publish_waits_for_readers)
+{
+    LiveTransportNetwork live{MakeNetwork(3, 0, "route_000")};
+
+    auto snapshot{live.GetSnapshot()};
+    std::atomic<bool> published{false};
+    std::thread publisher{[&live, &published]() {
+        live.Publish(MakeNetwork(3, 1, "route_001"));
+        published = true;
+    }};
+
+    // The old network must stay alive until we drop our snapshot.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(published);
+    auto routes{snapshot->GetRoutesServingStation("station_0")};
+    ASSERT_EQ(routes.size(), 1);
+    EXPECT_TRUE(routes[0] == "route_000");
+    EXPECT_EQ(snapshot.GetVersion(), 1);
+
+    // New readers already see the new network.
+    while(live.GetVersion() != 2)
+    {
+        std::this_thread::yield();
+    }
+
+    {
+        auto dropped{std::move(snapshot)};
+    }
+    publisher.join();
+    EXPECT_TRUE(published);
+}
+
+TEST(LiveTransportNetworkTest, Stress_concurrent_readers_and_reloads)
+{
+    using EventType = PassengerEvent::Type;
+
+    const size_t nStations{20};
+    const size_t nReaders{4};
+    const size_t nReloads{50};
+    const size_t nEvents{20000};
+
+    LiveTransportNetwork live{MakeNetwork(nStations, 0, "route_1")};
+    std::atomic<bool> done{false};
+
+    // Readers check that every snapshot is a consistent network.
+    std::atomic<size_t> badReads{0};
+    std::vector<std::thread> readers{};
+    for(size_t reader{0}; reader < nReaders; ++reader)
+    {
+        readers.emplace_back([&live, &done, &badReads, nStations]() {
+            while(!done)
+            {
+                auto snapshot{live.GetSnapshot()};
+                for(size_t idx{0}; idx < nStations; ++idx)
+                {
+                    const auto stationId{"station_" + std::to_string(idx)};
+                    auto routes{snapshot->GetRoutesServingStation(stationId)};
+                    if(routes.size() != 1 || routes[0] != "route_" + std::to_string(snapshot.GetVersion() % 2))
+                    {
+                        ++badReads;
+                    }
+                    snapshot->GetPassengerCount(stationId);
+                }
+            }
+        });
+    }
+
+    // Passenger events keep flowing while we reload the network.
+    std::thread recorder{[&live, nStations, nEvents]() {
+        for(size_t event{0}; event < nEvents; ++event)
+        {
+            const auto stationId{"station_" + std::to_string(event % nStations)};
+            EXPECT_TRUE(live.RecordPassengerEvent({stationId, EventType::In}));
+        }
+    }};
+
+    // Versions alternate between the two routes, so that the readers can tell
+    // which network they are looking at.
+    std::thread reloader{[&live, nStations, nReloads]() {
+        for(size_t reload{0}; reload < nReloads; ++reload)
+        {
+            auto version{live.GetVersion() + 1};
+            live.Publish(MakeNetwork(nStations, version % nStations, "route_" + std::to_string(version % 2)));
+        }
+    }};
+
+    recorder.join();
+    reloader.join();
+    done = true;
+    for(auto& reader : readers)
+    {
+        reader.join();
+    }
+
+    EXPECT_EQ(badReads, 0);
+    EXPECT_EQ(live.GetVersion(), 1 + nReloads);
+
+    // No event was lost across reloads.
+    auto snapshot{live.GetSnapshot()};
+    long long int total{0};
+    for(size_t idx{0}; idx < nStations; ++idx)
+    {
+        total += snapshot->GetPassengerCount("station_" + std::to_string(idx));
+    }
+    EXPECT_EQ(total, nEvents);
+}
@@ -0,0 +1,701 @@
+#include "LocalServer.hpp"
+
+#include <openssl/ssl.h>
+
+#include <boost/beast.hpp>
+#include <boost/beast/ssl.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
+#include <string_view>
+#include <utility>
+
+using NetworkMonitor::LocalServer;
+using NetworkMonitor::LocalServerOptions;
+
+namespace http = boost::beast::http;
+namespace websocket = boost::beast::websocket;
+using tcp = boost::asio::ip::tcp;
+
+namespace {
+
+using SslStream = boost::beast::ssl_stream<boost::beast::tcp_stream>;
+
+// STOMP
+
+struct StompFrame
+{
+    std::string command{};
+    std::map<std::string, std::string> headers{};
+    std::string body{};
+};
+
+// We only parse what the network monitor sends: A command, headers and an
+// optional body terminated by a NULL octet.
+bool ParseStompFrame(const std::string& text, StompFrame& frame)
+{
+    std::istringstream is{text};
+    std::string line{};
+    auto getLine{[&is, &line]() {
+        if(!std::getline(is, line))
+        {
+            return false;
+        }
+        if(!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        return true;
+    }};
+
+    // Clients may send new lines as heart-beats before the command.
+    do
+    {
+        if(!getLine())
+        {
+            return false;
+        }
+    } while(line.empty());
+    frame.command = line;
+
+    while(getLine() && !line.empty())
+    {
+        const auto colon{line.find(':')};
+        if(colon == std::string::npos)
+        {
+            return false;
+        }
+
+        // The first occurrence of a header wins.
+        frame.headers.emplace(line.substr(0, colon), line.substr(colon + 1));
+    }
+
+    std::getline(is, frame.body, '\0');
+    return true;
+}
+
+std::string MakeStompFrame(const std::string& command,
+                           const std::vector<std::pair<std::string, std::string> >& headers,
+                           const std::string& body = {})
+{
+    std::string frame{command + "\n"};
+    for(const auto& [key, value] : headers)
+    {
+        frame += key + ":" + value + "\n";
+    }
+    frame += "\n" + body;
+    frame += '\0';
+    return frame;
+}
+
+std::string GetHeader(const StompFrame& frame, const std::string& key)
+{
+    auto it{frame.headers.find(key)};
+    return it == frame.headers.end() ? std::string{} : it->second;
+}
+
+// Current time in the format of the passenger event feed, with milliseconds.
+std::string GetFeedTimestamp()
+{
+    const auto now{std::chrono::system_clock::now()};
+    const auto time{std::chrono::system_clock::to_time_t(now)};
+    const auto millis{std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000};
+    std::tm tm{};
+#if defined(_WIN32)
+    gmtime_s(&tm, &time);
+#else
+    gmtime_r(&time, &tm);
+#endif
+    char buffer[64]{};
+    std::snprintf(buffer,
+                  sizeof(buffer),
+                  "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+                  tm.tm_year + 1900,
+                  tm.tm_mon + 1,
+                  tm.tm_mday,
+                  tm.tm_hour,
+                  tm.tm_min,
+                  tm.tm_sec,
+                  static_cast<int>(millis));
+    return buffer;
+}
+
+// HTTP
+
+// Strong entity tag from the size and the FNV-1a hash of the content.
+std::string MakeETag(const std::string& content)
+{
+    std::uint64_t hash{14695981039346656037ull};
+    for(unsigned char c : content)
+    {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    char buffer[48]{};
+    std::snprintf(buffer,
+                  sizeof(buffer),
+                  "\"%zx-%llx\"",
+                  content.size(),
+                  static_cast<unsigned long long>(hash));
+    return buffer;
+}
+
+enum class RangeResult
+{
+    None,
+    Satisfiable,
+    Unsatisfiable,
+};
+
+// Parse a single byte range: `bytes=first-last`, `bytes=first-` or
+// `bytes=-suffixLength`. We serve the whole file for anything else, including
+// multiple ranges, as RFC 7233 allows.
+RangeResult ParseByteRange(std::string_view header, std::size_t size, std::size_t& first, std::size_t& last)
+{
+    constexpr std::string_view prefix{"bytes="};
+    if(header.substr(0, prefix.size()) != prefix || header.find(',') != std::string_view::npos)
+    {
+        return RangeResult::None;
+    }
+    const auto spec{std::string{header.substr(prefix.size())}};
+    const auto dash{spec.find('-')};
+    if(dash == std::string::npos)
+    {
+        return RangeResult::None;
+    }
+    const auto firstText{spec.substr(0, dash)};
+    const auto lastText{spec.substr(dash + 1)};
+    try
+    {
+        if(firstText.empty())
+        {
+            const auto suffix{std::stoull(lastText)};
+            if(suffix == 0 || size == 0)
+            {
+                return RangeResult::Unsatisfiable;
+            }
+            first = suffix >= size ? 0 : size - suffix;
+            last = size - 1;
+            return RangeResult::Satisfiable;
+        }
+        first = std::stoull(firstText);
+        last = lastText.empty() ? size - 1 : std::min<std::size_t>(std::stoull(lastText), size - 1);
+    }
+    catch(const std::exception&)
+    {
+        return RangeResult::None;
+    }
+    if(first >= size || first > last)
+    {
+        return RangeResult::Unsatisfiable;
+    }
+    return RangeResult::Satisfiable;
+}
+
+std::string GetContentType(const std::filesystem::path& path)
+{
+    const auto extension{path.extension().string()};
+    if(extension == ".json")
+    {
+        return "application/json";
+    }
+    if(extension == ".txt")
+    {
+        return "text/plain";
+    }
+    return "application/octet-stream";
+}
+
+http::response<http::string_body> HandleFileRequest(const http::request<http::string_body>& request,
+                                                    const std::filesystem::path& documentRoot)
+{
+    http::response<http::string_body> response{http::status::ok, request.version()};
+    response.set(http::field::server, "network-monitor-local-server");
+    response.keep_alive(request.keep_alive());
+
+    auto fail{[&response](http::status status) {
+        response.result(status);
+        response.body() = std::string{http::obsolete_reason(status)};
+        response.set(http::field::content_type, "text/plain");
+        response.prepare_payload();
+        return response;
+    }};
+
+    if(request.method() != http::verb::get && request.method() != http::verb::head)
+    {
+        return fail(http::status::method_not_allowed);
+    }
+
+    // We never serve anything outside of the document root.
+    auto target{std::string{request.target()}};
+    target = target.substr(0, target.find('?'));
+    if(documentRoot.empty() || target.empty() || target.front() != '/' || target.find("..") != std::string::npos)
+    {
+        return fail(http::status::not_found);
+    }
+    const auto path{documentRoot / target.substr(1)};
+    std::ifstream file{path, std::ios::binary};
+    if(!std::filesystem::is_regular_file(path) || !file)
+    {
+        return fail(http::status::not_found);
+    }
+    std::string content{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+
+    const auto etag{MakeETag(content)};
+    response.set(http::field::etag, etag);
+    response.set(http::field::accept_ranges, "bytes");
+    response.set(http::field::content_type, GetContentType(path));
+
+    // Conditional request: The client already has this version.
+    const auto ifNoneMatch{request[http::field::if_none_match]};
+    if(!ifNoneMatch.empty() && (ifNoneMatch == "*" || ifNoneMatch.find(etag) != boost::beast::string_view::npos))
+    {
+        response.result(http::status::not_modified);
+        return response;
+    }
+
+    // Range request. With If-Range, the range only applies to this version.
+    const auto range{request[http::field::range]};
+    const auto ifRange{request[http::field::if_range]};
+    if(!range.empty() && (ifRange.empty() || ifRange == etag))
+    {
+        std::size_t first{0};
+        std::size_t last{0};
+        switch(ParseByteRange({range.data(), range.size()}, content.size(), first, last))
+        {
+            case RangeResult::Satisfiable:
+                response.result(http::status::partial_content);
+                response.set(http::field::content_range,
+                             "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+                                 std::to_string(content.size()));
+                content = content.substr(first, last - first + 1);
+                break;
+            case RangeResult::Unsatisfiable:
+                response.result(http::status::range_not_satisfiable);
+                response.set(http::field::content_range, "bytes */" + std::to_string(content.size()));
+                response.prepare_payload();
+                return response;
+            case RangeResult::None:
+                break;
+        }
+    }
+
+    response.content_length(content.size());
+    if(request.method() == http::verb::get)
+    {
+        response.body() = std::move(content);
+    }
+    return response;
+}
+
+} // namespace
+
+// LocalServer::WebSocketSession
+
+class LocalServer::WebSocketSession : public std::enable_shared_from_this<WebSocketSession>
+{
+public:
+    WebSocketSession(LocalServer& server, SslStream&& stream)
+        : server_{server}
+        , ws_{std::move(stream)}
+        , timer_{ws_.get_executor()}
+    {
+    }
+
+    void Start(http::request<http::string_body> request)
+    {
+        feed_ = request.target() == "/network-events";
+        if(!feed_ && request.target() != "/echo")
+        {
+            Close();
+            return;
+        }
+        ws_.set_option(websocket::stream_base::timeout::suggested(boost::beast::role_type::server));
+        ws_.async_accept(request, [self = shared_from_this()](auto ec) {
+            if(!ec)
+            {
+                self->Read();
+            }
+        });
+    }
+
+    void Close()
+    {
+        feeding_ = false;
+        timer_.cancel();
+        boost::beast::get_lowest_layer(ws_).close();
+    }
+
+private:
+    static constexpr std::size_t kMaxQueuedFrames{64};
+
+    LocalServer& server_;
+    websocket::stream<SslStream> ws_;
+    boost::beast::flat_buffer buffer_{};
+
+    // Frames waiting to be written. Only one write can be in flight.
+    std::deque<std::string> outbox_{};
+    bool closeAfterWrite_{false};
+
+    // STOMP feed state
+    bool feed_{false};
+    bool connected_{false};
+    bool feeding_{false};
+    std::string subscriptionId_{};
+    std::size_t nSent_{0};
+    std::chrono::steady_clock::time_point feedStart_{};
+    boost::asio::steady_timer timer_;
+    std::mt19937 rng_{42};
+
+    void Read()
+    {
+        ws_.async_read(buffer_, [self = shared_from_this()](auto ec, auto) { self->OnRead(ec); });
+    }
+
+    void OnRead(const boost::system::error_code& ec)
+    {
+        if(ec)
+        {
+            feeding_ = false;
+            timer_.cancel();
+            return;
+        }
+        const bool text{ws_.got_text()};
+        auto message{boost::beast::buffers_to_string(buffer_.data())};
+        buffer_.consume(buffer_.size());
+        if(feed_)
+        {
+            OnStompFrame(message);
+        }
+        else
+        {
+            ++server_.stats_.nEchoedMessages;
+            ws_.text(text);
+            Send(std::move(message));
+        }
+        Read();
+    }
+
+    void OnStompFrame(const std::string& message)
+    {
+        StompFrame frame{};
+        if(!ParseStompFrame(message, frame))
+        {
+            SendError("ValidationInvalidFrame");
+            return;
+        }
+        if(frame.command == "STOMP" || frame.command == "CONNECT")
+        {
+            if(GetHeader(frame, "login") != server_.options_.stompUsername ||
+               GetHeader(frame, "passcode") != server_.options_.stompPassword)
+            {
+                SendError("ValidationInvalidAuth");
+                return;
+            }
+            connected_ = true;
+            Send(MakeStompFrame("CONNECTED", {{"version", "1.2"}}));
+            return;
+        }
+        if(!connected_)
+        {
+            SendError("ValidationNotConnected");
+            return;
+        }
+        if(frame.command == "SUBSCRIBE")
+        {
+            if(GetHeader(frame, "destination") != "/passengers" || GetHeader(frame, "id").empty())
+            {
+                SendError("ValidationInvalidSubscription");
+                return;
+            }
+            subscriptionId_ = GetHeader(frame, "id");
+            SendReceipt(frame);
+            feeding_ = true;
+            nSent_ = 0;
+            feedStart_ = std::chrono::steady_clock::now();
+            Feed();
+            return;
+        }
+        if(frame.command == "UNSUBSCRIBE" || frame.command == "DISCONNECT")
+        {
+            feeding_ = false;
+            timer_.cancel();
+            SendReceipt(frame);
+            return;
+        }
+        SendError("ValidationInvalidCommand");
+    }
+
+    void SendReceipt(const StompFrame& frame)
+    {
+        const auto receipt{GetHeader(frame, "receipt")};
+        if(!receipt.empty())
+        {
+            Send(MakeStompFrame("RECEIPT", {{"receipt-id", receipt}}));
+        }
+    }
+
+    // Like the real feed, we close the connection after an error.
+    void SendError(const std::string& message)
+    {
+        Send(MakeStompFrame("ERROR", {{"version", "1.2"}, {"message", message}}));
+        closeAfterWrite_ = true;
+    }
+
+    // Send all the passenger events that are due, then wait for the next one.
+    // Events that are due are only queued while the outbox has room: When the
+    // client reads slowly, we catch up from the write handler.
+    void Feed()
+    {
+        if(!feeding_)
+        {
+            return;
+        }
+        const auto& options{server_.options_};
+        const auto elapsed{std::chrono::duration<double>(std::chrono::steady_clock::now() - feedStart_).count()};
+        auto due{static_cast<std::size_t>(elapsed * options.feedEventsPerSecond) + 1};
+        if(options.feedEvents > 0)
+        {
+            due = std::min(due, options.feedEvents);
+        }
+        while(nSent_ < due && outbox_.size() < kMaxQueuedFrames)
+        {
+            SendPassengerEvent();
+        }
+        if(options.feedEvents > 0 && nSent_ >= options.feedEvents)
+        {
+            feeding_ = false;
+            return;
+        }
+        if(nSent_ < due)
+        {
+            return;
+        }
+        const auto next{feedStart_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                         std::chrono::duration<double>(nSent_ / options.feedEventsPerSecond))};
+        timer_.expires_at(next);
+        timer_.async_wait([self = shared_from_this()](auto ec) {
+            if(!ec)
+            {
+                self->Feed();
+            }
+        });
+    }
+
+    void SendPassengerEvent()
+    {
+        const auto& stations{server_.options_.feedStationIds};
+        std::uniform_int_distribution<std::size_t> station{0, stations.size() - 1};
+        std::bernoulli_distribution in{0.5};
+        const nlohmann::json event{
+            {"datetime", GetFeedTimestamp()},
+            {"passenger_event", in(rng_) ? "in" : "out"},
+            {"station_id", stations[station(rng_)]},
+        };
+        Send(MakeStompFrame("MESSAGE",
+                            {
+                                {"subscription", subscriptionId_},
+                                {"message-id", std::to_string(nSent_)},
+                                {"destination", "/passengers"},
+                                {"content-type", "application/json"},
+                            },
+                            event.dump()));
+        ++nSent_;
+        ++server_.stats_.nFeedEvents;
+    }
+
+    void Send(std::string frame)
+    {
+        outbox_.push_back(std::move(frame));
+        if(outbox_.size() == 1)
+        {
+            Write();
+        }
+    }
+
+    void Write()
+    {
+        ws_.async_write(boost::asio::buffer(outbox_.front()), [self = shared_from_this()](auto ec, auto) {
+            self->OnWrite(ec);
+        });
+    }
+
+    void OnWrite(const boost::system::error_code& ec)
+    {
+        if(ec)
+        {
+            feeding_ = false;
+            timer_.cancel();
+            return;
+        }
+        outbox_.pop_front();
+        if(!outbox_.empty())
+        {
+            Write();
+            return;
+        }
+        if(closeAfterWrite_)
+        {
+            feeding_ = false;
+            timer_.cancel();
+            ws_.async_close(websocket::close_code::policy_error, [self = shared_from_this()](auto) {});
+            return;
+        }
+        Feed();
+    }
+};
+
+// LocalServer::Session
+
+// A TLS connection. It serves HTTP requests until it is upgraded to a
+// WebSocket connection.
+class LocalServer::Session : public std::enable_shared_from_this<Session>
+{
+public:
+    Session(LocalServer& server, tcp::socket&& socket)
+        : server_{server}
+        , stream_{std::move(socket), server.ctx_}
+    {
+    }
+
+    void Start()
+    {
+        stream_.async_handshake(boost::asio::ssl::stream_base::server,
+                                [self = shared_from_this()](auto ec) { self->OnHandshake(ec); });
+    }
+
+    void Close()
+    {
+        if(!upgraded_)
+        {
+            boost::beast::get_lowest_layer(stream_).close();
+        }
+    }
+
+private:
+    LocalServer& server_;
+    SslStream stream_;
+    boost::beast::flat_buffer buffer_{};
+    http::request<http::string_body> request_{};
+    http::response<http::string_body> response_{};
+    bool upgraded_{false};
+
+    void OnHandshake(const boost::system::error_code& ec)
+    {
+        if(ec)
+        {
+            return;
+        }
+        ++(SSL_session_reused(stream_.native_handle()) == 1 ? server_.stats_.nResumedTlsHandshakes
+                                                           : server_.stats_.nFullTlsHandshakes);
+        Read();
+    }
+
+    void Read()
+    {
+        request_ = {};
+        http::async_read(stream_, buffer_, request_, [self = shared_from_this()](auto ec, auto) {
+            self->OnRead(ec);
+        });
+    }
+
+    void OnRead(const boost::system::error_code& ec)
+    {
+        if(ec)
+        {
+            return;
+        }
+        if(websocket::is_upgrade(request_))
+        {
+            upgraded_ = true;
+            auto session{std::make_shared<WebSocketSession>(server_, std::move(stream_))};
+            server_.webSocketSessions_.push_back(session);
+            session->Start(std::move(request_));
+            return;
+        }
+
+        ++server_.stats_.nFileRequests;
+        response_ = HandleFileRequest(request_, server_.options_.documentRoot);
+        http::async_write(stream_, response_, [self = shared_from_this()](auto ec, auto) {
+            if(!ec && self->response_.keep_alive())
+            {
+                self->Read();
+            }
+        });
+    }
+};
+
+// LocalServer
+
+LocalServer::LocalServer(boost::asio::io_context& ioc, const LocalServerOptions& options)
+    : options_{options}
+    , ctx_{boost::asio::ssl::context::tls_server}
+    , acceptor_{ioc, {boost::asio::ip::make_address(options.address), options.port}}
+{
+    ctx_.use_certificate_chain_file(options_.certificateChainFile.string());
+    ctx_.use_private_key_file(options_.privateKeyFile.string(), boost::asio::ssl::context::pem);
+    port_ = acceptor_.local_endpoint().port();
+    Accept();
+}
+
+LocalServer::~LocalServer() = default;
+
+unsigned short LocalServer::GetPort() const
+{
+    return port_;
+}
+
+void LocalServer::Stop()
+{
+    boost::asio::dispatch(acceptor_.get_executor(), [this]() {
+        stopped_ = true;
+        boost::system::error_code ignored{};
+        acceptor_.close(ignored);
+        for(auto& weak : sessions_)
+        {
+            if(auto session{weak.lock()}; session != nullptr)
+            {
+                session->Close();
+            }
+        }
+        for(auto& weak : webSocketSessions_)
+        {
+            if(auto session{weak.lock()}; session != nullptr)
+            {
+                session->Close();
+            }
+        }
+    });
+}
+
+const LocalServer::Stats& LocalServer::GetStats() const
+{
+    return stats_;
+}
+
+void LocalServer::Accept()
+{
+    acceptor_.async_accept([this](auto ec, auto socket) {
+        if(ec || stopped_)
+        {
+            return;
+        }
+        ++stats_.nConnections;
+
+        // Forget the sessions that are gone.
+        sessions_.remove_if([](const auto& weak) { return weak.expired(); });
+        webSocketSessions_.remove_if([](const auto& weak) { return weak.expired(); });
+
+        auto session{std::make_shared<Session>(*this, std::move(socket))};
+        sessions_.push_back(session);
+        session->Start();
+        Accept();
+    });
+}
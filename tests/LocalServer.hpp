@@ -0,0 +1,118 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NetworkMonitor {
+
+/*! \brief Configuration of the LocalServer.
+ */
+struct LocalServerOptions
+{
+    std::string address{"127.0.0.1"};
+
+    //! 0 picks a free port: Use LocalServer::GetPort to find it.
+    unsigned short port{0};
+
+    std::filesystem::path certificateChainFile{TESTS_LOCALHOST_CERT_PEM};
+    std::filesystem::path privateKeyFile{TESTS_LOCALHOST_KEY_PEM};
+
+    //! Files served over HTTPS. Empty to serve nothing.
+    std::filesystem::path documentRoot{};
+
+    //! Credentials expected in the STOMP frame of the feed.
+    std::string stompUsername{"username"};
+    std::string stompPassword{"password"};
+
+    //! Passenger events sent by the feed, per second.
+    double feedEventsPerSecond{100.0};
+
+    //! Number of passenger events sent to each subscriber. 0 for no limit.
+    std::size_t feedEvents{0};
+
+    //! Stations the feed picks its passenger events from.
+    std::vector<std::string> feedStationIds{"station_000"};
+};
+
+/*! \brief Local stand-in for the servers the network monitor talks to.
+ *
+ *  Serves, over TLS on a loopback address:
+ *  - `/echo`: A WebSocket echo endpoint.
+ *  - `/network-events`: A WebSocket STOMP endpoint that mimics the passenger
+ *    event feed. Clients send a STOMP frame with the configured credentials
+ *    and SUBSCRIBE to `/passengers`; the server then sends MESSAGE frames at
+ *    the configured rate. Bad credentials get an ERROR frame.
+ *  - Any other path: HTTPS GET or HEAD of the files in the document root,
+ *    with ETag (If-None-Match, If-Range) and single byte range support.
+ *
+ *  The test certificate for localhost is signed by the test CA in
+ *  tests/local-ca.pem.
+ *
+ *  All handlers run on the io_context passed to the constructor, which must be
+ *  run by a single thread.
+ */
+class LocalServer
+{
+public:
+    /*! \brief Counters, safe to read from any thread.
+     */
+    struct Stats
+    {
+        std::atomic<std::size_t> nConnections{0};
+        std::atomic<std::size_t> nFullTlsHandshakes{0};
+        std::atomic<std::size_t> nResumedTlsHandshakes{0};
+        std::atomic<std::size_t> nEchoedMessages{0};
+        std::atomic<std::size_t> nFeedEvents{0};
+        std::atomic<std::size_t> nFileRequests{0};
+    };
+
+    /*! \brief Start listening.
+     *
+     *  \throws boost::system::system_error if the certificate cannot be loaded
+     *          or the address cannot be bound.
+     */
+    LocalServer(boost::asio::io_context& ioc, const LocalServerOptions& options = {});
+
+    LocalServer(const LocalServer& other) = delete;
+    LocalServer& operator=(const LocalServer& other) = delete;
+
+    ~LocalServer();
+
+    /*! \brief Port the server listens on.
+     */
+    unsigned short GetPort() const;
+
+    /*! \brief Stop accepting connections and close the open ones, so that
+     *         io_context::run can return. Can be called from any thread.
+     */
+    void Stop();
+
+    const Stats& GetStats() const;
+
+private:
+    class Session;
+    class WebSocketSession;
+
+    LocalServerOptions options_{};
+    boost::asio::ssl::context ctx_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    unsigned short port_{0};
+    Stats stats_{};
+
+    // Sessions are owned by their pending operations. We keep an eye on them
+    // to close them on Stop().
+    std::list<std::weak_ptr<Session> > sessions_{};
+    std::list<std::weak_ptr<WebSocketSession> > webSocketSessions_{};
+    bool stopped_{false};
+
+    void Accept();
+};
+
+} // namespace NetworkMonitor
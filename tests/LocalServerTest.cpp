@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/ssl.hpp>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+
+#include "LocalServer.hpp"
+
+using NetworkMonitor::LocalServer;
+using NetworkMonitor::LocalServerOptions;
+
+namespace http = boost::beast::http;
+
+namespace {
+
+// Synchronous HTTPS client, good enough to check the server responses.
+class HttpsClient
+{
+public:
+    explicit HttpsClient(unsigned short port)
+        : ctx_{boost::asio::ssl::context::tls_client}
+        , stream_{ioc_, ctx_}
+    {
+        ctx_.load_verify_file(TESTS_LOCAL_CA_PEM);
+        ctx_.set_verify_mode(boost::asio::ssl::verify_peer);
+        SSL_set_tlsext_host_name(stream_.native_handle(), "localhost");
+        boost::beast::get_lowest_layer(stream_).connect(
+            {boost::asio::ip::make_address("127.0.0.1"), port});
+        stream_.handshake(boost::asio::ssl::stream_base::client);
+    }
+
+    http::response<http::string_body> Get(const std::string& target,
+                                          const std::vector<std::pair<http::field, std::string> >& headers = {},
+                                          http::verb method = http::verb::get)
+    {
+        http::request<http::string_body> request{method, target, 11};
+        request.set(http::field::host, "localhost");
+        for(const auto& [field, value] : headers)
+        {
+            request.set(field, value);
+        }
+        http::write(stream_, request);
+
+        http::response_parser<http::string_body> parser{};
+        parser.skip(method == http::verb::head);
+        http::read(stream_, buffer_, parser);
+        return parser.release();
+    }
+
+private:
+    boost::asio::io_context ioc_{};
+    boost::asio::ssl::context ctx_;
+    boost::beast::ssl_stream<boost::beast::tcp_stream> stream_;
+    boost::beast::flat_buffer buffer_{};
+};
+
+std::string ReadFile(const std::string& path)
+{
+    std::ifstream file{path, std::ios::binary};
+    return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+// Run a local server from a background thread.
+class LocalServerTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        LocalServerOptions options{};
+        options.documentRoot = TESTS_WWW_DIR;
+        server_ = std::make_unique<LocalServer>(ioc_, options);
+        thread_ = std::thread{[this]() { ioc_.run(); }};
+    }
+
+    void TearDown() override
+    {
+        server_->Stop();
+        thread_.join();
+    }
+
+    boost::asio::io_context ioc_{};
+    std::unique_ptr<LocalServer> server_{nullptr};
+    std::thread thread_{};
+};
+
+} // namespace
+
+TEST_F(LocalServerTest, Get_file)
+{
+    const auto expected{ReadFile(std::string{TESTS_WWW_DIR} + "/network-layout.json")};
+    HttpsClient client{server_->GetPort()};
+    auto response{client.Get("/network-layout.json")};
+    EXPECT_EQ(response.result(), http::status::ok);
+    EXPECT_EQ(response.body(), expected);
+    EXPECT_EQ(response[http::field::content_type], "application/json");
+    EXPECT_EQ(response[http::field::accept_ranges], "bytes");
+    EXPECT_FALSE(response[http::field::etag].empty());
+
+    // HEAD has the same headers, and no body. The connection is kept alive.
+    auto head{client.Get("/network-layout.json", {}, http::verb::head)};
+    EXPECT_EQ(head.result(), http::status::ok);
+    EXPECT_EQ(head[http::field::etag], response[http::field::etag]);
+    EXPECT_EQ(head[http::field::content_length], std::to_string(expected.size()));
+    EXPECT_TRUE(head.body().empty());
+
+    EXPECT_EQ(client.Get("/missing.json").result(), http::status::not_found);
+    EXPECT_EQ(client.Get("/../LocalServer.cpp").result(), http::status::not_found);
+    EXPECT_EQ(client.Get("/network-layout.json", {}, http::verb::post).result(), http::status::method_not_allowed);
+    EXPECT_EQ(server_->GetStats().nFileRequests, 5);
+    EXPECT_EQ(server_->GetStats().nConnections, 1);
+}
+
+TEST_F(LocalServerTest, Get_etag)
+{
+    HttpsClient client{server_->GetPort()};
+    const auto etag{std::string{client.Get("/network-layout.json")[http::field::etag]}};
+
+    auto cached{client.Get("/network-layout.json", {{http::field::if_none_match, etag}})};
+    EXPECT_EQ(cached.result(), http::status::not_modified);
+    EXPECT_TRUE(cached.body().empty());
+
+    auto changed{client.Get("/network-layout.json", {{http::field::if_none_match, "\"0-0\""}})};
+    EXPECT_EQ(changed.result(), http::status::ok);
+}
+
+TEST_F(LocalServerTest, Get_range)
+{
+    const auto expected{ReadFile(std::string{TESTS_WWW_DIR} + "/network-layout.json")};
+    const auto size{std::to_string(expected.size())};
+    HttpsClient client{server_->GetPort()};
+
+    auto range{client.Get("/network-layout.json", {{http::field::range, "bytes=10-19"}})};
+    EXPECT_EQ(range.result(), http::status::partial_content);
+    EXPECT_EQ(range.body(), expected.substr(10, 10));
+    EXPECT_EQ(range[http::field::content_range], "bytes 10-19/" + size);
+
+    auto open{client.Get("/network-layout.json", {{http::field::range, "bytes=100-"}})};
+    EXPECT_EQ(open.result(), http::status::partial_content);
+    EXPECT_EQ(open.body(), expected.substr(100));
+
+    auto suffix{client.Get("/network-layout.json", {{http::field::range, "bytes=-5"}})};
+    EXPECT_EQ(suffix.result(), http::status::partial_content);
+    EXPECT_EQ(suffix.body(), expected.substr(expected.size() - 5));
+
+    auto unsatisfiable{client.Get("/network-layout.json", {{http::field::range, "bytes=" + size + "-"}})};
+    EXPECT_EQ(unsatisfiable.result(), http::status::range_not_satisfiable);
+    EXPECT_EQ(unsatisfiable[http::field::content_range], "bytes */" + size);
+
+    // Resuming a download of an older version gets the whole file.
+    auto stale{client.Get("/network-layout.json",
+                          {{http::field::range, "bytes=10-19"}, {http::field::if_range, "\"0-0\""}})};
+    EXPECT_EQ(stale.result(), http::status::ok);
+    EXPECT_EQ(stale.body(), expected);
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+
+#include <Log.hpp>
+#include <atomic>
+#include <boost/system/error_code.hpp>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::Logger;
+using NetworkMonitor::LogLevel;
+
+namespace {
+
+// Thread-safe line collector.
+struct Lines
+{
+    std::mutex mutex{};
+    std::vector<std::string> lines{};
+
+    Logger::Sink MakeSink()
+    {
+        return [this](std::string_view line) {
+            std::lock_guard<std::mutex> lock{mutex};
+            lines.emplace_back(line);
+        };
+    }
+};
+
+} // namespace
+
+TEST(LogTest, Write_basic)
+{
+    Lines lines{};
+    Logger logger{16, Logger::OverflowPolicy::Block, lines.MakeSink()};
+
+    logger.Write(LogLevel::Error,
+                 "OnConnect",
+                 boost::system::errc::make_error_code(boost::system::errc::connection_refused));
+    logger.Write(LogLevel::Info, "OnHandshake", boost::system::error_code{});
+    logger.Write(LogLevel::Warning, "Reload", "Layout changed");
+    logger.Flush();
+
+    ASSERT_EQ(lines.lines.size(), 3);
+    EXPECT_NE(lines.lines[0].find("ERROR"), std::string::npos);
+    EXPECT_NE(lines.lines[0].find("OnConnect] Error: Connection refused"), std::string::npos);
+    EXPECT_NE(lines.lines[1].find("INFO"), std::string::npos);
+    EXPECT_NE(lines.lines[1].find("OnHandshake] OK"), std::string::npos);
+    EXPECT_NE(lines.lines[2].find("WARNING"), std::string::npos);
+    EXPECT_NE(lines.lines[2].find("Reload] Layout changed"), std::string::npos);
+}
+
+TEST(LogTest, Write_truncates_long_messages)
+{
+    Lines lines{};
+    Logger logger{16, Logger::OverflowPolicy::Block, lines.MakeSink()};
+
+    const std::string message(Logger::kMaxMessageSize + 10, 'x');
+    logger.Write(LogLevel::Info, "Test", message);
+    logger.Flush();
+
+    ASSERT_EQ(lines.lines.size(), 1);
+    EXPECT_NE(lines.lines[0].find(std::string(Logger::kMaxMessageSize, 'x')), std::string::npos);
+    EXPECT_EQ(lines.lines[0].find(std::string(Logger::kMaxMessageSize + 1, 'x')), std::string::npos);
+}
+
+TEST(LogTest, SetLevel)
+{
+    Logger logger{16, Logger::OverflowPolicy::Block, [](std::string_view) {}};
+
+    EXPECT_FALSE(logger.IsEnabled(LogLevel::Debug));
+    EXPECT_TRUE(logger.IsEnabled(LogLevel::Info));
+    EXPECT_TRUE(logger.IsEnabled(LogLevel::Error));
+    logger.SetLevel(LogLevel::Error);
+    EXPECT_FALSE(logger.IsEnabled(LogLevel::Warning));
+    EXPECT_TRUE(logger.IsEnabled(LogLevel::Error));
+    logger.SetLevel(LogLevel::Off);
+    EXPECT_FALSE(logger.IsEnabled(LogLevel::Error));
+    EXPECT_FALSE(logger.IsEnabled(LogLevel::Off));
+}
+
+TEST(LogTest, OverflowPolicy_drop)
+{
+    // The sink blocks until we release it, so the buffer fills up.
+    std::promise<void> release{};
+    auto released{release.get_future().share()};
+    std::atomic<size_t> received{0};
+    Logger logger{4, Logger::OverflowPolicy::Drop, [&received, released](std::string_view) {
+                      released.wait();
+                      ++received;
+                  }};
+
+    const size_t nRecords{100};
+    for(size_t idx{0}; idx < nRecords; ++idx)
+    {
+        logger.Write(LogLevel::Info, "Test", "Message");
+    }
+    EXPECT_GT(logger.GetDroppedCount(), 0);
+
+    release.set_value();
+    logger.Flush();
+    EXPECT_EQ(received + logger.GetDroppedCount(), nRecords);
+}
+
+TEST(LogTest, OverflowPolicy_block)
+{
+    Lines lines{};
+    Logger logger{4, Logger::OverflowPolicy::Block, lines.MakeSink()};
+
+    // Several producers on a tiny buffer: Nothing gets lost.
+    const size_t nThreads{4};
+    const size_t nRecords{1000};
+    std::vector<std::thread> producers{};
+    for(size_t thread{0}; thread < nThreads; ++thread)
+    {
+        producers.emplace_back([&logger, nRecords]() {
+            for(size_t idx{0}; idx < nRecords; ++idx)
+            {
+                logger.Write(LogLevel::Info, "Test", "Message");
+            }
+        });
+    }
+    for(auto& producer : producers)
+    {
+        producer.join();
+    }
+    logger.Flush();
+
+    EXPECT_EQ(logger.GetDroppedCount(), 0);
+    EXPECT_EQ(lines.lines.size(), nThreads * nRecords);
+}
+
+TEST(LogTest, Log_default_logger)
+{
+    Lines lines{};
+    auto& logger{Logger::Default()};
+    logger.SetSink(lines.MakeSink());
+
+    // Successes are logged at the Debug level, which is off by default.
+    NetworkMonitor::Log("Test", boost::system::error_code{});
+    NetworkMonitor::Log("Test", boost::system::errc::make_error_code(boost::system::errc::timed_out));
+    NetworkMonitor::Log<LogLevel::Info>("Test", "Message");
+    logger.Flush();
+    logger.SetSink(nullptr);
+
+    ASSERT_EQ(lines.lines.size(), 2);
+    EXPECT_NE(lines.lines[0].find("Error: "), std::string::npos);
+    EXPECT_NE(lines.lines[1].find("Test] Message"), std::string::npos);
+}
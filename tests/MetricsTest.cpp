@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+
+#include <Metrics.hpp>
+#include <TransportNetwork.hpp>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::Counter;
+using NetworkMonitor::Histogram;
+using NetworkMonitor::MetricsRegistry;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::ScopedTimer;
+using NetworkMonitor::TransportNetwork;
+
+TEST(MetricsTest, Counter_concurrent)
+{
+    Counter counter{};
+    const size_t nThreads{4};
+    const size_t nIncrements{100000};
+    std::vector<std::thread> threads{};
+    for(size_t thread{0}; thread < nThreads; ++thread)
+    {
+        threads.emplace_back([&counter, nIncrements]() {
+            for(size_t idx{0}; idx < nIncrements; ++idx)
+            {
+                counter.Increment();
+            }
+        });
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+    counter.Increment(5);
+    EXPECT_EQ(counter.Get(), nThreads * nIncrements + 5);
+}
+
+TEST(MetricsTest, Histogram_percentiles)
+{
+    Histogram histogram{};
+    EXPECT_EQ(histogram.GetPercentile(0.5), 0);
+    for(std::uint64_t value{1}; value <= 1000; ++value)
+    {
+        histogram.Record(value);
+    }
+    EXPECT_EQ(histogram.GetCount(), 1000);
+    EXPECT_EQ(histogram.GetSum(), 500500);
+
+    // Small values are exact, large values are within 1 / kSubBuckets.
+    EXPECT_EQ(histogram.GetPercentile(0.0), 1);
+    EXPECT_EQ(histogram.GetPercentile(0.005), 5);
+    for(double q : {0.5, 0.9, 0.99, 1.0})
+    {
+        const auto expected{q * 1000};
+        const auto actual{static_cast<double>(histogram.GetPercentile(q))};
+        EXPECT_GE(actual, expected);
+        EXPECT_LE(actual, expected * (1.0 + 1.0 / Histogram::kSubBuckets));
+    }
+}
+
+TEST(MetricsTest, Histogram_extremes)
+{
+    Histogram histogram{};
+    histogram.Record(0);
+    histogram.Record(std::numeric_limits<std::uint64_t>::max());
+    EXPECT_EQ(histogram.GetCount(), 2);
+    EXPECT_EQ(histogram.GetPercentile(0.5), 0);
+    EXPECT_EQ(histogram.GetPercentile(1.0), std::numeric_limits<std::uint64_t>::max() - 1);
+
+    auto cumulative{histogram.GetCumulativeCounts()};
+    ASSERT_EQ(cumulative.size(), 65);
+    EXPECT_EQ(cumulative[0], 1);
+    EXPECT_EQ(cumulative[1], 1);
+    EXPECT_EQ(cumulative[63], 1);
+    EXPECT_EQ(cumulative[64], 2);
+}
+
+TEST(MetricsTest, Histogram_cumulative_counts)
+{
+    Histogram histogram{};
+    EXPECT_TRUE(histogram.GetCumulativeCounts().empty());
+    for(std::uint64_t value : {1, 7, 8, 1023, 1024})
+    {
+        histogram.Record(value);
+    }
+    auto cumulative{histogram.GetCumulativeCounts()};
+    ASSERT_EQ(cumulative.size(), 12);
+    EXPECT_EQ(cumulative[1], 1);   // < 2
+    EXPECT_EQ(cumulative[3], 2);   // < 8
+    EXPECT_EQ(cumulative[4], 3);   // < 16
+    EXPECT_EQ(cumulative[10], 4);  // < 1024
+    EXPECT_EQ(cumulative[11], 5);  // < 2048
+}
+
+TEST(MetricsTest, Export_prometheus)
+{
+    MetricsRegistry registry{};
+    registry.GetCounter("test_events_total", "Events.", "result=\"ok\"").Increment(3);
+    registry.GetCounter("test_events_total", "Events.", "result=\"failed\"").Increment();
+    registry.GetGauge("test_queue_size", "Queue\nsize.").Set(-2);
+    auto& histogram{registry.GetHistogram("test_size_bytes", "Sizes.")};
+    histogram.Record(3);
+    histogram.Record(100);
+
+    // Metrics are looked up by name and labels.
+    EXPECT_EQ(&registry.GetCounter("test_events_total", "", "result=\"ok\""),
+              &registry.GetCounter("test_events_total", "", "result=\"ok\""));
+    EXPECT_THROW(registry.GetGauge("test_events_total", ""), std::logic_error);
+
+    const auto text{registry.Export()};
+    const std::string expected{
+        "# HELP test_events_total Events.\n"
+        "# TYPE test_events_total counter\n"
+        "test_events_total{result=\"failed\"} 1\n"
+        "test_events_total{result=\"ok\"} 3\n"
+        "# HELP test_queue_size Queue\\nsize.\n"
+        "# TYPE test_queue_size gauge\n"
+        "test_queue_size -2\n"
+        "# HELP test_size_bytes Sizes.\n"
+        "# TYPE test_size_bytes histogram\n"
+        "test_size_bytes_bucket{le=\"1\"} 0\n"
+        "test_size_bytes_bucket{le=\"3\"} 1\n"
+        "test_size_bytes_bucket{le=\"7\"} 1\n"
+        "test_size_bytes_bucket{le=\"15\"} 1\n"
+        "test_size_bytes_bucket{le=\"31\"} 1\n"
+        "test_size_bytes_bucket{le=\"63\"} 1\n"
+        "test_size_bytes_bucket{le=\"127\"} 2\n"
+        "test_size_bytes_bucket{le=\"+Inf\"} 2\n"
+        "test_size_bytes_sum 103\n"
+        "test_size_bytes_count 2\n"};
+    EXPECT_EQ(text, expected);
+
+    std::string received{};
+    registry.Export([&received](std::string_view text) { received = text; });
+    EXPECT_EQ(received, expected);
+}
+
+TEST(MetricsTest, Export_histogram_unit)
+{
+    MetricsRegistry registry{};
+    auto& histogram{registry.GetHistogram("test_seconds", "Durations.", 1e-9)};
+    histogram.Record(std::chrono::microseconds{1});
+    const auto text{registry.Export()};
+    EXPECT_NE(text.find("test_seconds_bucket{le=\"1.023e-06\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("test_seconds_sum 1e-06\n"), std::string::npos);
+}
+
+TEST(MetricsTest, Export_file)
+{
+    MetricsRegistry registry{};
+    registry.GetCounter("test_total", "Total.").Increment(42);
+    const auto path{std::filesystem::temp_directory_path() / "network_monitor_metrics_test.prom"};
+    ASSERT_TRUE(registry.Export(path));
+
+    std::ifstream file{path};
+    std::stringstream content{};
+    content << file.rdbuf();
+    EXPECT_EQ(content.str(), registry.Export());
+    std::filesystem::remove(path);
+
+    EXPECT_FALSE(registry.Export(std::filesystem::path{"/this/path/does/not/exist.prom"}));
+}
+
+TEST(MetricsTest, Instrumentation_passenger_events)
+{
+    auto& registry{MetricsRegistry::Default()};
+    auto& recorded{registry.GetCounter("network_monitor_passenger_events_total", "", "result=\"recorded\"")};
+    auto& failed{registry.GetCounter("network_monitor_passenger_events_total", "", "result=\"failed\"")};
+
+    TransportNetwork nw{};
+    ASSERT_TRUE(nw.AddStation({"station_0", "Station Name"}));
+    const auto recordedBefore{recorded.Get()};
+    const auto failedBefore{failed.Get()};
+    EXPECT_TRUE(nw.RecordPassengerEvent({"station_0", PassengerEvent::Type::In}));
+    EXPECT_FALSE(nw.RecordPassengerEvent({"station_1", PassengerEvent::Type::In}));
+    EXPECT_EQ(recorded.Get(), recordedBefore + 1);
+    EXPECT_EQ(failed.Get(), failedBefore + 1);
+
+    // Disabled instrumentation does not count.
+    registry.SetEnabled(false);
+    EXPECT_TRUE(nw.RecordPassengerEvent({"station_0", PassengerEvent::Type::In}));
+    registry.SetEnabled(true);
+    EXPECT_EQ(recorded.Get(), recordedBefore + 1);
+}
+
+TEST(MetricsTest, ScopedTimer_basic)
+{
+    Histogram histogram{1e-9};
+    {
+        ScopedTimer timer{histogram};
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    ASSERT_EQ(histogram.GetCount(), 1);
+    EXPECT_GE(histogram.GetSum(), 2000000);
+}
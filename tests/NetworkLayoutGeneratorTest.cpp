@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+
+#include <FileDownloader.hpp>
+#include <NetworkLayoutGenerator.hpp>
+#include <TransportNetwork.hpp>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::Id;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::ParseJsonFile;
+using NetworkMonitor::ToJson;
+using NetworkMonitor::TransportNetwork;
+
+namespace {
+
+// Get the key names of a JSON object and of the first element of each of its
+// array fields, recursively.
+std::set<std::string> GetSchema(const nlohmann::json& json, const std::string& prefix = "")
+{
+    std::set<std::string> schema{};
+    for(const auto& [key, value] : json.items())
+    {
+        schema.insert(prefix + key);
+        const auto& element{value.is_array() && !value.empty() ? value.front() : value};
+        if(element.is_object())
+        {
+            schema.merge(GetSchema(element, prefix + key + "."));
+        }
+    }
+    return schema;
+}
+
+} // namespace
+
+TEST(NetworkLayoutGeneratorTest, GenerateNetworkLayout_well_formed)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 500;
+    options.nLines = 10;
+    options.routesPerLine = 4;
+    options.routeLength = 30;
+    options.interchangeDensity = 0.2;
+    options.minTravelTime = 2;
+    options.maxTravelTime = 7;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    ASSERT_EQ(layout.stations.size(), options.nStations);
+    ASSERT_EQ(layout.lines.size(), options.nLines);
+    EXPECT_EQ(layout.stations.front().id, "station_000");
+    EXPECT_EQ(layout.lines.front().id, "line_000");
+    EXPECT_EQ(layout.lines.front().routes.front().id, "route_000");
+
+    std::unordered_map<std::string, unsigned int> travelTimes{};
+    for(const auto& travelTime : layout.travelTimes)
+    {
+        EXPECT_GE(travelTime.travelTime, options.minTravelTime);
+        EXPECT_LE(travelTime.travelTime, options.maxTravelTime);
+        travelTimes[travelTime.startStationId + "-" + travelTime.endStationId] = travelTime.travelTime;
+        travelTimes[travelTime.endStationId + "-" + travelTime.startStationId] = travelTime.travelTime;
+    }
+
+    // The layout loads as-is, and has a travel time for every pair of
+    // adjacent stops.
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+    for(const auto& line : layout.lines)
+    {
+        ASSERT_EQ(line.routes.size(), options.routesPerLine);
+        EXPECT_EQ(line.routes[0].stops.size(), options.routeLength);
+        EXPECT_EQ(line.routes[1].stops.size(), options.routeLength);
+        for(const auto& route : line.routes)
+        {
+            EXPECT_EQ(route.lineId, line.id);
+            EXPECT_EQ(route.startStationId, route.stops.front());
+            EXPECT_EQ(route.endStationId, route.stops.back());
+            EXPECT_GE(route.stops.size(), 2);
+            EXPECT_EQ(std::set<Id>(route.stops.begin(), route.stops.end()).size(), route.stops.size());
+            for(size_t idx{1}; idx < route.stops.size(); ++idx)
+            {
+                EXPECT_EQ(travelTimes.count(route.stops[idx - 1] + "-" + route.stops[idx]), 1);
+            }
+        }
+        ASSERT_TRUE(nw.AddLine(line));
+    }
+}
+
+TEST(NetworkLayoutGeneratorTest, GenerateNetworkLayout_seed)
+{
+    NetworkLayoutOptions options{};
+    options.routesPerLine = 3;
+    const auto json = ToJson(GenerateNetworkLayout(options));
+    EXPECT_TRUE(ToJson(GenerateNetworkLayout(options)) == json);
+
+    options.seed = 43;
+    EXPECT_FALSE(ToJson(GenerateNetworkLayout(options)) == json);
+}
+
+TEST(NetworkLayoutGeneratorTest, GenerateNetworkLayout_interchanges)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 1000;
+    options.nLines = 20;
+    options.routeLength = 40;
+
+    // Without interchanges, no station is served by 2 lines.
+    options.interchangeDensity = 0.0;
+    auto layout{GenerateNetworkLayout(options)};
+    std::unordered_set<Id> served{};
+    for(const auto& line : layout.lines)
+    {
+        for(const auto& stop : line.routes.front().stops)
+        {
+            EXPECT_TRUE(served.insert(stop).second);
+        }
+    }
+
+    // With interchanges, about that share of the stops are shared.
+    options.interchangeDensity = 0.25;
+    layout = GenerateNetworkLayout(options);
+    served.clear();
+    size_t nShared{0};
+    for(const auto& line : layout.lines)
+    {
+        for(const auto& stop : line.routes.front().stops)
+        {
+            nShared += served.insert(stop).second ? 0 : 1;
+        }
+    }
+    const auto nStops{options.nLines * options.routeLength};
+    EXPECT_GT(nShared, nStops * 0.15);
+    EXPECT_LT(nShared, nStops * 0.35);
+}
+
+TEST(NetworkLayoutGeneratorTest, GenerateNetworkLayout_all_stations_in_use)
+{
+    // More stops than stations: Lines must share stations, but still visit
+    // each station at most once.
+    NetworkLayoutOptions options{};
+    options.nStations = 10;
+    options.nLines = 5;
+    options.routeLength = 10;
+    options.interchangeDensity = 0.0;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+    for(const auto& line : layout.lines)
+    {
+        EXPECT_TRUE(nw.AddLine(line));
+    }
+}
+
+TEST(NetworkLayoutGeneratorTest, GenerateNetworkLayout_invalid_options)
+{
+    NetworkLayoutOptions options{};
+    options.routeLength = 1;
+    EXPECT_THROW(GenerateNetworkLayout(options), std::invalid_argument);
+
+    options = {};
+    options.nStations = 10;
+    options.routeLength = 11;
+    EXPECT_THROW(GenerateNetworkLayout(options), std::invalid_argument);
+
+    options = {};
+    options.interchangeDensity = 1.5;
+    EXPECT_THROW(GenerateNetworkLayout(options), std::invalid_argument);
+
+    options = {};
+    options.minTravelTime = 6;
+    options.maxTravelTime = 5;
+    EXPECT_THROW(GenerateNetworkLayout(options), std::invalid_argument);
+}
+
+TEST(NetworkLayoutGeneratorTest, ToJson_schema)
+{
+    const auto expected = ParseJsonFile(std::string{TESTS_WWW_DIR} + "/network-layout.json");
+    const auto json = ToJson(GenerateNetworkLayout());
+    EXPECT_EQ(GetSchema(json), GetSchema(expected));
+    EXPECT_EQ(json["stations"].size(), 1000);
+    EXPECT_EQ(json["lines"].size(), 20);
+}
+
+TEST(NetworkLayoutGeneratorTest, GenerateNetworkLayout_large)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 1000000;
+    options.nLines = 20000;
+    options.routeLength = 50;
+    const auto layout{GenerateNetworkLayout(options)};
+    EXPECT_EQ(layout.stations.size(), options.nStations);
+    EXPECT_EQ(layout.stations.back().id, "station_999999");
+    EXPECT_EQ(layout.lines.size(), options.nLines);
+}
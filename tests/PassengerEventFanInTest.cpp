@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+
+#include <PassengerEventFanIn.hpp>
+#include <TransportNetwork.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::FanInMode;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventFanIn;
+using NetworkMonitor::PassengerEventFanInOptions;
+using NetworkMonitor::TransportNetwork;
+
+using EventType = NetworkMonitor::PassengerEvent::Type;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+namespace {
+
+const std::chrono::system_clock::time_point t0{seconds{1700000000}};
+
+// Run one local generator thread per feed. Feed `feed` sends events
+// `feed`, `feed + nFeeds`, `feed + 2 * nFeeds`, and so on, 1 ms apart, so that
+// the feeds interleave.
+void RunFeeds(PassengerEventFanIn& fanIn, std::size_t nEvents, std::size_t nStations)
+{
+    const auto nFeeds{fanIn.GetFeedCount()};
+    std::vector<std::thread> generators{};
+    for(std::size_t feed{0}; feed < nFeeds; ++feed)
+    {
+        generators.emplace_back([&fanIn, feed, nFeeds, nEvents, nStations]() {
+            std::mt19937 rng{static_cast<unsigned int>(feed)};
+            std::uniform_int_distribution<std::size_t> pickStation{0, nStations - 1};
+            for(std::size_t idx{feed}; idx < nEvents; idx += nFeeds)
+            {
+                const auto station{pickStation(rng)};
+                const PassengerEvent event{"station_" + std::to_string(station),
+                                           (idx + station) % 3 == 0 ? EventType::Out : EventType::In,
+                                           t0 + milliseconds{idx}};
+                EXPECT_TRUE(fanIn.Push(feed, event));
+            }
+        });
+    }
+    for(auto& generator : generators)
+    {
+        generator.join();
+    }
+}
+
+} // namespace
+
+TEST(PassengerEventFanInTest, merged_order)
+{
+    constexpr std::size_t kEvents{100000};
+    std::vector<std::chrono::system_clock::time_point> timestamps{};
+    PassengerEventFanInOptions options{};
+    options.queueCapacity = 256;
+
+    // Long enough that a slow generator never gets left out.
+    options.idleTimeout = seconds{10};
+    PassengerEventFanIn fanIn{[&timestamps](const PassengerEvent& event) { timestamps.push_back(event.timestamp); },
+                              4, options};
+    RunFeeds(fanIn, kEvents, 10);
+    fanIn.Flush();
+
+    ASSERT_EQ(timestamps.size(), kEvents);
+    EXPECT_TRUE(std::is_sorted(timestamps.begin(), timestamps.end()));
+    const auto stats{fanIn.GetStats()};
+    EXPECT_EQ(stats.applied, kEvents);
+    EXPECT_EQ(stats.late, 0);
+    ASSERT_EQ(stats.feeds.size(), 4);
+    for(const auto& feed : stats.feeds)
+    {
+        EXPECT_EQ(feed.pushed, kEvents / 4);
+        EXPECT_EQ(feed.applied, kEvents / 4);
+        EXPECT_EQ(feed.depth, 0);
+        EXPECT_EQ(feed.lag, milliseconds{0});
+    }
+    EXPECT_FALSE(fanIn.Push(4, {"station_0"}));
+}
+
+TEST(PassengerEventFanInTest, merged_lag)
+{
+    std::vector<PassengerEvent> applied{};
+    PassengerEventFanInOptions options{};
+    options.idleTimeout = seconds{10};
+    PassengerEventFanIn fanIn{[&applied](const PassengerEvent& event) { applied.push_back(event); }, 2, options};
+
+    // Feed 1 only has an event at 5 s: The merge cannot go past it until
+    // feed 1 sends more.
+    for(int second{0}; second < 10; ++second)
+    {
+        fanIn.Push(0, {"station_0", EventType::In, t0 + seconds{second}});
+    }
+    fanIn.Push(1, {"station_1", EventType::In, t0 + seconds{5}});
+    auto stats{fanIn.GetStats()};
+    for(int attempt{0}; attempt < 500 && stats.applied < 7; ++attempt)
+    {
+        std::this_thread::sleep_for(milliseconds{10});
+        stats = fanIn.GetStats();
+    }
+    EXPECT_EQ(stats.applied, 7);
+    EXPECT_EQ(stats.feeds[0].applied, 6);
+    EXPECT_EQ(stats.feeds[0].depth, 4);
+    EXPECT_EQ(stats.feeds[0].lag, seconds{4});
+    EXPECT_EQ(stats.feeds[1].applied, 1);
+    EXPECT_EQ(stats.feeds[1].depth, 0);
+
+    // Flushing does not wait for feed 1.
+    fanIn.Flush();
+    ASSERT_EQ(applied.size(), 11);
+    EXPECT_EQ(applied[6].stationId, "station_1");
+    stats = fanIn.GetStats();
+    EXPECT_EQ(stats.feeds[0].depth, 0);
+    EXPECT_EQ(stats.feeds[0].lag, seconds{0});
+}
+
+TEST(PassengerEventFanInTest, merged_idle_feed)
+{
+    std::size_t nApplied{0};
+    PassengerEventFanInOptions options{};
+    options.idleTimeout = milliseconds{20};
+    PassengerEventFanIn fanIn{[&nApplied](const PassengerEvent&) { ++nApplied; }, 2, options};
+
+    // Feed 1 is silent: The merge goes on without it.
+    for(int second{1}; second <= 10; ++second)
+    {
+        fanIn.Push(0, {"station_0", EventType::In, t0 + seconds{second}});
+    }
+    auto stats{fanIn.GetStats()};
+    for(int attempt{0}; attempt < 500 && stats.applied < 10; ++attempt)
+    {
+        std::this_thread::sleep_for(milliseconds{10});
+        stats = fanIn.GetStats();
+    }
+    EXPECT_EQ(stats.applied, 10);
+
+    // Its events are still applied when it comes back, late.
+    fanIn.Push(1, {"station_1", EventType::In, t0});
+    fanIn.Flush();
+    stats = fanIn.GetStats();
+    EXPECT_EQ(stats.applied, 11);
+    EXPECT_EQ(stats.late, 1);
+}
+
+TEST(PassengerEventFanInTest, sharded_counts)
+{
+    constexpr std::size_t kEvents{100000};
+    constexpr std::size_t kStations{10};
+    TransportNetwork nw{};
+    TransportNetwork expected{};
+    for(std::size_t station{0}; station < kStations; ++station)
+    {
+        const auto id{"station_" + std::to_string(station)};
+        ASSERT_TRUE(nw.AddStation({id, "Station Name " + std::to_string(station)}));
+        ASSERT_TRUE(expected.AddStation({id, "Station Name " + std::to_string(station)}));
+    }
+
+    PassengerEventFanInOptions options{};
+    options.mode = FanInMode::Sharded;
+    options.nShards = 3;
+    options.queueCapacity = 256;
+    {
+        PassengerEventFanIn fanIn{nw, 4, options};
+        RunFeeds(fanIn, kEvents, kStations);
+        fanIn.Flush();
+        const auto stats{fanIn.GetStats()};
+        EXPECT_EQ(stats.applied, kEvents);
+        for(const auto& feed : stats.feeds)
+        {
+            EXPECT_EQ(feed.pushed, kEvents / 4);
+            EXPECT_EQ(feed.depth, 0);
+        }
+    }
+
+    // The same events, applied directly.
+    PassengerEventFanIn direct{[&expected](const PassengerEvent& event) { expected.RecordPassengerEvent(event); }, 4};
+    RunFeeds(direct, kEvents, kStations);
+    direct.Flush();
+    for(std::size_t station{0}; station < kStations; ++station)
+    {
+        const auto id{"station_" + std::to_string(station)};
+        EXPECT_EQ(nw.GetPassengerCount(id), expected.GetPassengerCount(id));
+    }
+}
+
+TEST(PassengerEventFanInTest, destroy_applies_all)
+{
+    constexpr std::size_t kEvents{10000};
+    TransportNetwork nw{};
+    ASSERT_TRUE(nw.AddStation({"station_0", "Station Name 0"}));
+    for(const auto mode : {FanInMode::Merged, FanInMode::Sharded})
+    {
+        PassengerEventFanInOptions options{};
+        options.mode = mode;
+        options.nShards = 2;
+        {
+            PassengerEventFanIn fanIn{nw, 2, options};
+            for(std::size_t idx{0}; idx < kEvents; ++idx)
+            {
+                fanIn.Push(idx % 2, {"station_0", EventType::In, t0 + milliseconds{idx}});
+            }
+        }
+        EXPECT_EQ(nw.GetPassengerCount("station_0"), (mode == FanInMode::Merged ? 1 : 2) * kEvents);
+    }
+}
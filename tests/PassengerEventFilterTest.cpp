@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+
+#include <PassengerEventFilter.hpp>
+#include <TransportNetwork.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventFilter;
+using NetworkMonitor::PassengerEventFilterOptions;
+using NetworkMonitor::TransportNetwork;
+
+using EventType = NetworkMonitor::PassengerEvent::Type;
+using std::chrono::seconds;
+
+namespace {
+
+const std::chrono::system_clock::time_point t0{seconds{1700000000}};
+
+// Push all events through the filter, flush it, and return the events that
+// came out.
+std::vector<PassengerEvent> Filter(PassengerEventFilter& filter, const std::vector<PassengerEvent>& events)
+{
+    std::vector<PassengerEvent> output{};
+    const auto sink{[&output](const PassengerEvent& event) { output.push_back(event); }};
+    for(const auto& event : events)
+    {
+        filter.Push(event, sink);
+    }
+    filter.Flush(sink);
+    return output;
+}
+
+std::vector<std::uint64_t> GetSequences(const std::vector<PassengerEvent>& events)
+{
+    std::vector<std::uint64_t> sequences{};
+    for(const auto& event : events)
+    {
+        sequences.push_back(event.sequence);
+    }
+    return sequences;
+}
+
+} // namespace
+
+TEST(PassengerEventFilterTest, dedup)
+{
+    PassengerEventFilter filter{};
+    const std::vector<PassengerEvent> events{
+        {"station_000", EventType::In, {}, 1},
+        {"station_000", EventType::In, {}, 2},
+        {"station_000", EventType::In, {}, 1},
+        {"station_000", EventType::In, {}, 4},
+        {"station_000", EventType::In, {}, 3},
+        {"station_000", EventType::In, {}, 4},
+        // Events without a sequence number are all kept.
+        {"station_000", EventType::In},
+        {"station_000", EventType::In},
+    };
+    const auto output{Filter(filter, events)};
+    EXPECT_EQ(GetSequences(output), (std::vector<std::uint64_t>{1, 2, 4, 3, 0, 0}));
+
+    const auto stats{filter.GetStats()};
+    EXPECT_EQ(stats.accepted, 6);
+    EXPECT_EQ(stats.duplicates, 2);
+    EXPECT_EQ(stats.expired, 0);
+}
+
+TEST(PassengerEventFilterTest, dedup_window)
+{
+    PassengerEventFilterOptions options{};
+    options.dedupWindow = 128;
+    PassengerEventFilter filter{options};
+    const auto sink{[](const PassengerEvent&) {}};
+
+    for(std::uint64_t sequence{1}; sequence <= 1000; ++sequence)
+    {
+        filter.Push({"station_000", EventType::In, {}, sequence}, sink);
+    }
+    EXPECT_EQ(filter.GetStats().accepted, 1000);
+
+    // Duplicates within the window are dropped, and so is anything behind it.
+    filter.Push({"station_000", EventType::In, {}, 1000 - 128}, sink);
+    filter.Push({"station_000", EventType::In, {}, 1}, sink);
+    auto stats{filter.GetStats()};
+    EXPECT_EQ(stats.duplicates, 1);
+    EXPECT_EQ(stats.expired, 1);
+
+    // A jump forward past the whole window forgets everything.
+    filter.Push({"station_000", EventType::In, {}, 100000}, sink);
+    filter.Push({"station_000", EventType::In, {}, 100000 - 100}, sink);
+    filter.Push({"station_000", EventType::In, {}, 100000 - 100}, sink);
+    stats = filter.GetStats();
+    EXPECT_EQ(stats.accepted, 1002);
+    EXPECT_EQ(stats.duplicates, 2);
+
+    // Memory does not depend on the number of events.
+    EXPECT_LT(filter.GetMemorySize(), 1024);
+}
+
+TEST(PassengerEventFilterTest, reorder)
+{
+    PassengerEventFilterOptions options{};
+    options.maxLateness = seconds{10};
+    PassengerEventFilter filter{options};
+    std::vector<PassengerEvent> output{};
+    const auto sink{[&output](const PassengerEvent& event) { output.push_back(event); }};
+
+    filter.Push({"station_000", EventType::In, t0 + seconds{2}, 2}, sink);
+    filter.Push({"station_000", EventType::In, t0 + seconds{1}, 1}, sink);
+    filter.Push({"station_000", EventType::In, t0 + seconds{5}, 4}, sink);
+    filter.Push({"station_000", EventType::In, t0 + seconds{3}, 3}, sink);
+    EXPECT_TRUE(output.empty());
+    EXPECT_EQ(filter.GetStats().buffered, 4);
+
+    // Events move on once the newest timestamp is 10 seconds past them.
+    filter.Push({"station_000", EventType::In, t0 + seconds{13}, 5}, sink);
+    EXPECT_EQ(GetSequences(output), (std::vector<std::uint64_t>{1, 2, 3}));
+
+    // Too late to be put back in order: Passed on right away.
+    filter.Push({"station_000", EventType::In, t0, 6}, sink);
+    EXPECT_EQ(GetSequences(output), (std::vector<std::uint64_t>{1, 2, 3, 6}));
+
+    // Without new events, the clock moves them on.
+    filter.AdvanceTo(t0 + seconds{15}, sink);
+    EXPECT_EQ(GetSequences(output), (std::vector<std::uint64_t>{1, 2, 3, 6, 4}));
+    filter.Flush(sink);
+    EXPECT_EQ(GetSequences(output), (std::vector<std::uint64_t>{1, 2, 3, 6, 4, 5}));
+
+    const auto stats{filter.GetStats()};
+    EXPECT_EQ(stats.accepted, 6);
+    EXPECT_EQ(stats.reordered, 2);
+    EXPECT_EQ(stats.late, 1);
+    EXPECT_EQ(stats.buffered, 0);
+}
+
+TEST(PassengerEventFilterTest, reorder_bounded)
+{
+    PassengerEventFilterOptions options{};
+    options.maxLateness = seconds{3600};
+    options.maxBuffered = 3;
+    PassengerEventFilter filter{options};
+    std::vector<PassengerEvent> output{};
+    const auto sink{[&output](const PassengerEvent& event) { output.push_back(event); }};
+
+    // The buffer never holds more than 3 events: The oldest one moves on, and
+    // the event after it is then too late.
+    for(std::uint64_t sequence{1}; sequence <= 5; ++sequence)
+    {
+        filter.Push({"station_000", EventType::In, t0 + seconds{6 - sequence}, sequence}, sink);
+        EXPECT_LE(filter.GetStats().buffered, 3);
+    }
+    EXPECT_EQ(GetSequences(output), (std::vector<std::uint64_t>{4, 5}));
+    filter.Flush(sink);
+    EXPECT_EQ(GetSequences(output), (std::vector<std::uint64_t>{4, 5, 3, 2, 1}));
+    EXPECT_EQ(filter.GetStats().late, 1);
+}
+
+TEST(PassengerEventFilterTest, network_counts)
+{
+    TransportNetwork nw{};
+    ASSERT_TRUE(nw.AddStation({"station_000", "Station Name 0"}));
+    ASSERT_TRUE(nw.AddStation({"station_001", "Station Name 1"}));
+
+    // A feed that reconnects: Replays a part of its events, shuffled a bit.
+    std::vector<PassengerEvent> events{};
+    for(std::uint64_t sequence{1}; sequence <= 1000; ++sequence)
+    {
+        events.push_back({sequence % 2 == 0 ? "station_000" : "station_001",
+                          sequence % 3 == 0 ? EventType::Out : EventType::In, t0 + seconds{sequence}, sequence});
+    }
+    auto feed{events};
+    feed.insert(feed.begin() + 600, events.begin() + 500, events.begin() + 600);
+    std::mt19937 rng{42};
+    for(std::size_t idx{0}; idx + 5 < feed.size(); idx += 5)
+    {
+        std::shuffle(feed.begin() + idx, feed.begin() + idx + 5, rng);
+    }
+
+    PassengerEventFilterOptions options{};
+    options.maxLateness = seconds{10};
+    PassengerEventFilter filter{options};
+    std::vector<PassengerEvent> output{};
+    const auto record{[&nw, &output](const PassengerEvent& event) {
+        EXPECT_TRUE(nw.RecordPassengerEvent(event));
+        output.push_back(event);
+    }};
+    for(const auto& event : feed)
+    {
+        filter.Push(event, record);
+    }
+    filter.Flush(record);
+
+    // The network saw each event once, in order.
+    EXPECT_EQ(filter.GetStats().duplicates, 100);
+    EXPECT_EQ(filter.GetStats().late, 0);
+    ASSERT_EQ(output.size(), events.size());
+    EXPECT_TRUE(std::is_sorted(output.begin(), output.end(), [](const auto& a, const auto& b) {
+        return a.timestamp < b.timestamp;
+    }));
+    long long int expected[2]{0, 0};
+    for(const auto& event : events)
+    {
+        expected[event.stationId == "station_000" ? 0 : 1] += event.type == EventType::In ? 1 : -1;
+    }
+    EXPECT_EQ(nw.GetPassengerCount("station_000"), expected[0]);
+    EXPECT_EQ(nw.GetPassengerCount("station_001"), expected[1]);
+}
@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+
+#include <PassengerEventLog.hpp>
+#include <TransportNetwork.hpp>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::Id;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventLog;
+using NetworkMonitor::PassengerEventLogOptions;
+using NetworkMonitor::StationPassengerCount;
+using NetworkMonitor::TransportNetwork;
+
+namespace {
+
+// Log options on a fresh directory, with no periodic checkpoint.
+PassengerEventLogOptions GetTestOptions(const std::string& name)
+{
+    PassengerEventLogOptions options{};
+    options.directory = std::filesystem::temp_directory_path() / ("network_monitor_" + name);
+    options.checkpointInterval = std::chrono::seconds{0};
+    std::filesystem::remove_all(options.directory);
+    return options;
+}
+
+std::size_t CountSegments(const std::filesystem::path& directory)
+{
+    std::size_t nSegments{0};
+    for(const auto& entry : std::filesystem::directory_iterator{directory})
+    {
+        nSegments += entry.path().extension() == ".log" ? 1 : 0;
+    }
+    return nSegments;
+}
+
+} // namespace
+
+TEST(PassengerEventLogTest, recover_from_log)
+{
+    const auto options{GetTestOptions("recover_from_log")};
+    {
+        PassengerEventLog log{options};
+        EXPECT_TRUE(log.GetRecoveredCounts().empty());
+        EXPECT_TRUE(log.Append({"station_000", PassengerEvent::Type::In}));
+        EXPECT_TRUE(log.Append({"station_000", PassengerEvent::Type::In}));
+        EXPECT_TRUE(log.Append({"station_001", PassengerEvent::Type::Out}));
+        EXPECT_TRUE(log.Append({"station_002", PassengerEvent::Type::In}));
+        EXPECT_TRUE(log.Append({"station_002", PassengerEvent::Type::Out}));
+        EXPECT_FALSE(log.Append({std::string(PassengerEventLog::kMaxStationIdSize + 1, 'x')}));
+        EXPECT_TRUE(log.Commit());
+
+        const auto stats{log.GetStats()};
+        EXPECT_EQ(stats.events, 5);
+        EXPECT_GE(stats.commits, 1);
+        EXPECT_GT(stats.bytes, 0);
+        EXPECT_EQ(stats.errors, 0);
+    }
+
+    // Stations with a count of 0 are left out.
+    PassengerEventLog log{options};
+    const std::vector<StationPassengerCount> expected{{"station_000", 2}, {"station_001", -1}};
+    ASSERT_EQ(log.GetRecoveredCounts().size(), expected.size());
+    for(std::size_t idx{0}; idx < expected.size(); ++idx)
+    {
+        EXPECT_EQ(log.GetRecoveredCounts()[idx].stationId, expected[idx].stationId);
+        EXPECT_EQ(log.GetRecoveredCounts()[idx].count, expected[idx].count);
+    }
+    std::filesystem::remove_all(options.directory);
+}
+
+TEST(PassengerEventLogTest, recover_from_checkpoint)
+{
+    const auto options{GetTestOptions("recover_from_checkpoint")};
+    {
+        PassengerEventLog log{options};
+        for(int idx{0}; idx < 100; ++idx)
+        {
+            log.Append({"station_000", PassengerEvent::Type::In});
+        }
+        ASSERT_TRUE(log.Checkpoint());
+        EXPECT_EQ(log.GetStats().checkpoints, 1);
+
+        // The checkpoint replaces the segments before it.
+        EXPECT_EQ(CountSegments(options.directory), 1);
+        log.Append({"station_000", PassengerEvent::Type::Out});
+        log.Append({"station_001", PassengerEvent::Type::In});
+    }
+    {
+        PassengerEventLog log{options};
+        ASSERT_EQ(log.GetRecoveredCounts().size(), 2);
+        EXPECT_EQ(log.GetRecoveredCounts()[0].count, 99);
+        EXPECT_EQ(log.GetRecoveredCounts()[1].count, 1);
+
+        // The counts survive another checkpoint.
+        ASSERT_TRUE(log.Checkpoint());
+    }
+    PassengerEventLog log{options};
+    ASSERT_EQ(log.GetRecoveredCounts().size(), 2);
+    EXPECT_EQ(log.GetRecoveredCounts()[0].count, 99);
+    EXPECT_EQ(log.GetRecoveredCounts()[1].count, 1);
+    std::filesystem::remove_all(options.directory);
+}
+
+TEST(PassengerEventLogTest, torn_tail)
+{
+    const auto options{GetTestOptions("torn_tail")};
+    {
+        PassengerEventLog log{options};
+        log.Append({"station_000", PassengerEvent::Type::In});
+        ASSERT_TRUE(log.Commit());
+        log.Append({"station_000", PassengerEvent::Type::In});
+    }
+
+    // Simulate a crash in the middle of a write: Cut the last commit short.
+    std::filesystem::path segment{};
+    for(const auto& entry : std::filesystem::directory_iterator{options.directory})
+    {
+        if(entry.path().extension() == ".log" && entry.file_size() > 0)
+        {
+            segment = entry.path();
+        }
+    }
+    ASSERT_FALSE(segment.empty());
+    const auto size{std::filesystem::file_size(segment)};
+    std::filesystem::resize_file(segment, size - 3);
+    {
+        PassengerEventLog log{options};
+        ASSERT_EQ(log.GetRecoveredCounts().size(), 1);
+        EXPECT_EQ(log.GetRecoveredCounts()[0].count, 1);
+
+        // New records go to a new segment, after the torn one.
+        log.Append({"station_000", PassengerEvent::Type::In});
+    }
+    {
+        PassengerEventLog log{options};
+        ASSERT_EQ(log.GetRecoveredCounts().size(), 1);
+        EXPECT_EQ(log.GetRecoveredCounts()[0].count, 2);
+    }
+
+    // A corrupt frame stops the replay of its segment.
+    {
+        std::fstream file{segment, std::ios::in | std::ios::out | std::ios::binary};
+        file.seekp(8);
+        file.put('\xFF');
+    }
+    PassengerEventLog log{options};
+    ASSERT_EQ(log.GetRecoveredCounts().size(), 1);
+    EXPECT_EQ(log.GetRecoveredCounts()[0].count, 1);
+    std::filesystem::remove_all(options.directory);
+}
+
+TEST(PassengerEventLogTest, concurrent_appends)
+{
+    auto options{GetTestOptions("concurrent_appends")};
+    options.capacity = 256;
+    options.commitInterval = std::chrono::milliseconds{1};
+    constexpr int kThreads{4};
+    constexpr int kEvents{20000};
+    {
+        PassengerEventLog log{options};
+        std::vector<std::thread> threads{};
+        for(int thread{0}; thread < kThreads; ++thread)
+        {
+            threads.emplace_back([&log, thread]() {
+                const Id station{"station_00" + std::to_string(thread)};
+                for(int idx{0}; idx < kEvents; ++idx)
+                {
+                    log.Append({station, idx % 3 == 0 ? PassengerEvent::Type::Out : PassengerEvent::Type::In});
+                }
+            });
+        }
+        for(auto& thread : threads)
+        {
+            thread.join();
+        }
+        ASSERT_TRUE(log.Commit());
+        EXPECT_EQ(log.GetStats().events, kThreads * kEvents);
+    }
+    PassengerEventLog log{options};
+    ASSERT_EQ(log.GetRecoveredCounts().size(), kThreads);
+    for(const auto& [station, count] : log.GetRecoveredCounts())
+    {
+        EXPECT_EQ(count, kEvents - 2 * ((kEvents + 2) / 3));
+    }
+    std::filesystem::remove_all(options.directory);
+}
+
+TEST(PassengerEventLogTest, restore_network)
+{
+    const auto options{GetTestOptions("restore_network")};
+    TransportNetwork nw{};
+    ASSERT_TRUE(nw.AddStation({"station_000", "Station Name 0"}));
+    ASSERT_TRUE(nw.AddStation({"station_001", "Station Name 1"}));
+    {
+        PassengerEventLog log{options};
+        for(const auto& event : std::vector<PassengerEvent>{
+                {"station_000", PassengerEvent::Type::In},
+                {"station_000", PassengerEvent::Type::In},
+                {"station_001", PassengerEvent::Type::In},
+                {"station_missing", PassengerEvent::Type::In},
+            })
+        {
+            if(nw.RecordPassengerEvent(event))
+            {
+                log.Append(event);
+            }
+        }
+    }
+
+    TransportNetwork restored{};
+    ASSERT_TRUE(restored.AddStation({"station_000", "Station Name 0"}));
+    ASSERT_TRUE(restored.AddStation({"station_001", "Station Name 1"}));
+    PassengerEventLog log{options};
+    auto counts{log.GetRecoveredCounts()};
+    counts.push_back({"station_missing", 5});
+    EXPECT_EQ(restored.SetPassengerCounts(counts), 2);
+    EXPECT_EQ(restored.GetPassengerCount("station_000"), nw.GetPassengerCount("station_000"));
+    EXPECT_EQ(restored.GetPassengerCount("station_001"), nw.GetPassengerCount("station_001"));
+    const auto busiest{restored.GetBusiestStations(1)};
+    ASSERT_EQ(busiest.size(), 1);
+    EXPECT_EQ(busiest[0].stationId, "station_000");
+    std::filesystem::remove_all(options.directory);
+}
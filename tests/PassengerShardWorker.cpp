@@ -0,0 +1,62 @@
+#include <NetworkLayoutGenerator.hpp>
+#include <PassengerShards.hpp>
+#include <TransportNetwork.hpp>
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+using NetworkMonitor::ConsistentHashRing;
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::PassengerShardServer;
+using NetworkMonitor::TransportNetwork;
+
+// Usage: network_monitor_shard_worker <socket path> <shard> <shards> <stations> [seed]
+// Local shard process for the tests and the benchmarks. It loads the network
+// layout generated with the given number of stations and seed, then serves
+// its shard until it gets SIGINT or SIGTERM.
+int main(int argc, char* argv[])
+{
+    if(argc < 5)
+    {
+        std::cerr << "Usage: " << argv[0] << " <socket path> <shard> <shards> <stations> [seed]" << std::endl;
+        return 2;
+    }
+    NetworkLayoutOptions options{};
+    options.nStations = std::strtoul(argv[4], nullptr, 10);
+    options.nLines = std::max<std::size_t>(options.nStations / 50, 1);
+    if(argc > 5)
+    {
+        options.seed = std::strtoull(argv[5], nullptr, 10);
+    }
+    const auto layout{GenerateNetworkLayout(options)};
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        nw.AddStation(station);
+    }
+    nw.AddLines(layout.lines);
+
+    try
+    {
+        boost::asio::io_context ioc{};
+        PassengerShardServer server{ioc,
+                                    nw,
+                                    ConsistentHashRing{std::strtoul(argv[3], nullptr, 10)},
+                                    std::strtoul(argv[2], nullptr, 10),
+                                    argv[1]};
+        boost::asio::signal_set signals{ioc, SIGINT, SIGTERM};
+        signals.async_wait([&server](auto, auto) { server.Stop(); });
+        ioc.run();
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
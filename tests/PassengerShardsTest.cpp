@@ -0,0 +1,297 @@
+#include <gtest/gtest.h>
+
+#include <NetworkLayoutGenerator.hpp>
+#include <PassengerShards.hpp>
+#include <TransportNetwork.hpp>
+
+#include <boost/asio.hpp>
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::ConsistentHashRing;
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerShardRouter;
+using NetworkMonitor::PassengerShardRouterOptions;
+using NetworkMonitor::PassengerShardServer;
+using NetworkMonitor::TransportNetwork;
+
+using EventType = NetworkMonitor::PassengerEvent::Type;
+
+extern char** environ;
+
+namespace {
+
+std::filesystem::path GetSocketPath(const std::string& name, std::size_t shard)
+{
+    return std::filesystem::temp_directory_path() /
+           ("nm-" + name + "-" + std::to_string(getpid()) + "-" + std::to_string(shard) + ".sock");
+}
+
+// Local shard worker processes, stopped on destruction.
+class ShardProcesses
+{
+public:
+    ShardProcesses(const std::string& name, std::size_t nShards, std::size_t nStations)
+    {
+        for(std::size_t shard{0}; shard < nShards; ++shard)
+        {
+            paths_.push_back(GetSocketPath(name, shard));
+            std::vector<std::string> args{TESTS_SHARD_WORKER, paths_.back().string(), std::to_string(shard),
+                                          std::to_string(nShards), std::to_string(nStations)};
+            std::vector<char*> argv{};
+            for(auto& arg : args)
+            {
+                argv.push_back(arg.data());
+            }
+            argv.push_back(nullptr);
+            pid_t pid{0};
+            if(posix_spawn(&pid, TESTS_SHARD_WORKER, nullptr, nullptr, argv.data(), environ) == 0)
+            {
+                pids_.push_back(pid);
+            }
+        }
+    }
+
+    ~ShardProcesses()
+    {
+        for(const auto pid : pids_)
+        {
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+    std::size_t GetCount() const
+    {
+        return pids_.size();
+    }
+
+    const std::vector<std::filesystem::path>& GetPaths() const
+    {
+        return paths_;
+    }
+
+private:
+    std::vector<std::filesystem::path> paths_{};
+    std::vector<pid_t> pids_{};
+};
+
+// The layout the shard workers load.
+NetworkLayout GetWorkerLayout(std::size_t nStations)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = nStations;
+    options.nLines = std::max<std::size_t>(nStations / 50, 1);
+    return GenerateNetworkLayout(options);
+}
+
+} // namespace
+
+TEST(ConsistentHashRingTest, balance)
+{
+    constexpr std::size_t kShards{4};
+    constexpr std::size_t kStations{10000};
+    ConsistentHashRing ring{kShards};
+    EXPECT_EQ(ring.GetShardCount(), kShards);
+    std::vector<std::size_t> nStations(kShards, 0);
+    for(std::size_t idx{0}; idx < kStations; ++idx)
+    {
+        const auto shard{ring.GetShard("station_" + std::to_string(idx))};
+        ASSERT_LT(shard, kShards);
+        ++nStations[shard];
+    }
+    for(const auto count : nStations)
+    {
+        EXPECT_GT(count, kStations / kShards * 3 / 4);
+        EXPECT_LT(count, kStations / kShards * 5 / 4);
+    }
+
+    // A single shard owns everything.
+    ConsistentHashRing single{0};
+    EXPECT_EQ(single.GetShardCount(), 1);
+    EXPECT_EQ(single.GetShard("station_0"), 0);
+}
+
+TEST(ConsistentHashRingTest, adding_a_shard)
+{
+    constexpr std::size_t kStations{10000};
+    ConsistentHashRing before{4};
+    ConsistentHashRing after{5};
+    ConsistentHashRing same{4};
+    std::size_t nMoved{0};
+    for(std::size_t idx{0}; idx < kStations; ++idx)
+    {
+        const auto id{"station_" + std::to_string(idx)};
+        EXPECT_EQ(before.GetShard(id), same.GetShard(id));
+        if(before.GetShard(id) != after.GetShard(id))
+        {
+            // Stations only move to the new shard.
+            EXPECT_EQ(after.GetShard(id), 4);
+            ++nMoved;
+        }
+    }
+    EXPECT_GT(nMoved, kStations / 5 / 2);
+    EXPECT_LT(nMoved, kStations / 5 * 3 / 2);
+}
+
+TEST(PassengerShardsTest, local_processes)
+{
+    constexpr std::size_t kShards{3};
+    constexpr std::size_t kStations{200};
+    constexpr std::size_t kEvents{20000};
+    ShardProcesses shards{"processes", kShards, kStations};
+    ASSERT_EQ(shards.GetCount(), kShards);
+
+    // The reference network gets the same events directly.
+    const auto layout{GetWorkerLayout(kStations)};
+    TransportNetwork expected{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(expected.AddStation(station));
+    }
+
+    // Two feeds, each with its own router. Small batches, to send many.
+    PassengerShardRouterOptions options{};
+    options.batchBytes = 1024;
+    PassengerShardRouter router0{shards.GetPaths(), options};
+    PassengerShardRouter router1{shards.GetPaths(), options};
+    ASSERT_EQ(router0.GetShardCount(), kShards);
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<std::size_t> pickStation{0, kStations - 1};
+    std::bernoulli_distribution enters{0.6};
+    for(std::size_t idx{0}; idx < kEvents; ++idx)
+    {
+        const PassengerEvent event{layout.stations[pickStation(rng)].id, enters(rng) ? EventType::In : EventType::Out};
+        expected.RecordPassengerEvent(event);
+        (idx % 2 == 0 ? router0 : router1).RecordPassengerEvent(event);
+    }
+    router0.RecordPassengerEvent({"station_missing", EventType::In});
+    router0.Flush();
+    router1.Flush();
+
+    for(const auto& station : layout.stations)
+    {
+        EXPECT_EQ(router0.GetPassengerCount(station.id), expected.GetPassengerCount(station.id));
+    }
+    EXPECT_EQ(router0.GetPassengerCount("station_missing"), 0);
+
+    // Scatter-gather across the shards.
+    const auto busiest{router1.GetBusiestStations(10)};
+    const auto expectedBusiest{expected.GetBusiestStations(10)};
+    ASSERT_EQ(busiest.size(), expectedBusiest.size());
+    for(std::size_t idx{0}; idx < busiest.size(); ++idx)
+    {
+        EXPECT_EQ(busiest[idx].count, expectedBusiest[idx].count);
+        EXPECT_EQ(busiest[idx].count, expected.GetPassengerCount(busiest[idx].stationId));
+    }
+    EXPECT_EQ(router1.GetBusiestStations(kStations + 10).size(), kStations);
+    EXPECT_TRUE(router1.GetBusiestStations(0).empty());
+
+    const auto stats{router0.GetShardStats()};
+    ASSERT_EQ(stats.size(), kShards);
+    std::uint64_t recorded{0};
+    std::uint64_t failed{0};
+    for(const auto& shard : stats)
+    {
+        EXPECT_GT(shard.recorded, 0);
+        EXPECT_EQ(shard.misrouted, 0);
+        recorded += shard.recorded;
+        failed += shard.failed;
+    }
+    EXPECT_EQ(recorded, kEvents);
+    EXPECT_EQ(failed, 1);
+}
+
+TEST(PassengerShardsTest, misrouted)
+{
+    // An in-process shard 0 of 2, behind a router that believes in a single
+    // shard: The shard drops the events of the stations it does not own.
+    const auto layout{GetWorkerLayout(100)};
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+    const ConsistentHashRing ring{2};
+    const auto path{GetSocketPath("misrouted", 0)};
+    boost::asio::io_context ioc{};
+    PassengerShardServer server{ioc, nw, ring, 0, path};
+    std::thread thread{[&ioc]() { ioc.run(); }};
+
+    std::size_t nOwned{0};
+    {
+        PassengerShardRouter router{{path}};
+        for(const auto& station : layout.stations)
+        {
+            router.RecordPassengerEvent({station.id, EventType::In});
+            nOwned += ring.GetShard(station.id) == 0 ? 1 : 0;
+        }
+        router.Flush();
+        const auto stats{router.GetShardStats()};
+        ASSERT_EQ(stats.size(), 1);
+        EXPECT_EQ(stats[0].recorded, nOwned);
+        EXPECT_EQ(stats[0].misrouted, layout.stations.size() - nOwned);
+        for(const auto& station : layout.stations)
+        {
+            EXPECT_EQ(router.GetPassengerCount(station.id), ring.GetShard(station.id) == 0 ? 1 : 0);
+        }
+        EXPECT_EQ(router.GetBusiestStations(layout.stations.size()).size(), nOwned);
+    }
+    EXPECT_EQ(server.GetStats().recorded, nOwned);
+
+    boost::asio::post(ioc, [&server]() { server.Stop(); });
+    thread.join();
+}
+
+TEST(PassengerShardsTest, connect_timeout)
+{
+    PassengerShardRouterOptions options{};
+    options.connectTimeout = std::chrono::milliseconds{50};
+    EXPECT_THROW(PassengerShardRouter({GetSocketPath("nobody", 0)}, options), boost::system::system_error);
+}
+
+TEST(PassengerShardsTest, oversized_frame)
+{
+    // A frame that announces a 4 GiB payload: The shard closes the
+    // connection instead of allocating it.
+    TransportNetwork nw{};
+    const ConsistentHashRing ring{1};
+    const auto path{GetSocketPath("oversized", 0)};
+    boost::asio::io_context ioc{};
+    PassengerShardServer server{ioc, nw, ring, 0, path};
+    std::thread thread{[&ioc]() { ioc.run(); }};
+
+    boost::asio::io_context clientIoc{};
+    boost::asio::local::stream_protocol::socket socket{clientIoc};
+    socket.connect(path.string());
+    const char header[5]{'\xff', '\xff', '\xff', '\xff', 1};
+    boost::asio::write(socket, boost::asio::buffer(header));
+    char reply{0};
+    boost::system::error_code ec{};
+    boost::asio::read(socket, boost::asio::buffer(&reply, 1), ec);
+    EXPECT_EQ(ec, boost::asio::error::eof);
+
+    boost::asio::post(ioc, [&server]() { server.Stop(); });
+    thread.join();
+
+    PassengerShardRouterOptions options{};
+    options.batchBytes = 64 * 1024 * 1024;
+    EXPECT_THROW(PassengerShardRouter({path}, options), std::invalid_argument);
+}
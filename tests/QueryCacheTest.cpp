@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#include <QueryCache.hpp>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::QueryCache;
+
+namespace {
+
+// Sends all keys to the same set, to exercise the evictions.
+struct ConstantHash
+{
+    std::size_t operator()(int) const
+    {
+        return 42;
+    }
+};
+
+} // namespace
+
+TEST(QueryCacheTest, insert_find)
+{
+    QueryCache<int, int> cache{100, 4};
+    EXPECT_FALSE(cache.Find(1, 0).has_value());
+
+    cache.Insert(1, 0, 10);
+    const auto value{cache.Find(1, 0)};
+    ASSERT_TRUE(value.has_value());
+    EXPECT_EQ(*value, 10);
+
+    // Inserting a key again replaces its value.
+    cache.Insert(1, 0, 20);
+    EXPECT_EQ(*cache.Find(1, 0), 20);
+
+    const auto stats{cache.GetStats()};
+    EXPECT_EQ(stats.hits, 2);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.evictions, 0);
+    EXPECT_EQ(stats.entries, 1);
+    EXPECT_GE(stats.capacity, 100);
+    EXPECT_GT(stats.memory, 0);
+    EXPECT_DOUBLE_EQ(stats.HitRate(), 2.0 / 3);
+}
+
+TEST(QueryCacheTest, version)
+{
+    QueryCache<int, int> cache{100, 4};
+    cache.Insert(1, 0, 10);
+
+    // Entries of another version miss, and are overwritten in place.
+    EXPECT_FALSE(cache.Find(1, 1).has_value());
+    cache.Insert(1, 1, 11);
+    EXPECT_EQ(*cache.Find(1, 1), 11);
+    EXPECT_FALSE(cache.Find(1, 0).has_value());
+    EXPECT_EQ(cache.GetStats().entries, 1);
+}
+
+TEST(QueryCacheTest, clock_eviction)
+{
+    constexpr int kWays{QueryCache<int, int>::kWays};
+    QueryCache<int, int, ConstantHash> cache{kWays, 1};
+    for(int k{0}; k < kWays; ++k)
+    {
+        cache.Insert(k, 0, k);
+    }
+    EXPECT_EQ(cache.GetStats().evictions, 0);
+
+    // The entries that were hit since they were inserted get a second chance.
+    for(int k{0}; k < kWays; k += 2)
+    {
+        EXPECT_TRUE(cache.Find(k, 0).has_value());
+    }
+    cache.Insert(kWays, 0, kWays);
+    EXPECT_EQ(cache.GetStats().evictions, 1);
+    EXPECT_FALSE(cache.Find(1, 0).has_value());
+    for(int k{0}; k < kWays; k += 2)
+    {
+        EXPECT_TRUE(cache.Find(k, 0).has_value());
+    }
+    EXPECT_EQ(*cache.Find(kWays, 0), kWays);
+
+    // Entries of an older version are replaced before any eviction.
+    cache.Insert(kWays + 1, 1, kWays + 1);
+    EXPECT_EQ(cache.GetStats().evictions, 1);
+    EXPECT_EQ(cache.GetStats().entries, kWays);
+}
+
+TEST(QueryCacheTest, concurrent)
+{
+    QueryCache<int, int> cache{256, 8};
+    constexpr int kThreads{4};
+    constexpr int kLookups{20000};
+    std::vector<std::thread> threads{};
+    for(int thread{0}; thread < kThreads; ++thread)
+    {
+        threads.emplace_back([&cache]() {
+            for(int idx{0}; idx < kLookups; ++idx)
+            {
+                const auto key{idx % 1000};
+                if(const auto value{cache.Find(key, 0)})
+                {
+                    EXPECT_EQ(*value, 2 * key);
+                }
+                else
+                {
+                    cache.Insert(key, 0, 2 * key);
+                }
+            }
+        });
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+    const auto stats{cache.GetStats()};
+    EXPECT_EQ(stats.hits + stats.misses, kThreads * kLookups);
+    EXPECT_LE(stats.entries, stats.capacity);
+}
@@ -1,17 +1,38 @@
 #include <gtest/gtest.h>
 
+#include <NetworkLayoutGenerator.hpp>
 #include <TransportNetwork.hpp>
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
+using NetworkMonitor::FlowWindow;
+using NetworkMonitor::CrowdingRoutingOptions;
+using NetworkMonitor::GenerateNetworkLayout;
 using NetworkMonitor::Id;
+using NetworkMonitor::LayoutChangeSet;
 using NetworkMonitor::Line;
+using NetworkMonitor::MemoryMode;
+using NetworkMonitor::NetworkLayout;
+using NetworkMonitor::NetworkLayoutOptions;
 using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::QueryCacheOptions;
+using NetworkMonitor::ReachabilitySeed;
+using NetworkMonitor::ReachableStation;
 using NetworkMonitor::Route;
+using NetworkMonitor::RouteIdView;
+using NetworkMonitor::RouteTravelTimeQuery;
 using NetworkMonitor::Station;
 using NetworkMonitor::TransportNetwork;
+using NetworkMonitor::TravelTimeProfile;
+using NetworkMonitor::TravelTimeQuery;
 
 TEST(TransportNetworkTest, AddStation_basic)
 {
@@ -247,7 +268,148 @@ TEST(TransportNetworkTest, AddLine_duplicate)
     EXPECT_TRUE(!ok);
 }
 
-TEST(TransportNetworkTest, DISABLED_PassengerEvents_basic)
+TEST(TransportNetworkTest, AddLines_matches_AddLine)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 5000;
+    options.nLines = 1000;
+    options.routesPerLine = 3;
+    options.routeLength = 20;
+    options.interchangeDensity = 0.3;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork sequential{};
+    TransportNetwork bulk{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(sequential.AddStation(station));
+        ASSERT_TRUE(bulk.AddStation(station));
+    }
+
+    // Lines added in two batches land after the lines already there.
+    const auto half{layout.lines.begin() + layout.lines.size() / 2};
+    for(const auto& line : layout.lines)
+    {
+        ASSERT_TRUE(sequential.AddLine(line));
+    }
+    ASSERT_TRUE(bulk.AddLines({layout.lines.begin(), half}, 4));
+    ASSERT_TRUE(bulk.AddLines({half, layout.lines.end()}, 3));
+
+    // Same routes, in the same order, at every station.
+    const auto at{std::chrono::system_clock::now()};
+    for(size_t idx{0}; idx < layout.stations.size(); ++idx)
+    {
+        const auto& station{layout.stations[idx]};
+        const auto expected{sequential.GetRoutesServingStation(station.id)};
+        const auto routes{bulk.GetRoutesServingStation(station.id)};
+        ASSERT_TRUE(std::equal(routes.begin(), routes.end(), expected.begin(), expected.end()));
+
+        // A different number of passengers at each station.
+        for(size_t event{0}; event < idx % 7 + 1; ++event)
+        {
+            ASSERT_TRUE(sequential.RecordPassengerEvent({station.id, PassengerEvent::Type::In, at}));
+            ASSERT_TRUE(bulk.RecordPassengerEvent({station.id, PassengerEvent::Type::In, at}));
+        }
+    }
+
+    // Same stations on every line.
+    for(const auto& line : layout.lines)
+    {
+        EXPECT_EQ(bulk.GetLinePassengerFlow(line.id, FlowWindow::OneMinute, at).in,
+                  sequential.GetLinePassengerFlow(line.id, FlowWindow::OneMinute, at).in);
+    }
+}
+
+TEST(TransportNetworkTest, AddLines_all_or_nothing)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 100;
+    options.nLines = 10;
+    options.routeLength = 10;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+
+    // The last route of the last line has a missing stop.
+    auto lines{layout.lines};
+    lines.back().routes.back().stops.back() = "station_missing";
+    EXPECT_FALSE(nw.AddLines(lines, 2));
+
+    // A line appears twice.
+    lines = layout.lines;
+    lines.push_back(lines.front());
+    EXPECT_FALSE(nw.AddLines(lines, 2));
+
+    // A line has the same route twice.
+    lines = layout.lines;
+    lines.back().routes.push_back(lines.back().routes.front());
+    EXPECT_FALSE(nw.AddLines(lines, 2));
+
+    // Nothing was added.
+    for(const auto& station : layout.stations)
+    {
+        EXPECT_TRUE(nw.GetRoutesServingStation(station.id).empty());
+    }
+    EXPECT_THROW(nw.GetLinePassengerFlow(layout.lines.front().id, FlowWindow::OneMinute, {}), std::runtime_error);
+
+    // A line already in the network.
+    ASSERT_TRUE(nw.AddLines(layout.lines));
+    EXPECT_FALSE(nw.AddLines({layout.lines.front()}));
+    EXPECT_FALSE(nw.AddLine(layout.lines.back()));
+}
+
+TEST(TransportNetworkTest, Move)
+{
+    bool ok{false};
+
+    // route0: 0 ---> 1
+    Station station0{
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1{
+        "station_001",
+        "Station Name 1",
+    };
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_001",
+        {"station_000", "station_001"},
+    };
+    Line line{
+        "line_000",
+        "Line Name",
+        {route0},
+    };
+
+    // The topology must survive the network being moved, as it lives in an
+    // arena owned by the network.
+    TransportNetwork nw0{};
+    ok = true;
+    ok &= nw0.AddStation(station0);
+    ok &= nw0.AddStation(station1);
+    ok &= nw0.AddLine(line);
+    ASSERT_TRUE(ok);
+    TransportNetwork nw1{std::move(nw0)};
+    auto routes{nw1.GetRoutesServingStation(station1.id)};
+    ASSERT_EQ(routes.size(), 1);
+    EXPECT_TRUE(routes[0] == route0.id);
+
+    // Replacing a network releases its topology.
+    nw1 = TransportNetwork{};
+    EXPECT_EQ(nw1.GetRoutesServingStation(station1.id).size(), 0);
+    ok = nw1.AddStation(station0);
+    EXPECT_TRUE(ok);
+}
+
+TEST(TransportNetworkTest, PassengerEvents_basic)
 {
     TransportNetwork nw{};
     bool ok{false};
@@ -324,14 +486,13 @@ TEST(TransportNetworkTest, DISABLED_PassengerEvents_basic)
     EXPECT_EQ(nw.GetPassengerCount(station2.id), -1);
 }
 
-TEST(TransportNetworkTest, DISABLED_GetRoutesServingStation_basic)
+TEST(TransportNetworkTest, PassengerFlow_windows)
 {
     TransportNetwork nw{};
     bool ok{false};
 
     // Add a line with 1 route.
     // route0: 0 ---> 1 ---> 2
-    // Plus a station served by no routes: 3.
     Station station0{
         "station_000",
         "Station Name 0",
@@ -344,10 +505,6 @@ TEST(TransportNetworkTest, DISABLED_GetRoutesServingStation_basic)
         "station_002",
         "Station Name 2",
     };
-    Station station3{
-        "station_003",
-        "Station Name 3",
-    };
     Route route0{
         "route_000",
         "inbound",
@@ -365,32 +522,78 @@ TEST(TransportNetworkTest, DISABLED_GetRoutesServingStation_basic)
     ok &= nw.AddStation(station0);
     ok &= nw.AddStation(station1);
     ok &= nw.AddStation(station2);
-    ok &= nw.AddStation(station3);
     ASSERT_TRUE(ok);
     ok = nw.AddLine(line);
     ASSERT_TRUE(ok);
 
-    // Check the routes served.
-    std::vector<Id> routes{};
-    routes = nw.GetRoutesServingStation(station0.id);
-    EXPECT_EQ(routes.size(), 1);
-    EXPECT_TRUE(routes[0] == route0.id);
-    routes = nw.GetRoutesServingStation(station1.id);
-    EXPECT_EQ(routes.size(), 1);
-    EXPECT_TRUE(routes[0] == route0.id);
-    routes = nw.GetRoutesServingStation(station2.id);
-    EXPECT_EQ(routes.size(), 1);
-    EXPECT_TRUE(routes[0] == route0.id);
-    routes = nw.GetRoutesServingStation(station3.id);
-    EXPECT_EQ(routes.size(), 0);
+    // Record events at different times, and query the flows as time goes by.
+    // We align the start time to the hour, so that the bucket boundaries are
+    // predictable.
+    using EventType = PassengerEvent::Type;
+    using namespace std::chrono;
+    const system_clock::time_point t0{hours{500000}};
+    ok = true;
+    ok &= nw.RecordPassengerEvent({station0.id, EventType::In, t0});
+    ok &= nw.RecordPassengerEvent({station0.id, EventType::In, t0 + seconds{30}});
+    ok &= nw.RecordPassengerEvent({station0.id, EventType::Out, t0 + seconds{30}});
+    ASSERT_TRUE(ok);
+
+    auto flow{nw.GetPassengerFlow(station0.id, FlowWindow::OneMinute, t0 + seconds{50})};
+    EXPECT_EQ(flow.in, 2);
+    EXPECT_EQ(flow.out, 1);
+    EXPECT_EQ(flow.Net(), 1);
+
+    ok = true;
+    ok &= nw.RecordPassengerEvent({station0.id, EventType::In, t0 + minutes{3}});
+    ok &= nw.RecordPassengerEvent({station1.id, EventType::Out, t0 + minutes{3}});
+    ASSERT_TRUE(ok);
+
+    // 1-minute window.
+    flow = nw.GetPassengerFlow(station0.id, FlowWindow::OneMinute, t0 + minutes{3} + seconds{5});
+    EXPECT_EQ(flow.in, 1);
+    EXPECT_EQ(flow.out, 0);
+
+    // 5-minute window.
+    flow = nw.GetPassengerFlow(station0.id, FlowWindow::FiveMinutes, t0 + minutes{3} + seconds{5});
+    EXPECT_EQ(flow.in, 3);
+    EXPECT_EQ(flow.out, 1);
+
+    // Line flows add up the flows of all the stations served by the line.
+    flow = nw.GetLinePassengerFlow(line.id, FlowWindow::FiveMinutes, t0 + minutes{4});
+    EXPECT_EQ(flow.in, 3);
+    EXPECT_EQ(flow.out, 2);
+    EXPECT_EQ(flow.Net(), 1);
+
+    ok = nw.RecordPassengerEvent({station0.id, EventType::In, t0 + minutes{30}});
+    ASSERT_TRUE(ok);
+    flow = nw.GetPassengerFlow(station0.id, FlowWindow::FiveMinutes, t0 + minutes{30});
+    EXPECT_EQ(flow.in, 1);
+    EXPECT_EQ(flow.out, 0);
+
+    // 1-hour window.
+    flow = nw.GetPassengerFlow(station0.id, FlowWindow::OneHour, t0 + minutes{30});
+    EXPECT_EQ(flow.in, 4);
+    EXPECT_EQ(flow.out, 1);
+    flow = nw.GetPassengerFlow(station0.id, FlowWindow::OneHour, t0 + minutes{64});
+    EXPECT_EQ(flow.in, 1);
+    EXPECT_EQ(flow.out, 0);
+
+    // Events without a timestamp only count towards the running count.
+    ok = nw.RecordPassengerEvent({station2.id, EventType::In});
+    ASSERT_TRUE(ok);
+    EXPECT_EQ(nw.GetPassengerCount(station2.id), 1);
+    EXPECT_EQ(nw.GetPassengerFlow(station2.id, FlowWindow::OneHour, t0 + minutes{30}).in, 0);
+
+    // Unknown stations and lines.
+    EXPECT_THROW(nw.GetPassengerFlow("station_042", FlowWindow::OneMinute, t0), std::runtime_error);
+    EXPECT_THROW(nw.GetLinePassengerFlow("line_042", FlowWindow::OneMinute, t0), std::runtime_error);
 }
 
-TEST(TransportNetworkTest, DISABLED_GetRoutesServingStation_lone_station)
+TEST(TransportNetworkTest, PassengerFlow_ring_reuse)
 {
     TransportNetwork nw{};
     bool ok{false};
 
-    // Add a single station.
     Station station0{
         "station_000",
         "Station Name 0",
@@ -398,18 +601,85 @@ TEST(TransportNetworkTest, DISABLED_GetRoutesServingStation_lone_station)
     ok = nw.AddStation(station0);
     ASSERT_TRUE(ok);
 
-    // Check the routes served.
-    auto routes{nw.GetRoutesServingStation(station0.id)};
-    EXPECT_EQ(routes.size(), 0);
+    // Events 1 hour apart land in the same buckets. Newer events replace the
+    // older ones, and late events for a recycled bucket are dropped.
+    using EventType = PassengerEvent::Type;
+    using namespace std::chrono;
+    const system_clock::time_point t0{hours{500000}};
+    ok = true;
+    ok &= nw.RecordPassengerEvent({station0.id, EventType::In, t0});
+    ok &= nw.RecordPassengerEvent({station0.id, EventType::In, t0 + hours{1}});
+    ok &= nw.RecordPassengerEvent({station0.id, EventType::In, t0});
+    ASSERT_TRUE(ok);
+    EXPECT_EQ(nw.GetPassengerCount(station0.id), 3);
+
+    auto flow{nw.GetPassengerFlow(station0.id, FlowWindow::OneMinute, t0 + hours{1})};
+    EXPECT_EQ(flow.in, 1);
+    flow = nw.GetPassengerFlow(station0.id, FlowWindow::OneHour, t0 + hours{1});
+    EXPECT_EQ(flow.in, 1);
+    flow = nw.GetPassengerFlow(station0.id, FlowWindow::OneHour, t0);
+    EXPECT_EQ(flow.in, 0);
 }
 
-TEST(TransportNetworkTest, DISABLED_TravelTime_basic)
+TEST(TransportNetworkTest, BusiestStations_basic)
 {
     TransportNetwork nw{};
-    bool ok{false};
+    bool ok{true};
+
+    // Add stations with no lines: Crowding does not depend on the topology.
+    const size_t nStations{10};
+    for(size_t idx{0}; idx < nStations; ++idx)
+    {
+        ok &= nw.AddStation({"station_00" + std::to_string(idx), "Station Name " + std::to_string(idx)});
+    }
+    ASSERT_TRUE(ok);
+
+    // Station N gets N passengers in.
+    using EventType = PassengerEvent::Type;
+    for(size_t idx{0}; idx < nStations; ++idx)
+    {
+        for(size_t passenger{0}; passenger < idx; ++passenger)
+        {
+            ok &= nw.RecordPassengerEvent({"station_00" + std::to_string(idx), EventType::In});
+        }
+    }
+    ASSERT_TRUE(ok);
+
+    auto busiest{nw.GetBusiestStations(3)};
+    ASSERT_EQ(busiest.size(), 3);
+    EXPECT_EQ(busiest[0].stationId, "station_009");
+    EXPECT_EQ(busiest[0].count, 9);
+    EXPECT_EQ(busiest[1].stationId, "station_008");
+    EXPECT_EQ(busiest[1].count, 8);
+    EXPECT_EQ(busiest[2].stationId, "station_007");
+    EXPECT_EQ(busiest[2].count, 7);
+
+    // The ranking follows the counts as they go down, too.
+    for(size_t passenger{0}; passenger < 9; ++passenger)
+    {
+        ok &= nw.RecordPassengerEvent({"station_009", EventType::Out});
+    }
+    ASSERT_TRUE(ok);
+    busiest = nw.GetBusiestStations(2);
+    ASSERT_EQ(busiest.size(), 2);
+    EXPECT_EQ(busiest[0].stationId, "station_008");
+    EXPECT_EQ(busiest[1].stationId, "station_007");
+
+    // We cannot get more stations than there are in the network.
+    busiest = nw.GetBusiestStations(100);
+    ASSERT_EQ(busiest.size(), nStations);
+    for(size_t idx{1}; idx < busiest.size(); ++idx)
+    {
+        EXPECT_GE(busiest[idx - 1].count, busiest[idx].count);
+    }
+    EXPECT_EQ(nw.GetBusiestStations(0).size(), 0);
+}
+
+TEST(TransportNetworkTest, CrowdingAlerts_hysteresis)
+{
+    TransportNetwork nw{};
+    bool ok{true};
 
-    // Add a line with 1 route.
-    // route0: 0 ---> 1 ---> 2
     Station station0{
         "station_000",
         "Station Name 0",
@@ -418,130 +688,823 @@ TEST(TransportNetworkTest, DISABLED_TravelTime_basic)
         "station_001",
         "Station Name 1",
     };
-    Station station2{
-        "station_002",
-        "Station Name 2",
-    };
-    Route route0{
-        "route_000",
-        "inbound",
-        "line_000",
-        "station_000",
-        "station_002",
-        {"station_000", "station_001", "station_002"},
-    };
-    Line line{
-        "line_000",
-        "Line Name",
-        {route0},
-    };
-    ok = true;
     ok &= nw.AddStation(station0);
     ok &= nw.AddStation(station1);
-    ok &= nw.AddStation(station2);
-    ASSERT_TRUE(ok);
-    ok = nw.AddLine(line);
     ASSERT_TRUE(ok);
 
-    unsigned int travelTime{0};
+    std::vector<std::pair<long long int, bool>> alerts{};
+    auto subscription{nw.SubscribeToCrowding(station0.id, 3, 1, [&alerts](const Id& station, auto count, auto crowded) {
+        EXPECT_EQ(station, "station_000");
+        alerts.emplace_back(count, crowded);
+    })};
+    ASSERT_NE(subscription, 0);
 
-    // Get travel time before setting it.
-    travelTime = nw.GetTravelTime(station0.id, station1.id);
-    EXPECT_EQ(travelTime, 0);
+    // Invalid subscriptions.
+    EXPECT_EQ(nw.SubscribeToCrowding("station_042", 3, 1, [](const Id&, auto, auto) {}), 0);
+    EXPECT_EQ(nw.SubscribeToCrowding(station0.id, 3, 3, [](const Id&, auto, auto) {}), 0);
 
-    // Cannot set the travel time between non-adjacent stations.
-    ok = nw.SetTravelTime(station0.id, station2.id, 1);
-    EXPECT_TRUE(!ok);
+    // Count: 1, 2, 3 (fires), 4, 3, 2, 3, 2, 1 (fires), 2, 3 (fires).
+    using EventType = PassengerEvent::Type;
+    for(auto type : {EventType::In,
+                     EventType::In,
+                     EventType::In,
+                     EventType::In,
+                     EventType::Out,
+                     EventType::Out,
+                     EventType::In,
+                     EventType::Out,
+                     EventType::Out,
+                     EventType::In,
+                     EventType::In})
+    {
+        ok &= nw.RecordPassengerEvent({station0.id, type});
+        ok &= nw.RecordPassengerEvent({station1.id, type});
+    }
+    ASSERT_TRUE(ok);
+    ASSERT_EQ(alerts.size(), 3);
+    EXPECT_EQ(alerts[0], std::make_pair(3LL, true));
+    EXPECT_EQ(alerts[1], std::make_pair(1LL, false));
+    EXPECT_EQ(alerts[2], std::make_pair(3LL, true));
 
-    // Set the travel time between adjacent stations.
-    ok = nw.SetTravelTime(station0.id, station1.id, 2);
+    // No more alerts once we unsubscribe.
+    ok = nw.UnsubscribeFromCrowding(subscription);
     EXPECT_TRUE(ok);
-    EXPECT_EQ(nw.GetTravelTime(station0.id, station1.id), 2);
+    ok = nw.UnsubscribeFromCrowding(subscription);
+    EXPECT_FALSE(ok);
+    for(size_t idx{0}; idx < 5; ++idx)
+    {
+        nw.RecordPassengerEvent({station0.id, EventType::Out});
+    }
+    EXPECT_EQ(alerts.size(), 3);
+}
 
-    // Set travel time between adjacend stations, even if they appear in the
-    // reverse order in the route.
-    ok = nw.SetTravelTime(station1.id, station0.id, 3);
-    EXPECT_TRUE(ok);
-    EXPECT_EQ(nw.GetTravelTime(station1.id, station0.id), 3);
+TEST(TransportNetworkTest, CrowdingAlerts_reentrant)
+{
+    TransportNetwork nw{};
+    ASSERT_TRUE(nw.AddStation({"station_000", "Station Name 0"}));
+    ASSERT_TRUE(nw.AddStation({"station_001", "Station Name 1"}));
+
+    // The first callback subscribes many times, which moves the
+    // subscriptions, and cancels the second subscription, whose alert fires
+    // for the same event.
+    std::vector<std::string> alerts{};
+    std::size_t second{0};
+    const auto first{nw.SubscribeToCrowding("station_000", 1, 0, [&](const Id&, auto, auto crowded) {
+        alerts.push_back(crowded ? "first" : "first cleared");
+        if(!crowded)
+        {
+            return;
+        }
+        for(size_t idx{0}; idx < 100; ++idx)
+        {
+            EXPECT_NE(nw.SubscribeToCrowding("station_001", 1, 0, [](const Id&, auto, auto) {}), 0);
+        }
+        EXPECT_TRUE(nw.UnsubscribeFromCrowding(second));
+    })};
+    second = nw.SubscribeToCrowding("station_000", 1, 0, [&alerts](const Id&, auto, auto) {
+        alerts.push_back("second");
+    });
+    ASSERT_NE(first, 0);
+    ASSERT_NE(second, 0);
+    ASSERT_TRUE(nw.RecordPassengerEvent({"station_000", PassengerEvent::Type::In}));
+    EXPECT_EQ(alerts, (std::vector<std::string>{"first", "second"}));
+
+    // The second subscription is gone for the next events.
+    ASSERT_TRUE(nw.RecordPassengerEvent({"station_000", PassengerEvent::Type::Out}));
+    EXPECT_EQ(alerts, (std::vector<std::string>{"first", "second", "first cleared"}));
+    EXPECT_TRUE(nw.UnsubscribeFromCrowding(first));
+
+    // Cancelled slots are reused, and the IDs of cancelled subscriptions do
+    // not match the subscriptions that reuse their slot.
+    const auto memory{nw.GetMemoryUsage().crowding};
+    auto subscription{nw.SubscribeToCrowding("station_000", 1, 0, [](const Id&, auto, auto) {})};
+    for(size_t idx{0}; idx < 1000; ++idx)
+    {
+        ASSERT_TRUE(nw.UnsubscribeFromCrowding(subscription));
+        const auto next{nw.SubscribeToCrowding("station_000", 1, 0, [](const Id&, auto, auto) {})};
+        ASSERT_NE(next, subscription);
+        EXPECT_FALSE(nw.UnsubscribeFromCrowding(subscription));
+        subscription = next;
+    }
+    EXPECT_EQ(nw.GetMemoryUsage().crowding, memory);
+}
+
+TEST(TransportNetworkTest, BusiestStations_concurrent)
+{
+    TransportNetwork nw{};
+    const size_t nStations{100};
+    for(size_t idx{0}; idx < nStations; ++idx)
+    {
+        ASSERT_TRUE(nw.AddStation({"station_" + std::to_string(idx), "Station Name " + std::to_string(idx)}));
+    }
+
+    // Station N gets N passengers in, from all threads, while we query.
+    const size_t nThreads{4};
+    std::vector<std::thread> threads{};
+    for(size_t thread{0}; thread < nThreads; ++thread)
+    {
+        threads.emplace_back([&nw]() {
+            for(size_t idx{0}; idx < nStations; ++idx)
+            {
+                for(size_t passenger{0}; passenger < idx; ++passenger)
+                {
+                    nw.RecordPassengerEvent({"station_" + std::to_string(idx), PassengerEvent::Type::In});
+                }
+            }
+        });
+    }
+    for(size_t query{0}; query < 100; ++query)
+    {
+        EXPECT_EQ(nw.GetBusiestStations(5).size(), 5);
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    const auto busiest{nw.GetBusiestStations(nStations)};
+    ASSERT_EQ(busiest.size(), nStations);
+    for(size_t idx{0}; idx < nStations; ++idx)
+    {
+        EXPECT_EQ(busiest[idx].stationId, "station_" + std::to_string(nStations - 1 - idx));
+        EXPECT_EQ(busiest[idx].count, static_cast<long long int>(nThreads * (nStations - 1 - idx)));
+    }
 }
 
-TEST(TransportNetworkTest, DISABLED_TravelTime_over_route)
+TEST(TransportNetworkTest, CrowdingAwareJourneys_basic)
 {
     TransportNetwork nw{};
     bool ok{false};
 
-    // Add a line with 3 routes.
-    // route0: 0 ---> 1 ---> 2 ---> 3
-    // route1: 3 ---> 1 ---> 2
-    // route2: 3 ---> 1 ---> 0
-    Station station0{
-        "station_000",
-        "Station Name 0",
-    };
-    Station station1{
-        "station_001",
-        "Station Name 1",
-    };
-    Station station2{
-        "station_002",
-        "Station Name 2",
-    };
-    Station station3{
-        "station_003",
-        "Station Name 3",
-    };
+    // Add 2 lines with 1 route each.
+    // route0: 0 ---> 1 ---> 3
+    // route1: 0 ---> 2 ---> 3
+    ok = true;
+    for(const auto* id : {"station_000", "station_001", "station_002", "station_003"})
+    {
+        ok &= nw.AddStation({id, "Station Name"});
+    }
+    ASSERT_TRUE(ok);
     Route route0{
         "route_000",
         "inbound",
         "line_000",
         "station_000",
         "station_003",
-        {"station_000", "station_001", "station_002", "station_003"},
+        {"station_000", "station_001", "station_003"},
     };
     Route route1{
         "route_001",
         "inbound",
-        "line_000",
-        "station_003",
-        "station_002",
-        {"station_003", "station_001", "station_002"},
-    };
-    Route route2{
-        "route_002",
-        "inbound",
-        "line_000",
-        "station_003",
+        "line_001",
         "station_000",
-        {"station_003", "station_001", "station_000"},
-    };
-    Line line{
-        "line_000",
-        "Line Name",
-        {route0, route1, route2},
+        "station_003",
+        {"station_000", "station_002", "station_003"},
     };
     ok = true;
-    ok &= nw.AddStation(station0);
-    ok &= nw.AddStation(station1);
-    ok &= nw.AddStation(station2);
-    ok &= nw.AddStation(station3);
-    ASSERT_TRUE(ok);
-    ok = nw.AddLine(line);
+    ok &= nw.AddLine({"line_000", "Line Name 0", {route0}});
+    ok &= nw.AddLine({"line_001", "Line Name 1", {route1}});
+    ok &= nw.SetTravelTime("station_000", "station_001", 1);
+    ok &= nw.SetTravelTime("station_001", "station_003", 1);
+    ok &= nw.SetTravelTime("station_000", "station_002", 2);
+    ok &= nw.SetTravelTime("station_002", "station_003", 2);
     ASSERT_TRUE(ok);
 
-    // Set all travel times.
-    ok = true;
-    ok &= nw.SetTravelTime(station0.id, station1.id, 1);
-    ok &= nw.SetTravelTime(station1.id, station2.id, 2);
-    ok &= nw.SetTravelTime(station2.id, station3.id, 3);
-    ok &= nw.SetTravelTime(station3.id, station1.id, 4);
-    ASSERT_TRUE(ok);
+    // Without crowding, the fastest journey comes first.
+    auto journeys{nw.GetCrowdingAwareJourneys("station_000", "station_003", 3)};
+    ASSERT_EQ(journeys.size(), 2);
+    EXPECT_EQ(journeys[0].stops, (std::vector<Id>{"station_000", "station_001", "station_003"}));
+    EXPECT_EQ(journeys[0].travelTime, 2);
+    EXPECT_EQ(journeys[0].cost, 2);
+    ASSERT_EQ(journeys[0].legs.size(), 1);
+    EXPECT_EQ(journeys[0].legs[0].lineId, "line_000");
+    EXPECT_EQ(journeys[0].legs[0].routeId, "route_000");
+    EXPECT_EQ(journeys[0].legs[0].startStationId, "station_000");
+    EXPECT_EQ(journeys[0].legs[0].endStationId, "station_003");
+    EXPECT_EQ(journeys[1].stops, (std::vector<Id>{"station_000", "station_002", "station_003"}));
+    EXPECT_EQ(journeys[1].cost, 4);
+    EXPECT_EQ(nw.GetCrowdingAwareJourneys("station_000", "station_003", 1).size(), 1);
 
-    // Check the cumulative travel times.
-    unsigned int travelTime{0};
-    // route0
-    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station0.id, station1.id), 1);
-    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station0.id, station2.id), 1 + 2);
-    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station0.id, station3.id), 1 + 2 + 3);
+    // 5 passengers above the threshold of station 1 cost 5 minutes.
+    CrowdingRoutingOptions options{};
+    options.threshold = 5;
+    options.minutesPerPassenger = 1.0;
+    nw.SetCrowdingRoutingOptions(options);
+    for(size_t idx{0}; idx < 10; ++idx)
+    {
+        ASSERT_TRUE(nw.RecordPassengerEvent({"station_001", PassengerEvent::Type::In}));
+    }
+    journeys = nw.GetCrowdingAwareJourneys("station_000", "station_003", 2);
+    ASSERT_EQ(journeys.size(), 2);
+    EXPECT_EQ(journeys[0].stops, (std::vector<Id>{"station_000", "station_002", "station_003"}));
+    EXPECT_EQ(journeys[0].cost, 4);
+    EXPECT_EQ(journeys[1].stops, (std::vector<Id>{"station_000", "station_001", "station_003"}));
+    EXPECT_EQ(journeys[1].travelTime, 2);
+    EXPECT_EQ(journeys[1].cost, 1 + 5 + 1);
+
+    // The penalty follows the passenger count.
+    for(size_t idx{0}; idx < 10; ++idx)
+    {
+        ASSERT_TRUE(nw.RecordPassengerEvent({"station_001", PassengerEvent::Type::Out}));
+    }
+    journeys = nw.GetCrowdingAwareJourneys("station_000", "station_003", 1);
+    ASSERT_EQ(journeys.size(), 1);
+    EXPECT_EQ(journeys[0].stops, (std::vector<Id>{"station_000", "station_001", "station_003"}));
+
+    // No journeys to the same station, against the routes, or to a station that
+    // is not in the network.
+    EXPECT_TRUE(nw.GetCrowdingAwareJourneys("station_000", "station_000", 1).empty());
+    EXPECT_TRUE(nw.GetCrowdingAwareJourneys("station_003", "station_000", 1).empty());
+    EXPECT_TRUE(nw.GetCrowdingAwareJourneys("station_000", "station_missing", 1).empty());
+}
+
+TEST(TransportNetworkTest, CrowdingAwareJourneys_interchange)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // Add 3 lines with 1 route each.
+    // route0: 0 ---> 1
+    // route1:        1 ---> 2
+    // route2: 0 ----------> 2
+    ok = true;
+    for(const auto* id : {"station_000", "station_001", "station_002"})
+    {
+        ok &= nw.AddStation({id, "Station Name"});
+    }
+    ASSERT_TRUE(ok);
+    Route route0{"route_000", "inbound", "line_000", "station_000", "station_001", {"station_000", "station_001"}};
+    Route route1{"route_001", "inbound", "line_001", "station_001", "station_002", {"station_001", "station_002"}};
+    Route route2{"route_002", "inbound", "line_002", "station_000", "station_002", {"station_000", "station_002"}};
+    ok = true;
+    ok &= nw.AddLine({"line_000", "Line Name 0", {route0}});
+    ok &= nw.AddLine({"line_001", "Line Name 1", {route1}});
+    ok &= nw.AddLine({"line_002", "Line Name 2", {route2}});
+    ok &= nw.SetTravelTime("station_000", "station_001", 1);
+    ok &= nw.SetTravelTime("station_001", "station_002", 1);
+    ok &= nw.SetTravelTime("station_000", "station_002", 3);
+    ASSERT_TRUE(ok);
+
+    auto journeys{nw.GetCrowdingAwareJourneys("station_000", "station_002", 1)};
+    ASSERT_EQ(journeys.size(), 1);
+    ASSERT_EQ(journeys[0].legs.size(), 2);
+    EXPECT_EQ(journeys[0].legs[0].routeId, "route_000");
+    EXPECT_EQ(journeys[0].legs[0].endStationId, "station_001");
+    EXPECT_EQ(journeys[0].legs[1].routeId, "route_001");
+    EXPECT_EQ(journeys[0].legs[1].startStationId, "station_001");
+    EXPECT_EQ(journeys[0].cost, 2);
+
+    // Changing at a crowded station 1 is now slower than the direct route.
+    CrowdingRoutingOptions options{};
+    options.interchangePenalty = 5;
+    nw.SetCrowdingRoutingOptions(options);
+    ASSERT_TRUE(nw.RecordPassengerEvent({"station_001", PassengerEvent::Type::In}));
+    journeys = nw.GetCrowdingAwareJourneys("station_000", "station_002", 2);
+    ASSERT_EQ(journeys.size(), 2);
+    EXPECT_EQ(journeys[0].stops, (std::vector<Id>{"station_000", "station_002"}));
+    EXPECT_EQ(journeys[0].cost, 3);
+    EXPECT_EQ(journeys[1].stops, (std::vector<Id>{"station_000", "station_001", "station_002"}));
+    EXPECT_EQ(journeys[1].cost, 1 + 1 + 5);
+}
+
+TEST(TransportNetworkTest, CrowdingAwareJourneys_concurrent)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // Add 2 lines with 1 route each.
+    // route0: 0 ---> 1 ---> 3
+    // route1: 0 ---> 2 ---> 3
+    ok = true;
+    for(const auto* id : {"station_000", "station_001", "station_002", "station_003"})
+    {
+        ok &= nw.AddStation({id, "Station Name"});
+    }
+    ASSERT_TRUE(ok);
+    ok = true;
+    ok &= nw.AddLine({"line_000",
+                      "Line Name 0",
+                      {{"route_000", "inbound", "line_000", "station_000", "station_003",
+                        {"station_000", "station_001", "station_003"}}}});
+    ok &= nw.AddLine({"line_001",
+                      "Line Name 1",
+                      {{"route_001", "inbound", "line_001", "station_000", "station_003",
+                        {"station_000", "station_002", "station_003"}}}});
+    ok &= nw.SetTravelTime("station_000", "station_001", 1);
+    ok &= nw.SetTravelTime("station_001", "station_003", 1);
+    ok &= nw.SetTravelTime("station_000", "station_002", 2);
+    ok &= nw.SetTravelTime("station_002", "station_003", 2);
+    ASSERT_TRUE(ok);
+
+    // Station 1 gets passengers in from all threads while we query. The
+    // queries must not lose the last change of the count: Only the last
+    // passenger makes station 1 crowded.
+    const size_t nThreads{4};
+    const size_t nPassengers{10};
+    CrowdingRoutingOptions options{};
+    options.threshold = nThreads * nPassengers - 1;
+    options.minutesPerPassenger = 1.0;
+    nw.SetCrowdingRoutingOptions(options);
+    std::vector<std::thread> threads{};
+    for(size_t thread{0}; thread < nThreads; ++thread)
+    {
+        threads.emplace_back([&nw]() {
+            for(size_t passenger{0}; passenger < nPassengers; ++passenger)
+            {
+                nw.RecordPassengerEvent({"station_001", PassengerEvent::Type::In});
+            }
+        });
+    }
+    for(size_t query{0}; query < 100; ++query)
+    {
+        EXPECT_EQ(nw.GetCrowdingAwareJourneys("station_000", "station_003", 1).size(), 1);
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    const auto journeys{nw.GetCrowdingAwareJourneys("station_000", "station_003", 1)};
+    ASSERT_EQ(journeys.size(), 1);
+    EXPECT_EQ(journeys[0].stops, (std::vector<Id>{"station_000", "station_001", "station_003"}));
+    EXPECT_EQ(journeys[0].cost, 1 + 1 + 1);
+}
+
+TEST(TransportNetworkTest, GetReachableStations_basic)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // Add 2 lines with 1 route each.
+    // route0: 0 ---> 1 ---> 3
+    // route1: 0 ---> 2 ---> 3
+    ok = true;
+    for(const auto* id : {"station_000", "station_001", "station_002", "station_003"})
+    {
+        ok &= nw.AddStation({id, "Station Name"});
+    }
+    ASSERT_TRUE(ok);
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_003",
+        {"station_000", "station_001", "station_003"},
+    };
+    Route route1{
+        "route_001",
+        "inbound",
+        "line_001",
+        "station_000",
+        "station_003",
+        {"station_000", "station_002", "station_003"},
+    };
+    ok = true;
+    ok &= nw.AddLine({"line_000", "Line Name 0", {route0}});
+    ok &= nw.AddLine({"line_001", "Line Name 1", {route1}});
+    ok &= nw.SetTravelTime("station_000", "station_001", 1);
+    ok &= nw.SetTravelTime("station_001", "station_003", 1);
+    ok &= nw.SetTravelTime("station_000", "station_002", 2);
+    ok &= nw.SetTravelTime("station_002", "station_003", 2);
+    ASSERT_TRUE(ok);
+
+    const auto toPairs{[](const std::vector<ReachableStation>& reached) {
+        std::vector<std::pair<Id, unsigned int>> pairs{};
+        for(const auto& station : reached)
+        {
+            pairs.emplace_back(station.stationId, station.travelTime);
+        }
+        return pairs;
+    }};
+    using Pairs = std::vector<std::pair<Id, unsigned int>>;
+
+    // Each station at its shortest travel time, sorted by travel time.
+    EXPECT_EQ(toPairs(nw.GetReachableStations("station_000", 2)),
+              (Pairs{{"station_000", 0}, {"station_001", 1}, {"station_002", 2}, {"station_003", 2}}));
+    EXPECT_EQ(toPairs(nw.GetReachableStations("station_000", 1)), (Pairs{{"station_000", 0}, {"station_001", 1}}));
+    EXPECT_EQ(toPairs(nw.GetReachableStations("station_000", 0)), (Pairs{{"station_000", 0}}));
+
+    // Only along the routes.
+    EXPECT_EQ(toPairs(nw.GetReachableStations("station_003", 10)), (Pairs{{"station_003", 0}}));
+    EXPECT_TRUE(nw.GetReachableStations("station_missing", 10).empty());
+
+    // Several seeds, some with a head start.
+    std::vector<ReachabilitySeed> seeds{{"station_000", 1}, {"station_002", 0}};
+    EXPECT_EQ(toPairs(nw.GetReachableStations(seeds, 3)),
+              (Pairs{{"station_002", 0}, {"station_000", 1}, {"station_001", 2}, {"station_003", 2}}));
+    seeds = {{"station_000", 5}, {"station_missing", 0}, {"station_001", 0}};
+    EXPECT_EQ(toPairs(nw.GetReachableStations(seeds, 3)), (Pairs{{"station_001", 0}, {"station_003", 1}}));
+    EXPECT_TRUE(nw.GetReachableStations(std::vector<ReachabilitySeed>{}, 3).empty());
+
+    // The travel times follow SetTravelTime.
+    ASSERT_TRUE(nw.SetTravelTime("station_001", "station_003", 5));
+    EXPECT_EQ(toPairs(nw.GetReachableStations("station_000", 4)),
+              (Pairs{{"station_000", 0}, {"station_001", 1}, {"station_002", 2}, {"station_003", 4}}));
+}
+
+TEST(TransportNetworkTest, GetReachableStations_generated)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 500;
+    options.nLines = 20;
+    options.routesPerLine = 2;
+    options.routeLength = 20;
+    options.interchangeDensity = 0.3;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+    ASSERT_TRUE(nw.AddLines(layout.lines));
+    for(const auto& travelTime : layout.travelTimes)
+    {
+        ASSERT_TRUE(nw.SetTravelTime(travelTime.startStationId, travelTime.endStationId, travelTime.travelTime));
+    }
+
+    // Without crowding, the cheapest journey takes the shortest travel time.
+    for(size_t idx{0}; idx < 10; ++idx)
+    {
+        const auto& from{layout.stations[idx * 37].id};
+        const auto reached{nw.GetReachableStations(from, 30)};
+        ASSERT_FALSE(reached.empty());
+        EXPECT_EQ(reached.front().stationId, from);
+        for(size_t stationIdx{1}; stationIdx < reached.size(); ++stationIdx)
+        {
+            const auto& station{reached[stationIdx]};
+            EXPECT_LE(reached[stationIdx - 1].travelTime, station.travelTime);
+            const auto journeys{nw.GetCrowdingAwareJourneys(from, station.stationId, 1)};
+            ASSERT_EQ(journeys.size(), 1);
+            EXPECT_EQ(journeys[0].travelTime, station.travelTime);
+        }
+
+        // The scratch space left by the previous query does not leak into the
+        // next one.
+        const auto again{nw.GetReachableStations(from, 15)};
+        ASSERT_LE(again.size(), reached.size());
+        for(size_t stationIdx{0}; stationIdx < again.size(); ++stationIdx)
+        {
+            EXPECT_EQ(again[stationIdx].stationId, reached[stationIdx].stationId);
+            EXPECT_EQ(again[stationIdx].travelTime, reached[stationIdx].travelTime);
+        }
+        EXPECT_TRUE(again.size() == reached.size() || reached[again.size()].travelTime > 15);
+    }
+}
+
+TEST(TransportNetworkTest, GetRoutesServingStation_basic)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // Add a line with 1 route.
+    // route0: 0 ---> 1 ---> 2
+    // Plus a station served by no routes: 3.
+    Station station0{
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1{
+        "station_001",
+        "Station Name 1",
+    };
+    Station station2{
+        "station_002",
+        "Station Name 2",
+    };
+    Station station3{
+        "station_003",
+        "Station Name 3",
+    };
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    Line line{
+        "line_000",
+        "Line Name",
+        {route0},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ok &= nw.AddStation(station2);
+    ok &= nw.AddStation(station3);
+    ASSERT_TRUE(ok);
+    ok = nw.AddLine(line);
+    ASSERT_TRUE(ok);
+
+    // Check the routes served.
+    RouteIdView routes{};
+    routes = nw.GetRoutesServingStation(station0.id);
+    EXPECT_EQ(routes.size(), 1);
+    EXPECT_TRUE(routes[0] == route0.id);
+    routes = nw.GetRoutesServingStation(station1.id);
+    EXPECT_EQ(routes.size(), 1);
+    EXPECT_TRUE(routes[0] == route0.id);
+    routes = nw.GetRoutesServingStation(station2.id);
+    EXPECT_EQ(routes.size(), 1);
+    EXPECT_TRUE(routes[0] == route0.id);
+    routes = nw.GetRoutesServingStation(station3.id);
+    EXPECT_EQ(routes.size(), 0);
+}
+
+TEST(TransportNetworkTest, GetRoutesServingStation_lone_station)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // Add a single station.
+    Station station0{
+        "station_000",
+        "Station Name 0",
+    };
+    ok = nw.AddStation(station0);
+    ASSERT_TRUE(ok);
+
+    // Check the routes served.
+    auto routes{nw.GetRoutesServingStation(station0.id)};
+    EXPECT_EQ(routes.size(), 0);
+}
+
+TEST(TransportNetworkTest, GetRoutesServingStation_terminal_stations)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // Add a line with 2 routes, and a second line ending on a shared terminal.
+    // line0/route0: 0 ---> 1 ---> 2
+    // line0/route1: 2 ---> 1 ---> 0
+    // line1/route2: 3 ---> 2
+    Station station0{
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1{
+        "station_001",
+        "Station Name 1",
+    };
+    Station station2{
+        "station_002",
+        "Station Name 2",
+    };
+    Station station3{
+        "station_003",
+        "Station Name 3",
+    };
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    Route route1{
+        "route_001",
+        "outbound",
+        "line_000",
+        "station_002",
+        "station_000",
+        {"station_002", "station_001", "station_000"},
+    };
+    Route route2{
+        "route_002",
+        "inbound",
+        "line_001",
+        "station_003",
+        "station_002",
+        {"station_003", "station_002"},
+    };
+    Line line0{
+        "line_000",
+        "Line Name 0",
+        {route0, route1},
+    };
+    Line line1{
+        "line_001",
+        "Line Name 1",
+        {route2},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ok &= nw.AddStation(station2);
+    ok &= nw.AddStation(station3);
+    ASSERT_TRUE(ok);
+    ok = true;
+    ok &= nw.AddLine(line0);
+    ok &= nw.AddLine(line1);
+    ASSERT_TRUE(ok);
+
+    // Routes are listed in insertion order, terminal stops included.
+    auto routes{nw.GetRoutesServingStation(station2.id)};
+    ASSERT_EQ(routes.size(), 3);
+    EXPECT_TRUE(routes[0] == route0.id);
+    EXPECT_TRUE(routes[1] == route1.id);
+    EXPECT_TRUE(routes[2] == route2.id);
+    routes = nw.GetRoutesServingStation(station3.id);
+    ASSERT_EQ(routes.size(), 1);
+    EXPECT_TRUE(routes[0] == route2.id);
+
+    // Unknown stations have no routes.
+    routes = nw.GetRoutesServingStation("station_042");
+    EXPECT_TRUE(routes.empty());
+}
+
+TEST(TransportNetworkTest, GetRoutesServingStation_failed_line)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // A line that fails to be added must not show up in the index, even if
+    // some of its routes were valid.
+    // route0: 0 ---> 1
+    // route1: 1 ---> 2 (station 2 is missing)
+    Station station0{
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1{
+        "station_001",
+        "Station Name 1",
+    };
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_001",
+        {"station_000", "station_001"},
+    };
+    Route route1{
+        "route_001",
+        "inbound",
+        "line_000",
+        "station_001",
+        "station_002",
+        {"station_001", "station_002"},
+    };
+    Line line{
+        "line_000",
+        "Line Name",
+        {route0, route1},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ASSERT_TRUE(ok);
+    ok = nw.AddLine(line);
+    ASSERT_FALSE(ok);
+
+    EXPECT_EQ(nw.GetRoutesServingStation(station0.id).size(), 0);
+    EXPECT_EQ(nw.GetRoutesServingStation(station1.id).size(), 0);
+}
+
+TEST(TransportNetworkTest, TravelTime_basic)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // Add a line with 1 route.
+    // route0: 0 ---> 1 ---> 2
+    Station station0{
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1{
+        "station_001",
+        "Station Name 1",
+    };
+    Station station2{
+        "station_002",
+        "Station Name 2",
+    };
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    Line line{
+        "line_000",
+        "Line Name",
+        {route0},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ok &= nw.AddStation(station2);
+    ASSERT_TRUE(ok);
+    ok = nw.AddLine(line);
+    ASSERT_TRUE(ok);
+
+    unsigned int travelTime{0};
+
+    // Get travel time before setting it.
+    travelTime = nw.GetTravelTime(station0.id, station1.id);
+    EXPECT_EQ(travelTime, 0);
+
+    // Cannot set the travel time between non-adjacent stations.
+    ok = nw.SetTravelTime(station0.id, station2.id, 1);
+    EXPECT_TRUE(!ok);
+
+    // Set the travel time between adjacent stations.
+    ok = nw.SetTravelTime(station0.id, station1.id, 2);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(nw.GetTravelTime(station0.id, station1.id), 2);
+
+    // Set travel time between adjacend stations, even if they appear in the
+    // reverse order in the route.
+    ok = nw.SetTravelTime(station1.id, station0.id, 3);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(nw.GetTravelTime(station1.id, station0.id), 3);
+}
+
+TEST(TransportNetworkTest, TravelTime_over_route)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // Add a line with 3 routes.
+    // route0: 0 ---> 1 ---> 2 ---> 3
+    // route1: 3 ---> 1 ---> 2
+    // route2: 3 ---> 1 ---> 0
+    Station station0{
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1{
+        "station_001",
+        "Station Name 1",
+    };
+    Station station2{
+        "station_002",
+        "Station Name 2",
+    };
+    Station station3{
+        "station_003",
+        "Station Name 3",
+    };
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_003",
+        {"station_000", "station_001", "station_002", "station_003"},
+    };
+    Route route1{
+        "route_001",
+        "inbound",
+        "line_000",
+        "station_003",
+        "station_002",
+        {"station_003", "station_001", "station_002"},
+    };
+    Route route2{
+        "route_002",
+        "inbound",
+        "line_000",
+        "station_003",
+        "station_000",
+        {"station_003", "station_001", "station_000"},
+    };
+    Line line{
+        "line_000",
+        "Line Name",
+        {route0, route1, route2},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ok &= nw.AddStation(station2);
+    ok &= nw.AddStation(station3);
+    ASSERT_TRUE(ok);
+    ok = nw.AddLine(line);
+    ASSERT_TRUE(ok);
+
+    // Set all travel times.
+    ok = true;
+    ok &= nw.SetTravelTime(station0.id, station1.id, 1);
+    ok &= nw.SetTravelTime(station1.id, station2.id, 2);
+    ok &= nw.SetTravelTime(station2.id, station3.id, 3);
+    ok &= nw.SetTravelTime(station3.id, station1.id, 4);
+    ASSERT_TRUE(ok);
+
+    // Check the cumulative travel times.
+    unsigned int travelTime{0};
+    // route0
+    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station0.id, station1.id), 1);
+    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station0.id, station2.id), 1 + 2);
+    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station0.id, station3.id), 1 + 2 + 3);
     EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station1.id, station3.id), 2 + 3);
     // route1
     EXPECT_EQ(nw.GetTravelTime(line.id, route1.id, station3.id, station1.id), 4);
@@ -556,3 +1519,898 @@ TEST(TransportNetworkTest, DISABLED_TravelTime_over_route)
     EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station1.id, station0.id), 0);
     EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station1.id, station1.id), 0);
 }
+
+TEST(TransportNetworkTest, TravelTime_batch)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 2000;
+    options.nLines = 100;
+    options.routesPerLine = 4;
+    options.routeLength = 30;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+    ASSERT_TRUE(nw.AddLines(layout.lines));
+    for(const auto& travelTime : layout.travelTimes)
+    {
+        ASSERT_TRUE(nw.SetTravelTime(travelTime.startStationId, travelTime.endStationId, travelTime.travelTime));
+    }
+
+    // Ask for every pair of adjacent stops, every stretch of a route starting at
+    // its first stop, and a few invalid queries.
+    std::vector<TravelTimeQuery> queries{};
+    std::vector<RouteTravelTimeQuery> routeQueries{};
+    const Id missing{"station_missing"};
+    for(const auto& line : layout.lines)
+    {
+        for(const auto& route : line.routes)
+        {
+            for(size_t idx{0}; idx < route.stops.size(); ++idx)
+            {
+                routeQueries.push_back({line.id, route.id, route.stops.front(), route.stops[idx]});
+                routeQueries.push_back({line.id, route.id, route.stops[idx], route.stops.front()});
+                if(idx > 0)
+                {
+                    queries.push_back({route.stops[idx - 1], route.stops[idx]});
+                }
+            }
+        }
+    }
+    queries.push_back({layout.stations.front().id, missing});
+    routeQueries.push_back({layout.lines.front().id, "route_missing", missing, missing});
+
+    std::vector<unsigned int> travelTimes(queries.size());
+    nw.GetTravelTimes(queries.data(), queries.size(), travelTimes.data(), 4);
+    for(size_t idx{0}; idx < queries.size(); ++idx)
+    {
+        const auto& query{queries[idx]};
+        ASSERT_EQ(travelTimes[idx], nw.GetTravelTime(Id{query.stationA}, Id{query.stationB}));
+    }
+    EXPECT_GT(travelTimes.front(), 0);
+    EXPECT_EQ(travelTimes.back(), 0);
+
+    std::vector<unsigned int> routeTravelTimes(routeQueries.size());
+    nw.GetTravelTimes(routeQueries.data(), routeQueries.size(), routeTravelTimes.data(), 4);
+    for(size_t idx{0}; idx < routeQueries.size(); ++idx)
+    {
+        const auto& query{routeQueries[idx]};
+        ASSERT_EQ(routeTravelTimes[idx],
+                  nw.GetTravelTime(Id{query.line}, Id{query.route}, Id{query.stationA}, Id{query.stationB}));
+    }
+    EXPECT_EQ(routeTravelTimes.back(), 0);
+
+    // The full route is the sum of its stretches.
+    const auto& route{layout.lines.front().routes.front()};
+    unsigned int total{0};
+    for(size_t idx{1}; idx < route.stops.size(); ++idx)
+    {
+        total += nw.GetTravelTime(route.stops[idx - 1], route.stops[idx]);
+    }
+    EXPECT_EQ(routeTravelTimes[2 * (route.stops.size() - 1)], total);
+}
+
+TEST(TransportNetworkTest, TravelTimeProfile_basic)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // Add a line with 1 route.
+    // route0: 0 ---> 1 ---> 2
+    Station station0{
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1{
+        "station_001",
+        "Station Name 1",
+    };
+    Station station2{
+        "station_002",
+        "Station Name 2",
+    };
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    Line line{
+        "line_000",
+        "Line Name",
+        {route0},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ok &= nw.AddStation(station2);
+    ASSERT_TRUE(ok);
+    ok = nw.AddLine(line);
+    ASSERT_TRUE(ok);
+    ok = nw.SetTravelTime(station0.id, station1.id, 2);
+    ASSERT_TRUE(ok);
+
+    // Peak from 07:00 to 10:00, off-peak otherwise.
+    using std::chrono::hours;
+    TravelTimeProfile profile{{{hours{7}, 5}, {hours{10}, 3}}};
+    const std::chrono::system_clock::time_point day{hours{24 * 20000}};
+
+    // Cannot set a profile between non-adjacent stations, or a malformed one.
+    EXPECT_FALSE(nw.SetTravelTimeProfile(station0.id, station2.id, profile));
+    EXPECT_FALSE(nw.SetTravelTimeProfile(station0.id, station1.id, TravelTimeProfile{}));
+    EXPECT_FALSE(nw.SetTravelTimeProfile(
+        station0.id, station1.id, TravelTimeProfile{{{hours{10}, 3}, {hours{7}, 5}}}));
+    EXPECT_FALSE(nw.SetTravelTimeProfile(station0.id, station1.id, TravelTimeProfile{{{hours{24}, 3}}}));
+
+    // Without a profile, the static travel time holds all day.
+    EXPECT_EQ(nw.GetTravelTime(station0.id, station1.id, day + hours{8}), 2);
+
+    ok = nw.SetTravelTimeProfile(station1.id, station0.id, profile);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(nw.GetTravelTime(station0.id, station1.id, day + hours{7}), 5);
+    EXPECT_EQ(nw.GetTravelTime(station0.id, station1.id, day + hours{9} + std::chrono::minutes{59}), 5);
+    EXPECT_EQ(nw.GetTravelTime(station0.id, station1.id, day + hours{10}), 3);
+    EXPECT_EQ(nw.GetTravelTime(station1.id, station0.id, day + hours{23}), 3);
+
+    // Before the first step, the last step of the previous day holds.
+    EXPECT_EQ(nw.GetTravelTime(station0.id, station1.id, day + hours{3}), 3);
+
+    // The static travel time is unchanged.
+    EXPECT_EQ(nw.GetTravelTime(station0.id, station1.id), 2);
+    EXPECT_EQ(nw.GetTravelTime(station1.id, station2.id, day + hours{8}), 0);
+
+    // A static travel time replaces the profile.
+    ok = nw.SetTravelTime(station0.id, station1.id, 4);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(nw.GetTravelTime(station0.id, station1.id, day + hours{8}), 4);
+}
+
+TEST(TransportNetworkTest, TravelTimeProfile_over_route)
+{
+    TransportNetwork nw{};
+    bool ok{false};
+
+    // Add a line with 1 route.
+    // route0: 0 ---> 1 ---> 2 ---> 3
+    Station station0{
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1{
+        "station_001",
+        "Station Name 1",
+    };
+    Station station2{
+        "station_002",
+        "Station Name 2",
+    };
+    Station station3{
+        "station_003",
+        "Station Name 3",
+    };
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_003",
+        {"station_000", "station_001", "station_002", "station_003"},
+    };
+    Line line{
+        "line_000",
+        "Line Name",
+        {route0},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ok &= nw.AddStation(station2);
+    ok &= nw.AddStation(station3);
+    ASSERT_TRUE(ok);
+    ok = nw.AddLine(line);
+    ASSERT_TRUE(ok);
+
+    // Each leg takes 10 minutes, and 20 minutes from 08:00.
+    using std::chrono::hours;
+    using std::chrono::minutes;
+    const TravelTimeProfile profile{{{hours{0}, 10}, {hours{8}, 20}}};
+    ok = true;
+    ok &= nw.SetTravelTimeProfile(station0.id, station1.id, profile);
+    ok &= nw.SetTravelTimeProfile(station1.id, station2.id, profile);
+    ok &= nw.SetTravelTimeProfile(station2.id, station3.id, profile);
+    ASSERT_TRUE(ok);
+
+    // Leaving at 07:45, we reach station 2 at 08:05: The last leg is slower.
+    const std::chrono::system_clock::time_point day{hours{24 * 20000}};
+    const auto departure{day + hours{7} + minutes{45}};
+    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station0.id, station3.id, departure), 10 + 10 + 20);
+    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station0.id, station3.id, day + hours{8}), 20 + 20 + 20);
+    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station1.id, station3.id, departure), 10 + 10);
+    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station3.id, station0.id, departure), 0);
+
+    // The clock wraps around midnight: Leaving at 23:45, the first leg is
+    // still slow.
+    EXPECT_EQ(nw.GetTravelTime(line.id, route0.id, station0.id, station3.id, day - minutes{15}), 20 + 10 + 10);
+
+    // Batch queries with and without a departure time.
+    const std::vector<RouteTravelTimeQuery> queries{
+        {line.id, route0.id, station0.id, station3.id, departure},
+        {line.id, route0.id, station0.id, station3.id},
+    };
+    std::vector<unsigned int> travelTimes(queries.size());
+    nw.GetTravelTimes(queries.data(), queries.size(), travelTimes.data(), 1);
+    EXPECT_EQ(travelTimes[0], 10 + 10 + 20);
+    EXPECT_EQ(travelTimes[1], 0);
+    const std::vector<TravelTimeQuery> adjacentQueries{
+        {station2.id, station3.id, day + hours{8}},
+        {station2.id, station3.id, day + hours{7}},
+    };
+    nw.GetTravelTimes(adjacentQueries.data(), adjacentQueries.size(), travelTimes.data(), 1);
+    EXPECT_EQ(travelTimes[0], 20);
+    EXPECT_EQ(travelTimes[1], 10);
+}
+
+TEST(TransportNetworkTest, TravelTimeProfile_deduplicated)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 2000;
+    options.nLines = 100;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+    ASSERT_TRUE(nw.AddLines(layout.lines));
+
+    // The same 2 profiles on every station pair take as much memory as on a
+    // single pair.
+    using std::chrono::hours;
+    const TravelTimeProfile peak{{{hours{7}, 5}, {hours{10}, 3}, {hours{17}, 5}, {hours{19}, 3}}};
+    const TravelTimeProfile flat{{{hours{0}, 4}}};
+    const auto& first{layout.travelTimes.front()};
+    ASSERT_TRUE(nw.SetTravelTimeProfile(first.startStationId, first.endStationId, peak));
+    ASSERT_TRUE(nw.SetTravelTimeProfile(first.startStationId, first.endStationId, flat));
+    const auto usage{nw.GetMemoryUsage().travelTimeProfiles};
+    EXPECT_GT(usage, 0);
+    for(size_t idx{0}; idx < layout.travelTimes.size(); ++idx)
+    {
+        const auto& travelTime{layout.travelTimes[idx]};
+        ASSERT_TRUE(nw.SetTravelTimeProfile(
+            travelTime.startStationId, travelTime.endStationId, idx % 2 == 0 ? peak : flat));
+    }
+    EXPECT_EQ(nw.GetMemoryUsage().travelTimeProfiles, usage);
+
+    const std::chrono::system_clock::time_point eight{hours{8}};
+    const auto& second{layout.travelTimes[1]};
+    EXPECT_EQ(nw.GetTravelTime(first.startStationId, first.endStationId, eight), 5);
+    EXPECT_EQ(nw.GetTravelTime(second.startStationId, second.endStationId, eight), 4);
+}
+
+TEST(TransportNetworkTest, QueryCache_basic)
+{
+    TransportNetwork nw{};
+    QueryCacheOptions cacheOptions{};
+    cacheOptions.capacity = 100;
+    nw.SetQueryCacheOptions(cacheOptions);
+
+    // route0: 0 ---> 1 ---> 2
+    ASSERT_TRUE(nw.AddStation({"station_000", "Station Name 0"}));
+    ASSERT_TRUE(nw.AddStation({"station_001", "Station Name 1"}));
+    ASSERT_TRUE(nw.AddStation({"station_002", "Station Name 2"}));
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    ASSERT_TRUE(nw.AddLine({"line_000", "Line Name", {route0}}));
+    ASSERT_TRUE(nw.SetTravelTime("station_000", "station_001", 1));
+    ASSERT_TRUE(nw.SetTravelTime("station_001", "station_002", 2));
+
+    const Id line{"line_000"};
+    const Id route{"route_000"};
+    EXPECT_EQ(nw.GetTravelTime(line, route, "station_000", "station_002"), 3);
+    EXPECT_EQ(nw.GetTravelTime(line, route, "station_000", "station_002"), 3);
+    EXPECT_EQ(nw.GetTravelTime(line, route, "station_001", "station_002"), 2);
+    auto stats{nw.GetQueryCacheStats()};
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 2);
+    EXPECT_EQ(stats.entries, 2);
+    EXPECT_GE(stats.capacity, 100);
+    EXPECT_EQ(nw.GetMemoryUsage().queryCache, stats.memory);
+
+    // Unknown IDs, adjacent station queries and queries with a departure time
+    // bypass the cache.
+    EXPECT_EQ(nw.GetTravelTime(line, "route_missing", "station_000", "station_002"), 0);
+    EXPECT_EQ(nw.GetTravelTime(line, route, "station_000", "station_missing"), 0);
+    EXPECT_EQ(nw.GetTravelTime("station_000", "station_001"), 1);
+    const std::chrono::system_clock::time_point eight{std::chrono::hours{8}};
+    EXPECT_EQ(nw.GetTravelTime(line, route, "station_000", "station_002", eight), 3);
+    stats = nw.GetQueryCacheStats();
+    EXPECT_EQ(stats.hits + stats.misses, 3);
+
+    // Changing a travel time invalidates the cached answers.
+    ASSERT_TRUE(nw.SetTravelTime("station_001", "station_002", 5));
+    EXPECT_EQ(nw.GetTravelTime(line, route, "station_000", "station_002"), 6);
+    EXPECT_EQ(nw.GetTravelTime(line, route, "station_000", "station_002"), 6);
+    stats = nw.GetQueryCacheStats();
+    EXPECT_EQ(stats.hits, 2);
+    EXPECT_EQ(stats.misses, 3);
+    EXPECT_EQ(stats.entries, 2);
+
+    // So does adding a line.
+    Route route1{
+        "route_001",
+        "outbound",
+        "line_001",
+        "station_002",
+        "station_000",
+        {"station_002", "station_000"},
+    };
+    ASSERT_TRUE(nw.AddLine({"line_001", "Line Name", {route1}}));
+    EXPECT_EQ(nw.GetTravelTime(line, route, "station_000", "station_002"), 6);
+    EXPECT_EQ(nw.GetQueryCacheStats().misses, 4);
+
+    // Batch queries go through the cache too.
+    const std::vector<RouteTravelTimeQuery> queries{
+        {line, route, "station_000", "station_002"},
+        {line, route, "station_001", "station_002"},
+    };
+    std::vector<unsigned int> travelTimes(queries.size());
+    nw.GetTravelTimes(queries.data(), queries.size(), travelTimes.data());
+    EXPECT_EQ(travelTimes, (std::vector<unsigned int>{6, 5}));
+    stats = nw.GetQueryCacheStats();
+    EXPECT_EQ(stats.hits, 3);
+    EXPECT_EQ(stats.misses, 5);
+
+    // Disabling the cache drops it.
+    nw.SetQueryCacheOptions(QueryCacheOptions{});
+    EXPECT_EQ(nw.GetTravelTime(line, route, "station_000", "station_002"), 6);
+    EXPECT_EQ(nw.GetQueryCacheStats().hits, 0);
+    EXPECT_EQ(nw.GetMemoryUsage().queryCache, 0);
+}
+
+TEST(TransportNetworkTest, QueryCache_matches_uncached)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 2000;
+    options.nLines = 100;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork cached{};
+    TransportNetwork uncached{};
+    for(auto* nw : {&cached, &uncached})
+    {
+        for(const auto& station : layout.stations)
+        {
+            ASSERT_TRUE(nw->AddStation(station));
+        }
+        ASSERT_TRUE(nw->AddLines(layout.lines));
+        for(const auto& travelTime : layout.travelTimes)
+        {
+            ASSERT_TRUE(nw->SetTravelTime(travelTime.startStationId, travelTime.endStationId, travelTime.travelTime));
+        }
+    }
+    // A small cache, to exercise the evictions.
+    QueryCacheOptions cacheOptions{};
+    cacheOptions.capacity = 64;
+    cacheOptions.nShards = 4;
+    cached.SetQueryCacheOptions(cacheOptions);
+
+    // Query every route from its first stop, twice, from several threads.
+    std::vector<RouteTravelTimeQuery> queries{};
+    for(const auto& line : layout.lines)
+    {
+        for(const auto& route : line.routes)
+        {
+            for(const auto& stop : route.stops)
+            {
+                queries.push_back({line.id, route.id, route.stops.front(), stop});
+            }
+        }
+    }
+    const auto nQueries{queries.size()};
+    queries.insert(queries.end(), queries.begin(), queries.end());
+    std::vector<unsigned int> expected(queries.size());
+    std::vector<unsigned int> travelTimes(queries.size());
+    uncached.GetTravelTimes(queries.data(), queries.size(), expected.data(), 1);
+    cached.GetTravelTimes(queries.data(), queries.size(), travelTimes.data(), 4);
+    EXPECT_EQ(travelTimes, expected);
+
+    const auto stats{cached.GetQueryCacheStats()};
+    EXPECT_EQ(stats.hits + stats.misses, 2 * nQueries);
+    EXPECT_GT(stats.evictions, 0);
+    EXPECT_LE(stats.entries, stats.capacity);
+}
+
+TEST(TransportNetworkTest, GetRoutesServingStations_batch)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 10000;
+    options.nLines = 200;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+    ASSERT_TRUE(nw.AddLines(layout.lines));
+
+    std::vector<std::string_view> stations{};
+    for(const auto& station : layout.stations)
+    {
+        stations.push_back(station.id);
+    }
+    stations.push_back("station_missing");
+
+    std::vector<RouteIdView> routes(stations.size());
+    nw.GetRoutesServingStations(stations.data(), stations.size(), routes.data(), 3);
+    for(size_t idx{0}; idx < stations.size(); ++idx)
+    {
+        const auto expected{nw.GetRoutesServingStation(Id{stations[idx]})};
+        EXPECT_EQ(routes[idx].begin(), expected.begin());
+        EXPECT_EQ(routes[idx].size(), expected.size());
+    }
+    EXPECT_TRUE(routes.back().empty());
+}
+
+TEST(TransportNetworkTest, MemoryUsage_basic)
+{
+    TransportNetwork nw{};
+    const auto empty{nw.GetMemoryUsage()};
+    EXPECT_EQ(empty.stations, 0);
+    EXPECT_EQ(empty.strings, 0);
+
+    // route0: 0 ---> 1
+    ASSERT_TRUE(nw.AddStation({"station_000", "Station Name 0"}));
+    ASSERT_TRUE(nw.AddStation({"station_001", "Station Name 1"}));
+    Route route0{
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_001",
+        {"station_000", "station_001"},
+    };
+    ASSERT_TRUE(nw.AddLine({"line_000", "Line Name", {route0}}));
+
+    const auto usage{nw.GetMemoryUsage()};
+    EXPECT_EQ(usage.strings, 2 * (11 + 14) + 8 + 9 + 9);
+    EXPECT_GT(usage.stations, 0);
+    EXPECT_GT(usage.lines, 0);
+    EXPECT_GT(usage.edges, 0);
+    EXPECT_GT(usage.routeIndex, 0);
+    EXPECT_GT(usage.lookupTables, 0);
+    EXPECT_GT(usage.passengerFlow, 0);
+    EXPECT_GT(usage.crowding, 0);
+    EXPECT_EQ(usage.Total(),
+              usage.stations + usage.lines + usage.edges + usage.routeIndex + usage.strings + usage.lookupTables +
+                  usage.passengerFlow + usage.crowding + usage.travelTimeProfiles + usage.queryCache +
+                  usage.arenaOverhead);
+}
+
+TEST(TransportNetworkTest, MemoryMode_compact)
+{
+    NetworkLayoutOptions options{};
+    options.nStations = 1000;
+    options.nLines = 20;
+    const auto layout{GenerateNetworkLayout(options)};
+
+    TransportNetwork defaultNw{};
+    TransportNetwork compactNw{MemoryMode::Compact};
+    EXPECT_EQ(defaultNw.GetMemoryMode(), MemoryMode::Default);
+    EXPECT_EQ(compactNw.GetMemoryMode(), MemoryMode::Compact);
+    for(auto* nw : {&defaultNw, &compactNw})
+    {
+        for(const auto& station : layout.stations)
+        {
+            ASSERT_TRUE(nw->AddStation(station));
+        }
+        ASSERT_TRUE(nw->AddLines(layout.lines));
+    }
+
+    // No flow counters until a station gets timestamped events.
+    EXPECT_EQ(compactNw.GetMemoryUsage().passengerFlow, 0);
+    EXPECT_LT(compactNw.GetMemoryUsage().Total(), defaultNw.GetMemoryUsage().Total() / 2);
+    EXPECT_EQ(compactNw.GetPassengerFlow("station_000", FlowWindow::OneHour, std::chrono::system_clock::now()).in, 0);
+
+    // Several threads race to record the first events of the same stations.
+    const auto at{std::chrono::system_clock::now()};
+    const size_t nThreads{4};
+    const size_t nStations{10};
+    std::vector<std::thread> threads{};
+    for(size_t thread{0}; thread < nThreads; ++thread)
+    {
+        threads.emplace_back([&compactNw, &layout, at]() {
+            for(size_t idx{0}; idx < nStations; ++idx)
+            {
+                compactNw.RecordPassengerEvent({layout.stations[idx].id, PassengerEvent::Type::In, at});
+            }
+        });
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+    for(size_t idx{0}; idx < nStations; ++idx)
+    {
+        for(size_t event{0}; event < nThreads; ++event)
+        {
+            defaultNw.RecordPassengerEvent({layout.stations[idx].id, PassengerEvent::Type::In, at});
+        }
+    }
+
+    // Only the stations with events got flow counters.
+    EXPECT_GT(compactNw.GetMemoryUsage().passengerFlow, 0);
+    EXPECT_LE(compactNw.GetMemoryUsage().passengerFlow,
+              2 * nStations * defaultNw.GetMemoryUsage().passengerFlow / options.nStations);
+    for(const auto window : {FlowWindow::OneMinute, FlowWindow::FiveMinutes, FlowWindow::OneHour})
+    {
+        EXPECT_EQ(compactNw.GetPassengerFlow(layout.stations.front().id, window, at).in, nThreads);
+        for(const auto& line : layout.lines)
+        {
+            EXPECT_EQ(compactNw.GetLinePassengerFlow(line.id, window, at).in,
+                      defaultNw.GetLinePassengerFlow(line.id, window, at).in);
+        }
+    }
+}
+
+TEST(TransportNetworkTest, LayoutChanges_basic)
+{
+    NetworkLayout layout{};
+    for(const auto* id : {"station_0", "station_1", "station_2", "station_3", "station_4"})
+    {
+        layout.stations.push_back(Station{id, std::string{"Name "} + id});
+    }
+    layout.lines.push_back(Line{"line_0",
+                                "Line 0",
+                                {
+                                    Route{"route_0", "inbound", "line_0", "station_0", "station_2",
+                                          {"station_0", "station_1", "station_2"}},
+                                    Route{"route_1", "outbound", "line_0", "station_2", "station_0",
+                                          {"station_2", "station_1", "station_0"}},
+                                }});
+    layout.lines.push_back(Line{"line_1",
+                                "Line 1",
+                                {
+                                    Route{"route_2", "inbound", "line_1", "station_2", "station_3",
+                                          {"station_2", "station_3"}},
+                                }});
+    layout.travelTimes = {{"station_0", "station_1", 1}, {"station_1", "station_2", 2}, {"station_2", "station_3", 3}};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+    ASSERT_TRUE(nw.AddLines(layout.lines));
+    for(const auto& [stationA, stationB, travelTime] : layout.travelTimes)
+    {
+        ASSERT_TRUE(nw.SetTravelTime(stationA, stationB, travelTime));
+    }
+    EXPECT_TRUE(nw.DiffLayout(layout).empty());
+
+    const auto at{std::chrono::system_clock::now()};
+    for(size_t idx{0}; idx < 3; ++idx)
+    {
+        ASSERT_TRUE(nw.RecordPassengerEvent({"station_0", PassengerEvent::Type::In, at}));
+        ASSERT_TRUE(nw.RecordPassengerEvent({"station_3", PassengerEvent::Type::In}));
+        ASSERT_TRUE(nw.RecordPassengerEvent({"station_4", PassengerEvent::Type::In}));
+    }
+    std::vector<std::pair<Id, bool>> alerts{};
+    auto callback{[&alerts](const Id& station, long long int, bool crowded) { alerts.emplace_back(station, crowded); }};
+    const auto keptSubscription{nw.SubscribeToCrowding("station_0", 5, 0, callback)};
+    const auto removedSubscription{nw.SubscribeToCrowding("station_3", 5, 0, callback)};
+    ASSERT_NE(keptSubscription, 0);
+    ASSERT_NE(removedSubscription, 0);
+
+    // Rename a station, move route 0 to a new station, drop line 1 with the
+    // stations it leaves behind, add a line, and change a travel time.
+    auto newLayout{layout};
+    newLayout.stations.erase(newLayout.stations.begin() + 3, newLayout.stations.end());
+    newLayout.stations[1].name = "New Name 1";
+    newLayout.stations.push_back(Station{"station_5", "Name 5"});
+    newLayout.lines[0].routes[0].stops.push_back("station_5");
+    newLayout.lines[0].routes[0].endStationId = "station_5";
+    newLayout.lines[1] = Line{"line_2",
+                              "Line 2",
+                              {
+                                  Route{"route_3", "inbound", "line_2", "station_5", "station_0",
+                                        {"station_5", "station_0"}},
+                              }};
+    newLayout.travelTimes = {
+        {"station_0", "station_1", 1}, {"station_1", "station_2", 4}, {"station_2", "station_5", 5}, {"station_5", "station_0", 6}};
+
+    const auto changes{nw.DiffLayout(newLayout)};
+    ASSERT_EQ(changes.addedStations.size(), 1);
+    EXPECT_EQ(changes.addedStations[0].id, "station_5");
+    ASSERT_EQ(changes.renamedStations.size(), 1);
+    EXPECT_EQ(changes.renamedStations[0].name, "New Name 1");
+    EXPECT_EQ(changes.removedStations, (std::vector<Id>{"station_3", "station_4"}));
+    ASSERT_EQ(changes.addedLines.size(), 1);
+    EXPECT_EQ(changes.addedLines[0].id, "line_2");
+    EXPECT_EQ(changes.removedLines, std::vector<Id>{"line_1"});
+    ASSERT_EQ(changes.modifiedLines.size(), 1);
+    EXPECT_EQ(changes.modifiedLines[0].lineId, "line_0");
+    ASSERT_EQ(changes.modifiedLines[0].addedRoutes.size(), 1);
+    EXPECT_EQ(changes.modifiedLines[0].addedRoutes[0].id, "route_0");
+    EXPECT_EQ(changes.modifiedLines[0].removedRoutes, std::vector<Id>{"route_0"});
+    // The stops of the added routes get their travel times, even unchanged,
+    // unless other routes already link them.
+    EXPECT_EQ(changes.travelTimes.size(), 3);
+    EXPECT_EQ(changes.size(), 12);
+
+    // A station that a remaining route serves cannot be removed.
+    auto badChanges{changes};
+    badChanges.removedStations.push_back("station_2");
+    EXPECT_FALSE(nw.ApplyLayoutChanges(badChanges));
+    EXPECT_EQ(nw.DiffLayout(newLayout).size(), changes.size());
+
+    ASSERT_TRUE(nw.ApplyLayoutChanges(changes));
+    EXPECT_TRUE(nw.DiffLayout(newLayout).empty());
+    EXPECT_EQ(nw.GetPassengerCount("station_0"), 3);
+    EXPECT_EQ(nw.GetPassengerFlow("station_0", FlowWindow::OneMinute, at).in, 3);
+    EXPECT_EQ(nw.GetPassengerCount("station_5"), 0);
+    EXPECT_THROW(nw.GetPassengerCount("station_3"), std::runtime_error);
+    EXPECT_FALSE(nw.RecordPassengerEvent({"station_4", PassengerEvent::Type::In}));
+
+    const auto routes{nw.GetRoutesServingStation("station_0")};
+    EXPECT_EQ(std::vector<std::string_view>(routes.begin(), routes.end()),
+              (std::vector<std::string_view>{"route_1", "route_0", "route_3"}));
+    EXPECT_EQ(nw.GetRoutesServingStation("station_3").size(), 0);
+    EXPECT_EQ(nw.GetTravelTime("station_1", "station_2"), 4);
+    EXPECT_EQ(nw.GetTravelTime("line_0", "route_0", "station_0", "station_5"), 10);
+    EXPECT_EQ(nw.GetTravelTime("line_2", "route_3", "station_5", "station_0"), 6);
+    EXPECT_EQ(nw.GetTravelTime("line_1", "route_2", "station_2", "station_3"), 0);
+    EXPECT_THROW(nw.GetLinePassengerFlow("line_1", FlowWindow::OneMinute, at), std::runtime_error);
+    EXPECT_EQ(nw.GetLinePassengerFlow("line_2", FlowWindow::OneMinute, at).in, 3);
+
+    const auto reached{nw.GetReachableStations("station_5", 11)};
+    ASSERT_EQ(reached.size(), 4);
+    EXPECT_EQ(reached[1].stationId, "station_0");
+    EXPECT_EQ(reached[3].stationId, "station_2");
+    EXPECT_EQ(reached[3].travelTime, 11);
+
+    // The subscriptions of removed stations are cancelled, the others fire.
+    EXPECT_FALSE(nw.UnsubscribeFromCrowding(removedSubscription));
+    EXPECT_EQ(nw.SetPassengerCounts({{"station_0", 10}, {"station_2", 20}, {"station_3", 30}}), 2);
+    EXPECT_EQ(alerts, (std::vector<std::pair<Id, bool>>{{"station_0", true}}));
+    const auto busiest{nw.GetBusiestStations(10)};
+    ASSERT_EQ(busiest.size(), 4);
+    EXPECT_EQ(busiest[0].stationId, "station_2");
+    EXPECT_EQ(busiest[1].stationId, "station_0");
+    EXPECT_TRUE(nw.UnsubscribeFromCrowding(keptSubscription));
+}
+
+TEST(TransportNetworkTest, LayoutChanges_reused_ids)
+{
+    NetworkLayout layout{};
+    for(const auto* id : {"station_0", "station_1", "station_2"})
+    {
+        layout.stations.push_back(Station{id, std::string{"Name "} + id});
+    }
+    layout.lines.push_back(Line{"line_0",
+                                "Line 0",
+                                {
+                                    Route{"route_0", "inbound", "line_0", "station_0", "station_2",
+                                          {"station_0", "station_1", "station_2"}},
+                                }});
+    layout.travelTimes = {{"station_0", "station_1", 1}, {"station_1", "station_2", 2}};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+    ASSERT_TRUE(nw.AddLines(layout.lines));
+    for(const auto& [stationA, stationB, travelTime] : layout.travelTimes)
+    {
+        ASSERT_TRUE(nw.SetTravelTime(stationA, stationB, travelTime));
+    }
+
+    // Replace station 2 and line 0 with new ones under the same IDs.
+    LayoutChangeSet changes{};
+    changes.removedStations = {"station_2"};
+    changes.addedStations = {Station{"station_2", "New Name 2"}};
+    changes.removedLines = {"line_0"};
+    changes.addedLines = {Line{"line_0",
+                               "New Line 0",
+                               {
+                                   Route{"route_0", "inbound", "line_0", "station_0", "station_2",
+                                         {"station_0", "station_2"}},
+                               }}};
+    changes.travelTimes = {{"station_0", "station_2", 7}};
+
+    // An ID can still be added only once.
+    auto badChanges{changes};
+    badChanges.addedStations.push_back(Station{"station_2", "Other Name 2"});
+    EXPECT_FALSE(nw.ApplyLayoutChanges(badChanges));
+    badChanges = changes;
+    badChanges.addedLines.push_back(changes.addedLines[0]);
+    EXPECT_FALSE(nw.ApplyLayoutChanges(badChanges));
+
+    ASSERT_TRUE(nw.ApplyLayoutChanges(changes));
+    EXPECT_EQ(nw.GetPassengerCount("station_2"), 0);
+    EXPECT_EQ(nw.GetTravelTime("line_0", "route_0", "station_0", "station_2"), 7);
+    EXPECT_EQ(nw.GetRoutesServingStation("station_1").size(), 0);
+
+    auto newLayout{layout};
+    newLayout.stations[2].name = "New Name 2";
+    newLayout.lines = changes.addedLines;
+    newLayout.travelTimes = changes.travelTimes;
+    EXPECT_TRUE(nw.DiffLayout(newLayout).empty());
+}
+
+TEST(TransportNetworkTest, LayoutChanges_keep_profiles)
+{
+    NetworkLayout layout{};
+    for(const auto* id : {"station_0", "station_1", "station_2"})
+    {
+        layout.stations.push_back(Station{id, std::string{"Name "} + id});
+    }
+    layout.lines.push_back(Line{"line_0",
+                                "Line 0",
+                                {
+                                    Route{"route_0", "inbound", "line_0", "station_0", "station_1",
+                                          {"station_0", "station_1"}},
+                                }});
+    layout.travelTimes = {{"station_0", "station_1", 20}};
+
+    TransportNetwork nw{};
+    for(const auto& station : layout.stations)
+    {
+        ASSERT_TRUE(nw.AddStation(station));
+    }
+    ASSERT_TRUE(nw.AddLines(layout.lines));
+    ASSERT_TRUE(nw.SetTravelTime("station_0", "station_1", 20));
+    using std::chrono::hours;
+    const std::chrono::system_clock::time_point day{hours{24 * 20000}};
+    ASSERT_TRUE(nw.SetTravelTimeProfile("station_0", "station_1", TravelTimeProfile{{{hours{7}, 30}, {hours{10}, 20}}}));
+
+    // Add a route back over the profiled stops, and replace route 0 with one
+    // that goes on to station 2.
+    auto newLayout{layout};
+    newLayout.lines[0].routes[0].stops.push_back("station_2");
+    newLayout.lines[0].routes[0].endStationId = "station_2";
+    newLayout.lines.push_back(Line{"line_1",
+                                   "Line 1",
+                                   {
+                                       Route{"route_1", "outbound", "line_1", "station_1", "station_0",
+                                             {"station_1", "station_0"}},
+                                   }});
+    newLayout.travelTimes.push_back({"station_1", "station_2", 5});
+
+    const auto changes{nw.DiffLayout(newLayout)};
+    ASSERT_EQ(changes.travelTimes.size(), 1);
+    EXPECT_EQ(changes.travelTimes[0].endStationId, "station_2");
+    ASSERT_TRUE(nw.ApplyLayoutChanges(changes));
+    EXPECT_TRUE(nw.DiffLayout(newLayout).empty());
+
+    // The added edges keep the profile of the stops they link.
+    EXPECT_EQ(nw.GetTravelTime("station_0", "station_1"), 20);
+    EXPECT_EQ(nw.GetTravelTime("station_0", "station_1", day + hours{8}), 30);
+    EXPECT_EQ(nw.GetTravelTime("station_1", "station_0", day + hours{8}), 30);
+    EXPECT_EQ(nw.GetTravelTime("line_1", "route_1", "station_1", "station_0"), 20);
+    EXPECT_EQ(nw.GetTravelTime("line_0", "route_0", "station_0", "station_2"), 25);
+}
+
+TEST(TransportNetworkTest, LayoutChanges_generated)
+{
+    // Turn a network into one with a different layout, and compare it with
+    // the network built from that layout.
+    NetworkLayoutOptions options{};
+    options.nStations = 600;
+    options.nLines = 12;
+    options.routesPerLine = 3;
+    options.routeLength = 30;
+    options.interchangeDensity = 0.3;
+    options.seed = 1;
+    const auto oldLayout{GenerateNetworkLayout(options)};
+    options.nStations = 500;
+    options.nLines = 14;
+    options.seed = 2;
+    const auto newLayout{GenerateNetworkLayout(options)};
+
+    auto load{[](TransportNetwork& nw, const NetworkLayout& layout) {
+        for(const auto& station : layout.stations)
+        {
+            ASSERT_TRUE(nw.AddStation(station));
+        }
+        ASSERT_TRUE(nw.AddLines(layout.lines));
+        for(const auto& [stationA, stationB, travelTime] : layout.travelTimes)
+        {
+            ASSERT_TRUE(nw.SetTravelTime(stationA, stationB, travelTime));
+        }
+    }};
+    TransportNetwork expected{};
+    load(expected, newLayout);
+
+    const auto at{std::chrono::system_clock::now()};
+    for(const auto mode : {MemoryMode::Default, MemoryMode::Compact})
+    {
+        TransportNetwork nw{mode};
+        load(nw, oldLayout);
+        for(size_t idx{0}; idx < oldLayout.stations.size(); ++idx)
+        {
+            for(size_t event{0}; event < idx % 7; ++event)
+            {
+                nw.RecordPassengerEvent({oldLayout.stations[idx].id, PassengerEvent::Type::In, at});
+            }
+        }
+
+        const auto changes{nw.DiffLayout(newLayout)};
+        EXPECT_EQ(changes.removedStations.size(), 100);
+        ASSERT_TRUE(nw.ApplyLayoutChanges(changes));
+        EXPECT_TRUE(nw.DiffLayout(newLayout).empty());
+
+        for(size_t idx{0}; idx < newLayout.stations.size(); ++idx)
+        {
+            const auto& id{newLayout.stations[idx].id};
+            EXPECT_EQ(nw.GetPassengerCount(id), static_cast<long long int>(idx % 7));
+            EXPECT_EQ(nw.GetPassengerFlow(id, FlowWindow::OneMinute, at).in, idx % 7);
+            auto routes{nw.GetRoutesServingStation(id)};
+            auto expectedRoutes{expected.GetRoutesServingStation(id)};
+            std::vector<std::string_view> sorted(routes.begin(), routes.end());
+            std::vector<std::string_view> expectedSorted(expectedRoutes.begin(), expectedRoutes.end());
+            std::sort(sorted.begin(), sorted.end());
+            std::sort(expectedSorted.begin(), expectedSorted.end());
+            EXPECT_EQ(sorted, expectedSorted);
+        }
+        for(size_t idx{newLayout.stations.size()}; idx < oldLayout.stations.size(); ++idx)
+        {
+            EXPECT_THROW(nw.GetPassengerCount(oldLayout.stations[idx].id), std::runtime_error);
+        }
+        for(const auto& [stationA, stationB, travelTime] : newLayout.travelTimes)
+        {
+            EXPECT_EQ(nw.GetTravelTime(stationA, stationB), travelTime);
+        }
+        for(const auto& line : newLayout.lines)
+        {
+            for(const auto& route : line.routes)
+            {
+                EXPECT_EQ(nw.GetTravelTime(line.id, route.id, route.startStationId, route.endStationId),
+                          expected.GetTravelTime(line.id, route.id, route.startStationId, route.endStationId));
+            }
+        }
+        for(size_t idx{0}; idx < 10; ++idx)
+        {
+            const auto& from{newLayout.stations[idx * 47].id};
+            auto reached{nw.GetReachableStations(from, 20)};
+            auto expectedReached{expected.GetReachableStations(from, 20)};
+            ASSERT_EQ(reached.size(), expectedReached.size());
+            auto byId{[](const auto& a, const auto& b) { return a.stationId < b.stationId; }};
+            std::sort(reached.begin(), reached.end(), byId);
+            std::sort(expectedReached.begin(), expectedReached.end(), byId);
+            for(size_t stationIdx{0}; stationIdx < reached.size(); ++stationIdx)
+            {
+                EXPECT_EQ(reached[stationIdx].stationId, expectedReached[stationIdx].stationId);
+                EXPECT_EQ(reached[stationIdx].travelTime, expectedReached[stationIdx].travelTime);
+            }
+        }
+        const auto busiest{nw.GetBusiestStations(20)};
+        ASSERT_EQ(busiest.size(), 20);
+        for(const auto& station : busiest)
+        {
+            EXPECT_EQ(station.count, 6);
+        }
+
+        // A small change to the layout gives a small change set.
+        auto changedLayout{newLayout};
+        changedLayout.travelTimes[0].travelTime += 10;
+        changedLayout.lines[0].routes.pop_back();
+        const auto smallChanges{nw.DiffLayout(changedLayout)};
+        EXPECT_EQ(smallChanges.size(), 3);
+        ASSERT_TRUE(nw.ApplyLayoutChanges(smallChanges));
+        EXPECT_TRUE(nw.DiffLayout(changedLayout).empty());
+    }
+}
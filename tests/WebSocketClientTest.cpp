@@ -1,28 +1,43 @@
 #include <gtest/gtest.h>
 
 #include <boost/asio.hpp>
+#include <chrono>
 #include <filesystem>
+#include <functional>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#include "AllocationCounter.hpp"
+#include "LocalServer.hpp"
+#include "TlsContext.hpp"
 #include "WebSocketClient.hpp"
 
 using namespace testing;
+using NetworkMonitor::AllocationCounter;
+using NetworkMonitor::ConnectionTimeouts;
+using NetworkMonitor::ConnectionTiming;
+using NetworkMonitor::GetSharedTlsClientContext;
+using NetworkMonitor::LocalServer;
+using NetworkMonitor::LocalServerOptions;
+using NetworkMonitor::TlsSessionCache;
 using NetworkMonitor::WebSocketClient;
 
-TEST(NetworkMonitorTest, DISABLED_basicTest)
+TEST(NetworkMonitorTest, basicTest)
 {
+    boost::asio::io_context ioc{};
+    LocalServer server{ioc};
+
     // Connection targets
-    const std::string url{"ltnm.learncppthroughprojects.com"};
+    const std::string url{"localhost"};
     const std::string endpoint{"/echo"};
-    const std::string port{"443"};
+    const std::string port{std::to_string(server.GetPort())};
     const std::string message{"Hello WebSocket"};
 
     boost::asio::ssl::context ctx{boost::asio::ssl::context::tlsv12_client};
-    ctx.load_verify_file(TESTS_CACERT_PEM);
-
-    // Always start with an I/O context object.
-    boost::asio::io_context ioc{};
+    ctx.load_verify_file(TESTS_LOCAL_CA_PEM);
 
     // The class under test
     WebSocketClient client{url, endpoint, port, ioc, ctx};
@@ -46,11 +61,14 @@ TEST(NetworkMonitorTest, DISABLED_basicTest)
         }
     }};
 
-    auto onClose{[&disconnected](auto ec) { disconnected = !ec; }};
+    auto onClose{[&disconnected, &server](auto ec) {
+        disconnected = !ec;
+        server.Stop();
+    }};
 
-    auto onReceive{[&client, &onClose, &messageReceived, &echo, &message](auto ec, auto received) {
+    auto onReceive{[&client, &onClose, &messageReceived, &echo](auto ec, auto received) {
         messageReceived = !ec;
-        echo = message;
+        echo = std::move(received);
         client.Close(onClose);
     }};
 
@@ -63,11 +81,13 @@ TEST(NetworkMonitorTest, DISABLED_basicTest)
     EXPECT_TRUE(messageReceived);
     EXPECT_TRUE(disconnected);
     EXPECT_EQ(echo, message);
+    EXPECT_EQ(server.GetStats().nEchoedMessages, 1);
 }
 
 TEST(NetworkMonitorTest, cert)
 {
     EXPECT_TRUE(std::filesystem::exists(TESTS_CACERT_PEM));
+    EXPECT_TRUE(std::filesystem::exists(TESTS_LOCAL_CA_PEM));
 }
 
 bool CheckResponse(const std::string& response)
@@ -82,10 +102,13 @@ bool CheckResponse(const std::string& response)
 
 TEST(NetworkMonitorTest, stomp)
 {
+    boost::asio::io_context ioc{};
+    LocalServer server{ioc};
+
     // Connection targets
-    const std::string url{"ltnm.learncppthroughprojects.com"};
+    const std::string url{"localhost"};
     const std::string endpoint{"/network-events"};
-    const std::string port{"443"};
+    const std::string port{std::to_string(server.GetPort())};
 
     // STOMP frame
     const std::string username{"fake_username"};
@@ -103,10 +126,7 @@ TEST(NetworkMonitorTest, stomp)
 
     // TLS context
     boost::asio::ssl::context ctx{boost::asio::ssl::context::tlsv12_client};
-    ctx.load_verify_file(TESTS_CACERT_PEM);
-
-    // Always start with an I/O context object.
-    boost::asio::io_context ioc{};
+    ctx.load_verify_file(TESTS_LOCAL_CA_PEM);
 
     // The class under test
     WebSocketClient client{url, endpoint, port, ioc, ctx};
@@ -128,7 +148,10 @@ TEST(NetworkMonitorTest, stomp)
             client.Send(message, onSend);
         }
     }};
-    auto onClose{[&disconnected](auto ec) { disconnected = !ec; }};
+    auto onClose{[&disconnected, &server](auto ec) {
+        disconnected = !ec;
+        server.Stop();
+    }};
     auto onReceive{[&client, &onClose, &messageReceived, &response](auto ec, auto received) {
         messageReceived = !ec;
         response = std::move(received);
@@ -145,3 +168,337 @@ TEST(NetworkMonitorTest, stomp)
     EXPECT_TRUE(disconnected);
     EXPECT_TRUE(CheckResponse(response));
 }
+
+// Build a STOMP frame.
+std::string MakeStompFrame(const std::string& command, const std::vector<std::string>& headers)
+{
+    std::string frame{command + "\n"};
+    for(const auto& header : headers)
+    {
+        frame += header + "\n";
+    }
+    frame += "\n";
+    frame += '\0';
+    return frame;
+}
+
+TEST(NetworkMonitorTest, stomp_feed)
+{
+    const size_t nEvents{2000};
+    LocalServerOptions options{};
+    options.feedEventsPerSecond = 20000;
+    options.feedEvents = nEvents;
+    options.feedStationIds = {"station_000", "station_001", "station_002"};
+
+    boost::asio::io_context ioc{};
+    LocalServer server{ioc, options};
+    auto ctx{GetSharedTlsClientContext(TESTS_LOCAL_CA_PEM)};
+    WebSocketClient client{"localhost", "/network-events", std::to_string(server.GetPort()), ioc, *ctx};
+
+    std::vector<std::string> frames{};
+    auto onConnect{[&client, &options](auto ec) {
+        ASSERT_FALSE(ec);
+        client.Send(MakeStompFrame("STOMP",
+                                   {
+                                       "accept-version:1.2",
+                                       "host:transportforlondon.com",
+                                       "login:" + options.stompUsername,
+                                       "passcode:" + options.stompPassword,
+                                   }),
+                    // The client can only send one message at a time.
+                    [&client](auto ec) {
+                        ASSERT_FALSE(ec);
+                        client.Send(
+                            MakeStompFrame("SUBSCRIBE", {"id:0", "destination:/passengers", "receipt:subscribed"}));
+                    });
+    }};
+    auto onReceive{[&client, &server, &frames, nEvents](auto ec, auto received) {
+        frames.push_back(std::move(received));
+        if(frames.size() == nEvents + 2)
+        {
+            client.Close([&server](auto ec) { server.Stop(); });
+        }
+    }};
+    const auto start{std::chrono::steady_clock::now()};
+    client.Connect(onConnect, onReceive);
+    ioc.run();
+    const auto elapsed{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+
+    ASSERT_EQ(frames.size(), nEvents + 2);
+    EXPECT_EQ(frames[0].rfind("CONNECTED\n", 0), 0);
+    EXPECT_EQ(frames[1].rfind("RECEIPT\n", 0), 0);
+    EXPECT_NE(frames[1].find("receipt-id:subscribed\n"), std::string::npos);
+    for(size_t idx{2}; idx < frames.size(); ++idx)
+    {
+        const auto& frame{frames[idx]};
+        ASSERT_EQ(frame.rfind("MESSAGE\n", 0), 0);
+        EXPECT_NE(frame.find("subscription:0\n"), std::string::npos);
+        EXPECT_NE(frame.find("\"station_id\":\"station_00"), std::string::npos);
+        EXPECT_EQ(frame.back(), '\0');
+    }
+    EXPECT_EQ(server.GetStats().nFeedEvents, nEvents);
+
+    // The feed is paced: 2000 events at 20000 per second take 0.1 s.
+    EXPECT_GE(elapsed, 0.09);
+}
+
+TEST(NetworkMonitorTest, Connect_tls_handshake_timeout)
+{
+    using tcp = boost::asio::ip::tcp;
+
+    boost::asio::ssl::context ctx{boost::asio::ssl::context::tlsv12_client};
+    boost::asio::io_context ioc{};
+
+    // This server accepts TCP connections on IPv4 only, and never talks.
+    // If "localhost" resolves to an IPv6 address too, we must fall back to
+    // IPv4.
+    tcp::acceptor acceptor{ioc, {boost::asio::ip::make_address("127.0.0.1"), 0}};
+    tcp::socket server{ioc};
+    acceptor.async_accept(server, [](auto ec) {});
+    const auto port{std::to_string(acceptor.local_endpoint().port())};
+
+    ConnectionTimeouts timeouts{};
+    timeouts.tlsHandshake = std::chrono::milliseconds(200);
+    WebSocketClient client{"localhost", "/", port, ioc, ctx, timeouts};
+
+    bool called{false};
+    boost::system::error_code error{};
+    ConnectionTiming timing{};
+    client.ConnectWithTiming([&called, &error, &timing](auto ec, const auto& report) {
+        called = true;
+        error = ec;
+        timing = report;
+    });
+    ioc.run();
+
+    ASSERT_TRUE(called);
+    EXPECT_EQ(error, boost::beast::error::timeout);
+    EXPECT_EQ(timing.endpoint.address(), boost::asio::ip::make_address("127.0.0.1"));
+    EXPECT_GE(timing.nAttempts, 1);
+    EXPECT_GT(timing.resolve.count(), 0);
+    EXPECT_GT(timing.connect.count(), 0);
+    EXPECT_GE(timing.tlsHandshake, std::chrono::milliseconds(200));
+    EXPECT_EQ(timing.handshake.count(), 0);
+}
+
+TEST(NetworkMonitorTest, Connect_refused)
+{
+    using tcp = boost::asio::ip::tcp;
+
+    boost::asio::ssl::context ctx{boost::asio::ssl::context::tlsv12_client};
+    boost::asio::io_context ioc{};
+
+    // Find a port no one listens on.
+    std::string port{};
+    {
+        tcp::acceptor acceptor{ioc, {boost::asio::ip::make_address("127.0.0.1"), 0}};
+        port = std::to_string(acceptor.local_endpoint().port());
+    }
+
+    WebSocketClient client{"127.0.0.1", "/", port, ioc, ctx};
+    bool called{false};
+    boost::system::error_code error{};
+    ConnectionTiming timing{};
+    client.ConnectWithTiming([&called, &error, &timing](auto ec, const auto& report) {
+        called = true;
+        error = ec;
+        timing = report;
+    });
+    ioc.run();
+
+    ASSERT_TRUE(called);
+    EXPECT_EQ(error, boost::asio::error::connection_refused);
+    EXPECT_EQ(timing.nAttempts, 1);
+    EXPECT_GT(timing.connect.count(), 0);
+    EXPECT_EQ(timing.tlsHandshake.count(), 0);
+}
+
+TEST(NetworkMonitorTest, Connect_tls_session_resumption)
+{
+    TlsSessionCache::Default().Clear();
+
+    boost::asio::io_context ioc{};
+    LocalServer server{ioc};
+    auto ctx{GetSharedTlsClientContext(TESTS_LOCAL_CA_PEM)};
+    EXPECT_EQ(ctx, GetSharedTlsClientContext(TESTS_LOCAL_CA_PEM));
+
+    // We connect three times in a row. Only the first connection needs a full
+    // TLS handshake.
+    const size_t nConnections{3};
+    std::vector<std::unique_ptr<WebSocketClient> > clients{};
+    for(size_t idx{0}; idx < nConnections; ++idx)
+    {
+        clients.push_back(
+            std::make_unique<WebSocketClient>("localhost", "/echo", std::to_string(server.GetPort()), ioc, *ctx));
+    }
+    std::vector<boost::system::error_code> errors{};
+    std::vector<ConnectionTiming> timings{};
+    std::vector<std::string> echoes{};
+    std::function<void(size_t)> connect{};
+    connect = [&](size_t idx) {
+        if(idx == nConnections)
+        {
+            server.Stop();
+            return;
+        }
+        auto& client{*clients[idx]};
+        auto onConnect{[&, idx](auto ec, const auto& timing) {
+            errors.push_back(ec);
+            timings.push_back(timing);
+            if(ec)
+            {
+                server.Stop();
+                return;
+            }
+
+            // We exchange a message, so that the client receives the TLS 1.3
+            // session tickets, which come after the handshake.
+            clients[idx]->Send("Hello " + std::to_string(idx));
+        }};
+        auto onMessage{[&, idx](auto ec, auto&& message) {
+            echoes.push_back(message);
+            clients[idx]->Close([&connect, idx](auto ec) { connect(idx + 1); });
+        }};
+        client.ConnectWithTiming(onConnect, onMessage);
+    };
+    connect(0);
+    ioc.run();
+
+    ASSERT_EQ(errors.size(), nConnections);
+    for(size_t idx{0}; idx < nConnections; ++idx)
+    {
+        EXPECT_FALSE(errors[idx]);
+        EXPECT_EQ(timings[idx].tlsSessionResumed, idx > 0);
+        EXPECT_EQ(echoes[idx], "Hello " + std::to_string(idx));
+    }
+    EXPECT_EQ(server.GetStats().nFullTlsHandshakes, 1);
+    EXPECT_EQ(server.GetStats().nResumedTlsHandshakes, nConnections - 1);
+    EXPECT_EQ(TlsSessionCache::Default().GetSize(), 1);
+}
+
+TEST(NetworkMonitorTest, Connect_tls_host_name_verification)
+{
+    // The test certificate is for localhost and 127.0.0.1 only. We reach the
+    // server through another loopback address.
+    LocalServerOptions options{};
+    options.address = "127.0.0.2";
+    boost::asio::io_context ioc{};
+    LocalServer server{ioc, options};
+    auto ctx{GetSharedTlsClientContext(TESTS_LOCAL_CA_PEM)};
+    WebSocketClient client{"127.0.0.2", "/echo", std::to_string(server.GetPort()), ioc, *ctx};
+    boost::system::error_code error{};
+    client.ConnectWithTiming([&error, &server](auto ec, const auto&) {
+        error = ec;
+        server.Stop();
+    });
+    ioc.run();
+    EXPECT_EQ(error.category(), boost::asio::error::get_ssl_category());
+    EXPECT_EQ(server.GetStats().nFullTlsHandshakes, 0);
+}
+
+TEST(NetworkMonitorTest, AsyncRead_AsyncSend)
+{
+    boost::asio::io_context ioc{};
+    LocalServer server{ioc};
+    auto ctx{GetSharedTlsClientContext(TESTS_LOCAL_CA_PEM)};
+    WebSocketClient client{"localhost", "/echo", std::to_string(server.GetPort()), ioc, *ctx};
+
+    // Echo messages one at a time: Each read is started by its send.
+    const std::vector<std::string> messages{"Hello", std::string(100000, 'x'), "WebSocket"};
+    std::vector<std::string> echoes{};
+    std::function<void(size_t)> echo{[&](size_t idx) {
+        if(idx == messages.size())
+        {
+            client.AsyncClose([&server](auto ec) {
+                EXPECT_FALSE(ec);
+                server.Stop();
+            });
+            return;
+        }
+        client.AsyncSend(messages[idx], [&, idx](auto ec) {
+            ASSERT_FALSE(ec);
+            client.AsyncRead([&, idx](auto ec, std::string_view received) {
+                ASSERT_FALSE(ec);
+                echoes.emplace_back(received);
+                echo(idx + 1);
+            });
+        });
+    }};
+    client.AsyncConnect([&](auto ec, const ConnectionTiming& timing) {
+        ASSERT_FALSE(ec);
+        EXPECT_EQ(timing.nAttempts, 1);
+        echo(0);
+    });
+    ioc.run();
+
+    EXPECT_EQ(echoes, messages);
+}
+
+TEST(NetworkMonitorTest, read_loop_no_allocations)
+{
+    // The server runs on its own thread, so that we only count the
+    // allocations of the client.
+    boost::asio::io_context serverIoc{};
+    LocalServer server{serverIoc};
+    std::thread serverThread{[&serverIoc]() { serverIoc.run(); }};
+
+    boost::asio::io_context ioc{};
+    auto ctx{GetSharedTlsClientContext(TESTS_LOCAL_CA_PEM)};
+    WebSocketClient client{"localhost", "/echo", std::to_string(server.GetPort()), ioc, *ctx};
+
+    // The message fits in the small string buffer, so that the string passed
+    // to onMessage does not allocate either.
+    const std::string message{"Hello"};
+    const size_t nWarmUp{100};
+    const size_t nMessages{1000};
+    size_t nReceived{0};
+    AllocationCounter allocations{};
+    auto onConnect{[&client, &message](auto ec) {
+        ASSERT_FALSE(ec);
+        client.Send(message);
+    }};
+    auto onReceive{[&](auto ec, auto received) {
+        EXPECT_EQ(received, message);
+        if(++nReceived == nWarmUp)
+        {
+            allocations.Start();
+        }
+        if(nReceived == nWarmUp + nMessages)
+        {
+            allocations.Stop();
+            client.Close([&server](auto ec) { server.Stop(); });
+            return;
+        }
+        client.Send(message);
+    }};
+    client.Connect(onConnect, onReceive);
+    ioc.run();
+    serverThread.join();
+
+    EXPECT_EQ(nReceived, nWarmUp + nMessages);
+    EXPECT_EQ(allocations.Get(), 0);
+}
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+TEST(NetworkMonitorTest, awaitable)
+{
+    boost::asio::io_context ioc{};
+    LocalServer server{ioc};
+    auto ctx{GetSharedTlsClientContext(TESTS_LOCAL_CA_PEM)};
+    WebSocketClient client{"localhost", "/echo", std::to_string(server.GetPort()), ioc, *ctx};
+
+    const std::string message{"Hello WebSocket"};
+    std::string echo{};
+    auto session{[&]() -> boost::asio::awaitable<void> {
+        co_await client.AsyncConnect(boost::asio::use_awaitable);
+        co_await client.AsyncSend(message, boost::asio::use_awaitable);
+        echo = co_await client.AsyncRead(boost::asio::use_awaitable);
+        co_await client.AsyncClose(boost::asio::use_awaitable);
+        server.Stop();
+    }};
+    boost::asio::co_spawn(ioc, session(), [](std::exception_ptr e) { EXPECT_FALSE(e); });
+    ioc.run();
+
+    EXPECT_EQ(echo, message);
+}
+#endif
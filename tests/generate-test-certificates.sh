@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+# Generate the self-signed CA and the localhost certificate used by the local
+# test server. The files are checked in: Only run this script to replace them.
+set -euo pipefail
+
+cd "$(dirname "$0")"
+tmp="$(mktemp -d)"
+trap 'rm -rf "${tmp}"' EXIT
+
+# The CA key is thrown away: We never sign anything else with it.
+openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes \
+    -days 36500 -subj "/CN=Network Monitor Test CA" \
+    -addext "basicConstraints=critical,CA:TRUE" \
+    -addext "keyUsage=critical,keyCertSign,cRLSign" \
+    -keyout "${tmp}/ca-key.pem" -out local-ca.pem
+
+openssl req -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes \
+    -subj "/CN=localhost" \
+    -keyout localhost-key.pem -out "${tmp}/localhost.csr"
+
+cat > "${tmp}/localhost.ext" <<EXT
+basicConstraints=CA:FALSE
+keyUsage=critical,digitalSignature
+extendedKeyUsage=serverAuth
+subjectAltName=DNS:localhost,IP:127.0.0.1,IP:::1
+EXT
+
+openssl x509 -req -in "${tmp}/localhost.csr" -days 36500 \
+    -CA local-ca.pem -CAkey "${tmp}/ca-key.pem" -CAcreateserial -CAserial "${tmp}/ca.srl" \
+    -extfile "${tmp}/localhost.ext" -out localhost-cert.pem